@@ -0,0 +1,299 @@
+/*  Author: R. Bourquin
+    Copyright: (C) 2014 R. Bourquin
+    License: GNU GPL v2 or above
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "genzkeister.h"
+#include "benchmark.h"
+
+
+typedef void (*weights_formula_t)(acb_ptr, const acb_ptr, const int, const long);
+typedef void (*family_polynomial_t)(fmpq_poly_t, const int);
+
+
+void
+report_speedup(const std::string& name,
+               const bench_result_t& fast,
+               const bench_result_t& reference) {
+    /* Print the speedup of a kernel over its reference implementation
+     */
+    fprintf(bench_log, "%s speedup: %gx\n", name.c_str(), reference.median / fast.median);
+}
+
+
+void
+bench_exact(bench_results_t& results,
+            const int repetitions) {
+    /* Benchmark the exact extension over p
+     */
+    const int n = 3;
+    fmpq_poly_t Pn, Ep;
+    fmpq_poly_init(Pn);
+    fmpq_poly_init(Ep);
+    polynomial(Pn, n);
+
+    for(int p : {4, 8, 16, 32, 64}) {
+        std::string name = "find_extension/n=" + std::to_string(n) + "/p=" + std::to_string(p);
+        results.push_back(run_benchmark(name, [&]() { find_extension(Ep, Pn, p, 0); }, repetitions));
+    }
+
+    fmpq_poly_clear(Pn);
+    fmpq_poly_clear(Ep);
+}
+
+
+void
+bench_roots(bench_results_t& results,
+            const int repetitions) {
+    /* Benchmark root finding and weight computation over degree and precision
+     */
+    for(int deg : {16, 64, 256}) {
+        fmpq_poly_t P;
+        fmpq_poly_init(P);
+        polynomial(P, deg);
+        acb_ptr nodes = _acb_vec_init(deg);
+        acb_ptr weights = _acb_vec_init(deg);
+
+        for(long prec : {53, 212, 1024}) {
+            std::string suffix = "/deg=" + std::to_string(deg) + "/prec=" + std::to_string(prec);
+            results.push_back(run_benchmark("poly_roots" + suffix,
+                                            [&]() { poly_roots(nodes, P, 53, prec, 0); }, repetitions));
+            if(deg <= 64) {
+                results.push_back(run_benchmark("compute_nodes_and_weights" + suffix,
+                                                [&]() { compute_nodes_and_weights(nodes, weights, P, prec, 0); },
+                                                repetitions));
+            }
+        }
+
+        _acb_vec_clear(nodes, deg);
+        _acb_vec_clear(weights, deg);
+        fmpq_poly_clear(P);
+    }
+}
+
+
+void
+bench_formulas(bench_results_t& results,
+               const int repetitions) {
+    /* Benchmark the explicit weight formulas of all families
+     * on the nodes of the respective Gauss rule.
+     */
+    const long prec = 212;
+    std::vector<std::tuple<std::string, family_polynomial_t, weights_formula_t>> families = {
+        std::make_tuple("legendre", legendre_polynomial, evaluate_weights_formula_legendre),
+        std::make_tuple("laguerre", laguerre_polynomial, evaluate_weights_formula_laguerre),
+        std::make_tuple("hermitepro", hermite_polynomial_pro, evaluate_weights_formula_hermite_pro),
+        std::make_tuple("hermite", hermite_polynomial_phy, evaluate_weights_formula_hermite_phy),
+        std::make_tuple("chebyshevt", chebyshevt_polynomial, evaluate_weights_formula_chebyshevt),
+        std::make_tuple("chebyshevu", chebyshevu_polynomial, evaluate_weights_formula_chebyshevu)
+    };
+
+    for(auto it = families.begin(); it != families.end(); it++) {
+        for(int deg : {64, 256}) {
+            fmpq_poly_t P;
+            fmpq_poly_init(P);
+            std::get<1>(*it)(P, deg);
+            acb_ptr nodes = _acb_vec_init(deg);
+            acb_ptr weights = _acb_vec_init(deg);
+            poly_roots(nodes, P, 53, prec, 0);
+            make_real_roots(nodes, P, prec);
+
+            weights_formula_t formula = std::get<2>(*it);
+            std::string name = "weights_formula/" + std::get<0>(*it) + "/deg=" + std::to_string(deg);
+            results.push_back(run_benchmark(name, [&]() { formula(weights, nodes, deg, prec); }, repetitions));
+            /* The same on acb vectors for reference */
+            fixvec_enabled = 0;
+            results.push_back(run_benchmark(name + "/acb", [&]() { formula(weights, nodes, deg, prec); }, repetitions));
+            fixvec_enabled = 1;
+            report_speedup(name, results[results.size()-2], results.back());
+
+            _acb_vec_clear(nodes, deg);
+            _acb_vec_clear(weights, deg);
+            fmpq_poly_clear(P);
+        }
+    }
+}
+
+
+void
+bench_fixvec(bench_results_t& results,
+             const int repetitions) {
+    /* Benchmark the fixed-precision Horner evaluation against
+     * the acb reference on the nodes of a large Legendre rule.
+     */
+    const int deg = 512;
+    fmpq_poly_t P, Q;
+    fmpq_poly_init(P);
+    fmpq_poly_init(Q);
+    legendre_polynomial(P, deg);
+    legendre_polynomial(Q, deg-1);
+    acb_ptr nodes = _acb_vec_init(deg);
+    acb_ptr values = _acb_vec_init(deg);
+
+    for(long prec : {106, 212, 424}) {
+        poly_roots(nodes, P, 53, prec, 0);
+        make_real_roots(nodes, P, prec);
+
+        std::string name = "evaluate_polynomial_vector/deg=" + std::to_string(deg) + "/prec=" + std::to_string(prec);
+        results.push_back(run_benchmark(name, [&]() { evaluate_polynomial_vector(values, Q, nodes, deg, prec); }, repetitions));
+        fixvec_enabled = 0;
+        results.push_back(run_benchmark(name + "/acb", [&]() { evaluate_polynomial_vector(values, Q, nodes, deg, prec); }, repetitions));
+        fixvec_enabled = 1;
+        report_speedup(name, results[results.size()-2], results.back());
+    }
+
+    _acb_vec_clear(nodes, deg);
+    _acb_vec_clear(values, deg);
+    fmpq_poly_clear(P);
+    fmpq_poly_clear(Q);
+}
+
+
+template<int D>
+void
+bench_enumerators(bench_results_t& results,
+                  const int K,
+                  const int repetitions) {
+    /* Benchmark the enumerators in dimension D
+     */
+    std::string suffix = "/D=" + std::to_string(D) + "/K=" + std::to_string(K);
+
+    results.push_back(run_benchmark("Partitions" + suffix,
+                                    [&]() { Partitions<D>(K); }, repetitions));
+    results.push_back(run_benchmark("LatticePoints" + suffix,
+                                    [&]() { LatticePoints<D>(K); }, repetitions));
+
+    partitions_t<D> P = Partitions<D>(K);
+    results.push_back(run_benchmark("Permutations" + suffix,
+                                    [&]() {
+                                        for(auto it = P.begin(); it != P.end(); it++) {
+                                            Permutations<D>(*it);
+                                        }
+                                    }, repetitions));
+}
+
+
+template<int D>
+void
+bench_construction(bench_results_t& results,
+                   const generators_t& G,
+                   const tables_t& T,
+                   const int working_prec,
+                   const int repetitions) {
+    /* Benchmark the Genz-Keister construction in dimension D over K
+     */
+    for(unsigned int K : {3, 5, 7, 9}) {
+        if(K >= G.size()) {
+            break;
+        }
+        std::string name = "genz_keister_construction/D=" + std::to_string(D) + "/K=" + std::to_string(K + 1);
+        results.push_back(run_benchmark(name,
+                                        [&]() { genz_keister_construction<D>(K, G, T, working_prec, 0); },
+                                        repetitions));
+        results.push_back(run_benchmark(name + "/mixed",
+                                        [&]() { genz_keister_construction<D>(K, G, T, working_prec, 53); },
+                                        repetitions));
+    }
+}
+
+
+int main(int argc, char* argv[]) {
+
+    int repetitions = 5;
+    double tolerance = 0.1;
+    const char* output = NULL;
+    const char* baseline_file = NULL;
+    const char* store = NULL;
+
+    for(int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-r")) {
+            repetitions = std::max(1, atoi(argv[i+1]));
+            i++;
+        } else if (!strcmp(argv[i], "-o")) {
+            output = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-c")) {
+            baseline_file = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-t")) {
+            tolerance = atof(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-st")) {
+            store = argv[i+1];
+            i++;
+        } else {
+            printf("Benchmark the core kernels\n");
+            printf("Syntax: kesbench [-r R] [-o F] [-c B [-t T]] [-st S]\n");
+            printf("Options:\n");
+            printf("        -r   Number of timed repetitions per benchmark (default: 5)\n");
+            printf("        -o   Write the results as JSON to file F\n");
+            printf("        -c   Compare the medians against the baseline results in file B\n");
+            printf("        -t   Relative slowdown T counted as regression (default: 0.1)\n");
+            printf("        -st  Use the exact polynomial store in directory S for the generators\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    exact_store_open(store);
+    if(output == NULL) {
+        bench_log = stderr;
+    }
+
+    bench_results_t results;
+
+    bench_exact(results, repetitions);
+    bench_roots(results, repetitions);
+    bench_formulas(results, repetitions);
+    bench_fixvec(results, repetitions);
+
+    bench_enumerators<1>(results, 40, repetitions);
+    bench_enumerators<2>(results, 20, repetitions);
+    bench_enumerators<3>(results, 12, repetitions);
+
+    std::vector<int> levels = default_levels();
+    if(levels.size() > 0) {
+        const int working_prec = 106;
+        generators_t G = compute_generators(levels, 2*working_prec);
+        tables_t T = compute_tables(G, 2*working_prec);
+
+        bench_construction<1>(results, G, T, working_prec, repetitions);
+        bench_construction<2>(results, G, T, working_prec, repetitions);
+        bench_construction<3>(results, G, T, working_prec, repetitions);
+    }
+
+    if(output != NULL) {
+        FILE* file = fopen(output, "w");
+        if(file == NULL) {
+            printf("Can not open output file: %s\n", output);
+            return EXIT_FAILURE;
+        }
+        write_results(file, results, repetitions);
+        fclose(file);
+    } else {
+        write_results(stdout, results, repetitions);
+    }
+
+    if(baseline_file != NULL) {
+        std::map<std::string, double> baseline;
+        if(!read_baseline(baseline, baseline_file)) {
+            printf("Can not read baseline file: %s\n", baseline_file);
+            return EXIT_FAILURE;
+        }
+        if(compare_results(results, baseline, tolerance) > 0) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
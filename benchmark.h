@@ -0,0 +1,165 @@
+/*  Author: R. Bourquin
+ *  Copyright: (C) 2014 R. Bourquin
+ *  License: GNU GPL v2 or above
+ *
+ *  A library of helper functions to search for
+ *  Kronrod extensions of Gauss quadrature rules.
+ */
+
+#ifndef __HH__benchmark
+#define __HH__benchmark
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "libkes.h"
+
+
+/* Timing statistics of a single benchmark */
+struct bench_result_t {
+    std::string name;
+    int repetitions;
+    double min;
+    double median;
+    double mean;
+    double stddev;
+    double max;
+};
+
+typedef std::vector<bench_result_t> bench_results_t;
+
+/* Progress and comparisons, stderr while the JSON results go to stdout */
+FILE* bench_log = stdout;
+
+bench_result_t
+run_benchmark(const std::string name,
+              const std::function<void()> kernel,
+              const int repetitions) {
+    /* Run a kernel once for warm up and then time it repeatedly.
+     *
+     * name: The name of the benchmark
+     * kernel: The code to time
+     * repetitions: Number of timed runs
+     */
+    std::vector<double> t(repetitions);
+
+    kernel();
+    for(int r = 0; r < repetitions; r++) {
+        double start = monotonic_time();
+        kernel();
+        t[r] = monotonic_time() - start;
+    }
+    std::sort(t.begin(), t.end());
+
+    bench_result_t result;
+    result.name = name;
+    result.repetitions = repetitions;
+    result.min = t[0];
+    result.max = t[repetitions-1];
+    result.median = repetitions % 2 ? t[repetitions/2] : 0.5 * (t[repetitions/2-1] + t[repetitions/2]);
+    result.mean = 0.0;
+    for(int r = 0; r < repetitions; r++) {
+        result.mean += t[r];
+    }
+    result.mean /= repetitions;
+    result.stddev = 0.0;
+    for(int r = 0; r < repetitions; r++) {
+        result.stddev += (t[r] - result.mean) * (t[r] - result.mean);
+    }
+    result.stddev = repetitions > 1 ? sqrt(result.stddev / (repetitions - 1)) : 0.0;
+
+    fprintf(bench_log, "%s: %g s\n", name.c_str(), result.median);
+    return result;
+}
+
+
+void
+write_results(FILE* file,
+              const bench_results_t& results,
+              const int repetitions) {
+    /* Write the results as JSON, one benchmark per line
+     */
+    fprintf(file, "{\n");
+    fprintf(file, "\"family\": \"%s\",\n", family_name());
+    fprintf(file, "\"repetitions\": %d,\n", repetitions);
+    fprintf(file, "\"benchmarks\": [\n");
+    for(unsigned int i = 0; i < results.size(); i++) {
+        const bench_result_t& r = results[i];
+        fprintf(file, "{\"name\": \"%s\", \"repetitions\": %d, \"min\": %.6e, \"median\": %.6e, "
+                "\"mean\": %.6e, \"stddev\": %.6e, \"max\": %.6e}%s\n",
+                r.name.c_str(), r.repetitions, r.min, r.median, r.mean, r.stddev, r.max,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "]\n");
+    fprintf(file, "}\n");
+}
+
+
+bool
+read_baseline(std::map<std::string, double>& baseline,
+              const char* filename) {
+    /* Read the medians of a results file written by 'write_results'
+     */
+    FILE* file = fopen(filename, "r");
+    if(file == NULL) {
+        return false;
+    }
+
+    char *line = NULL;
+    size_t size = 0;
+    while(getline(&line, &size, file) > 0) {
+        char name[1024];
+        double median;
+        const char *c = strstr(line, "\"name\": \"");
+        const char *m = strstr(line, "\"median\": ");
+        if(c != NULL && m != NULL
+           && sscanf(c, "\"name\": \"%1023[^\"]\"", name) == 1
+           && sscanf(m, "\"median\": %lf", &median) == 1) {
+            baseline[name] = median;
+        }
+    }
+
+    free(line);
+    fclose(file);
+    return true;
+}
+
+
+int
+compare_results(const bench_results_t& results,
+                const std::map<std::string, double>& baseline,
+                const double tolerance) {
+    /* Compare medians against a baseline, returns the number of regressions
+     */
+    int regressions = 0;
+
+    fprintf(bench_log, "==================================================\n");
+    fprintf(bench_log, "%-56s %12s %12s %8s\n", "benchmark", "baseline [s]", "current [s]", "ratio");
+    for(auto it = results.begin(); it != results.end(); it++) {
+        auto b = baseline.find(it->name);
+        if(b == baseline.end()) {
+            fprintf(bench_log, "%-56s %12s %12.4e %8s\n", it->name.c_str(), "-", it->median, "new");
+            continue;
+        }
+        double ratio = it->median / b->second;
+        bool regression = ratio > 1.0 + tolerance;
+        regressions += regression;
+        fprintf(bench_log, "%-56s %12.4e %12.4e %8.3f%s\n", it->name.c_str(), b->second, it->median, ratio,
+               regression ? "  REGRESSION" : "");
+    }
+    fprintf(bench_log, "==================================================\n");
+    fprintf(bench_log, "Regressions beyond %.0f%%: %d\n", 100 * tolerance, regressions);
+
+    return regressions;
+}
+
+
+#endif
@@ -0,0 +1,319 @@
+/*  Author: R. Bourquin
+ *  Copyright: (C) 2014 R. Bourquin
+ *  License: GNU GPL v2 or above
+ *
+ *  A library of helper functions to search for
+ *  Kronrod extensions of Gauss quadrature rules.
+ */
+
+#ifndef __HH__coord
+#define __HH__coord
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "helpers.h"
+
+
+/* Protocol of the search coordinator
+ *
+ * The coordinator 'kescoord' listens on a TCP port and hands out units of
+ * work to 'ekes -w' and 'rekes -w' workers. Every request is one short
+ * connection carrying a single line, the coordinator answers with a line:
+ *
+ *   LEASE family worker
+ *     UNIT id L TILE n0 n1 p0 p1          all cells n0 <= n <= n1, p0 <= p <= p1
+ *     UNIT id L TREE maxp maxrec n p1 ... pj
+ *                                         all sequences below the prefix up to depth maxrec
+ *     WAIT seconds                        all units are leased, ask again later
+ *     DONE                                the search is complete
+ *     ERR message
+ *
+ *   BEAT id
+ *     OK                                  the lease is extended
+ *     LOST                                the lease expired and the unit was reassigned
+ *
+ *   RESULT id
+ *   CELL n p value                        ... for a tile
+ *   RULE: depth n p1 ... pk               ... for a subtree, as printed by rekes
+ *   END
+ *     OK
+ *
+ * The id names the lease, not the unit. A lease expires if no heartbeat
+ * arrives within L seconds, the unit is then handed out again under a new
+ * id. Results are idempotent, the first one received for a unit is kept,
+ * hence late results of expired leases are harmless.
+ *
+ * This header only depends on POSIX and 'helpers.h' and can be included
+ * by workers.
+ */
+
+#define COORD_MAXLINE 4096
+#define COORD_TIMEOUT 30
+#define COORD_RETRIES 8
+
+
+typedef struct {
+    const char *address;
+    long unit;
+    double interval;
+    int stop;
+    int lost;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+} coord_heartbeat_t;
+
+
+int coord_split_address(char *, char *, const char *);
+int coord_connect(const char *);
+int coord_request(char *, const char *, const char *, const size_t);
+int coord_lease(char *, const char *, const char *);
+int coord_submit(const char *, const char *, const size_t);
+void * coord_heartbeat_main(void *);
+void coord_heartbeat_start(coord_heartbeat_t *, const char *, const long, const double);
+int coord_heartbeat_stop(coord_heartbeat_t *);
+
+
+int coord_split_address(char *host,
+                        char *port,
+                        const char *address) {
+    /* Split 'host:port' or ':port', returns 0 if there is no port
+     *
+     * host: Buffer of size COORD_MAXLINE receiving the host, empty for any
+     * port: Buffer of size COORD_MAXLINE receiving the port
+     * address: The address
+     */
+    const char *colon;
+
+    colon = strrchr(address, ':');
+    if(colon == NULL || strlen(address) >= COORD_MAXLINE) {
+        return 0;
+    }
+    memcpy(host, address, colon - address);
+    host[colon - address] = '\0';
+    strcpy(port, colon + 1);
+    return strlen(port) > 0;
+}
+
+
+int coord_connect(const char *address) {
+    /* Connect to the coordinator, returns the socket or -1 on failure
+     *
+     * address: The address 'host:port' of the coordinator
+     */
+    char host[COORD_MAXLINE], port[COORD_MAXLINE];
+    struct addrinfo hints, *info, *ai;
+    struct timeval timeout;
+    int fd;
+
+    if(!coord_split_address(host, port, address)) {
+        return -1;
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if(getaddrinfo(strlen(host) > 0 ? host : "localhost", port, &hints, &info) != 0) {
+        return -1;
+    }
+
+    fd = -1;
+    for(ai = info; ai != NULL && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if(fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(info);
+
+    if(fd >= 0) {
+        timeout.tv_sec = COORD_TIMEOUT;
+        timeout.tv_usec = 0;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    }
+    return fd;
+}
+
+
+int coord_request(char *reply,
+                  const char *address,
+                  const char *request,
+                  const size_t len) {
+    /* Send a request and read the reply line, returns 1 on success
+     *
+     * reply: Buffer of size COORD_MAXLINE receiving the reply
+     * address: The address of the coordinator
+     * request: The request, one or more lines ending in a newline
+     * len: Length of the request
+     */
+    size_t sent;
+    ssize_t n;
+    int fd, ok;
+
+    if((fd = coord_connect(address)) < 0) {
+        return 0;
+    }
+    for(sent = 0; sent < len; sent += n) {
+        n = write(fd, request + sent, len - sent);
+        if(n <= 0) {
+            close(fd);
+            return 0;
+        }
+    }
+    ok = read_line(fd, reply, COORD_MAXLINE) >= 0;
+    close(fd);
+    return ok;
+}
+
+
+int coord_lease(char *reply,
+                const char *address,
+                const char *family) {
+    /* Lease the next unit, waiting while all units are leased and retrying
+     * with backoff while the coordinator is unreachable. Returns 1 if the
+     * reply is a 'UNIT' line and 0 once the search is complete or failed.
+     *
+     * reply: Buffer of size COORD_MAXLINE receiving the reply
+     * address: The address of the coordinator
+     * family: The polynomial family of the worker
+     */
+    char request[COORD_MAXLINE], host[256];
+    int len, failures, wait;
+
+    if(gethostname(host, sizeof(host)) != 0) {
+        strcpy(host, "unknown");
+    }
+    host[sizeof(host) - 1] = '\0';
+    len = snprintf(request, sizeof(request), "LEASE %s %s:%ld\n", family, host, (long) getpid());
+
+    failures = 0;
+    for(;;) {
+        if(!coord_request(reply, address, request, len)) {
+            if(++failures > COORD_RETRIES) {
+                printf("Coordinator %s unreachable, giving up\n", address);
+                return 0;
+            }
+            sleep(1 << (failures < 5 ? failures : 5));
+            continue;
+        }
+        failures = 0;
+        if(!strncmp(reply, "UNIT ", 5)) {
+            return 1;
+        } else if(sscanf(reply, "WAIT %d", &wait) == 1) {
+            sleep(wait > 0 ? wait : 1);
+        } else if(!strcmp(reply, "DONE")) {
+            return 0;
+        } else {
+            printf("Coordinator: %s\n", reply);
+            return 0;
+        }
+    }
+}
+
+
+int coord_submit(const char *address,
+                 const char *result,
+                 const size_t len) {
+    /* Send a 'RESULT' message, retrying with backoff, returns 1 on success
+     *
+     * address: The address of the coordinator
+     * result: The message from 'RESULT id' up to and including 'END'
+     * len: Length of the message
+     */
+    char reply[COORD_MAXLINE];
+    int failures;
+
+    for(failures = 0; failures <= COORD_RETRIES; failures++) {
+        if(coord_request(reply, address, result, len)) {
+            return !strcmp(reply, "OK");
+        }
+        sleep(1 << (failures < 5 ? failures : 5));
+    }
+    return 0;
+}
+
+
+void * coord_heartbeat_main(void *arg) {
+    /* Send a heartbeat for the unit every interval until stopped
+     */
+    coord_heartbeat_t *beat;
+    struct timespec deadline;
+    char request[64], reply[COORD_MAXLINE];
+    int len;
+
+    beat = (coord_heartbeat_t *) arg;
+    len = snprintf(request, sizeof(request), "BEAT %ld\n", beat->unit);
+
+    pthread_mutex_lock(&beat->lock);
+    while(!beat->stop) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += (time_t) beat->interval;
+        deadline.tv_nsec += (long) ((beat->interval - (time_t) beat->interval) * 1e9);
+        if(deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&beat->wakeup, &beat->lock, &deadline);
+        if(beat->stop) {
+            break;
+        }
+        pthread_mutex_unlock(&beat->lock);
+        if(coord_request(reply, beat->address, request, len) && !strcmp(reply, "LOST")) {
+            __atomic_store_n(&beat->lost, 1, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_lock(&beat->lock);
+    }
+    pthread_mutex_unlock(&beat->lock);
+    return NULL;
+}
+
+
+void coord_heartbeat_start(coord_heartbeat_t *beat,
+                           const char *address,
+                           const long unit,
+                           const double interval) {
+    /* Start sending heartbeats for a leased unit from a background thread
+     *
+     * beat: The heartbeat
+     * address: The address of the coordinator
+     * unit: The id of the lease
+     * interval: Seconds between two heartbeats
+     */
+    beat->address = address;
+    beat->unit = unit;
+    beat->interval = interval;
+    beat->stop = 0;
+    beat->lost = 0;
+    pthread_mutex_init(&beat->lock, NULL);
+    pthread_cond_init(&beat->wakeup, NULL);
+    pthread_create(&beat->thread, NULL, coord_heartbeat_main, beat);
+}
+
+
+int coord_heartbeat_stop(coord_heartbeat_t *beat) {
+    /* Stop the heartbeats, returns 1 if the coordinator reported the lease lost
+     *
+     * beat: The heartbeat
+     */
+    pthread_mutex_lock(&beat->lock);
+    beat->stop = 1;
+    pthread_cond_signal(&beat->wakeup);
+    pthread_mutex_unlock(&beat->lock);
+    pthread_join(beat->thread, NULL);
+    pthread_mutex_destroy(&beat->lock);
+    pthread_cond_destroy(&beat->wakeup);
+    return beat->lost;
+}
+
+
+#endif
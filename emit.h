@@ -0,0 +1,479 @@
+/*  Author: R. Bourquin
+ *  Copyright: (C) 2014 R. Bourquin
+ *  License: GNU GPL v2 or above
+ *
+ *  A library of helper functions to search for
+ *  Kronrod extensions of Gauss quadrature rules.
+ */
+
+#ifndef __HH__emit
+#define __HH__emit
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <float.h>
+
+#include "libkes.h"
+
+
+#define EMIT_DOUBLE 0
+#define EMIT_LONG_DOUBLE 1
+#define EMIT_DOUBLE_DOUBLE 2
+
+
+int emit_parse_type(const char *);
+long emit_type_bits(const int);
+int emit_value(FILE *, const arb_t, const int);
+void emit_header_begin(FILE *, const char *, const char *);
+void emit_header_end(FILE *, const char *);
+void emit_declaration(FILE *, const char *, const char *, const char *);
+void emit_int_array(FILE *, const char *, const char *, const long *, const long);
+long emit_real_array(FILE *, const char *, const char *, arb_srcptr, const long, const long, const int);
+long emit_acb_array(FILE *, const char *, const char *, const acb_ptr, const long, const int);
+
+void sort_index_by_nodes(long *, const acb_ptr, const long);
+void sort_nodes_and_weights(acb_ptr, acb_ptr, const long);
+void compute_nested_rule(acb_ptr, acb_ptr, long *, long *, const fmpq_poly_t, const fmpq_poly_struct *, const int, const long, const int);
+long emit_nested_rule(FILE *, const char *, const int[], const int, const acb_ptr, const acb_ptr, const long *, const long *, const int);
+
+
+int emit_parse_type(const char *name) {
+    /* Map the name of a C floating point type to its emission type.
+     * Returns -1 for unknown names.
+     *
+     * name: One of 'double', 'longdouble' or 'doubledouble'
+     */
+    if(!strcmp(name, "double") || !strcmp(name, "d")) {
+        return EMIT_DOUBLE;
+    } else if(!strcmp(name, "longdouble") || !strcmp(name, "ld")) {
+        return EMIT_LONG_DOUBLE;
+    } else if(!strcmp(name, "doubledouble") || !strcmp(name, "dd")) {
+        return EMIT_DOUBLE_DOUBLE;
+    }
+    return -1;
+}
+
+
+long emit_type_bits(const int type) {
+    /* Number of mantissa bits carried by an emission type.
+     *
+     * type: The emission type
+     */
+    switch(type) {
+    case EMIT_LONG_DOUBLE:
+        return LDBL_MANT_DIG;
+    case EMIT_DOUBLE_DOUBLE:
+        return 2 * DBL_MANT_DIG;
+    default:
+        return DBL_MANT_DIG;
+    }
+}
+
+
+int emit_value(FILE *file,
+               const arb_t x,
+               const int type) {
+    /* Write the correctly rounded midpoint of a ball as a C literal.
+     *
+     * For double-double values two literals {hi, lo} are written where
+     * hi is the nearest double to x and lo the nearest double to x - hi.
+     * Returns 1 if both endpoints of the ball round to the same value,
+     * that is the literal is the correctly rounded value of any point
+     * inside the ball, and 0 otherwise.
+     *
+     * file: The output file
+     * x: The ball to write
+     * type: The emission type
+     */
+    arf_t lo, hi, r;
+    double d, e;
+    long double l;
+    long bits;
+    int certain;
+
+    arf_init(lo);
+    arf_init(hi);
+    arf_init(r);
+
+    /* Check that the rounding is determined by the ball */
+    bits = emit_type_bits(type);
+    arb_get_lbound_arf(lo, x, 2 * bits);
+    arb_get_ubound_arf(hi, x, 2 * bits);
+    arf_set_round(lo, lo, bits, ARF_RND_NEAR);
+    arf_set_round(hi, hi, bits, ARF_RND_NEAR);
+    certain = arf_equal(lo, hi);
+
+    switch(type) {
+    case EMIT_LONG_DOUBLE:
+        /* Split into two doubles, the sum is exact in long double */
+        arf_set_round(r, arb_midref(x), LDBL_MANT_DIG, ARF_RND_NEAR);
+        d = arf_get_d(r, ARF_RND_NEAR);
+        arf_set_d(lo, d);
+        arf_sub(r, r, lo, ARF_PREC_EXACT, ARF_RND_NEAR);
+        e = arf_get_d(r, ARF_RND_NEAR);
+        l = (long double) d + (long double) e;
+        fprintf(file, "%.*LeL", DECIMAL_DIG - 1, l);
+        break;
+    case EMIT_DOUBLE_DOUBLE:
+        d = arf_get_d(arb_midref(x), ARF_RND_NEAR);
+        arf_set_d(lo, d);
+        arf_sub(r, arb_midref(x), lo, ARF_PREC_EXACT, ARF_RND_NEAR);
+        e = arf_get_d(r, ARF_RND_NEAR);
+        fprintf(file, "{%.16e, %.16e}", d, e);
+        break;
+    default:
+        d = arf_get_d(arb_midref(x), ARF_RND_NEAR);
+        fprintf(file, "%.16e", d);
+        break;
+    }
+
+    arf_clear(lo);
+    arf_clear(hi);
+    arf_clear(r);
+    return certain;
+}
+
+
+void emit_header_begin(FILE *file,
+                       const char *prefix,
+                       const char *comment) {
+    /* Write the include guard and the qualifier macro of a rule header.
+     *
+     * The arrays are 'static constexpr' when compiled as C++
+     * and 'static const' when compiled as C.
+     *
+     * file: The output file
+     * prefix: Prefix for all symbols in the header
+     * comment: Free text placed into the leading comment
+     */
+    const char *c;
+
+    fprintf(file, "/* %s */\n\n", comment);
+    fprintf(file, "#ifndef ");
+    for(c = prefix; *c; c++) fputc(toupper(*c), file);
+    fprintf(file, "_H\n#define ");
+    for(c = prefix; *c; c++) fputc(toupper(*c), file);
+    fprintf(file, "_H\n\n#ifdef __cplusplus\n#define ");
+    for(c = prefix; *c; c++) fputc(toupper(*c), file);
+    fprintf(file, "_CONST static constexpr\n#else\n#define ");
+    for(c = prefix; *c; c++) fputc(toupper(*c), file);
+    fprintf(file, "_CONST static const\n#endif\n\n");
+}
+
+
+void emit_header_end(FILE *file,
+                     const char *prefix) {
+    /* Close the include guard of a rule header.
+     *
+     * file: The output file
+     * prefix: Prefix for all symbols in the header
+     */
+    const char *c;
+
+    fprintf(file, "#endif  /* ");
+    for(c = prefix; *c; c++) fputc(toupper(*c), file);
+    fprintf(file, "_H */\n");
+}
+
+
+void emit_declaration(FILE *file,
+                      const char *prefix,
+                      const char *ctype,
+                      const char *name) {
+    /* Write the qualified declarator of an array without its extents.
+     *
+     * file: The output file
+     * prefix: Prefix for all symbols in the header
+     * ctype: The C element type
+     * name: Name of the array
+     */
+    const char *c;
+
+    for(c = prefix; *c; c++) fputc(toupper(*c), file);
+    fprintf(file, "_CONST %s %s_%s", ctype, prefix, name);
+}
+
+
+void emit_int_array(FILE *file,
+                    const char *prefix,
+                    const char *name,
+                    const long *values,
+                    const long len) {
+    /* Write an integer array.
+     *
+     * file: The output file
+     * prefix: Prefix for all symbols in the header
+     * name: Name of the array
+     * values: The entries
+     * len: Number of entries
+     */
+    long i;
+
+    emit_declaration(file, prefix, "long", name);
+    fprintf(file, "[%ld] = {", len);
+    for(i = 0; i < len; i++) {
+        fprintf(file, i > 0 ? ", %ld" : "%ld", values[i]);
+    }
+    fprintf(file, "};\n\n");
+}
+
+
+long emit_real_array(FILE *file,
+                     const char *prefix,
+                     const char *name,
+                     arb_srcptr values,
+                     const long rows,
+                     const long cols,
+                     const int type) {
+    /* Write a table of real numbers with given row and column count.
+     * A single column is written as a one dimensional array.
+     * Returns the number of entries which are not provably correctly rounded.
+     *
+     * file: The output file
+     * prefix: Prefix for all symbols in the header
+     * name: Name of the array
+     * values: The entries in row-major order
+     * rows: Number of rows
+     * cols: Number of columns
+     * type: The emission type
+     */
+    long i, j, uncertain;
+
+    emit_declaration(file, prefix, type == EMIT_LONG_DOUBLE ? "long double" : "double", name);
+    fprintf(file, "[%ld]", rows);
+    if(cols > 1) fprintf(file, "[%ld]", cols);
+    if(type == EMIT_DOUBLE_DOUBLE) fprintf(file, "[2]");
+    fprintf(file, " = {\n");
+
+    uncertain = 0;
+    for(i = 0; i < rows; i++) {
+        fprintf(file, cols > 1 ? "    {" : "    ");
+        for(j = 0; j < cols; j++) {
+            if(j > 0) fprintf(file, ", ");
+            if(!emit_value(file, values + i*cols + j, type)) {
+                uncertain++;
+            }
+        }
+        fprintf(file, cols > 1 ? "}" : "");
+        fprintf(file, i + 1 < rows ? ",\n" : "\n");
+    }
+    fprintf(file, "};\n\n");
+
+    return uncertain;
+}
+
+
+long emit_acb_array(FILE *file,
+                    const char *prefix,
+                    const char *name,
+                    const acb_ptr values,
+                    const long len,
+                    const int type) {
+    /* Write the real parts of a vector of complex balls.
+     * Returns the number of entries which are not provably correctly rounded.
+     *
+     * file: The output file
+     * prefix: Prefix for all symbols in the header
+     * name: Name of the array
+     * values: The entries
+     * len: Number of entries
+     * type: The emission type
+     */
+    long i, uncertain;
+    arb_ptr re;
+
+    re = _arb_vec_init(len);
+    for(i = 0; i < len; i++) {
+        arb_set(re + i, acb_realref(values + i));
+    }
+    uncertain = emit_real_array(file, prefix, name, re, len, 1, type);
+    _arb_vec_clear(re, len);
+
+    return uncertain;
+}
+
+
+void sort_index_by_nodes(long *index,
+                         const acb_ptr nodes,
+                         const long n) {
+    /* Compute the permutation which sorts the nodes by their real parts.
+     *
+     * index: Array of length n receiving the permutation
+     * nodes: The nodes to sort
+     * n: Number of nodes
+     */
+    long i, j, t;
+
+    for(i = 0; i < n; i++) {
+        index[i] = i;
+    }
+    for(i = 1; i < n; i++) {
+        t = index[i];
+        j = i;
+        while(j > 0 &&
+              arf_cmp(arb_midref(acb_realref(nodes + index[j-1])),
+                      arb_midref(acb_realref(nodes + t))) > 0) {
+            index[j] = index[j-1];
+            j--;
+        }
+        index[j] = t;
+    }
+}
+
+
+void sort_nodes_and_weights(acb_ptr nodes,
+                            acb_ptr weights,
+                            const long n) {
+    /* Sort quadrature nodes in-place and permute the weights along
+     *
+     * nodes: The nodes to sort
+     * weights: The weights belonging to the nodes
+     * n: Number of nodes
+     */
+    long i;
+    long *index;
+    acb_ptr t;
+
+    index = (long *) malloc(n * sizeof(long));
+    sort_index_by_nodes(index, nodes, n);
+
+    t = _acb_vec_init(n);
+    for(i = 0; i < n; i++) acb_set(t + i, nodes + index[i]);
+    for(i = 0; i < n; i++) acb_swap(nodes + i, t + i);
+    for(i = 0; i < n; i++) acb_set(t + i, weights + index[i]);
+    for(i = 0; i < n; i++) acb_swap(weights + i, t + i);
+
+    _acb_vec_clear(t, n);
+    free(index);
+}
+
+
+void compute_nested_rule(acb_ptr nodes,
+                         acb_ptr weights,
+                         long *offsets,
+                         long *weight_offsets,
+                         const fmpq_poly_t Pn,
+                         const fmpq_poly_struct *factors,
+                         const int k,
+                         const long prec,
+                         const int loglevel) {
+    /* Compute all rules of a nested extension tower in nested order.
+     *
+     * The nodes are ordered by level: first the roots of P_n, then the
+     * roots of E_1 and so on, each level sorted in ascending order.
+     * The rule of level j uses the nodes  nodes[0 .. offsets[j+1])  and
+     * its weights are  weights[weight_offsets[j] .. weight_offsets[j+1]).
+     *
+     * nodes: Array of length deg(P_n E_1 ... E_{k-1}) for the nodes
+     * weights: Array of length  \sum_j offsets[j+1]  for the weights
+     * offsets: Array of length k+1 for the node level boundaries
+     * weight_offsets: Array of length k+1 for the weight level boundaries
+     * Pn: The polynomial defining the basis
+     * factors: The extensions E_1, ..., E_{k-1}
+     * k: The number of levels in the tower
+     * prec: Number of bits in target precision
+     * loglevel: The log verbosity
+     */
+    int j;
+    long i, deg;
+    long *index;
+    fmpq_poly_t P;
+    acb_ptr lnodes, lweights;
+
+    fmpq_poly_init(P);
+    fmpq_poly_set(P, Pn);
+
+    offsets[0] = 0;
+    weight_offsets[0] = 0;
+
+    for(j = 0; j < k; j++) {
+        if(j > 0) {
+            fmpq_poly_mul(P, P, factors + j - 1);
+            fmpq_poly_canonicalise(P);
+        }
+
+        /* Nodes new on this level */
+        deg = j > 0 ? fmpq_poly_degree(factors + j - 1) : fmpq_poly_degree(Pn);
+        compute_nodes(nodes + offsets[j], j > 0 ? factors + j - 1 : Pn, prec, loglevel);
+        sort_nodes(nodes + offsets[j], deg);
+        offsets[j+1] = offsets[j] + deg;
+
+        /* Full rule of this level, mapped onto the nested node order */
+        deg = offsets[j+1];
+        lnodes = _acb_vec_init(deg);
+        lweights = _acb_vec_init(deg);
+        index = (long *) malloc(deg * sizeof(long));
+
+        compute_nodes_and_weights(lnodes, lweights, P, prec, loglevel);
+        sort_nodes_and_weights(lnodes, lweights, deg);
+        sort_index_by_nodes(index, nodes, deg);
+
+        for(i = 0; i < deg; i++) {
+            acb_set(weights + weight_offsets[j] + index[i], lweights + i);
+        }
+        weight_offsets[j+1] = weight_offsets[j] + deg;
+
+        free(index);
+        _acb_vec_clear(lnodes, deg);
+        _acb_vec_clear(lweights, deg);
+    }
+
+    fmpq_poly_clear(P);
+}
+
+
+long emit_nested_rule(FILE *file,
+                      const char *prefix,
+                      const int levels[],
+                      const int k,
+                      const acb_ptr nodes,
+                      const acb_ptr weights,
+                      const long *offsets,
+                      const long *weight_offsets,
+                      const int type) {
+    /* Write a complete header for a nested extension tower
+     * as computed by 'compute_nested_rule'.
+     * Returns the number of entries which are not provably correctly rounded.
+     *
+     * file: The output file
+     * prefix: Prefix for all symbols in the header
+     * levels: An array with the extension levels p_0, ..., p_{k-1}
+     * k: The number of levels in the tower
+     * nodes: The nodes in nested order
+     * weights: The weights of all levels
+     * offsets: The node level boundaries
+     * weight_offsets: The weight level boundaries
+     * type: The emission type
+     */
+    int j;
+    long uncertain;
+    long *lv;
+
+    emit_header_begin(file, prefix,
+                      "Nested Kronrod extension rule generated by kes\n *\n"
+                      " * The rule of level j uses the nodes  nodes[offsets[0] .. offsets[j+1])\n"
+                      " * and the weights  weights[weight_offsets[j] .. weight_offsets[j+1]).");
+
+    lv = (long *) malloc(k * sizeof(long));
+    for(j = 0; j < k; j++) {
+        lv[j] = levels[j];
+    }
+
+    fprintf(file, "/* Family: %s */\n", family_name());
+    emit_declaration(file, prefix, "int", "nlevels");
+    fprintf(file, " = %d;\n\n", k);
+    emit_int_array(file, prefix, "levels", lv, k);
+    emit_int_array(file, prefix, "offsets", offsets, k + 1);
+    emit_int_array(file, prefix, "weight_offsets", weight_offsets, k + 1);
+    uncertain = emit_acb_array(file, prefix, "nodes", nodes, offsets[k], type);
+    uncertain += emit_acb_array(file, prefix, "weights", weights, weight_offsets[k], type);
+    emit_header_end(file, prefix);
+
+    free(lv);
+    return uncertain;
+}
+
+
+#endif
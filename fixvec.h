@@ -0,0 +1,598 @@
+/*  Author: R. Bourquin
+ *  Copyright: (C) 2014 R. Bourquin
+ *  License: GNU GPL v2 or above
+ *
+ *  A library of helper functions to search for
+ *  Kronrod extensions of Gauss quadrature rules.
+ */
+
+#ifndef __HH__fixvec
+#define __HH__fixvec
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "flint/flint.h"
+#include "flint/fmpz.h"
+#include "flint/fmpq.h"
+#include "flint/fmpq_poly.h"
+
+#include "arf.h"
+#include "arb.h"
+#include "acb.h"
+
+#include "scheduler.h"
+
+
+/* Contiguous vectors of real balls at one fixed precision
+ *
+ * An acb vector holds one heap allocated mantissa per ball, loops over
+ * large rules chase a pointer per entry. A fixvec keeps all entries as
+ * structure of arrays: the mantissas of 'limbs' limbs each back to back,
+ * the exponents, the signs and the radii. Entry i is the ball
+ *
+ *   (-1)^sign[i] man[i] 2^(exp[i] - limbs FLINT_BITS)  +/-  rad[i] 2^exp[i]
+ *
+ * where the mantissa is an integer with the top bit set or zero and the
+ * radius is a double relative to the exponent, rounded upwards. All
+ * arithmetic truncates the mantissa and adds one unit in the last place
+ * to the radius, hence results are rigorous enclosures like those of arb.
+ *
+ * The bulk kernels work entrywise, an operand of length 1 is broadcast.
+ * Conversion to and from arb happens only at the boundaries. Real
+ * vectors up to FIXVEC_MAXPREC bits qualify, see 'fixvec_applicable'.
+ */
+
+#define FIXVEC_MAXLIMBS 15
+#define FIXVEC_MAXPREC (FIXVEC_MAXLIMBS * FLINT_BITS)
+#define FIXVEC_BLOCK 16
+#define FIXVEC_UP(r) ((r) * (1.0 + 8.8817841970012523e-16))
+
+
+typedef struct {
+    long len;
+    long limbs;
+    long prec;
+    mp_limb_t *man;
+    slong *exp;
+    int *sign;
+    double *rad;
+} fixvec_struct;
+
+typedef fixvec_struct fixvec_t[1];
+
+typedef struct {
+    fixvec_struct *values;
+    const fixvec_struct *coeffs;
+    const fixvec_struct *points;
+} fixvec_horner_t;
+
+
+int fixvec_enabled = 1;
+
+
+int fixvec_applicable(const acb_ptr, const long, const long);
+void fixvec_init(fixvec_t, const long, const long);
+void fixvec_clear(fixvec_t);
+int _fixvec_is_zero(const fixvec_t, const long);
+void _fixvec_set(fixvec_t, const long, const fixvec_t, const long);
+void _fixvec_set_arb(fixvec_t, const long, const arb_t);
+void _fixvec_get_arb(arb_t, const fixvec_t, const long);
+void _fixvec_mul(fixvec_t, const long, const fixvec_t, const long, const fixvec_t, const long);
+void _fixvec_add(fixvec_t, const long, const fixvec_t, const long, const fixvec_t, const long, const int);
+void _fixvec_div(fixvec_t, const long, const fixvec_t, const long, const fixvec_t, const long);
+void fixvec_set_acb(fixvec_t, const acb_ptr);
+void fixvec_get_acb(acb_ptr, const fixvec_t);
+void fixvec_set_arb_scalar(fixvec_t, const arb_t);
+void fixvec_mul(fixvec_t, const fixvec_t, const fixvec_t);
+void fixvec_add(fixvec_t, const fixvec_t, const fixvec_t);
+void fixvec_sub(fixvec_t, const fixvec_t, const fixvec_t);
+void fixvec_div(fixvec_t, const fixvec_t, const fixvec_t);
+void fixvec_horner_task(void *, const long);
+void fixvec_poly_evaluate(fixvec_t, const fmpq_poly_t, const fixvec_t);
+
+
+int fixvec_applicable(const acb_ptr vec,
+                      const long len,
+                      const long prec) {
+    /* Whether a vector can be processed as fixvec: it must be
+     * exactly real and the precision not too large.
+     *
+     * vec: The vector
+     * len: Length of the vector
+     * prec: The working precision
+     */
+    long i;
+
+    if(!fixvec_enabled || prec > FIXVEC_MAXPREC) {
+        return 0;
+    }
+    for(i = 0; i < len; i++) {
+        if(!acb_is_real(vec + i)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+void fixvec_init(fixvec_t v,
+                 const long len,
+                 const long prec) {
+    /* Initialise a vector of zeros
+     *
+     * v: The vector
+     * len: Number of entries
+     * prec: Precision in bits, at most FIXVEC_MAXPREC
+     */
+    v->len = len;
+    v->limbs = (prec + FLINT_BITS - 1) / FLINT_BITS;
+    v->prec = prec;
+    v->man = (mp_limb_t *) calloc(len * v->limbs, sizeof(mp_limb_t));
+    v->exp = (slong *) calloc(len, sizeof(slong));
+    v->sign = (int *) calloc(len, sizeof(int));
+    v->rad = (double *) calloc(len, sizeof(double));
+}
+
+
+void fixvec_clear(fixvec_t v) {
+    free(v->man);
+    free(v->exp);
+    free(v->sign);
+    free(v->rad);
+}
+
+
+int _fixvec_is_zero(const fixvec_t v,
+                    const long i) {
+    /* Whether the midpoint of entry i is zero
+     */
+    return v->man[(i + 1) * v->limbs - 1] == 0;
+}
+
+
+void _fixvec_set(fixvec_t z,
+                 const long i,
+                 const fixvec_t x,
+                 const long j) {
+    /* z[i] = x[j]
+     */
+    memmove(z->man + i * z->limbs, x->man + j * x->limbs, z->limbs * sizeof(mp_limb_t));
+    z->exp[i] = x->exp[j];
+    z->sign[i] = x->sign[j];
+    z->rad[i] = x->rad[j];
+}
+
+
+void _fixvec_set_arb(fixvec_t z,
+                     const long i,
+                     const arb_t a) {
+    /* z[i] = a, the mantissa is truncated to the precision of z
+     */
+    const long L = z->limbs;
+    mp_limb_t *zm;
+    fmpz_t m, e;
+    mpz_t t;
+    mag_t r;
+    long bits, shift, k;
+    int inexact;
+
+    fmpz_init(m);
+    fmpz_init(e);
+    mpz_init(t);
+    mag_init(r);
+    zm = z->man + i * L;
+    inexact = 0;
+
+    arf_get_fmpz_2exp(m, e, arb_midref(a));
+    if(fmpz_is_zero(m)) {
+        mpn_zero(zm, L);
+        z->sign[i] = 0;
+        z->exp[i] = mag_is_zero(arb_radref(a)) ? 0 : (slong) ceil(mag_get_d_log2_approx(arb_radref(a)));
+    } else {
+        fmpz_get_mpz(t, m);
+        z->sign[i] = mpz_sgn(t) < 0;
+        mpz_abs(t, t);
+        bits = mpz_sizeinbase(t, 2);
+        shift = bits - L * FLINT_BITS;
+        if(shift > 0) {
+            inexact = !mpz_divisible_2exp_p(t, shift);
+            mpz_tdiv_q_2exp(t, t, shift);
+        } else {
+            mpz_mul_2exp(t, t, -shift);
+        }
+        for(k = 0; k < L; k++) {
+            zm[k] = mpz_getlimbn(t, k);
+        }
+        z->exp[i] = fmpz_get_si(e) + bits;
+    }
+
+    /* The radius relative to the exponent */
+    mag_mul_2exp_si(r, arb_radref(a), -z->exp[i]);
+    if(mag_is_zero(r)) {
+        z->rad[i] = 0.0;
+    } else if(mag_cmp_2exp_si(r, -1000) < 0) {
+        z->rad[i] = ldexp(1.0, -1000);
+    } else {
+        z->rad[i] = mag_get_d(r);
+    }
+    if(inexact) {
+        z->rad[i] = FIXVEC_UP(z->rad[i] + ldexp(1.0, -L * FLINT_BITS));
+    }
+
+    fmpz_clear(m);
+    fmpz_clear(e);
+    mpz_clear(t);
+    mag_clear(r);
+}
+
+
+void _fixvec_get_arb(arb_t a,
+                     const fixvec_t z,
+                     const long i) {
+    /* a = z[i], exactly
+     */
+    const long L = z->limbs;
+    fmpz_t m, e;
+    mpz_t t;
+
+    if(_fixvec_is_zero(z, i)) {
+        arf_zero(arb_midref(a));
+    } else {
+        fmpz_init(m);
+        fmpz_init(e);
+        mpz_init(t);
+        mpz_import(t, L, -1, sizeof(mp_limb_t), 0, 0, z->man + i * L);
+        fmpz_set_mpz(m, t);
+        if(z->sign[i]) {
+            fmpz_neg(m, m);
+        }
+        fmpz_set_si(e, z->exp[i] - L * FLINT_BITS);
+        arf_set_fmpz_2exp(arb_midref(a), m, e);
+        fmpz_clear(m);
+        fmpz_clear(e);
+        mpz_clear(t);
+    }
+
+    if(isfinite(z->rad[i])) {
+        mag_set_d(arb_radref(a), z->rad[i]);
+        mag_mul_2exp_si(arb_radref(a), arb_radref(a), z->exp[i]);
+    } else {
+        mag_inf(arb_radref(a));
+    }
+}
+
+
+void _fixvec_mul(fixvec_t z,
+                 const long i,
+                 const fixvec_t x,
+                 const long j,
+                 const fixvec_t y,
+                 const long k) {
+    /* z[i] = x[j] y[k]
+     *
+     * |xy - x'y'| <= |x'| ry + |y'| rx + rx ry with |x'|, |y'| < 2^exp
+     */
+    const long L = z->limbs;
+    mp_limb_t t[2*FIXVEC_MAXLIMBS];
+    slong e;
+    double rx, ry;
+
+    rx = x->rad[j];
+    ry = y->rad[k];
+    e = x->exp[j] + y->exp[k];
+
+    if(_fixvec_is_zero(x, j) || _fixvec_is_zero(y, k)) {
+        mpn_zero(z->man + i * L, L);
+        z->sign[i] = 0;
+        z->exp[i] = e;
+        z->rad[i] = FIXVEC_UP(rx + ry + rx * ry);
+        return;
+    }
+
+    mpn_mul_n(t, x->man + j * L, y->man + k * L, L);
+    if(!(t[2*L-1] >> (FLINT_BITS - 1))) {
+        mpn_lshift(t, t, 2*L, 1);
+        e--;
+    }
+    z->sign[i] = x->sign[j] ^ y->sign[k];
+    memcpy(z->man + i * L, t + L, L * sizeof(mp_limb_t));
+    z->rad[i] = FIXVEC_UP(ldexp(rx + ry + rx * ry, x->exp[j] + y->exp[k] - e) + ldexp(1.0, -L * FLINT_BITS));
+    z->exp[i] = e;
+}
+
+
+void _fixvec_add(fixvec_t z,
+                 const long i,
+                 const fixvec_t x,
+                 const long j,
+                 const fixvec_t y,
+                 const long k,
+                 const int negate) {
+    /* z[i] = x[j] + y[k] or x[j] - y[k] if negate is set
+     *
+     * The smaller operand is aligned in a buffer with a guard limb.
+     */
+    const long L = z->limbs;
+    mp_limb_t ta[FIXVEC_MAXLIMBS+1], tb[FIXVEC_MAXLIMBS+1], tz[FIXVEC_MAXLIMBS+1];
+    const mp_limb_t *am, *bm;
+    slong ea, eb, e, d;
+    double ra, rb, lost;
+    int sa, sb, sz, za, zb;
+    long q, h, s;
+
+    /* a is the operand of larger exponent */
+    if(x->exp[j] >= y->exp[k]) {
+        am = x->man + j * L; ea = x->exp[j]; sa = x->sign[j]; ra = x->rad[j]; za = _fixvec_is_zero(x, j);
+        bm = y->man + k * L; eb = y->exp[k]; sb = y->sign[k] ^ negate; rb = y->rad[k]; zb = _fixvec_is_zero(y, k);
+    } else {
+        am = y->man + k * L; ea = y->exp[k]; sa = y->sign[k] ^ negate; ra = y->rad[k]; za = _fixvec_is_zero(y, k);
+        bm = x->man + j * L; eb = x->exp[j]; sb = x->sign[j]; rb = x->rad[j]; zb = _fixvec_is_zero(x, j);
+    }
+    if(za && !zb) {
+        /* Keep the scale of the nonzero operand */
+        z->rad[i] = FIXVEC_UP(rb + ldexp(ra, ea - eb));
+        memmove(z->man + i * L, bm, L * sizeof(mp_limb_t));
+        z->sign[i] = sb;
+        z->exp[i] = eb;
+        return;
+    }
+
+    ta[0] = 0;
+    memcpy(ta + 1, am, L * sizeof(mp_limb_t));
+    mpn_zero(tb, L + 1);
+    lost = 0.0;
+    d = ea - eb;
+    if(zb) {
+        /* Nothing to align */
+    } else if(d >= (L + 1) * FLINT_BITS) {
+        /* All of b is below the guard limb */
+        lost = ldexp(1.0, eb - ea);
+    } else {
+        q = d / FLINT_BITS;
+        s = d % FLINT_BITS;
+        memcpy(tb + 1, bm, L * sizeof(mp_limb_t));
+        if(q > 0) {
+            memmove(tb, tb + q, (L + 1 - q) * sizeof(mp_limb_t));
+            mpn_zero(tb + L + 1 - q, q);
+        }
+        if(s > 0) {
+            mpn_rshift(tb, tb, L + 1, s);
+        }
+        if(d > FLINT_BITS) {
+            lost = ldexp(1.0, -(L + 1) * FLINT_BITS);
+        }
+    }
+
+    e = ea;
+    if(sa == sb) {
+        sz = sa;
+        if(mpn_add_n(tz, ta, tb, L + 1)) {
+            mpn_rshift(tz, tz, L + 1, 1);
+            tz[L] |= ((mp_limb_t) 1) << (FLINT_BITS - 1);
+            e++;
+        }
+    } else if(mpn_cmp(ta, tb, L + 1) >= 0) {
+        sz = sa;
+        mpn_sub_n(tz, ta, tb, L + 1);
+    } else {
+        sz = sb;
+        mpn_sub_n(tz, tb, ta, L + 1);
+    }
+
+    /* Normalise */
+    for(h = L; h >= 0 && tz[h] == 0; h--);
+    if(h < 0) {
+        sz = 0;
+        mpn_zero(tz, L + 1);
+    } else {
+        s = (L - h) * FLINT_BITS + __builtin_clzl(tz[h]);
+        if(s > 0) {
+            q = s / FLINT_BITS;
+            if(q > 0) {
+                memmove(tz + q, tz, (L + 1 - q) * sizeof(mp_limb_t));
+                mpn_zero(tz, q);
+            }
+            if(s % FLINT_BITS > 0) {
+                mpn_lshift(tz, tz, L + 1, s % FLINT_BITS);
+            }
+            e -= s;
+        }
+    }
+
+    z->rad[i] = FIXVEC_UP(ldexp(ra + ldexp(rb, eb - ea) + lost, ea - e) + ldexp(2.0, -L * FLINT_BITS));
+    memcpy(z->man + i * L, tz + 1, L * sizeof(mp_limb_t));
+    z->sign[i] = sz;
+    z->exp[i] = e;
+}
+
+
+void _fixvec_div(fixvec_t z,
+                 const long i,
+                 const fixvec_t x,
+                 const long j,
+                 const fixvec_t y,
+                 const long k) {
+    /* z[i] = x[j] / y[k]
+     *
+     * With mantissas mx < 1 and my the quotient is off by at most
+     * (mx ry + my rx) / (my (my - ry)) 2^(ex - ey).
+     */
+    const long L = z->limbs;
+    mp_limb_t num[2*FIXVEC_MAXLIMBS], q[FIXVEC_MAXLIMBS+1], r[FIXVEC_MAXLIMBS];
+    slong e;
+    double rx, ry, my;
+
+    rx = x->rad[j];
+    ry = y->rad[k];
+    e = x->exp[j] - y->exp[k];
+    my = _fixvec_is_zero(y, k) ? 0.0 : ldexp((double) (y->man[(k + 1) * L - 1] >> 11), -53);
+
+    if(!(ry < my)) {
+        /* The divisor contains zero */
+        mpn_zero(z->man + i * L, L);
+        z->sign[i] = 0;
+        z->exp[i] = e;
+        z->rad[i] = INFINITY;
+        return;
+    }
+
+    if(_fixvec_is_zero(x, j)) {
+        mpn_zero(q, L + 1);
+    } else {
+        mpn_zero(num, L);
+        memcpy(num + L, x->man + j * L, L * sizeof(mp_limb_t));
+        mpn_tdiv_qr(q, r, 0, num, 2*L, y->man + k * L, L);
+        if(q[L] != 0) {
+            mpn_rshift(q, q, L + 1, 1);
+            e++;
+        }
+    }
+
+    z->rad[i] = FIXVEC_UP(ldexp((ry + rx) / (my * (my - ry)), x->exp[j] - y->exp[k] - e)
+                          + ldexp(2.0, -L * FLINT_BITS));
+    memcpy(z->man + i * L, q, L * sizeof(mp_limb_t));
+    z->sign[i] = x->sign[j] ^ y->sign[k];
+    z->exp[i] = e;
+}
+
+
+void fixvec_set_acb(fixvec_t z,
+                    const acb_ptr v) {
+    /* Set z to the real parts of an acb vector of the same length
+     */
+    long i;
+
+    for(i = 0; i < z->len; i++) {
+        _fixvec_set_arb(z, i, acb_realref(v + i));
+    }
+}
+
+
+void fixvec_get_acb(acb_ptr v,
+                    const fixvec_t z) {
+    /* Set an acb vector of the same length to the real vector z
+     */
+    long i;
+
+    for(i = 0; i < z->len; i++) {
+        _fixvec_get_arb(acb_realref(v + i), z, i);
+        arb_zero(acb_imagref(v + i));
+    }
+}
+
+
+void fixvec_set_arb_scalar(fixvec_t z,
+                           const arb_t a) {
+    /* Set all entries of z to a
+     */
+    long i;
+
+    for(i = 0; i < z->len; i++) {
+        _fixvec_set_arb(z, i, a);
+    }
+}
+
+
+void fixvec_mul(fixvec_t z,
+                const fixvec_t x,
+                const fixvec_t y) {
+    long i;
+
+    for(i = 0; i < z->len; i++) {
+        _fixvec_mul(z, i, x, x->len == 1 ? 0 : i, y, y->len == 1 ? 0 : i);
+    }
+}
+
+
+void fixvec_add(fixvec_t z,
+                const fixvec_t x,
+                const fixvec_t y) {
+    long i;
+
+    for(i = 0; i < z->len; i++) {
+        _fixvec_add(z, i, x, x->len == 1 ? 0 : i, y, y->len == 1 ? 0 : i, 0);
+    }
+}
+
+
+void fixvec_sub(fixvec_t z,
+                const fixvec_t x,
+                const fixvec_t y) {
+    long i;
+
+    for(i = 0; i < z->len; i++) {
+        _fixvec_add(z, i, x, x->len == 1 ? 0 : i, y, y->len == 1 ? 0 : i, 1);
+    }
+}
+
+
+void fixvec_div(fixvec_t z,
+                const fixvec_t x,
+                const fixvec_t y) {
+    long i;
+
+    for(i = 0; i < z->len; i++) {
+        _fixvec_div(z, i, x, x->len == 1 ? 0 : i, y, y->len == 1 ? 0 : i);
+    }
+}
+
+
+void fixvec_horner_task(void *arg,
+                        const long b) {
+    /* Task evaluating a block of points
+     */
+    fixvec_horner_t *h;
+    long i, j, K;
+
+    h = (fixvec_horner_t *) arg;
+    K = h->coeffs->len - 1;
+    for(i = b * FIXVEC_BLOCK; i < FLINT_MIN((b + 1) * FIXVEC_BLOCK, h->values->len); i++) {
+        _fixvec_set(h->values, i, h->coeffs, K);
+        for(j = K - 1; j >= 0; j--) {
+            _fixvec_mul(h->values, i, h->values, i, h->points, i);
+            _fixvec_add(h->values, i, h->values, i, h->coeffs, j, 0);
+        }
+    }
+}
+
+
+void fixvec_poly_evaluate(fixvec_t values,
+                          const fmpq_poly_t P,
+                          const fixvec_t points) {
+    /* Evaluate a polynomial at all points by Horner's scheme,
+     * blocks of points are evaluated in parallel.
+     *
+     * values: The values P(x_i), of the length of the points
+     * P: The polynomial
+     * points: The points x_i
+     */
+    fixvec_t coeffs;
+    fixvec_horner_t h;
+    fmpq_t c;
+    arb_t a;
+    long j, K;
+
+    K = FLINT_MAX(fmpq_poly_degree(P), 0);
+    fixvec_init(coeffs, K + 1, values->prec);
+    fmpq_init(c);
+    arb_init(a);
+    for(j = 0; j <= K; j++) {
+        fmpq_poly_get_coeff_fmpq(c, P, j);
+        arb_set_fmpq(a, c, values->prec);
+        _fixvec_set_arb(coeffs, j, a);
+    }
+
+    h.values = values;
+    h.coeffs = coeffs;
+    h.points = points;
+    sched_for(0, (values->len + FIXVEC_BLOCK - 1) / FIXVEC_BLOCK, fixvec_horner_task, &h, SCHED_NORMAL);
+
+    fixvec_clear(coeffs);
+    fmpq_clear(c);
+    arb_clear(a);
+}
+
+
+#endif
@@ -7,17 +7,20 @@
 #include <stdio.h>
 #include <string.h>
 #include <iostream>
+#include <algorithm>
 
 #include "genzkeister.h"
+#include "output.h"
 
 
 int main(int argc, char* argv[]) {
 
     if(argc < 2) {
         printf("Compute Genz-Keister quadrature rule\n");
-        printf("Syntax: genzkeister [-dc D] [-dp D] [-pn] [-pw] [-pge] [-pwf] -K K [n1 n2 n3 ...nk]\n");
+        printf("Syntax: genzkeister [-dc D] [-nmd] [-dp D] [-pn] [-pw] [-pge] [-pwf] [-st S] [-eh F [-et T] [-en N]] [-stats] [-mem] [-perf] [-trace T] -K K [n1 n2 n3 ...nk]\n");
         printf("Options:\n");
         printf("        -dc  Compute nodes and weights up to this number of decimal digits\n");
+        printf("        -nmd Compute all weights in arb, not in double-double or quad-double first\n");
         printf("        -dp  Print this number of decimal digits\n");
         printf("        -pn  Do not print the nodes\n");
         printf("        -pw  Do not print the weights\n");
@@ -26,6 +29,14 @@ int main(int argc, char* argv[]) {
         printf("        -pai Print the a_i values\n");
         printf("        -pwf Print the weight factors\n");
         printf("        -pzs Print the Z-sequence\n");
+        printf("        -st  Use the exact polynomial store in directory S (default: $KES_STORE)\n");
+        printf("        -eh  Write the rule with its orbit tables as C/C++ header to file F\n");
+        printf("        -et  Floating point type T of the header: double, longdouble or doubledouble\n");
+        printf("        -en  Prefix N for all symbols in the header (default: gk_rule)\n");
+        printf("        -stats  Print a timing summary of all stages on exit\n");
+        printf("        -mem    Add allocation counts and peak memory per stage and thread to the summary\n");
+        printf("        -perf   Add hardware counters per stage and thread to the summary (Linux only)\n");
+        printf("        -trace  Write a Chrome trace of all stages and threads to file T\n");
         printf("        -K   Set the level of the rule\n");
         printf("        Further optional parameters  n1 ... nk  define the Kronrod extension used\n");
         return EXIT_FAILURE;
@@ -42,12 +53,18 @@ int main(int argc, char* argv[]) {
     bool print_avalues = false;
     bool print_weightfactors = false;
     bool print_zsequence = false;
+    const char* store = NULL;
+    const char* emit_file = NULL;
+    const char* emit_prefix = "gk_rule";
+    int emit_type = EMIT_DOUBLE;
 
     for(int i = 1; i < argc; i++) {
         if (!strcmp(argv[i], "-dc")) {
             /* 'digits' is in base 10 and log(10)/log(2) = 3.32193 */
             target_prec = 3.32193 * atoi(argv[i+1]);
             i++;
+        } else if (!strcmp(argv[i], "-nmd")) {
+            multidouble_enabled = 0;
         } else if (!strcmp(argv[i], "-dp")) {
             nrprintdigits = atoi(argv[i+1]);
             i++;
@@ -65,6 +82,34 @@ int main(int argc, char* argv[]) {
             print_weightfactors = true;
         } else if (!strcmp(argv[i], "-pzs")) {
             print_zsequence = true;
+        } else if (!strcmp(argv[i], "-st")) {
+            store = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-eh")) {
+            emit_file = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-et")) {
+            emit_type = emit_parse_type(argv[i+1]);
+            if(emit_type < 0) {
+                printf("Unknown floating point type: %s\n", argv[i+1]);
+                return EXIT_FAILURE;
+            }
+            i++;
+        } else if (!strcmp(argv[i], "-en")) {
+            emit_prefix = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-stats")) {
+            stats_enable();
+        } else if (!strcmp(argv[i], "-mem")) {
+            memstats_enable();
+            stats_enable();
+        } else if (!strcmp(argv[i], "-perf")) {
+            if(perf_enable()) {
+                stats_enable();
+            }
+        } else if (!strcmp(argv[i], "-trace")) {
+            trace_enable(argv[i+1]);
+            i++;
         } else if (!strcmp(argv[i], "-K")) {
             K = atoi(argv[i+1]);
             i++;
@@ -73,6 +118,13 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    exact_store_open(store);
+
+    if(emit_file != NULL) {
+        /* Enough bits to decide the rounding of all entries */
+        target_prec = std::max(target_prec, (int)emit_type_bits(emit_type) + 32);
+    }
+
     /* Dimension of the quadrature rule */
     const unsigned int D = DIMENSION;
 
@@ -82,21 +134,7 @@ int main(int argc, char* argv[]) {
 
     /* Default rule definition */
     if(levels.size() == 0) {
-#ifdef LEGENDRE
-        levels = {1, 2, 4, 8, 16, 32};//, 64};
-#endif
-#ifdef HERMITEPRO
-        levels = {1, 2, 6, 10, 16};//, 68};
-#endif
-#ifdef HERMITE
-        levels = {1, 2, 6, 10, 16};//, 68};
-#endif
-#ifdef CHEBYSHEVT
-        levels = {1, 2, 4, 6, 12, 24};//, 48};
-#endif
-#ifdef CHEBYSHEVU
-        levels = {1, 2, 4, 8, 16, 32};//, 64};
-#endif
+        levels = default_levels();
     }
 
     std::cout << "Kronrod extension:  ";
@@ -111,6 +149,7 @@ int main(int argc, char* argv[]) {
     nodes_t<D> nodes;
     weights_t weights;
     rule_t<D> rule;
+    orbits_t<D> orbits;
 
     for(unsigned int working_prec = target_prec; ; working_prec *= 2) {
         std::cout << "--------------------------------------------------\n";
@@ -119,7 +158,9 @@ int main(int argc, char* argv[]) {
         /* Compute data tables */
         // TODO: Assert generator g_0 = 0
         G = compute_generators(levels, 2*working_prec);
+        double start = stage_begin();
         T = compute_tables(G, 2*working_prec);
+        stage_end(STAGE_TABLES, start);
 
         if(K >= G.size()) {
             std::cout << "***********************************\n";
@@ -129,7 +170,17 @@ int main(int argc, char* argv[]) {
         }
 
         /* Compute a Genz-Keister quadrature rule */
-        rule = genz_keister_construction<D>(K, G, T, working_prec);
+        start = stage_begin();
+        orbits_t<D> current = genz_keister_orbits<D>(K, T);
+        if(rule.first.size() > 0 && current == orbits) {
+            /* Keep the orbits which are accurate already */
+            long recomputed = genz_keister_recompute<D>(rule, orbits, K, G, T, working_prec, target_prec);
+            std::cout << "Orbits recomputed: " << recomputed << " of " << orbits.size() << std::endl;
+        } else {
+            rule = genz_keister_construction<D>(K, G, T, working_prec, target_prec);
+            orbits = current;
+        }
+        stage_end(STAGE_CONSTRUCTION, start);
 
         nodes = rule.first;
         weights = rule.second;
@@ -142,33 +193,45 @@ int main(int argc, char* argv[]) {
 
     /* Print nodes and weights */
     std::cout << "==================================================\n";
-    std::cout << "DIMENSION: " << D << std::endl;
-    std::cout << "LEVEL: " << K+1 << std::endl;
-    std::cout << "NUMBER NODES: " << nodes.size() << std::endl;
+    std::cout << "DIMENSION: " << D << "\n";
+    std::cout << "LEVEL: " << K+1 << "\n";
+    std::cout << "NUMBER NODES: " << nodes.size() << "\n";
+
+    if(emit_file != NULL && nodes.size() > 0) {
+        FILE* header = fopen(emit_file, "w");
+        if(header == NULL) {
+            std::cout << "Can not open header file: " << emit_file << "\n";
+        } else {
+            double start = stage_begin();
+            long uncertain = emit_rule_header<D>(header, emit_prefix, levels, K, G, orbits, rule, emit_type);
+            stage_end(STAGE_OUTPUT, start);
+            fclose(header);
+            std::cout << "Header written to: " << emit_file << "\n";
+            if(uncertain > 0) {
+                std::cout << "Warning: " << uncertain << " entries are not provably correctly rounded" << "\n";
+            }
+        }
+    }
 
     if(print_generators) {
         std::cout << "==================================================\n";
-        std::cout << "GENERATORS" << std::endl;
+        std::cout << "GENERATORS" << "\n";
 
-        for(auto it=G.begin(); it != G.end(); it++) {
-            std::cout << "| ";
-            arb_printd(&(*it), nrprintdigits);
-            std::cout << std::endl;
-        }
+        print_arb_table(stdout, G.data(), G.size(), 1, "| ", "", "\n", nrprintdigits);
     }
 
     if(print_moments) {
         std::cout << "==================================================\n";
-        std::cout << "MOMENTS" << std::endl;
+        std::cout << "MOMENTS" << "\n";
 
         moments_t M = std::get<0>(T);
         fmpq_mat_print(&M);
-        std::cout << std::endl;
+        std::cout << "\n";
     }
 
     if(print_avalues) {
         std::cout << "==================================================\n";
-        std::cout << "A-VALUES" << std::endl;
+        std::cout << "A-VALUES" << "\n";
 
         ai_t A = std::get<1>(T);
         arb_mat_printd(&A, nrprintdigits);
@@ -176,7 +239,7 @@ int main(int argc, char* argv[]) {
 
     if(print_weightfactors) {
         std::cout << "==================================================\n";
-        std::cout << "WEIGHTFACTORS" << std::endl;
+        std::cout << "WEIGHTFACTORS" << "\n";
 
         wft_t WF = std::get<2>(T);
         arb_mat_printd(&WF, nrprintdigits);
@@ -184,39 +247,30 @@ int main(int argc, char* argv[]) {
 
     if(print_zsequence) {
         std::cout << "==================================================\n";
-        std::cout << "Z-SEQUENCE" << std::endl;
+        std::cout << "Z-SEQUENCE" << "\n";
 
         z_t Z = std::get<3>(T);
         std::cout << "Z = [ ";
         for(auto it=Z.begin(); it != Z.end(); it++) {
             std::cout << (*it) << " ";
         }
-        std::cout << "]" << std::endl;
+        std::cout << "]" << "\n";
     }
 
     if(print_nodes) {
         std::cout << "==================================================\n";
-        std::cout << "NODES" << std::endl;
+        std::cout << "NODES" << "\n";
 
-        for(auto it=nodes.begin(); it != nodes.end(); it++) {
-            std::cout << "| ";
-            for(unsigned int d=0; d < D; d++) {
-                arb_printd(&((*it)[d]), nrprintdigits);
-                std::cout << ",\t\t";
-            }
-            std::cout << std::endl;
+        if(nodes.size() > 0) {
+            print_arb_table(stdout, &(nodes[0][0]), nodes.size(), D, "| ", ",\t\t", "\n", nrprintdigits);
         }
     }
 
     if(print_weights) {
         std::cout << "==================================================\n";
-        std::cout << "WEIGHTS" << std::endl;
+        std::cout << "WEIGHTS" << "\n";
 
-        for(auto it=weights.begin(); it != weights.end(); it++) {
-            std::cout << "| ";
-            arb_printd(&(*it), nrprintdigits);
-            std::cout << std::endl;
-        }
+        print_arb_table(stdout, weights.data(), weights.size(), 1, "| ", "", "\n", nrprintdigits);
     }
 
     std::cout << "==================================================\n";
@@ -21,6 +21,7 @@
 #include "acb.h"
 
 #include "libkes.h"
+#include "emit.h"
 #include "enumerators.h"
 
 
@@ -34,6 +35,8 @@ typedef std::vector<arb_struct> weights_t;
 template<int D> using node_t = std::array<arb_struct, D>;
 template<int D> using nodes_t = std::vector<node_t<D>>;
 template<int D> using rule_t = std::pair<nodes_t<D>, weights_t>;
+template<int D> using orbit_t = std::pair<partition_t<D>, long>;
+template<int D> using orbits_t = std::vector<orbit_t<D>>;
 
 
 void maxminsort(generators_t& generators, const acb_ptr g, const long n) {
@@ -69,6 +72,30 @@ void maxminsort(generators_t& generators, const acb_ptr g, const long n) {
 }
 
 
+std::vector<int> default_levels() {
+    /* The default Kronrod extension used for the generators
+     * of each symmetric family, empty for all other families.
+     */
+    std::vector<int> levels;
+#ifdef LEGENDRE
+    levels = {1, 2, 4, 8, 16, 32};//, 64};
+#endif
+#ifdef HERMITEPRO
+    levels = {1, 2, 6, 10, 16};//, 68};
+#endif
+#ifdef HERMITE
+    levels = {1, 2, 6, 10, 16};//, 68};
+#endif
+#ifdef CHEBYSHEVT
+    levels = {1, 2, 4, 6, 12, 24};//, 48};
+#endif
+#ifdef CHEBYSHEVU
+    levels = {1, 2, 4, 8, 16, 32};//, 64};
+#endif
+    return levels;
+}
+
+
 generators_t compute_generators(const std::vector<int> levels,
                                 const int working_prec) {
     /* Compute the generators.
@@ -93,7 +120,7 @@ generators_t compute_generators(const std::vector<int> levels,
     maxminsort(G, generators, deg);
 
     for(unsigned int i = 1; i < levels.size(); i++) {
-        bool solvable = find_extension(Ep, Pn, levels[i], 0);
+        bool solvable = find_extension_stored(Ep, Pn, levels.data(), i+1, 0);
         if(!solvable) {
             std::cout << "******************************\n";
             std::cout << "*** EXTENSION NOT SOVLABLE ***\n";
@@ -206,6 +233,50 @@ compute_ai(const generators_t& generators,
 }
 
 
+typedef struct {
+    const generators_t* generators;
+    const ai_t* A;
+    arb_mat_struct* weight_factors;
+    int number_generators;
+    int working_prec;
+} weightfactors_task_t;
+
+
+void
+weightfactors_row_task(void* arg, const long xi) {
+    /* Task computing the row xi of the weight factors
+     */
+    weightfactors_task_t* w = (weightfactors_task_t*) arg;
+    const generators_t& generators = *w->generators;
+
+    double start = stage_begin();
+    trace_precision(w->working_prec);
+
+    arb_t c, t, u;
+    arb_init(c);
+    arb_init(t);
+    arb_init(u);
+
+    arb_one(c);
+    for(int theta=0; theta < w->number_generators; theta++) {
+        if(theta != xi) {
+            arb_pow_ui(t, &generators[theta], 2, w->working_prec);
+            arb_pow_ui(u, &generators[xi], 2, w->working_prec);
+            arb_sub(t, u, t, w->working_prec);
+            arb_mul(c, c, t, w->working_prec);
+        }
+        if(theta >= xi) {
+            arb_div(t, arb_mat_entry(w->A, 0, theta), c, w->working_prec);
+            arb_set(arb_mat_entry(w->weight_factors, xi, theta), t);
+        }
+    }
+    arb_clear(c);
+    arb_clear(t);
+    arb_clear(u);
+    stage_end(STAGE_WEIGHTFACTORS, start);
+}
+
+
 wft_t
 compute_weightfactors(const generators_t& generators,
                       const ai_t& A,
@@ -218,39 +289,12 @@ compute_weightfactors(const generators_t& generators,
      */
     int number_generators = generators.size();
 
-    int theta;
-    arb_t c, t, u;
-
     arb_mat_t weight_factors;
     arb_mat_init(weight_factors, number_generators, number_generators);
     arb_mat_zero(weight_factors);
 
-#pragma omp parallel for                                        \
-    private(c,u,t,theta),                                       \
-    shared(weight_factors),                                     \
-    schedule(dynamic)
-    for(int xi=0; xi < number_generators; xi++) {
-        arb_init(c);
-        arb_init(t);
-        arb_init(u);
-
-        arb_one(c);
-        for(theta=0; theta < number_generators; theta++) {
-            if(theta != xi) {
-                arb_pow_ui(t, &generators[theta], 2, working_prec);
-                arb_pow_ui(u, &generators[xi], 2, working_prec);
-                arb_sub(t, u, t, working_prec);
-                arb_mul(c, c, t, working_prec);
-            }
-            if(theta >= xi) {
-                arb_div(t, arb_mat_entry(&A, 0, theta), c, working_prec);
-                arb_set(arb_mat_entry(weight_factors, xi, theta), t);
-            }
-        }
-        arb_clear(c);
-        arb_clear(t);
-        arb_clear(u);
-    }
+    weightfactors_task_t w = {&generators, &A, weight_factors, number_generators, working_prec};
+    sched_for(0, number_generators, weightfactors_row_task, &w, SCHED_NORMAL);
 
     return *weight_factors;
 }
@@ -390,43 +434,280 @@ compute_weights(const partition_t<D> P,
 }
 
 
+template<int D>
+bool
+admissible(const partition_t<D> P,
+           const int K,
+           const z_t& Z) {
+    /* Check if the orbit of partition `P` is part of the level K rule.
+     *
+     * P: Partition `P`
+     * K: Level of the quadrature rule
+     * Z: The Z-sequence
+     */
+    int s = 0;
+    for(int d=0; d < D; d++) {
+        s += P[d];
+        s += Z[P[d]];
+    }
+    return s <= K;
+}
+
+
+template<int D>
+orbits_t<D>
+genz_keister_orbits(const int K,
+                    const tables_t& tables) {
+    /* List the fully symmetric orbits of the Genz-Keister construction
+     * in the order in which 'genz_keister_construction' emits the nodes.
+     *
+     * K: Level of the quadrature rule
+     * tables: Tables with the Z-sequence
+     */
+    const z_t& Z = std::get<3>(tables);
+    orbits_t<D> orbits;
+
+    partitions_t<D> partitions = Partitions<D>(K);
+    for(auto it=partitions.begin(); it != partitions.end(); it++) {
+        partition_t<D> P = *it;
+        if(admissible<D>(P, K, Z)) {
+            // Number of sign flips times number of permutations
+            long size = 1L << nnz<D>(P);
+            size *= Permutations<D>(P).size();
+            orbits.push_back(std::make_pair(P, size));
+        }
+    }
+
+    return orbits;
+}
+
+
+/* Mixed precision construction
+ *
+ * The weight of an orbit is a sum of products of D weight factors and for
+ * large D K these dominate the runtime in arb. The weight factors come from
+ * tables at twice the working precision, hence they are rounded once to
+ * double-double or quad-double, see 'multidouble.h'. Each rounded factor
+ * carries an absolute error bound for its rounding and its radius, every
+ * product and sum propagates the bound in double precision rounded upwards.
+ * Orbits whose bound misses the target precision are recomputed in arb.
+ */
+
+#define GK_UP(r) ((r) * (1.0 + 3.5527136788005009e-15))
+
+
+typedef struct {
+    int n;
+    int N;
+    std::vector<md_t> factors;
+    std::vector<double> errors;
+} md_wft_t;
+
+
+md_wft_t
+round_weightfactors(const wft_t& weight_factors,
+                    const int n) {
+    /* Round all weight factors to multi-double numbers with error bounds
+     *
+     * weight_factors: Table with the weight factors
+     * n: Number of limbs
+     */
+    md_wft_t T;
+    T.n = n;
+    T.N = arb_mat_nrows(&weight_factors);
+    T.factors.resize(T.N * T.N);
+    T.errors.resize(T.N * T.N);
+
+    for(int xi=0; xi < T.N; xi++) {
+        for(int theta=0; theta < T.N; theta++) {
+            const arb_struct* a = arb_mat_entry(&weight_factors, xi, theta);
+            md_t* f = &T.factors[xi * T.N + theta];
+            md_set_arf(f, arb_midref(a), n);
+            if(arf_is_finite(arb_midref(a)) && mag_is_finite(arb_radref(a)) && isfinite(f->x[0])) {
+                T.errors[xi * T.N + theta] = GK_UP(mag_get_d(arb_radref(a)) + ldexp(fabs(f->x[0]), -50*n));
+            } else {
+                T.errors[xi * T.N + theta] = INFINITY;
+            }
+        }
+    }
+
+    return T;
+}
+
+
+template<int D>
+bool
+compute_weights_md(arb_t W,
+                   const partition_t<D> P,
+                   const int K,
+                   const md_wft_t& T,
+                   const int target_prec) {
+    /* Compute the weight for partition `P` in multi-double arithmetic,
+     * returns false if the error bound misses the target precision.
+     *
+     * W: The weight as ball of the rounded value and the error bound
+     * P: Partition `P`
+     * K: Rule order
+     * T: Table with the rounded weight factors
+     * target_prec: Target precision
+     */
+    const double u = ldexp(1.0, -50*T.n);
+    md_t S, w;
+    double eS, ew, mw, mf, ef;
+
+    md_zero(&S);
+    eS = 0.0;
+
+    latticepoints_t<D> U = LatticePoints<D>(K-sum<D>(P));
+    partition_t<D> Q;
+
+    for(auto it=U.begin(); it != U.end(); it++) {
+        Q = *it;
+        md_set_d(&w, 1.0);
+        ew = 0.0;
+        for(int d=0; d < D; d++) {
+            int i = P[d] * T.N + P[d] + Q[d];
+            const md_t* f = &T.factors[i];
+            // |wf - w'f'| <= |w'| ef + |f'| ew + ew ef + u |w'f'|
+            mw = GK_UP(fabs(w.x[0]));
+            mf = GK_UP(fabs(f->x[0]));
+            ef = T.errors[i];
+            md_mul(&w, &w, f, T.n);
+            ew = GK_UP(mw * ef + mf * ew + ew * ef + u * GK_UP(fabs(w.x[0])));
+        }
+        md_add(&S, &S, &w, T.n);
+        eS = GK_UP(eS + ew + u * GK_UP(fabs(S.x[0]) + 2.0 * fabs(w.x[0])));
+    }
+    // Number of non-zero, the division is exact
+    int k = nnz<D>(P);
+    if(k > 0) {
+        for(int j=0; j < T.n; j++) {
+            S.x[j] = ldexp(S.x[j], -k);
+        }
+        eS = ldexp(eS, -k);
+    }
+
+    md_get_arf(arb_midref(W), &S, T.n);
+    if(isfinite(eS) && isfinite(S.x[0])) {
+        mag_set_d(arb_radref(W), eS);
+    } else {
+        mag_inf(arb_radref(W));
+    }
+
+    return mag_cmp_2exp_si(arb_radref(W), -target_prec) < 0;
+}
+
+
+template<int D>
+struct construction_task_t {
+    const std::vector<partition_t<D>>* orbits;
+    weights_t* weights;
+    const wft_t* weight_factors;
+    const md_wft_t* rounded;
+    int K;
+    int working_prec;
+    int target_prec;
+};
+
+
+template<int D>
+void
+construction_orbit_task(void* arg, const long j) {
+    /* Task computing the weight of orbit j, in multi-double arithmetic
+     * first if enabled and in arb if the error bound is too large.
+     */
+    construction_task_t<D>* c = (construction_task_t<D>*) arg;
+    const partition_t<D>& P = (*c->orbits)[j];
+    arb_struct* W = &(*c->weights)[j];
+
+    if(c->rounded != NULL) {
+        if(compute_weights_md<D>(W, P, c->K, *c->rounded, c->target_prec)) {
+            stats_count(COUNT_MIXED_ORBITS, 1);
+            return;
+        }
+        stats_count(COUNT_MIXED_FALLBACKS, 1);
+        arb_clear(W);
+    }
+    weights_t w = compute_weights<D>(P, c->K, *c->weight_factors, c->working_prec);
+    *W = w[0];
+}
+
+
+template<int D>
+weights_t
+compute_orbit_weights(const std::vector<partition_t<D>>& orbits,
+                      const int K,
+                      const tables_t& tables,
+                      const int working_prec,
+                      const int target_prec) {
+    /* Compute the weights of the given orbits in parallel.
+     *
+     * orbits: The partitions of the orbits
+     * K: Level of the quadrature rule
+     * tables: Tables with the weight factors
+     * working_prec: Working precision
+     * target_prec: Target precision of the weights, if positive and small
+     *              enough the weights are computed in mixed precision
+     */
+    const wft_t& weight_factors = std::get<2>(tables);
+
+    // Round the weight factors for the mixed precision mode
+    md_wft_t rounded;
+    bool mixed = multidouble_enabled && target_prec > 0 && target_prec + MD_GUARD <= MD_MAXPREC;
+    if(mixed) {
+        rounded = round_weightfactors(weight_factors, target_prec + MD_GUARD <= 100 ? 2 : 4);
+    }
+
+    weights_t weights(orbits.size());
+    for(auto it=weights.begin(); it != weights.end(); it++) {
+        arb_init(&(*it));
+    }
+    construction_task_t<D> c = {&orbits, &weights, &weight_factors, mixed ? &rounded : NULL,
+                                K, working_prec, target_prec};
+    sched_for(0, orbits.size(), construction_orbit_task<D>, &c, SCHED_NORMAL);
+
+    return weights;
+}
+
+
 template<int D>
 rule_t<D>
 genz_keister_construction(const int K,
                           const generators_t& generators,
                           const tables_t& tables,
-                          const int working_prec) {
+                          const int working_prec,
+                          const int target_prec) {
     /* Compute the Genz-Keister construction.
      *
      * K: Level of the quadrature rule
      * generators: Table with precomputed generators
-     * weight_factors: Table with the weight factors
-     * Z:
+     * tables: Tables with the weight factors and the Z-sequence
      * working_prec: Working precision
+     * target_prec: Target precision of the weights, if positive and small
+     *              enough the weights are computed in mixed precision
      */
-    wft_t weight_factors = std::get<2>(tables);
-    z_t Z = std::get<3>(tables);
+    const z_t& Z = std::get<3>(tables);
 
     nodes_t<D> nodes;
     weights_t weights;
 
-    // Iterate over all relevant integer partitions
+    // Collect all relevant integer partitions
+    std::vector<partition_t<D>> orbits;
     partitions_t<D> partitions = Partitions<D>(K);
     for(auto it=partitions.begin(); it != partitions.end(); it++) {
-        partition_t<D> P = *it;
-        int s = 0;
-        for(int d=0; d < D; d++) {
-            s += P[d];
-            s += Z[P[d]];
+        if(admissible<D>(*it, K, Z)) {
+            orbits.push_back(*it);
         }
-        if(s <= K) {
-            // Compute nodes and weights for given partition
-            nodes_t<D> p = compute_nodes<D>(P, generators, working_prec);
-            weights_t w = compute_weights<D>(P, K, weight_factors, working_prec);
-            for(int i=0; i < p.size(); i++) {
-                nodes.push_back(p[i]);
-                weights.push_back(w[0]);
-            }
+    }
+
+    weights_t orbit_weights = compute_orbit_weights<D>(orbits, K, tables, working_prec, target_prec);
+
+    // Compute nodes for every partition
+    for(unsigned int j=0; j < orbits.size(); j++) {
+        nodes_t<D> p = compute_nodes<D>(orbits[j], generators, working_prec);
+        for(int i=0; i < p.size(); i++) {
+            nodes.push_back(p[i]);
+            weights.push_back(orbit_weights[j]);
         }
     }
 
@@ -475,4 +756,121 @@ check_accuracy(const nodes_t<D>& nodes,
 }
 
 
+template<int D>
+long
+genz_keister_recompute(rule_t<D>& rule,
+                       const orbits_t<D>& orbits,
+                       const int K,
+                       const generators_t& generators,
+                       const tables_t& tables,
+                       const int working_prec,
+                       const int target_prec) {
+    /* Recompute those orbits of a rule whose nodes or weight miss the
+     * target precision, all others are kept. Returns the number of
+     * recomputed orbits.
+     *
+     * rule: The nodes and weights, updated in place
+     * orbits: The orbits making up the rule, see 'genz_keister_orbits'
+     * K: Level of the quadrature rule
+     * generators: Table with precomputed generators
+     * tables: Tables with the weight factors
+     * working_prec: Working precision
+     * target_prec: Target precision
+     */
+    nodes_t<D>& nodes = rule.first;
+    weights_t& weights = rule.second;
+
+    // Find the inaccurate orbits
+    std::vector<partition_t<D>> failing;
+    std::vector<long> offsets;
+    long offset = 0;
+    for(auto it=orbits.begin(); it != orbits.end(); it++) {
+        nodes_t<D> p(nodes.begin() + offset, nodes.begin() + offset + it->second);
+        weights_t w(weights.begin() + offset, weights.begin() + offset + 1);
+        if(!check_accuracy<D>(p, w, target_prec)) {
+            failing.push_back(it->first);
+            offsets.push_back(offset);
+        }
+        offset += it->second;
+    }
+
+    // Recompute them in place
+    weights_t orbit_weights = compute_orbit_weights<D>(failing, K, tables, working_prec, target_prec);
+    for(unsigned int j=0; j < failing.size(); j++) {
+        nodes_t<D> p = compute_nodes<D>(failing[j], generators, working_prec);
+        for(int i=0; i < p.size(); i++) {
+            nodes[offsets[j] + i] = p[i];
+            weights[offsets[j] + i] = orbit_weights[j];
+        }
+    }
+    stats_count(COUNT_ORBITS_RECOMPUTED, failing.size());
+
+    return failing.size();
+}
+
+
+template<int D>
+long
+emit_rule_header(FILE *file,
+                 const char *prefix,
+                 const std::vector<int>& levels,
+                 const int K,
+                 const generators_t& generators,
+                 const orbits_t<D>& orbits,
+                 const rule_t<D>& rule,
+                 const int type) {
+    /* Write a Genz-Keister rule as C/C++ header including the orbit tables.
+     * Returns the number of entries which are not provably correctly rounded.
+     *
+     * file: The output file
+     * prefix: Prefix for all symbols in the header
+     * levels: The Kronrod extension used
+     * K: Level of the quadrature rule
+     * generators: Table with the generators
+     * orbits: The orbits making up the rule
+     * rule: The nodes and weights
+     * type: The emission type
+     */
+    const nodes_t<D>& nodes = rule.first;
+    const weights_t& weights = rule.second;
+    long norbits = orbits.size();
+    long uncertain = 0;
+
+    std::vector<long> lv(levels.begin(), levels.end());
+    std::vector<long> partitions;
+    std::vector<long> offsets(1, 0);
+    weights_t orbit_weights;
+    for(auto it=orbits.begin(); it != orbits.end(); it++) {
+        for(int d=0; d < D; d++) {
+            partitions.push_back(it->first[d]);
+        }
+        orbit_weights.push_back(weights[offsets.back()]);
+        offsets.push_back(offsets.back() + it->second);
+    }
+
+    emit_header_begin(file, prefix,
+                      "Genz-Keister rule generated by genzkeister\n *\n"
+                      " * Orbit i has the partition  partitions[i*D .. (i+1)*D)  and the weight\n"
+                      " * orbit_weights[i], its nodes are  nodes[orbit_offsets[i] .. orbit_offsets[i+1]).");
+
+    fprintf(file, "/* Family: %s */\n", family_name());
+    emit_declaration(file, prefix, "int", "dimension");
+    fprintf(file, " = %d;\n", D);
+    emit_declaration(file, prefix, "int", "level");
+    fprintf(file, " = %d;\n", K + 1);
+    emit_declaration(file, prefix, "long", "norbits");
+    fprintf(file, " = %ld;\n\n", norbits);
+    emit_int_array(file, prefix, "levels", lv.data(), lv.size());
+    uncertain += emit_real_array(file, prefix, "generators", generators.data(), generators.size(), 1, type);
+    emit_int_array(file, prefix, "partitions", partitions.data(), partitions.size());
+    emit_int_array(file, prefix, "orbit_offsets", offsets.data(), offsets.size());
+    uncertain += emit_real_array(file, prefix, "orbit_weights", orbit_weights.data(), norbits, 1, type);
+    uncertain += emit_real_array(file, prefix, "nodes", &(nodes[0][0]), nodes.size(), D, type);
+    uncertain += emit_real_array(file, prefix, "weights", weights.data(), weights.size(), 1, type);
+    emit_header_end(file, prefix);
+
+    return uncertain;
+}
+
+
 #endif
@@ -1 +1,3 @@
-awk -e '/RULE/ {S = ""; for (i = 3; i <= 3+$2; i++) {S = S $(i) " ";}; print S;}' recs*.dat | sort | uniq > all_rules.dat
+# Merge the rules of all runs into the binary index and list them
+./ruleindex -b all_rules.idx recs*.dat
+./ruleindex all_rules.idx > all_rules.dat
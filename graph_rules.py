@@ -1,6 +1,8 @@
 import sys
 from functools import reduce
 
+from ruleindex import RuleIndex
+
 
 if len(sys.argv) == 2:
     f = sys.argv[1]
@@ -10,28 +12,40 @@ else:
 
 ruletree = {}
 
-with open(f, "r") as F:
-    for line in F.readlines():
-        if line.startswith("Search for recursive extensions of:"):
-            n = line[37:-1]
-            print("n: {}".format(n))
-        if line.startswith("Maximal allowed extension order p: "):
-            p = line[35:-1]
-            print("Max. p: {}".format(p))
-        if line.startswith("Maximal allowed recursion depth: "):
-            rec = line[33:-1]
-            print("Max. depth: {}".format(rec))
-
-        if line.startswith("RULE:"):
-            print(line[:-1])
-            L = line.split()
-            data = L[2:(4+int(L[1]))]
-            t = ruletree
-            for digit in data:
-                if digit in t:
-                    t = t[digit]
-                else:
-                    t[digit] = {}
+if f.endswith(".idx"):
+    # A binary rule index holds the prefix tree already
+    index = RuleIndex(f)
+    def stringify(t):
+        return {str(k): stringify(v) for k, v in t.items()}
+    ruletree = stringify(index.tree())
+    n = "-".join(ruletree.keys())
+    p = "all"
+    rec = index.maxdepth()
+    index.close()
+    print("Rules: {}".format(index.nrules))
+else:
+    with open(f, "r") as F:
+        for line in F.readlines():
+            if line.startswith("Search for recursive extensions of:"):
+                n = line[37:-1]
+                print("n: {}".format(n))
+            if line.startswith("Maximal allowed extension order p: "):
+                p = line[35:-1]
+                print("Max. p: {}".format(p))
+            if line.startswith("Maximal allowed recursion depth: "):
+                rec = line[33:-1]
+                print("Max. depth: {}".format(rec))
+
+            if line.startswith("RULE:"):
+                print(line[:-1])
+                L = line.split()
+                data = L[2:(4+int(L[1]))]
+                t = ruletree
+                for digit in data:
+                    if digit in t:
+                        t = t[digit]
+                    else:
+                        t[digit] = {}
 
 def print_rule(rule, rd):
     for k, v in rd.items():
@@ -9,30 +9,353 @@
 #ifndef __HH__helpers
 #define __HH__helpers
 
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
 
-void ps(const int, const int, const int);
-void logit(const int, const int, const char *, ...);
+
+/* Logging
+ *
+ * Every message belongs to a subsystem and has a level. It is printed
+ * if its level is at most the verbosity given at run time and at most
+ * the compile time limit LOGMAX_<subsystem>, e.g. -DLOGMAX_NUMERICS=1.
+ * The limits default to 9, or to -1 if PRINTLOG is 0, in which case all
+ * logging compiles out. The macros evaluate their arguments only if the
+ * message is printed.
+ *
+ * Subsystems:
+ *   SEARCH      Search for extensions and the recursive enumeration
+ *   NUMERICS    Root finding and weights
+ *   VALIDATION  Validation of nodes and weights
+ *   CACHE       Exact store and rule cache
+ *   SERVER      The rule server
+ *
+ * By default messages are written directly to stdout. After 'log_async_enable'
+ * each thread formats its messages into its own ring buffer and a background
+ * thread writes them out, hence the workers never contend for stdout.
+ * Call 'log_flush' before output that must follow the log messages.
+ */
+
+#ifndef PRINTLOG
+#define PRINTLOG 1
+#endif
+
+#if PRINTLOG
+#define LOGMAX_DEFAULT 9
+#else
+#define LOGMAX_DEFAULT -1
+#endif
+
+#ifndef LOGMAX_SEARCH
+#define LOGMAX_SEARCH LOGMAX_DEFAULT
+#endif
+#ifndef LOGMAX_NUMERICS
+#define LOGMAX_NUMERICS LOGMAX_DEFAULT
+#endif
+#ifndef LOGMAX_VALIDATION
+#define LOGMAX_VALIDATION LOGMAX_DEFAULT
+#endif
+#ifndef LOGMAX_CACHE
+#define LOGMAX_CACHE LOGMAX_DEFAULT
+#endif
+#ifndef LOGMAX_SERVER
+#define LOGMAX_SERVER LOGMAX_DEFAULT
+#endif
+
+#define log_enabled(sub, level, verbosity) \
+    (LOGMAX_##sub >= (level) && (verbosity) >= (level))
+
+/* Log a message in printf style */
+#define logit(sub, level, verbosity, ...)                       \
+    do {                                                        \
+        if(log_enabled(sub, level, verbosity)) {                \
+            log_write(0, __VA_ARGS__);                          \
+        }                                                       \
+    } while(0)
+
+/* Log a message indented by 'indent' levels */
+#define logit_indent(sub, level, verbosity, indent, ...)        \
+    do {                                                        \
+        if(log_enabled(sub, level, verbosity)) {                \
+            log_write(indent, __VA_ARGS__);                     \
+        }                                                       \
+    } while(0)
+
+/* Log a polynomial, its pretty string is the last argument of the format */
+#define logit_poly(sub, level, verbosity, poly, ...)            \
+    do {                                                        \
+        if(log_enabled(sub, level, verbosity)) {                \
+            char *log_str_ = fmpq_poly_get_str_pretty(poly, "t"); \
+            log_write(0, __VA_ARGS__, log_str_);                \
+            flint_free(log_str_);                               \
+        }                                                       \
+    } while(0)
 
 
-void ps(const int loglevel, const int verbosity, const int n) {
-    int i;
-    if(verbosity >= loglevel) {
-        for(i = 0; i < n; i++) {
-            printf("  ");
+#define LOG_RINGSIZE (1 << 16)
+#define LOG_MAXLOCAL 512
+
+typedef struct log_ring_s {
+    char *data;
+    /* Bytes ever written by the owning thread and ever read by the writer */
+    unsigned long head;
+    unsigned long tail;
+    /* The owning thread has exited */
+    int orphan;
+    struct log_ring_s *next;
+} log_ring_t;
+
+
+int log_async = 0;
+int log_stop = 0;
+log_ring_t *log_rings = NULL;
+pthread_key_t log_key;
+pthread_t log_writer;
+pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t log_wakeup = PTHREAD_COND_INITIALIZER;
+
+
+void log_write(const int, const char *, ...);
+void log_async_enable(void);
+log_ring_t * log_ring(void);
+void log_ring_release(void *);
+void log_ring_put(const char *, const size_t);
+void log_drain(void);
+void log_flush(void);
+void * log_main(void *);
+void log_close(void);
+int read_line(const int, char *, const size_t);
+
+
+void log_write(const int indent, const char *format, ...) {
+    /* Format a message and write it to the sink
+     *
+     * indent: Number of indentation levels of two spaces
+     * format: The printf format
+     */
+    char local[LOG_MAXLOCAL];
+    char *msg;
+    int pad, len;
+    va_list argp, copy;
+
+    pad = indent > 0 ? 2 * indent : 0;
+    pad = pad < LOG_MAXLOCAL / 2 ? pad : LOG_MAXLOCAL / 2;
+    msg = local;
+    memset(msg, ' ', pad);
+
+    va_start(argp, format);
+    va_copy(copy, argp);
+    len = vsnprintf(msg + pad, LOG_MAXLOCAL - pad, format, argp);
+    if(len >= LOG_MAXLOCAL - pad) {
+        msg = (char *) malloc(pad + len + 1);
+        memset(msg, ' ', pad);
+        vsnprintf(msg + pad, len + 1, format, copy);
+    }
+    va_end(copy);
+    va_end(argp);
+
+    if(len > 0) {
+        if(log_async) {
+            log_ring_put(msg, pad + len);
+        } else {
+            fwrite(msg, 1, pad + len, stdout);
         }
     }
+    if(msg != local) {
+        free(msg);
+    }
 }
 
 
-void logit(const int loglevel, const int verbosity, const char *format, ...) {
-#if PRINTLOG
-    va_list argp;
-    if(verbosity >= loglevel) {
-        va_start(argp, format);
-        vprintf(format, argp);
-        va_end(argp);
+void log_async_enable(void) {
+    /* Switch to per-thread ring buffers drained by a writer thread
+     */
+    if(log_async) {
+        return;
     }
-#endif
+    if(pthread_key_create(&log_key, log_ring_release) != 0) {
+        return;
+    }
+    if(pthread_create(&log_writer, NULL, log_main, NULL) != 0) {
+        printf("Can not start the log writer\n");
+        return;
+    }
+    log_async = 1;
+    atexit(log_close);
+}
+
+
+log_ring_t * log_ring(void) {
+    /* The ring buffer of the calling thread, created on first use
+     */
+    log_ring_t *r;
+
+    r = (log_ring_t *) pthread_getspecific(log_key);
+    if(r == NULL) {
+        r = (log_ring_t *) calloc(1, sizeof(log_ring_t));
+        r->data = (char *) malloc(LOG_RINGSIZE);
+        pthread_mutex_lock(&log_lock);
+        r->next = log_rings;
+        log_rings = r;
+        pthread_mutex_unlock(&log_lock);
+        pthread_setspecific(log_key, r);
+    }
+    return r;
+}
+
+
+void log_ring_release(void *r) {
+    /* Hand the ring of an exiting thread over to the writer
+     */
+    __atomic_store_n(&((log_ring_t *) r)->orphan, 1, __ATOMIC_RELEASE);
+}
+
+
+void log_ring_put(const char *msg,
+                  const size_t len) {
+    /* Append a message to the ring of the calling thread
+     *
+     * msg: The message
+     * len: Length of the message
+     */
+    log_ring_t *r;
+    unsigned long head;
+    size_t pos, first;
+
+    if(len >= LOG_RINGSIZE) {
+        /* Too large for the ring, write in order after everything pending */
+        pthread_mutex_lock(&log_lock);
+        log_drain();
+        fwrite(msg, 1, len, stdout);
+        pthread_mutex_unlock(&log_lock);
+        return;
+    }
+
+    r = log_ring();
+    head = r->head;
+    while(head + len - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) > LOG_RINGSIZE) {
+        pthread_cond_signal(&log_wakeup);
+        sched_yield();
+    }
+    pos = head % LOG_RINGSIZE;
+    first = LOG_RINGSIZE - pos < len ? LOG_RINGSIZE - pos : len;
+    memcpy(r->data + pos, msg, first);
+    memcpy(r->data, msg + first, len - first);
+    __atomic_store_n(&r->head, head + len, __ATOMIC_RELEASE);
+}
+
+
+void log_drain(void) {
+    /* Write out the contents of all rings, the caller holds 'log_lock'
+     */
+    log_ring_t *r, **prev;
+    unsigned long head;
+    size_t pos, len, first;
+    int orphan;
+
+    prev = &log_rings;
+    while((r = *prev) != NULL) {
+        /* An orphan has no more writes after its flag */
+        orphan = __atomic_load_n(&r->orphan, __ATOMIC_ACQUIRE);
+        head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        len = head - r->tail;
+        if(len > 0) {
+            pos = r->tail % LOG_RINGSIZE;
+            first = LOG_RINGSIZE - pos < len ? LOG_RINGSIZE - pos : len;
+            fwrite(r->data + pos, 1, first, stdout);
+            fwrite(r->data, 1, len - first, stdout);
+            __atomic_store_n(&r->tail, head, __ATOMIC_RELEASE);
+        }
+        if(orphan) {
+            *prev = r->next;
+            free(r->data);
+            free(r);
+        } else {
+            prev = &r->next;
+        }
+    }
+    fflush(stdout);
+}
+
+
+void log_flush(void) {
+    /* Write out all pending messages
+     */
+    if(!log_async) {
+        fflush(stdout);
+        return;
+    }
+    pthread_mutex_lock(&log_lock);
+    log_drain();
+    pthread_mutex_unlock(&log_lock);
+}
+
+
+void * log_main(void *arg) {
+    /* The writer thread, drains the rings ten times per second or on demand
+     */
+    struct timespec deadline;
+
+    pthread_mutex_lock(&log_lock);
+    while(!log_stop) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += 100000000;
+        if(deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&log_wakeup, &log_lock, &deadline);
+        log_drain();
+    }
+    pthread_mutex_unlock(&log_lock);
+    return NULL;
+}
+
+
+void log_close(void) {
+    /* Stop the writer and write out the remaining messages
+     */
+    pthread_mutex_lock(&log_lock);
+    log_stop = 1;
+    pthread_cond_signal(&log_wakeup);
+    pthread_mutex_unlock(&log_lock);
+    pthread_join(log_writer, NULL);
+
+    log_drain();
+    log_async = 0;
+}
+
+
+int read_line(const int fd,
+              char *line,
+              const size_t size) {
+    /* Read a single line from a socket without the newline.
+     * Returns the length of the line or -1 on end of file.
+     *
+     * fd: The socket
+     * line: Buffer for the line
+     * size: Size of the buffer
+     */
+    size_t n;
+    char c;
+
+    n = 0;
+    while(read(fd, &c, 1) == 1) {
+        if(c == '\n') {
+            line[n] = '\0';
+            return n;
+        }
+        if(n + 1 < size) {
+            line[n++] = c;
+        }
+    }
+    line[n] = '\0';
+    return n > 0 ? (int) n : -1;
 }
 
 
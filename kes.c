@@ -8,12 +8,14 @@
 #include <string.h>
 
 #include "libkes.h"
+#include "emit.h"
+#include "output.h"
 
 
 int main(int argc, char* argv[]) {
-    int i, j, k;
+    int i, k;
     int levels[argc-1];
-    fmpq_poly_t Pn, Ep;
+    fmpq_poly_t Pn, Ep, Et;
     long deg;
     char *strf;
     acb_ptr nodes;
@@ -25,18 +27,45 @@ int main(int argc, char* argv[]) {
     int target_prec;
     int nrprintdigits;
     int loglevel;
+    char *store;
+    char *cache;
+    char key[RULE_CACHE_MAXKEY];
+    int cached;
+    long cached_prec;
+    char *emit_file;
+    char *emit_prefix;
+    int emit_type;
+    FILE *header;
+    fmpq_poly_struct *factors;
+    acb_ptr nested_nodes, nested_weights;
+    long *offsets, *weight_offsets;
+    long uncertain;
+    double start;
 
     if(argc <= 1) {
         printf("Compute a nested generalized Kronrod extension of a Gauss rule\n");
-        printf("Syntax: kes [-ve] [-vw] [-cn] [-cw] [-dc D] [-dp D] [-l L] n p1 p2 ... pk\n");
+        printf("Syntax: kes [-ve] [-vw] [-cn] [-cw] [-dc D] [-nmd] [-dp D] [-l L] [-la] [-threads N] [-st S] [-rc C] [-eh F [-et T] [-en N]] [-stats] [-mem] [-perf] [-trace T] [-tm M] n p1 p2 ... pk\n");
         printf("Options:\n");
         printf("        -ve  Validate the polynomial extension by nodes\n");
         printf("        -vw  Validate the polynomial extension by weights\n");
         printf("        -cn  Compute the nodes\n");
         printf("        -cw  Compute the weights\n");
         printf("        -dc  Compute nodes and weights up to this number of decimal digits\n");
+        printf("        -nmd Use ball arithmetic only, also for 16 to 60 digits\n");
         printf("        -dp  Print this number of decimal digits\n");
         printf("        -l   Set the log level\n");
+        printf("        -la  Log asynchronously through per-thread buffers\n");
+        printf("        -threads Use N worker threads (default: $KES_THREADS), give it before -mem, -perf, -trace and -tm\n");
+        printf("        -st  Use the exact polynomial store in directory S (default: $KES_STORE)\n");
+        printf("        -rc  Use the numeric rule cache in directory C (default: $KES_RULECACHE)\n");
+        printf("        -eh  Write nodes and weights of all levels as C/C++ header to file F\n");
+        printf("        -et  Floating point type T of the header: double, longdouble or doubledouble\n");
+        printf("        -en  Prefix N for all symbols in the header (default: kes_rule)\n");
+        printf("        -stats  Print a timing summary of all stages on exit\n");
+        printf("        -mem    Add allocation counts and peak memory per stage and thread to the summary\n");
+        printf("        -perf   Add hardware counters per stage and thread to the summary (Linux only)\n");
+        printf("        -trace  Write a Chrome trace of all stages and threads to file T\n");
+        printf("        -tm  Append coefficient size and precision telemetry per candidate to file M\n");
         return EXIT_FAILURE;
     }
 
@@ -47,6 +76,11 @@ int main(int argc, char* argv[]) {
     comp_weights = 0;
     validate_extension = 0;
     validate_weights = 0;
+    store = NULL;
+    cache = NULL;
+    emit_file = NULL;
+    emit_prefix = "kes_rule";
+    emit_type = EMIT_DOUBLE;
 
     k = 0;
     for(i = 1; i < argc; i++) {
@@ -62,18 +96,65 @@ int main(int argc, char* argv[]) {
             /* 'digits' is in base 10 and log(10)/log(2) = 3.32193 */
             target_prec = 3.32193 * atoi(argv[i+1]);
             i++;
+        } else if (!strcmp(argv[i], "-nmd")) {
+            multidouble_enabled = 0;
         } else if (!strcmp(argv[i], "-dp")) {
             nrprintdigits = atoi(argv[i+1]);
             i++;
+        } else if (!strcmp(argv[i], "-la")) {
+            log_async_enable();
+        } else if (!strcmp(argv[i], "-threads")) {
+            if(!sched_set_threads(atoi(argv[i+1]))) {
+                printf("Can not use %s threads, give -threads before -mem, -perf, -trace and -tm\n", argv[i+1]);
+                return EXIT_FAILURE;
+            }
+            i++;
         } else if (!strcmp(argv[i], "-l")) {
             loglevel = atoi(argv[i+1]);
             i++;
+        } else if (!strcmp(argv[i], "-st")) {
+            store = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-rc")) {
+            cache = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-eh")) {
+            emit_file = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-et")) {
+            emit_type = emit_parse_type(argv[i+1]);
+            if(emit_type < 0) {
+                printf("Unknown floating point type: %s\n", argv[i+1]);
+                return EXIT_FAILURE;
+            }
+            i++;
+        } else if (!strcmp(argv[i], "-en")) {
+            emit_prefix = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-stats")) {
+            stats_enable();
+        } else if (!strcmp(argv[i], "-mem")) {
+            memstats_enable();
+            stats_enable();
+        } else if (!strcmp(argv[i], "-perf")) {
+            if(perf_enable()) {
+                stats_enable();
+            }
+        } else if (!strcmp(argv[i], "-trace")) {
+            trace_enable(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-tm")) {
+            telemetry_enable(argv[i+1], family_name());
+            i++;
         } else {
             levels[k] = atoi(argv[i]);
             k++;
         }
     }
 
+    exact_store_open(store);
+    rule_cache_open(cache);
+
     /* Compute extension */
     fmpq_poly_init(Pn);
     polynomial(Pn, levels[0]);
@@ -89,7 +170,53 @@ int main(int argc, char* argv[]) {
 
     fmpq_poly_init(Ep);
 
-    solvable = find_multi_extension(Ep, Pn, k, levels, validate_extension, loglevel);
+    factors = (fmpq_poly_struct *) malloc((k > 1 ? k - 1 : 1) * sizeof(fmpq_poly_struct));
+    for(i = 0; i < k - 1; i++) {
+        fmpq_poly_init(factors + i);
+    }
+
+    if(emit_file != NULL) {
+        /* Enough bits to decide the rounding of all entries */
+        target_prec = FLINT_MAX(target_prec, emit_type_bits(emit_type) + 32);
+    }
+
+    solvable = find_multi_extension(Ep, factors, Pn, k, levels, validate_extension, loglevel);
+
+    if(solvable && emit_file != NULL) {
+        /* Write the nested rule as header */
+        fmpq_poly_init(Et);
+        polynomial(Et, levels[0]);
+        deg = fmpq_poly_degree(Et) + fmpq_poly_degree(Ep);
+        nested_nodes = _acb_vec_init(deg);
+        nested_weights = _acb_vec_init(k * deg);
+        offsets = (long *) malloc((k + 1) * sizeof(long));
+        weight_offsets = (long *) malloc((k + 1) * sizeof(long));
+
+        compute_nested_rule(nested_nodes, nested_weights, offsets, weight_offsets,
+                            Et, factors, k, target_prec, loglevel);
+
+        header = fopen(emit_file, "w");
+        if(header == NULL) {
+            printf("Can not open header file: %s\n", emit_file);
+        } else {
+            start = stage_begin();
+            uncertain = emit_nested_rule(header, emit_prefix, levels, k,
+                                         nested_nodes, nested_weights,
+                                         offsets, weight_offsets, emit_type);
+            stage_end(STAGE_OUTPUT, start);
+            fclose(header);
+            printf("Header written to: %s\n", emit_file);
+            if(uncertain > 0) {
+                printf("Warning: %ld entries are not provably correctly rounded\n", uncertain);
+            }
+        }
+
+        _acb_vec_clear(nested_nodes, deg);
+        _acb_vec_clear(nested_weights, k * deg);
+        free(offsets);
+        free(weight_offsets);
+        fmpq_poly_clear(Et);
+    }
 
     fmpq_poly_mul(Pn, Pn, Ep);
     fmpq_poly_canonicalise(Pn);
@@ -102,6 +229,7 @@ int main(int argc, char* argv[]) {
         if(loglevel >= 2) {
             printf("-------------------------------------------------\n");
             printf("Ending with final polynomial:\n");
+            flint_free(strf);
             strf = fmpq_poly_get_str_pretty(Pn, "t");
             flint_printf("P : %s\n", strf);
         }
@@ -111,7 +239,18 @@ int main(int argc, char* argv[]) {
         weights = _acb_vec_init(deg);
 
         if(comp_weights || validate_weights) {
-            compute_nodes_and_weights(nodes, weights, Pn, target_prec, loglevel);
+            rule_cache_key(key, "kes", levels, k);
+            cached = rule_cache_lookup(nodes, weights, &cached_prec, key, deg, target_prec);
+            if(cached == RULE_CACHE_HIT) {
+                logit(CACHE, 1, loglevel, "Nodes and weights taken from cache (%ld bits)\n", cached_prec);
+            } else {
+                if(cached == RULE_CACHE_SEED) {
+                    logit(CACHE, 1, loglevel, "Refining cached nodes from %ld bits\n", cached_prec);
+                }
+                compute_nodes_and_weights_seeded(nodes, weights, Pn, cached == RULE_CACHE_SEED ? cached_prec : 0,
+                                                 target_prec, loglevel);
+                rule_cache_insert(nodes, weights, key, deg, target_prec);
+            }
         } else if(comp_nodes) {
             compute_nodes(nodes, Pn, target_prec, loglevel);
         }
@@ -132,21 +271,13 @@ int main(int argc, char* argv[]) {
             if(comp_nodes) {
                 printf("-------------------------------------------------\n");
                 printf("The nodes are:\n");
-                for(j = 0; j < deg; j++) {
-                    printf("| ");
-                    acb_printd(nodes + j, nrprintdigits);
-                    printf("\n");
-                }
+                print_acb_vec(stdout, nodes, deg, "| ", "\n", nrprintdigits);
             }
 
             if(comp_weights) {
                 printf("-------------------------------------------------\n");
                 printf("The weights are:\n");
-                for(j = 0; j < deg; j++) {
-                    printf("| ");
-                    acb_printd(weights + j, nrprintdigits);
-                    printf("\n");
-                }
+                print_acb_vec(stdout, weights, deg, "| ", "\n", nrprintdigits);
             }
         }
 
@@ -154,6 +285,11 @@ int main(int argc, char* argv[]) {
         _acb_vec_clear(weights, deg);
     }
 
+    for(i = 0; i < k - 1; i++) {
+        fmpq_poly_clear(factors + i);
+    }
+    free(factors);
+
     flint_free(strf);
     fmpq_poly_clear(Pn);
     fmpq_poly_clear(Ep);
@@ -8,47 +8,555 @@
 #include <string.h>
 
 #include "libkes.h"
+#include "coord.h"
+
+/* States of the cells of a map */
+#define CELL_UNKNOWN 0
+#define CELL_KNOWN 1
+#define CELL_PENDING 2
+#define CELL_EVALUATED 3
+#define CELL_INFERRED 4
+
+
+typedef struct {
+    int maxn;
+    int maxp;
+    int validate_ext;
+    int validate_weights;
+    int classify;
+    int loglevel;
+    /* Per cell (n, p) at index (n-1) * maxp + (p-1) */
+    int *value;
+    char *state;
+    classification_t *classes;
+} cellmap_t;
+
+
+typedef struct {
+    int i0, i1;
+    int j0, j1;
+} block_t;
+
+
+typedef struct {
+    cellmap_t *map;
+    const long *cells;
+} cells_t;
+
+
+void evaluate_cell(cellmap_t *map,
+                   fmpq_poly_t En,
+                   const fmpq_poly_t Pn,
+                   const int n,
+                   const int p) {
+    /* Evaluate a single cell of the map
+     *
+     * map: The map
+     * En: Workspace for the extension
+     * Pn: The polynomial of degree n
+     * n: Order of the rule
+     * p: Order of the extension
+     */
+    int solvable, record;
+    long nrroots, nrpweights;
+    int levels[2];
+    long c;
+    double start;
+
+    logit(SEARCH, 0, map->loglevel, "Trying to find an order %i Kronrod extension for H%i\n", p, n);
+    c = (long) (n-1) * map->maxp + (p-1);
+    levels[0] = n;
+    levels[1] = p;
+
+    start = candidate_begin(n, p, 0);
+    solvable = find_extension_stored(En, Pn, levels, 2, map->loglevel);
+    logit(SEARCH, 0, map->loglevel, "  Solvable extension rule found: %i\n", solvable);
+
+    if(map->classify) {
+        /* One pass answers all validation levels */
+        if(solvable) {
+            fmpq_poly_mul(En, Pn, En);
+        }
+        classify_rule(map->classes + c, solvable, En, NCHECKDIGITS, map->loglevel);
+        record = map->classes[c].cls;
+    } else if(solvable && map->validate_weights) {
+        fmpq_poly_mul(En, Pn, En);
+        record = validate_rule(&nrroots, &nrpweights, En, NCHECKDIGITS, map->loglevel);
+    } else if(solvable && map->validate_ext) {
+        record = validate_extension_by_poly(&nrroots, En, NCHECKDIGITS, map->loglevel);
+    } else {
+        record = solvable;
+    }
+    candidate_end(start, solvable, map->classify ? record >= CLASS_INDEFINITE : record);
+
+    map->value[c] = record;
+    map->state[c] = CELL_EVALUATED;
+}
+
+
+void evaluate_cell_task(void *arg,
+                        const long k) {
+    /* Task evaluating the k-th cell of a list
+     */
+    cells_t *list;
+    fmpq_poly_t Pn, En;
+    int n, p;
+
+    list = (cells_t *) arg;
+    n = list->cells[k] / list->map->maxp + 1;
+    p = list->cells[k] % list->map->maxp + 1;
+    fmpq_poly_init(Pn);
+    fmpq_poly_init(En);
+    polynomial(Pn, n);
+    evaluate_cell(list->map, En, Pn, n, p);
+    fmpq_poly_clear(Pn);
+    fmpq_poly_clear(En);
+}
+
+
+void evaluate_cells(cellmap_t *map,
+                    const long *cells,
+                    const long ncells) {
+    /* Evaluate a list of cells in parallel
+     *
+     * map: The map
+     * cells: The indices of the cells
+     * ncells: Number of cells
+     */
+    cells_t list;
+
+    list.map = map;
+    list.cells = cells;
+    sched_for(0, ncells, evaluate_cell_task, &list, SCHED_NORMAL);
+}
+
+
+void evaluate_row_task(void *arg,
+                       const long n) {
+    /* Task evaluating all unknown cells of the row n
+     */
+    cellmap_t *map;
+    fmpq_poly_t Pn, En;
+    long c;
+    int p;
+
+    map = (cellmap_t *) arg;
+    fmpq_poly_init(Pn);
+    fmpq_poly_init(En);
+    polynomial(Pn, n);
+    for(p = n; p <= map->maxp; p++) {
+        c = (long) (n-1) * map->maxp + (p-1);
+        if(map->state[c] == CELL_UNKNOWN) {
+            evaluate_cell(map, En, Pn, n, p);
+        }
+    }
+    fmpq_poly_clear(Pn);
+    fmpq_poly_clear(En);
+}
+
+
+void adaptive_sublattice(cellmap_t *map,
+                         const int a,
+                         const int b,
+                         const int stride,
+                         const int blocksize) {
+    /* Trace the region boundaries on the sublattice of the cells
+     * n = 1 + a + stride i and p = 1 + b + stride j.
+     *
+     * The sublattice is covered by blocks of 'blocksize' cells per side.
+     * A block whose corners are all evaluated to the same value is filled
+     * by inference, any other block is split into four until single cells
+     * are reached. Blocks with a known corner are always split.
+     *
+     * map: The map
+     * a, b: Offsets of the sublattice
+     * stride: Distance of the cells of the sublattice
+     * blocksize: Side of the initial blocks in cells of the sublattice
+     */
+    block_t *blocks, *next, *swap;
+    long nblocks, nnext, capacity;
+    long *cells, ncells;
+    long c, corner[4];
+    int W, H, i, j, i0, j0, im, jm, k, uniform, unknown;
+    int ni, nj;
+    block_t *bl;
+
+    W = map->maxn > a ? (map->maxn - 1 - a) / stride + 1 : 0;
+    H = map->maxp > b ? (map->maxp - 1 - b) / stride + 1 : 0;
+
+    /* Nothing to do if all cells are known, e.g. by the parity predicate */
+    unknown = 0;
+    for(i = 0; i < W && !unknown; i++) {
+        for(j = 0; j < H && !unknown; j++) {
+            c = (long) (a + stride * i) * map->maxp + (b + stride * j);
+            unknown = map->state[c] == CELL_UNKNOWN;
+        }
+    }
+    if(!unknown) {
+        return;
+    }
+
+    capacity = 4 * ((long) (W / blocksize + 2) * (H / blocksize + 2));
+    blocks = (block_t *) malloc(capacity * sizeof(block_t));
+    next = (block_t *) malloc(capacity * sizeof(block_t));
+    cells = (long *) malloc(4 * capacity * sizeof(long));
+
+    nblocks = 0;
+    for(i0 = 0; ; i0 += blocksize) {
+        for(j0 = 0; ; j0 += blocksize) {
+            bl = blocks + nblocks++;
+            bl->i0 = i0;
+            bl->i1 = i0 + blocksize < W - 1 ? i0 + blocksize : W - 1;
+            bl->j0 = j0;
+            bl->j1 = j0 + blocksize < H - 1 ? j0 + blocksize : H - 1;
+            if(bl->j1 == H - 1) {
+                break;
+            }
+        }
+        if(blocks[nblocks-1].i1 == W - 1) {
+            break;
+        }
+    }
+
+    while(nblocks > 0) {
+        /* Evaluate all corners not evaluated yet */
+        ncells = 0;
+        for(k = 0; k < nblocks; k++) {
+            bl = blocks + k;
+            corner[0] = (long) (a + stride * bl->i0) * map->maxp + (b + stride * bl->j0);
+            corner[1] = (long) (a + stride * bl->i0) * map->maxp + (b + stride * bl->j1);
+            corner[2] = (long) (a + stride * bl->i1) * map->maxp + (b + stride * bl->j0);
+            corner[3] = (long) (a + stride * bl->i1) * map->maxp + (b + stride * bl->j1);
+            for(i = 0; i < 4; i++) {
+                if(map->state[corner[i]] == CELL_UNKNOWN || map->state[corner[i]] == CELL_INFERRED) {
+                    map->state[corner[i]] = CELL_PENDING;
+                    cells[ncells++] = corner[i];
+                }
+            }
+        }
+        evaluate_cells(map, cells, ncells);
+
+        /* Fill uniform blocks and split all others */
+        nnext = 0;
+        for(k = 0; k < nblocks; k++) {
+            bl = blocks + k;
+            if(bl->i1 - bl->i0 <= 1 && bl->j1 - bl->j0 <= 1) {
+                /* All cells are corners */
+                continue;
+            }
+            corner[0] = (long) (a + stride * bl->i0) * map->maxp + (b + stride * bl->j0);
+            corner[1] = (long) (a + stride * bl->i0) * map->maxp + (b + stride * bl->j1);
+            corner[2] = (long) (a + stride * bl->i1) * map->maxp + (b + stride * bl->j0);
+            corner[3] = (long) (a + stride * bl->i1) * map->maxp + (b + stride * bl->j1);
+            uniform = 1;
+            for(i = 0; i < 4; i++) {
+                uniform = uniform && map->state[corner[i]] == CELL_EVALUATED
+                          && map->value[corner[i]] == map->value[corner[0]];
+            }
+            if(uniform) {
+                for(i = bl->i0; i <= bl->i1; i++) {
+                    for(j = bl->j0; j <= bl->j1; j++) {
+                        c = (long) (a + stride * i) * map->maxp + (b + stride * j);
+                        if(map->state[c] == CELL_UNKNOWN) {
+                            map->value[c] = map->value[corner[0]];
+                            map->state[c] = CELL_INFERRED;
+                        }
+                    }
+                }
+                continue;
+            }
+            im = (bl->i0 + bl->i1) / 2;
+            jm = (bl->j0 + bl->j1) / 2;
+            ni = bl->i1 - bl->i0 > 1 ? 2 : 1;
+            nj = bl->j1 - bl->j0 > 1 ? 2 : 1;
+            if(nnext + 4 > capacity) {
+                capacity *= 2;
+                blocks = (block_t *) realloc(blocks, capacity * sizeof(block_t));
+                next = (block_t *) realloc(next, capacity * sizeof(block_t));
+                cells = (long *) realloc(cells, 4 * capacity * sizeof(long));
+                bl = blocks + k;
+            }
+            for(i = 0; i < ni; i++) {
+                for(j = 0; j < nj; j++) {
+                    next[nnext].i0 = ni == 1 ? bl->i0 : (i == 0 ? bl->i0 : im);
+                    next[nnext].i1 = ni == 1 ? bl->i1 : (i == 0 ? im : bl->i1);
+                    next[nnext].j0 = nj == 1 ? bl->j0 : (j == 0 ? bl->j0 : jm);
+                    next[nnext].j1 = nj == 1 ? bl->j1 : (j == 0 ? jm : bl->j1);
+                    nnext++;
+                }
+            }
+        }
+        swap = blocks;
+        blocks = next;
+        next = swap;
+        nblocks = nnext;
+    }
+
+    free(blocks);
+    free(next);
+    free(cells);
+}
+
+
+long spot_check(cellmap_t *map,
+                const long count,
+                long *checked) {
+    /* Evaluate randomly chosen inferred cells, returns the number of
+     * cells whose inferred value was wrong. These keep the evaluated value.
+     *
+     * map: The map
+     * count: Number of cells to check
+     * checked: The number of cells checked
+     */
+    long *cells, *inferred;
+    long c, ncells, k, r, swap, mismatches;
+    unsigned int seed;
+
+    ncells = (long) map->maxn * map->maxp;
+    cells = (long *) malloc(ncells * sizeof(long));
+    inferred = (long *) malloc(ncells * sizeof(long));
+    k = 0;
+    for(c = 0; c < ncells; c++) {
+        if(map->state[c] == CELL_INFERRED) {
+            cells[k++] = c;
+        }
+    }
+
+    /* Partial Fisher-Yates shuffle with a fixed seed */
+    seed = 1;
+    *checked = count < k ? count : k;
+    for(c = 0; c < *checked; c++) {
+        r = c + rand_r(&seed) % (k - c);
+        swap = cells[c];
+        cells[c] = cells[r];
+        cells[r] = swap;
+        inferred[c] = map->value[cells[c]];
+    }
+    evaluate_cells(map, cells, *checked);
+
+    mismatches = 0;
+    for(c = 0; c < *checked; c++) {
+        if(map->value[cells[c]] != inferred[c]) {
+            printf("Spot check failed for n: %ld, p: %ld, inferred %ld, evaluated %i\n",
+                   cells[c] / map->maxp + 1, cells[c] % map->maxp + 1, inferred[c], map->value[cells[c]]);
+            mismatches++;
+        }
+    }
+    free(cells);
+    free(inferred);
+    return mismatches;
+}
+
+
+int work_tiles(const cellmap_t *options,
+               const char *address) {
+    /* Evaluate tiles leased from a coordinator until the search is complete
+     *
+     * options: Validation settings and log level used for all tiles
+     * address: The address 'host:port' of the coordinator
+     */
+    cellmap_t map;
+    coord_heartbeat_t beat;
+    char reply[COORD_MAXLINE];
+    char *result;
+    size_t len;
+    FILE *out;
+    long lease, c, ncells, tiles;
+    long *cells;
+    int lifetime, n0, n1, p0, p1, n, p;
+    int levels[2];
+
+    tiles = 0;
+    while(coord_lease(reply, address, family_name())) {
+        if(sscanf(reply, "UNIT %ld %d TILE %d %d %d %d", &lease, &lifetime, &n0, &n1, &p0, &p1) != 6
+           || n0 < 1 || p0 < 1 || n1 < n0 || p1 < p0) {
+            printf("Unexpected unit: %s\n", reply);
+            return 0;
+        }
+        printf("Tile n: %i-%i p: %i-%i (lease %ld)\n", n0, n1, p0, p1, lease);
+        fflush(stdout);
+
+        /* A map covering the tile, cells outside are never touched */
+        map = *options;
+        map.maxn = n1;
+        map.maxp = p1;
+        map.value = (int *) calloc((long) n1 * p1, sizeof(int));
+        map.state = (char *) calloc((long) n1 * p1, sizeof(char));
+        map.classes = NULL;
+        if(map.classify) {
+            map.classes = (classification_t *) calloc((long) n1 * p1, sizeof(classification_t));
+        }
+        cells = (long *) malloc((long) n1 * p1 * sizeof(long));
+        ncells = 0;
+        for(n = n0; n <= n1; n++) {
+            for(p = (p0 > n ? p0 : n); p <= p1; p++) {
+                c = (long) (n-1) * p1 + (p-1);
+                levels[0] = n;
+                levels[1] = p;
+                if(prune_skip(levels, 2)) {
+                    map.state[c] = CELL_KNOWN;
+                } else {
+                    cells[ncells++] = c;
+                }
+            }
+        }
+
+        coord_heartbeat_start(&beat, address, lease, lifetime / 3.0);
+        evaluate_cells(&map, cells, ncells);
+        if(coord_heartbeat_stop(&beat)) {
+            printf("Lease %ld expired, the tile was reassigned\n", lease);
+        }
+
+        out = open_memstream(&result, &len);
+        fprintf(out, "RESULT %ld\n", lease);
+        for(n = n0; n <= n1; n++) {
+            for(p = (p0 > n ? p0 : n); p <= p1; p++) {
+                fprintf(out, "CELL %i %i %i\n", n, p, map.value[(long) (n-1) * p1 + (p-1)]);
+            }
+        }
+        fprintf(out, "END\n");
+        fclose(out);
+        if(!coord_submit(address, result, len)) {
+            printf("Result of lease %ld not accepted\n", lease);
+        }
+
+        free(result);
+        free(cells);
+        free(map.value);
+        free(map.state);
+        free(map.classes);
+        tiles++;
+    }
+    printf("Tiles evaluated: %ld\n", tiles);
+    return 1;
+}
 
 
 int main(int argc, char* argv[]) {
     int i;
-    int maxn, maxp;
     int n, p;
-    int validate_ext, validate_weights;
-    fmpq_poly_t Pn, En;
-    int solvable;
-    long nrroots, nrpweights;
-    int record;
+    cellmap_t map;
+    long counts[NCLASSES];
     fmpz_mat_t table;
-    int loglevel;
+    char *store;
+    char *progress;
+    char *coordinator;
+    double interval;
+    int levels[2];
+    long c, planned, cost;
+    int block, stride;
+    long spot, checked, mismatches, evaluated, inferred, known;
 
     if(argc <= 1) {
         printf("Search for generalized Kronrod extensions of Gauss rules\n");
-        printf("Syntax: kes_enumerate [-vne] [-vw] [-l L] max_n max_p\n");
+        printf("Syntax: kes_enumerate [-vne] [-vw] [-nmd] [-cl] [-am B] [-asc K] [-l L] [-la] [-threads N] [-st S] [-stats] [-mem] [-perf] [-trace T] [-tm M] [-pm P] [-pi I] [-pr R] [-npr R] max_n max_p\n");
+        printf("       kes_enumerate [-vne] [-vw] [-nmd] [-cl] [-l L] [-threads N] [-st S] [-pr R] [-npr R] -w host:port\n");
         printf("        -vne  Validate the polynomial extension (default on)\n");
         printf("        -vw   Validate the weights (default off)\n");
+        printf("        -nmd  Validate in ball arithmetic only, not in double-double or quad-double first\n");
+        printf("        -cl   Classify every cell in one pass, the map shows the classes\n");
+        printf("        -am   Trace the region boundaries adaptively starting from blocks of B cells\n");
+        printf("        -asc  Verify K randomly chosen inferred cells of the adaptive map\n");
         printf("        -l   Set the log level\n");
+        printf("        -la  Log asynchronously through per-thread buffers\n");
+        printf("        -threads Use N worker threads (default: $KES_THREADS), give it before -mem, -perf, -trace, -tm and -pm\n");
+        printf("        -st  Use the exact polynomial store in directory S (default: $KES_STORE)\n");
+        printf("        -stats  Print a timing summary of all stages on exit\n");
+        printf("        -mem    Add allocation counts and peak memory per stage and thread to the summary\n");
+        printf("        -perf   Add hardware counters per stage and thread to the summary (Linux only)\n");
+        printf("        -trace  Write a Chrome trace of all stages and threads to file T\n");
+        printf("        -tm  Append coefficient size and precision telemetry per candidate to file M\n");
+        printf("        -pm  Periodically write progress metrics in Prometheus text format to file P\n");
+        printf("        -pi  Seconds between two updates of the progress metrics (default 15)\n");
+        printf("        -pr  Enable the pruning predicate R, 'all' enables all\n");
+        printf("        -npr Disable the pruning predicate R, 'all' disables all\n");
+        printf("        -w   Work on tiles leased from the coordinator at host:port, see 'kescoord'\n");
         return EXIT_FAILURE;
     }
 
-    maxn = 1;
-    maxp = 1;
-    validate_ext = 1;
-    validate_weights = 0;
-    loglevel = 0;
+    memset(&map, 0, sizeof(map));
+    map.maxn = 1;
+    map.maxp = 1;
+    map.validate_ext = 1;
+    map.validate_weights = 0;
+    map.classify = 0;
+    map.loglevel = 0;
+    store = NULL;
+    progress = NULL;
+    coordinator = NULL;
+    interval = 15.0;
+    block = 0;
+    spot = 0;
+    checked = 0;
+    mismatches = 0;
 
     for(i = 1; i < argc; i++) {
         if (!strcmp(argv[i], "-vne")) {
-            validate_ext = 0;
+            map.validate_ext = 0;
         } else if (!strcmp(argv[i], "-vw")) {
-            validate_weights = 1;
+            map.validate_weights = 1;
+        } else if (!strcmp(argv[i], "-nmd")) {
+            multidouble_enabled = 0;
+        } else if (!strcmp(argv[i], "-cl")) {
+            map.classify = 1;
+        } else if (!strcmp(argv[i], "-am")) {
+            block = atoi(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-asc")) {
+            spot = atol(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-la")) {
+            log_async_enable();
+        } else if (!strcmp(argv[i], "-threads")) {
+            if(!sched_set_threads(atoi(argv[i+1]))) {
+                printf("Can not use %s threads, give -threads before -mem, -perf, -trace, -tm and -pm\n", argv[i+1]);
+                return EXIT_FAILURE;
+            }
+            i++;
         } else if (!strcmp(argv[i], "-l")) {
-            loglevel = atoi(argv[i+1]);
+            map.loglevel = atoi(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-st")) {
+            store = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-stats")) {
+            stats_enable();
+        } else if (!strcmp(argv[i], "-mem")) {
+            memstats_enable();
+            stats_enable();
+        } else if (!strcmp(argv[i], "-perf")) {
+            if(perf_enable()) {
+                stats_enable();
+            }
+        } else if (!strcmp(argv[i], "-trace")) {
+            trace_enable(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-tm")) {
+            telemetry_enable(argv[i+1], family_name());
+            i++;
+        } else if (!strcmp(argv[i], "-pm")) {
+            progress = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-pi")) {
+            interval = atof(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-pr")) {
+            if(!prune_toggle(argv[i+1], 1)) {
+                return EXIT_FAILURE;
+            }
+            i++;
+        } else if (!strcmp(argv[i], "-npr")) {
+            if(!prune_toggle(argv[i+1], 0)) {
+                return EXIT_FAILURE;
+            }
+            i++;
+        } else if (!strcmp(argv[i], "-w")) {
+            coordinator = argv[i+1];
             i++;
         } else {
             if(i + 1 < argc) {
-                maxn = atoi(argv[i]);
-                maxp = atoi(argv[i+1]);
+                map.maxn = atoi(argv[i]);
+                map.maxp = atoi(argv[i+1]);
                 break;
             } else {
                 printf("Missing values for max_n or max_p!\n");
@@ -57,45 +565,124 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    /* Table for results */
-    fmpz_mat_init(table, maxn, maxp);
-
-#pragma omp parallel for                                        \
-    private(Pn,En,n,p,solvable,record,nrroots,nrpweights),      \
-    shared(table),                                              \
-    schedule(dynamic)
-    for(n = 1; n <= maxn; n++) {
-        fmpq_poly_init(Pn);
-        fmpq_poly_init(En);
-        polynomial(Pn, n);
-
-        for(p = n; p <= maxp; p++) {
-            logit(0, loglevel, "Trying to find an order %i Kronrod extension for H%i\n", p, n);
-            record = 0;
-
-            solvable = find_extension(En, Pn, p, loglevel);
-            logit(0, loglevel, "  Solvable extension rule found: %i\n", solvable);
-
-            if(solvable && validate_weights) {
-                fmpq_poly_mul(En, Pn, En);
-                record = validate_rule(&nrroots, &nrpweights, En, NCHECKDIGITS, loglevel);
-            } else if(solvable && validate_ext) {
-                record = validate_extension_by_poly(&nrroots, En, NCHECKDIGITS, loglevel);
+    exact_store_open(store);
+
+    if(coordinator != NULL) {
+        /* The coordinator assembles the map */
+        i = work_tiles(&map, coordinator);
+        log_flush();
+        prune_report();
+        return i ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    /* Cells below the diagonal are never evaluated, pruned cells are known */
+    map.value = (int *) calloc((long) map.maxn * map.maxp, sizeof(int));
+    map.state = (char *) calloc((long) map.maxn * map.maxp, sizeof(char));
+    map.classes = NULL;
+    if(map.classify) {
+        map.classes = (classification_t *) calloc((long) map.maxn * map.maxp, sizeof(classification_t));
+    }
+    planned = 0;
+    cost = 0;
+    for(n = 1; n <= map.maxn; n++) {
+        for(p = 1; p <= map.maxp; p++) {
+            c = (long) (n-1) * map.maxp + (p-1);
+            levels[0] = n;
+            levels[1] = p;
+            if(p < n) {
+                map.state[c] = CELL_KNOWN;
+            } else if(prune_skip(levels, 2)) {
+                logit(SEARCH, 0, map.loglevel, "Skipped an order %i Kronrod extension for H%i by a pruning predicate\n", p, n);
+                map.state[c] = CELL_KNOWN;
+                if(map.classify) {
+                    classify_rule(map.classes + c, 0, NULL, NCHECKDIGITS, map.loglevel);
+                }
             } else {
-                record = solvable;
+                planned++;
+                cost += progress_cost_model(n, p);
             }
-            fmpz_set_ui(fmpz_mat_entry(table , n-1 , p-1), record);
         }
-        fmpq_poly_clear(Pn);
-        fmpq_poly_clear(En);
     }
 
+    if(progress != NULL) {
+        progress_enable(progress, family_name(), interval);
+        if(block <= 0) {
+            progress_plan(planned, cost);
+        }
+    }
+
+    if(block > 0) {
+        /* Symmetric families alternate with the parities of n and p */
+        stride = prune_symmetric() ? 2 : 1;
+        for(i = 0; i < stride * stride; i++) {
+            adaptive_sublattice(&map, i / stride, i % stride, stride, block);
+        }
+        checked = 0;
+        mismatches = spot > 0 ? spot_check(&map, spot, &checked) : 0;
+    } else {
+        /* One task per row, thieves take the expensive rows of large n first */
+        sched_for(1, map.maxn + 1, evaluate_row_task, &map, SCHED_NORMAL);
+    }
+
+    /* Table for results */
+    fmpz_mat_init(table, map.maxn, map.maxp);
+    for(c = 0; c < (long) map.maxn * map.maxp; c++) {
+        fmpz_set_ui(fmpz_mat_entry(table, c / map.maxp, c % map.maxp), map.value[c]);
+    }
+
+    log_flush();
     printf("==============================================\n");
     fmpz_mat_print_pretty(table);
     printf("\n");
     printf("==============================================\n");
 
+    if(block > 0) {
+        /* Mark the inferred cells */
+        evaluated = 0;
+        inferred = 0;
+        known = 0;
+        for(c = 0; c < (long) map.maxn * map.maxp; c++) {
+            fmpz_set_ui(fmpz_mat_entry(table, c / map.maxp, c % map.maxp), map.state[c] == CELL_INFERRED);
+            evaluated += map.state[c] == CELL_EVALUATED;
+            inferred += map.state[c] == CELL_INFERRED;
+            known += map.state[c] == CELL_KNOWN && c / map.maxp <= c % map.maxp;
+        }
+        printf("Inferred cells:\n");
+        fmpz_mat_print_pretty(table);
+        printf("\n");
+        printf("Evaluated: %ld  Inferred: %ld  Known: %ld  Spot checks: %ld  Failed: %ld\n",
+               evaluated, inferred, known, checked, mismatches);
+        printf("----------------------------------------------\n");
+    }
+
+    if(map.classify) {
+        /* The classes with their extrema, see 'print_classification' */
+        memset(counts, 0, sizeof(counts));
+        printf("CLASS: n p  class nodes real domain positive negative indefinite");
+        printf(" node_min node_max imag_max weight_min weight_max\n");
+        for(n = 1; n <= map.maxn; n++) {
+            for(p = n; p <= map.maxp; p++) {
+                c = (long) (n-1) * map.maxp + (p-1);
+                counts[map.value[c]]++;
+                if(map.state[c] == CELL_INFERRED) {
+                    continue;
+                }
+                printf("CLASS: %i %i  ", n, p);
+                print_classification(map.classes + c);
+                printf("\n");
+            }
+        }
+        for(i = 0; i < NCLASSES; i++) {
+            printf("%i %-12s %ld\n", i, class_names[i], counts[i]);
+        }
+        printf("----------------------------------------------\n");
+        free(map.classes);
+    }
+    prune_report();
+
     fmpz_mat_clear(table);
+    free(map.value);
+    free(map.state);
 
     return EXIT_SUCCESS;
 }
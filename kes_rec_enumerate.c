@@ -8,6 +8,104 @@
 #include <string.h>
 
 #include "libkes.h"
+#include "coord.h"
+
+
+int work_subtrees(const char *address,
+                  const int validate_weights,
+                  const int classify,
+                  const int loglevel) {
+    /* Search subtrees leased from a coordinator until the search is complete
+     *
+     * address: The address 'host:port' of the coordinator
+     * validate_weights: Validate the extensions by weights
+     * classify: Classify every candidate
+     * loglevel: The log verbosity
+     */
+    coord_heartbeat_t beat;
+    char reply[COORD_MAXLINE];
+    char *result, *tok;
+    size_t len;
+    FILE *out;
+    long lease, subtrees, found;
+    int lifetime, maxp, limit, k, j;
+    int levels[RULEINDEX_MAXDEPTH];
+    fmpq_poly_t P, E;
+    fmpz_mat_t table;
+
+    subtrees = 0;
+    while(coord_lease(reply, address, family_name())) {
+        /* UNIT id L TREE maxp limit n p1 ... pj */
+        k = 0;
+        if(sscanf(reply, "UNIT %ld %d TREE %d %d", &lease, &lifetime, &maxp, &limit) == 4) {
+            strtok(reply, " ");
+            for(j = 0; j < 5; j++) {
+                strtok(NULL, " ");
+            }
+            while((tok = strtok(NULL, " ")) != NULL && k < RULEINDEX_MAXDEPTH) {
+                levels[k++] = atoi(tok);
+            }
+        }
+        if(k < 1 || limit < k || limit >= RULEINDEX_MAXDEPTH) {
+            printf("Unexpected unit: %s\n", reply);
+            return 0;
+        }
+        printf("Subtree below");
+        for(j = 0; j < k; j++) {
+            printf(" %i", levels[j]);
+        }
+        printf(" up to depth %i (lease %ld)\n", limit, lease);
+        fflush(stdout);
+
+        coord_heartbeat_start(&beat, address, lease, lifetime / 3.0);
+
+        /* The basis of the prefix, the extensions are in the store if enabled */
+        fmpq_poly_init(P);
+        fmpq_poly_init(E);
+        polynomial(P, levels[0]);
+        if(k > 1) {
+            find_multi_extension(E, NULL, P, k, levels, 0, loglevel);
+            fmpq_poly_mul(P, P, E);
+        }
+
+        fmpz_mat_init(table, limit+1, 1);
+        fmpz_mat_zero(table);
+        for(j = 0; j < k; j++) {
+            fmpz_set_si(fmpz_mat_entry(table, j, 0), levels[j]);
+        }
+
+        /* Collect the sequences found below the prefix */
+        rule_index = ruleindex_new(family_name());
+        if(!fmpq_poly_is_zero(P)) {
+            recursive_enumerate(P, maxp, k-1, limit, table, validate_weights, classify, loglevel);
+        }
+        log_flush();
+
+        if(coord_heartbeat_stop(&beat)) {
+            printf("Lease %ld expired, the subtree was reassigned\n", lease);
+        }
+
+        out = open_memstream(&result, &len);
+        fprintf(out, "RESULT %ld\n", lease);
+        found = ruleindex_write(out, rule_index, 0, levels, 0);
+        fprintf(out, "END\n");
+        fclose(out);
+        if(!coord_submit(address, result, len)) {
+            printf("Result of lease %ld not accepted\n", lease);
+        }
+        printf("Sequences found: %ld\n", found);
+
+        free(result);
+        ruleindex_free(rule_index);
+        rule_index = NULL;
+        fmpz_mat_clear(table);
+        fmpq_poly_clear(P);
+        fmpq_poly_clear(E);
+        subtrees++;
+    }
+    printf("Subtrees searched: %ld\n", subtrees);
+    return 1;
+}
 
 
 int main(int argc, char* argv[]) {
@@ -16,13 +114,36 @@ int main(int argc, char* argv[]) {
     fmpq_poly_t Pn;
     fmpz_mat_t table;
     int validate_weights;
+    int classify;
     int loglevel;
+    char *store;
+    char *progress;
+    char *indexfile;
+    char *coordinator;
+    double interval;
 
     if(argc <= 1) {
         printf("Recursively search for generalized Kronrod extensions of Gauss rules\n");
-        printf("Syntax: kes_rec_enumerate [-vw] [-l L] n max_p max_rec_depth\n");
+        printf("Syntax: kes_rec_enumerate [-vw] [-nmd] [-cl] [-l L] [-la] [-threads N] [-st S] [-stats] [-mem] [-perf] [-trace T] [-tm M] [-pm P] [-pi I] [-ix I] [-pr R] [-npr R] n max_p max_rec_depth\n");
+        printf("       kes_rec_enumerate [-vw] [-nmd] [-cl] [-l L] [-threads N] [-st S] [-pr R] [-npr R] -w host:port\n");
         printf("        -vw  Validate the polynomial extension by weights\n");
+        printf("        -nmd Validate in ball arithmetic only, not in double-double or quad-double first\n");
+        printf("        -cl  Classify every candidate and print a 'CLASS:' line with the extrema\n");
         printf("        -l   Set the log level\n");
+        printf("        -la  Log asynchronously through per-thread buffers\n");
+        printf("        -threads Use N worker threads (default: $KES_THREADS), give it before -mem, -perf, -trace, -tm and -pm\n");
+        printf("        -st  Use the exact polynomial store in directory S (default: $KES_STORE)\n");
+        printf("        -stats  Print a timing summary of all stages on exit\n");
+        printf("        -mem    Add allocation counts and peak memory per stage and thread to the summary\n");
+        printf("        -perf   Add hardware counters per stage and thread to the summary (Linux only)\n");
+        printf("        -trace  Write a Chrome trace of all stages and threads to file T\n");
+        printf("        -tm  Append coefficient size and precision telemetry per candidate to file M\n");
+        printf("        -pm  Periodically write progress metrics in Prometheus text format to file P\n");
+        printf("        -pi  Seconds between two updates of the progress metrics (default 15)\n");
+        printf("        -ix  Add the found sequences to the binary rule index I, see 'ruleindex'\n");
+        printf("        -pr  Enable the pruning predicate R, 'all' enables all\n");
+        printf("        -npr Disable the pruning predicate R, 'all' disables all\n");
+        printf("        -w   Work on subtrees leased from the coordinator at host:port, see 'kescoord'\n");
         return EXIT_FAILURE;
     }
 
@@ -30,14 +151,72 @@ int main(int argc, char* argv[]) {
     maxp = 1;
     maxrec = 1;
     validate_weights = 0;
+    classify = 0;
     loglevel = 0;
+    store = NULL;
+    progress = NULL;
+    indexfile = NULL;
+    coordinator = NULL;
+    interval = 15.0;
 
     for(i = 1; i < argc; i++) {
-        if (!strcmp(argv[i], "-l")) {
+        if (!strcmp(argv[i], "-la")) {
+            log_async_enable();
+        } else if (!strcmp(argv[i], "-threads")) {
+            if(!sched_set_threads(atoi(argv[i+1]))) {
+                printf("Can not use %s threads, give -threads before -mem, -perf, -trace, -tm and -pm\n", argv[i+1]);
+                return EXIT_FAILURE;
+            }
+            i++;
+        } else if (!strcmp(argv[i], "-l")) {
             loglevel = atoi(argv[i+1]);
             i++;
         } else if (!strcmp(argv[i], "-vw")) {
             validate_weights = 1;
+        } else if (!strcmp(argv[i], "-nmd")) {
+            multidouble_enabled = 0;
+        } else if (!strcmp(argv[i], "-cl")) {
+            classify = 1;
+        } else if (!strcmp(argv[i], "-st")) {
+            store = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-stats")) {
+            stats_enable();
+        } else if (!strcmp(argv[i], "-mem")) {
+            memstats_enable();
+            stats_enable();
+        } else if (!strcmp(argv[i], "-perf")) {
+            if(perf_enable()) {
+                stats_enable();
+            }
+        } else if (!strcmp(argv[i], "-trace")) {
+            trace_enable(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-tm")) {
+            telemetry_enable(argv[i+1], family_name());
+            i++;
+        } else if (!strcmp(argv[i], "-pm")) {
+            progress = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-pi")) {
+            interval = atof(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-ix")) {
+            indexfile = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-pr")) {
+            if(!prune_toggle(argv[i+1], 1)) {
+                return EXIT_FAILURE;
+            }
+            i++;
+        } else if (!strcmp(argv[i], "-npr")) {
+            if(!prune_toggle(argv[i+1], 0)) {
+                return EXIT_FAILURE;
+            }
+            i++;
+        } else if (!strcmp(argv[i], "-w")) {
+            coordinator = argv[i+1];
+            i++;
         } else {
             if(i + 2 < argc) {
                 n = atoi(argv[i]);
@@ -51,11 +230,36 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    exact_store_open(store);
+
+    if(coordinator != NULL) {
+        /* The coordinator collects the sequences */
+        i = work_subtrees(coordinator, validate_weights, classify, loglevel);
+        prune_report();
+        return i ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if(indexfile != NULL) {
+        /* Merge into the existing index, fail early on a mismatch */
+        rule_index = ruleindex_new(family_name());
+        if(!ruleindex_merge(rule_index, indexfile)) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(progress != NULL) {
+        progress_enable(progress, family_name(), interval);
+    }
+
     printf("-----------------------------------------\n");
     printf("Search for recursive extensions of: P%i\n", n);
     printf("Maximal allowed extension order p: %i\n", maxp);
     printf("Maximal allowed recursion depth: %i\n", maxrec);
     printf("-----------------------------------------\n");
+    if(classify) {
+        printf("CLASS: depth n p1 ... pk  class nodes real domain positive negative indefinite");
+        printf(" node_min node_max imag_max weight_min weight_max\n");
+    }
 
     /* Initialise the basis polynomial P1 */
     fmpq_poly_init(Pn);
@@ -69,8 +273,18 @@ int main(int argc, char* argv[]) {
     printf("RULE: %i  ", 0);
     fmpz_print(fmpz_mat_entry(table, 0, 0));
     printf("\n");
+    ruleindex_record(&n, 1);
+
+    recursive_enumerate(Pn, maxp, 0, maxrec, table, validate_weights, classify, loglevel);
 
-    recursive_enumerate(Pn, maxp, 0, maxrec, table, validate_weights, loglevel);
+    log_flush();
+    printf("-----------------------------------------\n");
+    prune_report();
+
+    if(rule_index != NULL) {
+        ruleindex_save(rule_index, indexfile);
+        ruleindex_free(rule_index);
+    }
 
     fmpq_poly_clear(Pn);
 
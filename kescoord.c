@@ -0,0 +1,682 @@
+/*  Author: R. Bourquin
+    Copyright: (C) 2014 R. Bourquin
+    License: GNU GPL v2 or above
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+
+#include "libkes.h"
+#include "coord.h"
+
+
+/* Kinds of units */
+#define UNIT_TILE 0
+#define UNIT_TREE 1
+
+/* States of units */
+#define UNIT_PENDING 0
+#define UNIT_LEASED 1
+#define UNIT_DONE 2
+
+
+typedef struct {
+    int kind;
+    int state;
+    long lease;
+    double expires;
+    /* The unit as sent after 'UNIT id L', also its key in the journal */
+    char *desc;
+    /* A tile n0 <= n <= n1, p0 <= p <= p1 */
+    int n0, n1, p0, p1;
+    /* A subtree below the prefix levels[0], ..., levels[k-1] up to depth 'limit' */
+    int levels[RULEINDEX_MAXDEPTH];
+    int k;
+    int limit;
+} unit_t;
+
+
+typedef struct {
+    int kind;
+    int lifetime;
+    int split;
+    int maxn;
+    int maxp;
+    int maxrec;
+    unit_t *units;
+    long nunits;
+    long capacity;
+    long ndone;
+    /* The unit of each lease ever handed out */
+    long *leases;
+    long nleases;
+    long lcapacity;
+    /* Results of the map or the recursive search */
+    int *value;
+    ruleindex_t *index;
+    FILE *journal;
+    /* Guards all of the above, clients are served by concurrent threads */
+    pthread_mutex_t lock;
+    pthread_cond_t idle;
+    int nclients;
+} coordinator_t;
+
+
+typedef struct {
+    coordinator_t *co;
+    int fd;
+} client_t;
+
+
+volatile sig_atomic_t stop = 0;
+
+
+void stop_handler(int signum) {
+    stop = 1;
+}
+
+
+double coordinator_time(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+
+unit_t * unit_add(coordinator_t *co,
+                  const int kind) {
+    /* Append a pending unit
+     *
+     * co: The coordinator
+     * kind: The kind of the unit
+     */
+    unit_t *u;
+
+    if(co->nunits == co->capacity) {
+        co->capacity = co->capacity > 0 ? 2 * co->capacity : 64;
+        co->units = (unit_t *) realloc(co->units, co->capacity * sizeof(unit_t));
+    }
+    u = co->units + co->nunits++;
+    memset(u, 0, sizeof(unit_t));
+    u->kind = kind;
+    u->state = UNIT_PENDING;
+    u->lease = -1;
+    return u;
+}
+
+
+void unit_add_tile(coordinator_t *co,
+                   const int n0,
+                   const int n1,
+                   const int p0,
+                   const int p1) {
+    unit_t *u;
+    char desc[COORD_MAXLINE];
+
+    u = unit_add(co, UNIT_TILE);
+    u->n0 = n0;
+    u->n1 = n1;
+    u->p0 = p0;
+    u->p1 = p1;
+    snprintf(desc, sizeof(desc), "TILE %i %i %i %i", n0, n1, p0, p1);
+    u->desc = strdup(desc);
+}
+
+
+void unit_add_tree(coordinator_t *co,
+                   const int levels[],
+                   const int k,
+                   const int limit) {
+    unit_t *u;
+    char desc[COORD_MAXLINE];
+    int j;
+
+    u = unit_add(co, UNIT_TREE);
+    memcpy(u->levels, levels, k * sizeof(int));
+    u->k = k;
+    u->limit = limit;
+    snprintf(desc, sizeof(desc), "TREE %i %i", co->maxp, limit);
+    for(j = 0; j < k; j++) {
+        snprintf(desc + strlen(desc), sizeof(desc) - strlen(desc), " %i", levels[j]);
+    }
+    u->desc = strdup(desc);
+}
+
+
+unit_t * unit_find(coordinator_t *co,
+                   const char *desc) {
+    /* The unfinished unit with the given description or NULL
+     */
+    long i;
+
+    for(i = 0; i < co->nunits; i++) {
+        if(co->units[i].state != UNIT_DONE && !strcmp(co->units[i].desc, desc)) {
+            return co->units + i;
+        }
+    }
+    return NULL;
+}
+
+
+void unit_complete(coordinator_t *co,
+                   unit_t *u,
+                   char *result) {
+    /* Merge the result of a unit and append it to the journal. Subtrees
+     * reaching the depth limit of the unit become new units.
+     *
+     * co: The coordinator
+     * u: The unit, not yet done
+     * result: The 'CELL' or 'RULE:' lines of the result, modified
+     */
+    char *line, *save;
+    char copy[COORD_MAXLINE];
+    int levels[RULEINDEX_MAXDEPTH];
+    int n, p, value, k, j, limit;
+    long i;
+
+    i = u - co->units;
+    for(line = strtok_r(result, "\n", &save); line != NULL; line = strtok_r(NULL, "\n", &save)) {
+        if(co->journal != NULL) {
+            fprintf(co->journal, "%s\n", line);
+        }
+        if(u->kind == UNIT_TILE) {
+            if(sscanf(line, "CELL %i %i %i", &n, &p, &value) == 3
+               && n >= u->n0 && n <= u->n1 && p >= u->p0 && p <= u->p1) {
+                co->value[(long) (n-1) * co->maxp + (p-1)] = value;
+            }
+        } else {
+            strncpy(copy, line, sizeof(copy) - 1);
+            copy[sizeof(copy) - 1] = '\0';
+            k = ruleindex_parse(levels, copy);
+            if(k <= u->k || k - 1 > u->limit) {
+                continue;
+            }
+            for(j = 0; j < u->k && levels[j] == u->levels[j]; j++);
+            if(j < u->k) {
+                continue;
+            }
+            ruleindex_insert(co->index, levels, k);
+            if(k - 1 == u->limit && u->limit < co->maxrec) {
+                limit = u->limit + co->split < co->maxrec ? u->limit + co->split : co->maxrec;
+                /* May move the units */
+                unit_add_tree(co, levels, k, limit);
+                u = co->units + i;
+            }
+        }
+    }
+    if(co->journal != NULL) {
+        fprintf(co->journal, "DONE %s\n", u->desc);
+        fflush(co->journal);
+        fsync(fileno(co->journal));
+    }
+    u->state = UNIT_DONE;
+    co->ndone++;
+}
+
+
+int journal_replay(coordinator_t *co,
+                   const char *filename) {
+    /* Complete all units recorded in a journal, returns the number of units
+     *
+     * co: The coordinator
+     * filename: The journal, a missing file is empty
+     */
+    FILE *in, *out;
+    char line[COORD_MAXLINE];
+    char *result;
+    size_t len;
+    unit_t *u;
+    int replayed;
+
+    in = fopen(filename, "r");
+    if(in == NULL) {
+        return 0;
+    }
+    replayed = 0;
+    out = open_memstream(&result, &len);
+    while(fgets(line, sizeof(line), in) != NULL) {
+        if(strncmp(line, "DONE ", 5)) {
+            fputs(line, out);
+            continue;
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        fclose(out);
+        u = unit_find(co, line + 5);
+        if(u != NULL) {
+            unit_complete(co, u, result);
+            replayed++;
+        }
+        free(result);
+        out = open_memstream(&result, &len);
+    }
+    fclose(out);
+    free(result);
+    fclose(in);
+    return replayed;
+}
+
+
+void handle_request(coordinator_t *co,
+                    const int fd) {
+    /* Answer a single request, see 'coord.h' for the protocol.
+     * The request is read completely before the coordinator is locked.
+     *
+     * co: The coordinator
+     * fd: The connected socket
+     */
+    char line[COORD_MAXLINE], reply[COORD_MAXLINE];
+    char family[COORD_MAXLINE], worker[COORD_MAXLINE];
+    char *result;
+    size_t len;
+    FILE *out;
+    unit_t *u;
+    long id, i;
+    int complete;
+
+    if(read_line(fd, line, sizeof(line)) < 0) {
+        return;
+    }
+
+    result = NULL;
+    if(sscanf(line, "RESULT %ld", &id) == 1) {
+        /* Read the whole result before merging anything */
+        out = open_memstream(&result, &len);
+        complete = 0;
+        while(read_line(fd, reply, sizeof(reply)) >= 0) {
+            if(!strcmp(reply, "END")) {
+                complete = 1;
+                break;
+            }
+            fprintf(out, "%s\n", reply);
+        }
+        fclose(out);
+        if(!complete) {
+            free(result);
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&co->lock);
+    if(sscanf(line, "LEASE %s %s", family, worker) == 2) {
+        if(strcmp(family, family_name())) {
+            snprintf(reply, sizeof(reply), "ERR family %s expected\n", family_name());
+        } else if(co->ndone == co->nunits) {
+            snprintf(reply, sizeof(reply), "DONE\n");
+        } else {
+            for(i = 0; i < co->nunits && co->units[i].state != UNIT_PENDING; i++);
+            if(i < co->nunits) {
+                if(co->nleases == co->lcapacity) {
+                    co->lcapacity = co->lcapacity > 0 ? 2 * co->lcapacity : 64;
+                    co->leases = (long *) realloc(co->leases, co->lcapacity * sizeof(long));
+                }
+                u = co->units + i;
+                u->state = UNIT_LEASED;
+                u->lease = co->nleases;
+                u->expires = coordinator_time() + co->lifetime;
+                co->leases[co->nleases++] = i;
+                snprintf(reply, sizeof(reply), "UNIT %ld %i %s\n", u->lease, co->lifetime, u->desc);
+                fprintf(stderr, "Lease %ld: %s to %s\n", u->lease, u->desc, worker);
+            } else {
+                snprintf(reply, sizeof(reply), "WAIT %i\n", co->lifetime > 3 ? co->lifetime / 3 : 1);
+            }
+        }
+    } else if(sscanf(line, "BEAT %ld", &id) == 1) {
+        u = id >= 0 && id < co->nleases ? co->units + co->leases[id] : NULL;
+        if(u != NULL && u->state == UNIT_LEASED && u->lease == id) {
+            u->expires = coordinator_time() + co->lifetime;
+            snprintf(reply, sizeof(reply), "OK\n");
+        } else {
+            snprintf(reply, sizeof(reply), "LOST\n");
+        }
+    } else if(result != NULL) {
+        /* The first result of a unit wins, later ones are discarded */
+        u = id >= 0 && id < co->nleases ? co->units + co->leases[id] : NULL;
+        if(u != NULL && u->state != UNIT_DONE) {
+            unit_complete(co, u, result);
+            fprintf(stderr, "Lease %ld done, %ld of %ld units\n", id, co->ndone, co->nunits);
+        }
+        free(result);
+        snprintf(reply, sizeof(reply), "OK\n");
+    } else {
+        snprintf(reply, sizeof(reply), "ERR unknown request\n");
+    }
+    pthread_mutex_unlock(&co->lock);
+
+    if(write(fd, reply, strlen(reply)) < 0) {
+        fprintf(stderr, "Can not answer request: %s\n", strerror(errno));
+    }
+}
+
+
+void * serve_client(void *arg) {
+    /* Answer the request of a connected client
+     *
+     * arg: The client, freed here
+     */
+    client_t *client;
+    coordinator_t *co;
+
+    client = (client_t *) arg;
+    co = client->co;
+    handle_request(co, client->fd);
+    close(client->fd);
+    free(client);
+
+    pthread_mutex_lock(&co->lock);
+    co->nclients--;
+    pthread_cond_signal(&co->idle);
+    pthread_mutex_unlock(&co->lock);
+    flint_cleanup();
+    return NULL;
+}
+
+
+void expire_leases(coordinator_t *co) {
+    /* Return the units of expired leases to the pending ones
+     */
+    double t;
+    long i;
+
+    pthread_mutex_lock(&co->lock);
+    t = coordinator_time();
+    for(i = 0; i < co->nunits; i++) {
+        if(co->units[i].state == UNIT_LEASED && co->units[i].expires < t) {
+            fprintf(stderr, "Lease %ld expired: %s\n", co->units[i].lease, co->units[i].desc);
+            co->units[i].state = UNIT_PENDING;
+        }
+    }
+    pthread_mutex_unlock(&co->lock);
+}
+
+
+int coordinator_listen(const char *port) {
+    /* Listen on a TCP port on all interfaces, returns the socket or -1
+     */
+    struct addrinfo hints, *info, *ai;
+    int fd, on;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if(getaddrinfo(NULL, port, &hints, &info) != 0) {
+        return -1;
+    }
+    fd = -1;
+    for(ai = info; ai != NULL && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if(fd < 0) {
+            continue;
+        }
+        on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if(bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 || listen(fd, 64) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(info);
+    return fd;
+}
+
+
+void serve(coordinator_t *co,
+           const int listener,
+           const double until) {
+    /* Answer requests until all units are done, or with 'until' positive
+     * until that time, or until interrupted. Each connection is served by
+     * its own thread, a stalled client only holds up its own thread.
+     * Returns once all client threads have finished.
+     *
+     * co: The coordinator
+     * listener: The listening socket
+     * until: End of the service, 0 to end when all units are done
+     */
+    struct pollfd pfd;
+    struct timeval timeout;
+    pthread_t thread;
+    client_t *client;
+    int fd, running;
+
+    running = 1;
+    while(!stop && running) {
+        pfd.fd = listener;
+        pfd.events = POLLIN;
+        if(poll(&pfd, 1, 1000) > 0) {
+            fd = accept(listener, NULL, NULL);
+            if(fd >= 0) {
+                /* A stalled client must not hold its thread for long */
+                timeout.tv_sec = COORD_TIMEOUT;
+                timeout.tv_usec = 0;
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                client = (client_t *) malloc(sizeof(client_t));
+                client->co = co;
+                client->fd = fd;
+                pthread_mutex_lock(&co->lock);
+                co->nclients++;
+                pthread_mutex_unlock(&co->lock);
+                if(pthread_create(&thread, NULL, serve_client, client) != 0) {
+                    pthread_mutex_lock(&co->lock);
+                    co->nclients--;
+                    pthread_mutex_unlock(&co->lock);
+                    close(fd);
+                    free(client);
+                } else {
+                    pthread_detach(thread);
+                }
+            }
+        }
+        expire_leases(co);
+        pthread_mutex_lock(&co->lock);
+        running = until > 0 ? coordinator_time() < until : co->ndone < co->nunits;
+        pthread_mutex_unlock(&co->lock);
+    }
+
+    pthread_mutex_lock(&co->lock);
+    while(co->nclients > 0) {
+        pthread_cond_wait(&co->idle, &co->lock);
+    }
+    pthread_mutex_unlock(&co->lock);
+}
+
+
+int main(int argc, char* argv[]) {
+    int i, n, p;
+    const char *port;
+    char *journal;
+    char *indexfile;
+    int tile;
+    int listener;
+    long c;
+    coordinator_t co;
+    ruleindex_t *probe;
+    fmpz_mat_t table;
+    int levels[RULEINDEX_MAXDEPTH];
+    struct sigaction action;
+
+    if(argc <= 1) {
+        printf("Coordinate a search over workers on many hosts\n");
+        printf("Syntax: kescoord [-port P] [-lease L] [-j J] [-tile T] -ekes max_n max_p\n");
+        printf("        kescoord [-port P] [-lease L] [-j J] [-split D] [-ix I] -rekes n max_p max_rec_depth\n");
+        printf("        -port  Listen on TCP port P (default 7077)\n");
+        printf("        -lease Seconds a lease lasts without a heartbeat (default 60)\n");
+        printf("        -j     Journal of all results in file J, a restart resumes from it\n");
+        printf("        -tile  Hand out tiles of T x T cells of the map (default 8)\n");
+        printf("        -split Hand out subtrees of D levels of the recursion (default 2)\n");
+        printf("        -ix    Add the found sequences to the binary rule index I, see 'ruleindex'\n");
+        printf("        -ekes  Coordinate the map of 'ekes max_n max_p', workers run 'ekes -w host:P'\n");
+        printf("        -rekes Coordinate 'rekes n max_p max_rec_depth', workers run 'rekes -w host:P'\n");
+        return EXIT_FAILURE;
+    }
+
+    memset(&co, 0, sizeof(co));
+    pthread_mutex_init(&co.lock, NULL);
+    pthread_cond_init(&co.idle, NULL);
+    co.kind = -1;
+    co.lifetime = 60;
+    co.split = 2;
+    port = "7077";
+    journal = NULL;
+    indexfile = NULL;
+    tile = 8;
+    n = 1;
+
+    for(i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-port") && i + 1 < argc) {
+            port = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-lease") && i + 1 < argc) {
+            co.lifetime = atoi(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            journal = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-tile") && i + 1 < argc) {
+            tile = atoi(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-split") && i + 1 < argc) {
+            co.split = atoi(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-ix") && i + 1 < argc) {
+            indexfile = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-ekes") && i + 2 < argc) {
+            co.kind = UNIT_TILE;
+            co.maxn = atoi(argv[i+1]);
+            co.maxp = atoi(argv[i+2]);
+            i += 2;
+        } else if (!strcmp(argv[i], "-rekes") && i + 3 < argc) {
+            co.kind = UNIT_TREE;
+            n = atoi(argv[i+1]);
+            co.maxp = atoi(argv[i+2]);
+            co.maxrec = atoi(argv[i+3]);
+            i += 3;
+        } else {
+            printf("Unknown or incomplete option: %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(co.kind < 0 || co.maxp < 1 || co.lifetime < 1 || tile < 1 || co.split < 1
+       || (co.kind == UNIT_TILE && co.maxn < 1)
+       || (co.kind == UNIT_TREE && (n < 1 || co.maxrec < 1 || co.maxrec >= RULEINDEX_MAXDEPTH))) {
+        printf("Missing or invalid search, see the options -ekes and -rekes!\n");
+        return EXIT_FAILURE;
+    }
+
+    if(co.kind == UNIT_TILE) {
+        /* Tiles with at least one cell p >= n */
+        co.value = (int *) calloc((long) co.maxn * co.maxp, sizeof(int));
+        for(i = 1; i <= co.maxn; i += tile) {
+            for(p = 1; p <= co.maxp; p += tile) {
+                if(p + tile - 1 >= i) {
+                    unit_add_tile(&co, i, i + tile - 1 < co.maxn ? i + tile - 1 : co.maxn,
+                                  p, p + tile - 1 < co.maxp ? p + tile - 1 : co.maxp);
+                }
+            }
+        }
+    } else {
+        /* The root subtree, deeper ones follow as results arrive */
+        if(indexfile != NULL) {
+            /* Fail early on a mismatch */
+            probe = ruleindex_new(family_name());
+            if(!ruleindex_merge(probe, indexfile)) {
+                return EXIT_FAILURE;
+            }
+            ruleindex_free(probe);
+        }
+        co.index = ruleindex_new(family_name());
+        ruleindex_insert(co.index, &n, 1);
+        unit_add_tree(&co, &n, 1, co.split < co.maxrec ? co.split : co.maxrec);
+    }
+
+    if(journal != NULL) {
+        i = journal_replay(&co, journal);
+        fprintf(stderr, "Resumed %i units from journal %s\n", i, journal);
+        co.journal = fopen(journal, "a");
+        if(co.journal == NULL) {
+            printf("Can not open journal: %s\n", journal);
+            return EXIT_FAILURE;
+        }
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_handler;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    listener = coordinator_listen(port);
+    if(listener < 0) {
+        printf("Can not listen on port: %s\n", port);
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "Coordinating %ld units for family %s on port %s\n", co.nunits, family_name(), port);
+
+    serve(&co, listener, 0);
+
+    if(co.ndone < co.nunits) {
+        fprintf(stderr, "Interrupted with %ld of %ld units done\n", co.ndone, co.nunits);
+        close(listener);
+        if(co.journal != NULL) {
+            fclose(co.journal);
+        }
+        return EXIT_FAILURE;
+    }
+
+    if(co.kind == UNIT_TILE) {
+        /* The map as printed by ekes */
+        fmpz_mat_init(table, co.maxn, co.maxp);
+        for(c = 0; c < (long) co.maxn * co.maxp; c++) {
+            fmpz_set_ui(fmpz_mat_entry(table, c / co.maxp, c % co.maxp), co.value[c]);
+        }
+        printf("==============================================\n");
+        fmpz_mat_print_pretty(table);
+        printf("\n");
+        printf("==============================================\n");
+        fmpz_mat_clear(table);
+    } else {
+        /* The sequences as printed by rekes */
+        printf("-----------------------------------------\n");
+        printf("Search for recursive extensions of: P%i\n", n);
+        printf("Maximal allowed extension order p: %i\n", co.maxp);
+        printf("Maximal allowed recursion depth: %i\n", co.maxrec);
+        printf("-----------------------------------------\n");
+        ruleindex_write(stdout, co.index, 0, levels, 0);
+        printf("-----------------------------------------\n");
+        if(indexfile != NULL) {
+            ruleindex_merge(co.index, indexfile);
+            ruleindex_save(co.index, indexfile);
+        }
+    }
+    fflush(stdout);
+
+    /* Tell the remaining workers that the search is complete */
+    serve(&co, listener, coordinator_time() + co.lifetime);
+
+    close(listener);
+    if(co.journal != NULL) {
+        fclose(co.journal);
+    }
+    for(c = 0; c < co.nunits; c++) {
+        free(co.units[c].desc);
+    }
+    free(co.units);
+    free(co.leases);
+    free(co.value);
+    if(co.index != NULL) {
+        ruleindex_free(co.index);
+    }
+    pthread_mutex_destroy(&co.lock);
+    pthread_cond_destroy(&co.idle);
+
+    return EXIT_SUCCESS;
+}
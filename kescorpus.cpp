@@ -0,0 +1,614 @@
+/*  Author: R. Bourquin
+    Copyright: (C) 2014 R. Bourquin
+    License: GNU GPL v2 or above
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+
+#include "arb_fmpz_poly.h"
+
+#include "libkes.h"
+#include "benchmark.h"
+
+
+/* A problem of the corpus: the tower below the last level and its last extension */
+struct corpus_case_t {
+    std::vector<int> levels;
+    std::string stratum;
+    std::string basis;
+    std::string extension;
+    int valid;
+    int solvable;
+    long deg;
+    long prec;
+    long cost;
+};
+
+typedef std::vector<corpus_case_t> corpus_t;
+
+const char* engine_names[] = {"assembly", "exact", "modular", "dixon", "arb", "realroot"};
+const int nengines = 6;
+
+
+std::string
+levels_string(const std::vector<int>& levels,
+              const char* sep) {
+    std::string s;
+    for(unsigned int i = 0; i < levels.size(); i++) {
+        s += (i > 0 ? sep : "") + std::to_string(levels[i]);
+    }
+    return s;
+}
+
+
+std::string
+octave(const long x) {
+    /* The power of two range containing x */
+    long b = 1;
+    while(2 * b <= x) {
+        b *= 2;
+    }
+    return std::to_string(b) + "-" + std::to_string(2 * b - 1);
+}
+
+
+void
+read_candidates(std::set<std::vector<int>>& candidates,
+                FILE* file) {
+    /* Collect level sequences from 'RULE:' lines of rekes, from the
+     * map printed by ekes and from plain lines 'n p1 ... pk'. The map
+     * lies between the first two '=' separator lines, as in plot_map.py.
+     * Later maps like the inferred cells of 'ekes -am' are skipped.
+     */
+    char *line = NULL;
+    size_t size = 0;
+    int row = 0;
+    /* 0 before, 1 inside and 2 after the map */
+    int section = 0;
+
+    while(getline(&line, &size, file) > 0) {
+        std::vector<int> values;
+        if(!strncmp(line, "=====", 5)) {
+            section = section < 2 ? section + 1 : section;
+            continue;
+        }
+        bool map = section == 1;
+        char *c = line;
+        if(map && strchr(line, '[') == NULL) {
+            continue;
+        } else if(!strncmp(c, "RULE:", 5)) {
+            c += 5;
+            /* Skip the depth */
+            strtol(c, &c, 10);
+        } else if(!map && !isdigit(*c)) {
+            continue;
+        }
+        for(char *end = c; *c != '\0'; c = end) {
+            while(*c != '\0' && !isdigit(*c) && *c != '-') {
+                c++;
+            }
+            if(*c == '\0') {
+                break;
+            }
+            values.push_back(strtol(c, &end, 10));
+        }
+        if(map) {
+            /* Row n-1 of the map holds the cells (n, p) for p >= n */
+            row++;
+            for(unsigned int p = row; p <= values.size(); p++) {
+                candidates.insert({row, (int) p});
+            }
+        } else if(values.size() >= 2) {
+            candidates.insert(values);
+        }
+    }
+    free(line);
+}
+
+
+void
+harvest_case(corpus_case_t& c,
+             const long target_prec) {
+    /* Build the tower of a level sequence and measure its precision needs.
+     * Cases whose tower already fails below the last level are invalid.
+     */
+    const std::vector<int>& levels = c.levels;
+    const int k = levels.size();
+    fmpq_poly_t Pt, Et;
+    char *strf;
+
+    fmpq_poly_init(Pt);
+    fmpq_poly_init(Et);
+    polynomial(Pt, levels[0]);
+
+    c.valid = 1;
+    c.solvable = 1;
+    for(int i = 1; i < k; i++) {
+        c.solvable = find_extension_stored(Et, Pt, levels.data(), i+1, 0);
+        if(!c.solvable || i == k-1) {
+            c.valid = i == k-1;
+            break;
+        }
+        fmpq_poly_mul(Pt, Pt, Et);
+        fmpq_poly_canonicalise(Pt);
+    }
+
+    strf = fmpq_poly_get_str(Pt);
+    c.basis = strf;
+    flint_free(strf);
+    strf = fmpq_poly_get_str(Et);
+    c.extension = strf;
+    flint_free(strf);
+
+    c.deg = fmpq_poly_degree(Pt) + levels[k-1];
+    c.cost = progress_cost_model(fmpq_poly_degree(Pt), levels[k-1]);
+    c.prec = 0;
+
+    if(c.solvable) {
+        rootdiag_t diag;
+        fmpq_poly_mul(Pt, Pt, Et);
+        acb_ptr roots = _acb_vec_init(c.deg);
+        poly_roots_diag(roots, &diag, Pt, 0, 53, target_prec, 0);
+        _acb_vec_clear(roots, c.deg);
+        c.prec = diag.final_prec;
+    }
+    c.stratum = "d" + octave(c.deg) + "/" + (c.solvable ? "p" + octave(c.prec) : "unsolvable");
+
+    fmpq_poly_clear(Pt);
+    fmpq_poly_clear(Et);
+}
+
+
+typedef struct {
+    corpus_t* cases;
+    long target_prec;
+} harvest_task_t;
+
+
+void
+harvest_case_task(void* arg, const long i) {
+    harvest_task_t* h = (harvest_task_t*) arg;
+    harvest_case((*h->cases)[i], h->target_prec);
+}
+
+
+void
+write_corpus(FILE* file,
+             const corpus_t& corpus,
+             const int digits) {
+    fprintf(file, "# kescorpus 1\n");
+    fprintf(file, "family %s\n", family_name());
+    fprintf(file, "digits %d\n", digits);
+    for(auto it = corpus.begin(); it != corpus.end(); it++) {
+        fprintf(file, "case %s\n", levels_string(it->levels, " ").c_str());
+        fprintf(file, "stratum %s\n", it->stratum.c_str());
+        fprintf(file, "solvable %d\n", it->solvable);
+        fprintf(file, "basis %s\n", it->basis.c_str());
+        fprintf(file, "extension %s\n", it->extension.c_str());
+    }
+}
+
+
+bool
+read_corpus(corpus_t& corpus,
+            int& digits,
+            FILE* file) {
+    /* Read a corpus written by 'write_corpus', fails on a different family
+     */
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    bool ok = true;
+
+    while(ok && (len = getline(&line, &size, file)) > 0) {
+        if(line[len-1] == '\n') {
+            line[len-1] = '\0';
+        }
+        char *value = strchr(line, ' ');
+        if(line[0] == '#' || value == NULL) {
+            continue;
+        }
+        *value++ = '\0';
+        if(!strcmp(line, "family")) {
+            if(strcmp(value, family_name())) {
+                printf("Corpus of family %s, but compiled for %s\n", value, family_name());
+                ok = false;
+            }
+        } else if(!strcmp(line, "digits")) {
+            digits = atoi(value);
+        } else if(!strcmp(line, "case")) {
+            corpus.push_back(corpus_case_t());
+            for(char *end = value; *value != '\0'; value = end) {
+                corpus.back().levels.push_back(strtol(value, &end, 10));
+                if(end == value) {
+                    break;
+                }
+            }
+        } else if(corpus.empty()) {
+            continue;
+        } else if(!strcmp(line, "stratum")) {
+            corpus.back().stratum = value;
+        } else if(!strcmp(line, "solvable")) {
+            corpus.back().solvable = atoi(value);
+        } else if(!strcmp(line, "basis")) {
+            corpus.back().basis = value;
+        } else if(!strcmp(line, "extension")) {
+            corpus.back().extension = value;
+        }
+    }
+    free(line);
+    return ok;
+}
+
+
+int
+harvest(const std::vector<const char*>& inputs,
+        const char* output,
+        const int per_stratum,
+        const int digits) {
+    /* Harvest a stratified corpus from the given rekes and ekes outputs
+     */
+    std::set<std::vector<int>> candidates;
+    for(auto it = inputs.begin(); it != inputs.end(); it++) {
+        FILE* file = strcmp(*it, "-") ? fopen(*it, "r") : stdin;
+        if(file == NULL) {
+            printf("Can not open input: %s\n", *it);
+            return EXIT_FAILURE;
+        }
+        read_candidates(candidates, file);
+        if(file != stdin) {
+            fclose(file);
+        }
+    }
+
+    corpus_t all;
+    for(auto it = candidates.begin(); it != candidates.end(); it++) {
+        corpus_case_t c;
+        c.levels = *it;
+        all.push_back(c);
+    }
+    printf("Harvesting %lu candidates\n", (unsigned long) all.size());
+
+    /* 'digits' is in base 10 and log(10)/log(2) = 3.32193 */
+    const long target_prec = 3.32193 * digits;
+    const long ncases = all.size();
+
+    harvest_task_t harvest = {&all, target_prec};
+    sched_for(0, ncases, harvest_case_task, &harvest, SCHED_NORMAL);
+
+    /* Pick evenly spaced cases by cost within each stratum */
+    std::map<std::string, std::vector<corpus_case_t*>> strata;
+    for(auto it = all.begin(); it != all.end(); it++) {
+        if(it->valid) {
+            strata[it->stratum].push_back(&(*it));
+        }
+    }
+
+    corpus_t corpus;
+    printf("%-32s %10s %10s\n", "stratum", "candidates", "selected");
+    for(auto it = strata.begin(); it != strata.end(); it++) {
+        std::vector<corpus_case_t*>& cases = it->second;
+        std::stable_sort(cases.begin(), cases.end(),
+                         [](const corpus_case_t* a, const corpus_case_t* b) { return a->cost < b->cost; });
+        const int n = cases.size();
+        const int m = std::min(n, per_stratum);
+        for(int j = 0; j < m; j++) {
+            corpus.push_back(*cases[m > 1 ? (long) j * (n - 1) / (m - 1) : n - 1]);
+        }
+        printf("%-32s %10d %10d\n", it->first.c_str(), n, m);
+    }
+
+    FILE* file = fopen(output, "w");
+    if(file == NULL) {
+        printf("Can not open output file: %s\n", output);
+        return EXIT_FAILURE;
+    }
+    write_corpus(file, corpus, digits);
+    fclose(file);
+    printf("Wrote %lu cases to %s\n", (unsigned long) corpus.size(), output);
+
+    return EXIT_SUCCESS;
+}
+
+
+int
+replay_case(bench_results_t& results,
+            const corpus_case_t& c,
+            const std::set<std::string>& engines,
+            const long target_prec,
+            const int repetitions) {
+    /* Time all engines on a case, returns the number of wrong results
+     */
+    fmpq_poly_t B, E, P, Ex;
+    fmpq_mat_t M, rhs, X;
+    const int p = c.levels.back();
+    const std::string prefix = "corpus/" + c.stratum + "/" + levels_string(c.levels, "-") + "/";
+    int wrong = 0;
+
+    fmpq_poly_init(B);
+    fmpq_poly_init(E);
+    fmpq_poly_init(P);
+    fmpq_poly_init(Ex);
+    if(fmpq_poly_set_str(B, c.basis.c_str()) || fmpq_poly_set_str(E, c.extension.c_str())) {
+        printf("Invalid polynomials for case %s\n", levels_string(c.levels, " ").c_str());
+        fmpq_poly_clear(B);
+        fmpq_poly_clear(E);
+        fmpq_poly_clear(P);
+        fmpq_poly_clear(Ex);
+        return 1;
+    }
+    fmpq_poly_mul(P, B, E);
+    const long deg = fmpq_poly_degree(P);
+
+    /* The exact engines solve the system for the extension */
+    fmpq_mat_init(M, p, p);
+    fmpq_mat_init(rhs, p, 1);
+    fmpq_mat_init(X, p, 1);
+    extension_system(M, rhs, B, p);
+
+    auto check = [&](const char* engine, int solvable) {
+        fmpq_poly_zero(Ex);
+        if(solvable) {
+            for(int i = 0; i < p; i++) {
+                fmpq_poly_set_coeff_fmpq(Ex, i, fmpq_mat_entry(X, i, 0));
+            }
+            fmpq_poly_set_coeff_si(Ex, p, 1);
+        }
+        if(solvable != c.solvable || !fmpq_poly_equal(Ex, E)) {
+            fprintf(bench_log, "Engine %s disagrees with the corpus on case %s\n", engine, levels_string(c.levels, " ").c_str());
+            wrong++;
+        }
+    };
+
+    if(engines.count("assembly")) {
+        results.push_back(run_benchmark(prefix + "assembly", [&]() { extension_system(M, rhs, B, p); }, repetitions));
+    }
+    if(engines.count("exact")) {
+        int solvable = 0;
+        results.push_back(run_benchmark(prefix + "exact",
+                                        [&]() { solvable = fmpq_mat_solve_fraction_free(X, M, rhs); }, repetitions));
+        check("exact", solvable);
+    }
+    if(engines.count("modular")) {
+        int solvable = 0;
+        results.push_back(run_benchmark(prefix + "modular",
+                                        [&]() { solvable = fmpq_mat_solve_multi_mod(X, M, rhs); }, repetitions));
+        check("modular", solvable);
+    }
+    if(engines.count("dixon")) {
+        int solvable = 0;
+        results.push_back(run_benchmark(prefix + "dixon",
+                                        [&]() { solvable = fmpq_mat_solve_dixon(X, M, rhs); }, repetitions));
+        check("dixon", solvable);
+    }
+
+    /* The numerical engines find the nodes of the rule */
+    if(c.solvable && deg > 0) {
+        acb_ptr roots = _acb_vec_init(deg);
+        if(engines.count("arb")) {
+            results.push_back(run_benchmark(prefix + "arb",
+                                            [&]() { poly_roots(roots, P, 53, target_prec, 0); }, repetitions));
+        }
+        if(engines.count("realroot")) {
+            fmpz_poly_t Z;
+            fmpz_poly_init(Z);
+            fmpq_poly_get_numerator(Z, P);
+            /* The certified solver requires a squarefree polynomial */
+            if(fmpz_poly_is_squarefree(Z)) {
+                results.push_back(run_benchmark(prefix + "realroot",
+                                                [&]() { arb_fmpz_poly_complex_roots(roots, Z, 0, target_prec); },
+                                                repetitions));
+            }
+            fmpz_poly_clear(Z);
+        }
+        _acb_vec_clear(roots, deg);
+    }
+
+    fmpq_mat_clear(M);
+    fmpq_mat_clear(rhs);
+    fmpq_mat_clear(X);
+    fmpq_poly_clear(B);
+    fmpq_poly_clear(E);
+    fmpq_poly_clear(P);
+    fmpq_poly_clear(Ex);
+    return wrong;
+}
+
+
+void
+print_summary(const bench_results_t& results) {
+    /* Sum of the medians per stratum and engine
+     */
+    std::map<std::string, std::map<std::string, double>> sums;
+    for(auto it = results.begin(); it != results.end(); it++) {
+        /* Names are corpus/stratum/levels/engine where the stratum contains one slash */
+        const std::string& name = it->name;
+        size_t last = name.rfind('/');
+        size_t levels = name.rfind('/', last - 1);
+        std::string stratum = name.substr(7, levels - 7);
+        sums[stratum][name.substr(last + 1)] += it->median;
+    }
+
+    fprintf(bench_log, "==================================================\n");
+    fprintf(bench_log, "%-24s", "stratum");
+    for(int e = 0; e < nengines; e++) {
+        fprintf(bench_log, " %12s", engine_names[e]);
+    }
+    fprintf(bench_log, "\n");
+    for(auto it = sums.begin(); it != sums.end(); it++) {
+        fprintf(bench_log, "%-24s", it->first.c_str());
+        for(int e = 0; e < nengines; e++) {
+            auto s = it->second.find(engine_names[e]);
+            if(s == it->second.end()) {
+                fprintf(bench_log, " %12s", "-");
+            } else {
+                fprintf(bench_log, " %12.4e", s->second);
+            }
+        }
+        fprintf(bench_log, "\n");
+    }
+    fprintf(bench_log, "==================================================\n");
+}
+
+
+int
+replay(const char* input,
+       const char* output,
+       const char* baseline_file,
+       const double tolerance,
+       const std::set<std::string>& engines,
+       int digits,
+       const int repetitions) {
+    /* Replay a corpus through the selected engines
+     */
+    corpus_t corpus;
+    int corpus_digits = 100;
+
+    FILE* file = strcmp(input, "-") ? fopen(input, "r") : stdin;
+    if(file == NULL) {
+        printf("Can not open corpus: %s\n", input);
+        return EXIT_FAILURE;
+    }
+    bool ok = read_corpus(corpus, corpus_digits, file);
+    if(file != stdin) {
+        fclose(file);
+    }
+    if(!ok) {
+        return EXIT_FAILURE;
+    }
+    digits = digits > 0 ? digits : corpus_digits;
+
+    /* 'digits' is in base 10 and log(10)/log(2) = 3.32193 */
+    const long target_prec = 3.32193 * digits;
+    bench_results_t results;
+    int wrong = 0;
+    if(output == NULL) {
+        bench_log = stderr;
+    }
+
+    for(auto it = corpus.begin(); it != corpus.end(); it++) {
+        wrong += replay_case(results, *it, engines, target_prec, repetitions);
+    }
+
+    if(output != NULL) {
+        FILE* file = fopen(output, "w");
+        if(file == NULL) {
+            printf("Can not open output file: %s\n", output);
+            return EXIT_FAILURE;
+        }
+        write_results(file, results, repetitions);
+        fclose(file);
+    } else {
+        write_results(stdout, results, repetitions);
+    }
+    print_summary(results);
+
+    if(wrong > 0) {
+        fprintf(bench_log, "Wrong results: %d\n", wrong);
+        return EXIT_FAILURE;
+    }
+
+    if(baseline_file != NULL) {
+        std::map<std::string, double> baseline;
+        if(!read_baseline(baseline, baseline_file)) {
+            printf("Can not read baseline file: %s\n", baseline_file);
+            return EXIT_FAILURE;
+        }
+        if(compare_results(results, baseline, tolerance) > 0) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+int main(int argc, char* argv[]) {
+
+    int repetitions = 5;
+    int per_stratum = 4;
+    int digits = 0;
+    double tolerance = 0.1;
+    const char* output = NULL;
+    const char* baseline_file = NULL;
+    const char* store = NULL;
+    std::set<std::string> engines(engine_names, engine_names + nengines);
+    std::vector<const char*> inputs;
+    int mode = 0;
+
+    if(argc > 1) {
+        mode = !strcmp(argv[1], "harvest") ? 1 : (!strcmp(argv[1], "replay") ? 2 : 0);
+    }
+
+    for(int i = 2; mode > 0 && i < argc; i++) {
+        if (!strcmp(argv[i], "-r")) {
+            repetitions = std::max(1, atoi(argv[i+1]));
+            i++;
+        } else if (!strcmp(argv[i], "-m")) {
+            per_stratum = std::max(1, atoi(argv[i+1]));
+            i++;
+        } else if (!strcmp(argv[i], "-dc")) {
+            digits = atoi(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-e")) {
+            engines.clear();
+            for(char *e = strtok(argv[i+1], ","); e != NULL; e = strtok(NULL, ",")) {
+                engines.insert(e);
+            }
+            i++;
+        } else if (!strcmp(argv[i], "-o")) {
+            output = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-c")) {
+            baseline_file = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-t")) {
+            tolerance = atof(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-st")) {
+            store = argv[i+1];
+            i++;
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
+
+    if(mode == 0 || inputs.empty() || (mode == 1 && output == NULL) || (mode == 2 && inputs.size() != 1)) {
+        printf("Harvest and replay a corpus of real extension problems\n");
+        printf("Syntax: kescorpus harvest [-m M] [-dc D] [-st S] -o C input ...\n");
+        printf("        kescorpus replay [-r R] [-e E] [-dc D] [-o F] [-c B [-t T]] C\n");
+        printf("Harvest:\n");
+        printf("        Collect candidates from rekes 'RULE:' lines (e.g. all_rules.dat), ekes maps\n");
+        printf("        and plain lines 'n p1 ... pk', stratify them by degree and precision needs\n");
+        printf("        and write the exact polynomials of the selected cases to the corpus C\n");
+        printf("        -m   Number of cases per stratum (default: 4)\n");
+        printf("        -dc  Target number of decimal digits for the precision needs (default: 100)\n");
+        printf("        -st  Use the exact polynomial store in directory S (default: $KES_STORE)\n");
+        printf("Replay:\n");
+        printf("        Time the engines on every case of the corpus C and check their results\n");
+        printf("        -r   Number of timed repetitions per engine (default: 5)\n");
+        printf("        -e   Comma separated engines (default: assembly,exact,modular,dixon,arb,realroot)\n");
+        printf("        -dc  Target number of decimal digits of the nodes (default: from the corpus)\n");
+        printf("        -o   Write the results as JSON to file F\n");
+        printf("        -c   Compare the medians against the baseline results in file B\n");
+        printf("        -t   Relative slowdown T counted as regression (default: 0.1)\n");
+        return EXIT_FAILURE;
+    }
+
+    exact_store_open(store);
+
+    if(mode == 1) {
+        return harvest(inputs, output, per_stratum, digits > 0 ? digits : 100);
+    }
+    return replay(inputs[0], output, baseline_file, tolerance, engines, digits, repetitions);
+}
@@ -0,0 +1,569 @@
+/*  Author: R. Bourquin
+    Copyright: (C) 2014 R. Bourquin
+    License: GNU GPL v2 or above
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "libkes.h"
+#include "output.h"
+#include "ruleserver.h"
+
+
+#define SERVER_MAXLEVELS 64
+
+#define SERVED_PENDING 0
+#define SERVED_READY 1
+#define SERVED_FAILED 2
+
+
+/* A rule held resident by the server */
+typedef struct served_rule {
+    char key[RULE_SERVER_MAXLINE];
+    int state;
+    int users;
+    char name[2][64];
+    long size[2];
+    char error[256];
+    struct served_rule *next;
+} served_rule;
+
+
+pthread_mutex_t served_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t served_cond = PTHREAD_COND_INITIALIZER;
+served_rule *served = NULL;
+int server_loglevel = 0;
+volatile sig_atomic_t server_stop = 0;
+
+
+int create_segment(char *name,
+                   const char *key,
+                   const int format,
+                   const char *data,
+                   const long size,
+                   const long len,
+                   const long prec) {
+    /* Create a shared memory segment holding a rule. The segment
+     * is read-only for everyone but stays writable through the
+     * creating descriptor, which is closed right away.
+     *
+     * name: Buffer of size 64 receiving the segment name
+     * key: The key of the rule
+     * format: The format of the data
+     * data: The rule data
+     * size: Size of the data in bytes
+     * len: Number of nodes
+     * prec: Number of bits the rule is accurate to
+     */
+    rule_segment_header header;
+    unsigned long long h;
+    const char *c;
+    char *segment;
+    long total;
+    int fd;
+
+    h = 14695981039346656037ULL;
+    for(c = key; *c; c++) {
+        h ^= (unsigned char) *c;
+        h *= 1099511628211ULL;
+    }
+    snprintf(name, 64, "/kesd.%ld.%016llx.%s", (long) getpid(), h, rule_format_name(format));
+
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, RULE_SEGMENT_MAGIC);
+    header.format = format;
+    header.len = len;
+    header.prec = prec;
+    header.size = size;
+    total = sizeof(header) + size;
+
+    shm_unlink(name);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0444);
+    if(fd < 0) {
+        return 0;
+    }
+    if(ftruncate(fd, total) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return 0;
+    }
+    segment = (char *) mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(segment == MAP_FAILED) {
+        shm_unlink(name);
+        return 0;
+    }
+    memcpy(segment, &header, sizeof(header));
+    memcpy(segment + sizeof(header), data, size);
+    munmap(segment, total);
+    return 1;
+}
+
+
+int compute_rule(served_rule *rule,
+                 const int levels[],
+                 const int k,
+                 const long prec) {
+    /* Compute the nodes and weights of a rule and publish them
+     * in both formats as shared memory segments. Returns the new
+     * state of the rule, which the caller sets under the lock.
+     *
+     * rule: The rule to fill in
+     * levels: The level sequence n, p_1, ..., p_k
+     * k: Length of the level sequence
+     * prec: Number of bits in target precision
+     */
+    fmpq_poly_t Pn, Ep;
+    acb_ptr nodes, weights;
+    char key[RULE_CACHE_MAXKEY];
+    long deg, cached_prec, i;
+    int cached, state;
+    double *values;
+    outbuf_t buf;
+    char *strf;
+    arb_srcptr x;
+
+    fmpq_poly_init(Pn);
+    fmpq_poly_init(Ep);
+    polynomial(Pn, levels[0]);
+
+    if(!find_multi_extension(Ep, NULL, Pn, k, levels, 0, server_loglevel)) {
+        strcpy(rule->error, "extension not solvable");
+        fmpq_poly_clear(Pn);
+        fmpq_poly_clear(Ep);
+        return SERVED_FAILED;
+    }
+    fmpq_poly_mul(Pn, Pn, Ep);
+    fmpq_poly_canonicalise(Pn);
+
+    deg = fmpq_poly_degree(Pn);
+    nodes = _acb_vec_init(deg);
+    weights = _acb_vec_init(deg);
+
+    rule_cache_key(key, "kes", levels, k);
+    cached = rule_cache_lookup(nodes, weights, &cached_prec, key, deg, prec);
+    if(cached != RULE_CACHE_HIT) {
+        compute_nodes_and_weights_seeded(nodes, weights, Pn, cached == RULE_CACHE_SEED ? cached_prec : 0,
+                                         prec, server_loglevel);
+        rule_cache_insert(nodes, weights, key, deg, prec);
+    }
+
+    /* Nodes first, then weights, real and imaginary parts alternating */
+    values = (double *) malloc(4 * deg * sizeof(double));
+    outbuf_init(buf);
+    for(i = 0; i < 4 * deg; i++) {
+        if(i < 2 * deg) {
+            x = i % 2 == 0 ? acb_realref(nodes + i/2) : acb_imagref(nodes + i/2);
+        } else {
+            x = i % 2 == 0 ? acb_realref(weights + i/2 - deg) : acb_imagref(weights + i/2 - deg);
+        }
+        values[i] = arf_get_d(arb_midref(x), ARF_RND_NEAR);
+        strf = arb_dump_str(x);
+        outbuf_puts(buf, strf);
+        outbuf_puts(buf, "\n");
+        flint_free(strf);
+    }
+
+    state = SERVED_READY;
+    rule->size[RULE_FORMAT_DOUBLE] = sizeof(rule_segment_header) + 4 * deg * sizeof(double);
+    rule->size[RULE_FORMAT_ARB] = sizeof(rule_segment_header) + buf->len;
+    if(!create_segment(rule->name[RULE_FORMAT_DOUBLE], rule->key, RULE_FORMAT_DOUBLE,
+                       (const char *) values, 4 * deg * sizeof(double), deg, prec)
+       || !create_segment(rule->name[RULE_FORMAT_ARB], rule->key, RULE_FORMAT_ARB,
+                          buf->data, buf->len, deg, prec)) {
+        state = SERVED_FAILED;
+        strcpy(rule->error, "can not create shared memory segment");
+        /* The failed rule is dropped, so is a segment already created */
+        shm_unlink(rule->name[RULE_FORMAT_DOUBLE]);
+    }
+
+    free(values);
+    outbuf_clear(buf);
+    _acb_vec_clear(nodes, deg);
+    _acb_vec_clear(weights, deg);
+    fmpq_poly_clear(Pn);
+    fmpq_poly_clear(Ep);
+    return state;
+}
+
+
+void serve_request(char *reply,
+                   char *line) {
+    /* Answer a single request line. Identical requests in flight
+     * are coalesced, later requests wait for the first one. A failed
+     * rule is dropped once all waiting requests are answered, hence
+     * the next request computes it again.
+     *
+     * reply: Buffer of size RULE_SERVER_MAXLINE receiving the reply
+     * line: The request line
+     */
+    char *token, *saveptr;
+    char family[64];
+    char key[RULE_SERVER_MAXLINE];
+    int levels[SERVER_MAXLEVELS];
+    int i, k, len, format, state;
+    long prec;
+    served_rule *rule, **prev;
+
+    token = strtok_r(line, " \t", &saveptr);
+    if(token == NULL || strcmp(token, "RULE")) {
+        strcpy(reply, "ERR unknown request\n");
+        return;
+    }
+    token = strtok_r(NULL, " \t", &saveptr);
+    if(token == NULL || strcmp(token, family_name())) {
+        snprintf(reply, RULE_SERVER_MAXLINE, "ERR this server serves the %s family\n", family_name());
+        return;
+    }
+    snprintf(family, sizeof(family), "%s", token);
+    token = strtok_r(NULL, " \t", &saveptr);
+    prec = token != NULL ? atol(token) : 0;
+    if(prec <= 0) {
+        strcpy(reply, "ERR invalid precision\n");
+        return;
+    }
+    token = strtok_r(NULL, " \t", &saveptr);
+    format = token != NULL ? rule_format_parse(token) : -1;
+    if(format < 0) {
+        strcpy(reply, "ERR unknown format\n");
+        return;
+    }
+    k = 0;
+    while((token = strtok_r(NULL, " \t", &saveptr)) != NULL && k < SERVER_MAXLEVELS) {
+        levels[k] = atoi(token);
+        if(levels[k] <= 0) {
+            strcpy(reply, "ERR invalid level sequence\n");
+            return;
+        }
+        k++;
+    }
+    if(k == 0 || token != NULL) {
+        strcpy(reply, "ERR invalid level sequence\n");
+        return;
+    }
+
+    /* Key 'family:prec:levels', both formats are served from one computation */
+    len = snprintf(key, sizeof(key), "%s:%ld:", family, prec);
+    for(i = 0; i < k; i++) {
+        len += snprintf(key + len, sizeof(key) - len, i > 0 ? ",%d" : "%d", levels[i]);
+    }
+
+    pthread_mutex_lock(&served_lock);
+    for(rule = served; rule != NULL && strcmp(rule->key, key); rule = rule->next);
+
+    if(rule == NULL) {
+        rule = (served_rule *) calloc(1, sizeof(served_rule));
+        strcpy(rule->key, key);
+        rule->state = SERVED_PENDING;
+        rule->users = 1;
+        rule->next = served;
+        served = rule;
+        pthread_mutex_unlock(&served_lock);
+
+        logit(SERVER, 1, server_loglevel, "Computing rule %s\n", key);
+        state = compute_rule(rule, levels, k, prec);
+
+        pthread_mutex_lock(&served_lock);
+        rule->state = state;
+        if(state == SERVED_FAILED) {
+            /* Later requests do not find it any more */
+            for(prev = &served; *prev != rule; prev = &(*prev)->next);
+            *prev = rule->next;
+        }
+        pthread_cond_broadcast(&served_cond);
+    } else {
+        rule->users++;
+        while(rule->state == SERVED_PENDING) {
+            pthread_cond_wait(&served_cond, &served_lock);
+        }
+    }
+
+    if(rule->state == SERVED_READY) {
+        snprintf(reply, RULE_SERVER_MAXLINE, "OK %s %ld\n", rule->name[format], rule->size[format]);
+    } else {
+        snprintf(reply, RULE_SERVER_MAXLINE, "ERR %s\n", rule->error);
+    }
+    rule->users--;
+    if(rule->state == SERVED_FAILED && rule->users == 0) {
+        free(rule);
+    }
+    pthread_mutex_unlock(&served_lock);
+}
+
+
+void * serve_client(void *arg) {
+    /* Serve all requests of a connected client
+     *
+     * arg: Pointer to the socket of the client
+     */
+    char line[RULE_SERVER_MAXLINE];
+    char reply[RULE_SERVER_MAXLINE];
+    int fd;
+
+    fd = *(int *) arg;
+    free(arg);
+
+    while(read_line(fd, line, sizeof(line)) >= 0) {
+        serve_request(reply, line);
+        if(write(fd, reply, strlen(reply)) < 0) {
+            break;
+        }
+    }
+
+    close(fd);
+    flint_cleanup();
+    return NULL;
+}
+
+
+void stop_server(int signum) {
+    server_stop = 1;
+}
+
+
+int run_server(const char *path) {
+    /* Listen on a Unix domain socket and serve clients,
+     * one thread per connection, until interrupted.
+     *
+     * path: The path of the socket
+     */
+    struct sockaddr_un addr;
+    struct sigaction action;
+    pthread_t thread;
+    int fd, client;
+    int *arg;
+    served_rule *rule;
+
+    if(strlen(path) >= sizeof(addr.sun_path)) {
+        printf("Socket path too long: %s\n", path);
+        return EXIT_FAILURE;
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_server;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if(fd < 0 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+        printf("Can not listen on socket: %s\n", path);
+        return EXIT_FAILURE;
+    }
+    printf("Serving %s rules on: %s\n", family_name(), path);
+    fflush(stdout);
+
+    while(!server_stop) {
+        client = accept(fd, NULL, NULL);
+        if(client < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        arg = (int *) malloc(sizeof(int));
+        *arg = client;
+        if(pthread_create(&thread, NULL, serve_client, arg) != 0) {
+            close(client);
+            free(arg);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    /* Remove all segments, clients keep their existing mappings */
+    close(fd);
+    unlink(path);
+    pthread_mutex_lock(&served_lock);
+    for(rule = served; rule != NULL; rule = rule->next) {
+        if(rule->state == SERVED_READY) {
+            shm_unlink(rule->name[RULE_FORMAT_DOUBLE]);
+            shm_unlink(rule->name[RULE_FORMAT_ARB]);
+        }
+    }
+    pthread_mutex_unlock(&served_lock);
+    printf("Server stopped\n");
+    return EXIT_SUCCESS;
+}
+
+
+int run_client(const char *path,
+               const int levels[],
+               const int k,
+               const long prec,
+               const int format,
+               const int nrprintdigits) {
+    /* Request a rule from a running server and print it
+     *
+     * path: The path of the socket
+     * levels: The level sequence n, p_1, ..., p_k
+     * k: Length of the level sequence
+     * prec: Number of bits in target precision
+     * format: The format of the rule data
+     * nrprintdigits: Number of decimal digits to print
+     */
+    char error[RULE_SERVER_MAXLINE];
+    rule_segment_t segment;
+    const double *values;
+    const char *c;
+    char *line;
+    acb_ptr nodes, weights;
+    arb_ptr x;
+    long len, i, n;
+    int fd;
+
+    fd = rule_server_connect(path);
+    if(fd < 0) {
+        printf("Can not connect to server: %s\n", path);
+        return EXIT_FAILURE;
+    }
+    if(!rule_server_request(&segment, error, fd, family_name(), levels, k, prec, format)) {
+        printf("Request failed: %s\n", error);
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    close(fd);
+
+    len = segment.header->len;
+    printf("Rule with %ld nodes accurate to %ld bits\n", len, segment.header->prec);
+
+    if(format == RULE_FORMAT_DOUBLE) {
+        values = (const double *) segment.data;
+        printf("-------------------------------------------------\n");
+        printf("The nodes are:\n");
+        for(i = 0; i < len; i++) {
+            printf("| %.17g + %.17gj\n", values[2*i], values[2*i + 1]);
+        }
+        printf("-------------------------------------------------\n");
+        printf("The weights are:\n");
+        for(i = 0; i < len; i++) {
+            printf("| %.17g + %.17gj\n", values[2*len + 2*i], values[2*len + 2*i + 1]);
+        }
+    } else {
+        nodes = _acb_vec_init(len);
+        weights = _acb_vec_init(len);
+        line = (char *) malloc(segment.header->size + 1);
+        c = segment.data;
+        for(i = 0; i < 4 * len; i++) {
+            if(i < 2 * len) {
+                x = i % 2 == 0 ? acb_realref(nodes + i/2) : acb_imagref(nodes + i/2);
+            } else {
+                x = i % 2 == 0 ? acb_realref(weights + i/2 - len) : acb_imagref(weights + i/2 - len);
+            }
+            for(n = 0; c[n] != '\n'; n++);
+            memcpy(line, c, n);
+            line[n] = '\0';
+            arb_load_str(x, line);
+            c += n + 1;
+        }
+        printf("-------------------------------------------------\n");
+        printf("The nodes are:\n");
+        print_acb_vec(stdout, nodes, len, "| ", "\n", nrprintdigits);
+        printf("-------------------------------------------------\n");
+        printf("The weights are:\n");
+        print_acb_vec(stdout, weights, len, "| ", "\n", nrprintdigits);
+        free(line);
+        _acb_vec_clear(nodes, len);
+        _acb_vec_clear(weights, len);
+    }
+
+    rule_segment_release(&segment);
+    return EXIT_SUCCESS;
+}
+
+
+int main(int argc, char* argv[]) {
+    int i, k;
+    int levels[argc];
+    char *server;
+    char *client;
+    char *store;
+    char *cache;
+    int format;
+    long target_prec;
+    int nrprintdigits;
+
+    if(argc <= 1) {
+        printf("Serve quadrature rules to local processes over a Unix domain socket\n");
+        printf("Syntax: kesd -s S [-st S] [-rc C] [-l L] [-la]\n");
+        printf("        kesd -c S [-dc D] [-dp D] [-f F] n p1 p2 ... pk\n");
+        printf("Options:\n");
+        printf("        -s   Run the server listening on socket S\n");
+        printf("        -st  Use the exact polynomial store in directory S (default: $KES_STORE)\n");
+        printf("        -rc  Use the numeric rule cache in directory C (default: $KES_RULECACHE)\n");
+        printf("        -l   Set the log level of the server\n");
+        printf("        -la  Log asynchronously through per-thread buffers\n");
+        printf("        -c   Request a rule from the server on socket S and print it\n");
+        printf("        -dc  Request nodes and weights up to this number of decimal digits\n");
+        printf("        -dp  Print this number of decimal digits\n");
+        printf("        -f   Format F of the rule: double or arb\n");
+        return EXIT_FAILURE;
+    }
+
+    server = NULL;
+    client = NULL;
+    store = NULL;
+    cache = NULL;
+    format = RULE_FORMAT_DOUBLE;
+    target_prec = 53;
+    nrprintdigits = 20;
+
+    k = 0;
+    for(i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-s")) {
+            server = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-c")) {
+            client = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-st")) {
+            store = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-rc")) {
+            cache = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-la")) {
+            log_async_enable();
+        } else if (!strcmp(argv[i], "-l")) {
+            server_loglevel = atoi(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-dc")) {
+            /* 'digits' is in base 10 and log(10)/log(2) = 3.32193 */
+            target_prec = 3.32193 * atoi(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-dp")) {
+            nrprintdigits = atoi(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-f")) {
+            format = rule_format_parse(argv[i+1]);
+            if(format < 0) {
+                printf("Unknown format: %s\n", argv[i+1]);
+                return EXIT_FAILURE;
+            }
+            i++;
+        } else {
+            levels[k] = atoi(argv[i]);
+            k++;
+        }
+    }
+
+    if(server != NULL) {
+        exact_store_open(store);
+        rule_cache_open(cache);
+        return run_server(server);
+    } else if(client != NULL && k > 0) {
+        return run_client(client, levels, k, target_prec, format, nrprintdigits);
+    }
+
+    printf("Either -s or -c with a level sequence is required\n");
+    return EXIT_FAILURE;
+}
@@ -22,64 +22,101 @@
 #include "helpers.h"
 #include "numerics.h"
 #include "switch.h"
+#include "prune.h"
+#include "store.h"
+#include "rulecache.h"
+#include "ruleindex.h"
+#include "stages.h"
+#include "multidouble.h"
 
 
 #define NCHECKDIGITS 53
 
 
+/* Outcome of a candidate, ordered such that every validation
+ * level is a threshold: solvable is >= CLASS_COMPLEX, valid
+ * nodes is >= CLASS_NEGATIVE and valid nodes and weights is
+ * >= CLASS_INDEFINITE, like 'validate_rule'.
+ */
+typedef enum {
+    CLASS_UNSOLVABLE,
+    CLASS_COMPLEX,
+    CLASS_OUTSIDE,
+    CLASS_NEGATIVE,
+    CLASS_INDEFINITE,
+    CLASS_VALID,
+    NCLASSES
+} class_t;
+
+const char *class_names[NCLASSES] = {
+    "unsolvable",
+    "complex",
+    "outside",
+    "negative",
+    "indefinite",
+    "valid"
+};
+
+typedef struct {
+    class_t cls;
+    long deg;
+    long real_nodes;
+    long domain_nodes;
+    long positive_weights;
+    long negative_weights;
+    long indefinite_weights;
+    /* Extrema of the midpoints, NAN if unsolvable */
+    double node_min;
+    double node_max;
+    double imag_max;
+    double weight_min;
+    double weight_max;
+} classification_t;
+
+
+void extension_system(fmpq_mat_t, fmpq_mat_t, const fmpq_poly_t, const int);
 int find_extension(fmpq_poly_t, const fmpq_poly_t, const int, const int);
-int find_multi_extension(fmpq_poly_t, const fmpq_poly_t, const int, const int[], const int, const int);
+int find_extension_stored(fmpq_poly_t, const fmpq_poly_t, const int[], const int, const int);
+int find_multi_extension(fmpq_poly_t, fmpq_poly_struct *, const fmpq_poly_t, const int, const int[], const int, const int);
 
-void recursiv_enumerate(const fmpq_poly_t, const int, const int, const int, fmpz_mat_t, const int, const int);
+void recursive_enumerate(const fmpq_poly_t, const int, const int, const int, fmpz_mat_t, const int, const int, const int);
 
 inline void compute_nodes(acb_ptr, const fmpq_poly_t, const long, const int);
 void compute_nodes_and_weights(acb_ptr, acb_ptr, const fmpq_poly_t, const long, const int);
+void compute_nodes_and_weights_seeded(acb_ptr, acb_ptr, const fmpq_poly_t, const long, const long, const int);
 
 int validate_rule(long*, long*, const fmpq_poly_t, const long, const int);
 int validate_extension_by_poly(long*, const fmpq_poly_t, const long, const int);
 int validate_extension_by_roots(const acb_ptr, const long, const long, const int);
 int validate_extension_by_weights(const acb_ptr, const long, const long, const int);
+void classify_rule(classification_t *, const int, const fmpq_poly_t, const long, const int);
+void print_classification(const classification_t *);
 
 
-int find_extension(fmpq_poly_t Ep,
-                   const fmpq_poly_t Pn,
-                   const int p,
-                   const int loglevel) {
-    /* Extend the degree n polynomial Pn by one Kronrod extension Ep of degree p.
-     *
-     * We search for a monic polynomial E_p(x) such that
-     * \int_\Omega P_n(t) E_p(t) t^i \rho(t) dt = 0   for all   i = 0, ..., p-1.
-     * To obtain the coefficients  a_0, ..., a_{p-1}  of E_p(t) we try to solve
-     * a  p \times p  linear system. If successful then the extension E_p exists.
-     *
-     * If the extension exists, the we return only the defining polynomial E_p
-     * and otherwise the zero polynomial.
-     *
-     * Note that the extension E_p is only valid if E_p has p real roots
-     * inside the domain \Omega and if further all weights are positive.
-     * These conditions are however not checked within this function.
+void extension_system(fmpq_mat_t M,
+                      fmpq_mat_t rhs,
+                      const fmpq_poly_t Pn,
+                      const int p) {
+    /* Build the  p \times p  linear system for the coefficients of the
+     * extension E_p of Pn, see 'find_extension'.
      *
-     * Ep: The polynomial defining the extension
+     * M: The system matrix, initialised with p rows and p columns
+     * rhs: The right hand side, initialised with p rows and 1 column
      * Pn: The polynomial defining the basis
      * p: The degree of the extension
-     * loglevel: The log verbosity
      */
     slong n;
     slong rows;
     slong cols;
-    fmpq_mat_t M, rhs, X;
     int i, k, j;
     slong deg;
     fmpq_t coeff, integral, element;
-    int solvable;
 
     fmpq_init(coeff);
     fmpq_init(integral);
     fmpq_init(element);
     rows = p;
     cols = p;
-    fmpq_mat_init(M, rows, cols);
-    fmpq_mat_init(rhs, rows, 1);
     fmpq_mat_zero(M);
     fmpq_mat_zero(rhs);
 
@@ -114,12 +151,59 @@ int find_extension(fmpq_poly_t Ep,
     }
     fmpq_mat_neg(rhs, rhs);
 
+    fmpq_clear(coeff);
+    fmpq_clear(integral);
+    fmpq_clear(element);
+}
+
+
+int find_extension(fmpq_poly_t Ep,
+                   const fmpq_poly_t Pn,
+                   const int p,
+                   const int loglevel) {
+    /* Extend the degree n polynomial Pn by one Kronrod extension Ep of degree p.
+     *
+     * We search for a monic polynomial E_p(x) such that
+     * \int_\Omega P_n(t) E_p(t) t^i \rho(t) dt = 0   for all   i = 0, ..., p-1.
+     * To obtain the coefficients  a_0, ..., a_{p-1}  of E_p(t) we try to solve
+     * a  p \times p  linear system. If successful then the extension E_p exists.
+     *
+     * If the extension exists, the we return only the defining polynomial E_p
+     * and otherwise the zero polynomial.
+     *
+     * Note that the extension E_p is only valid if E_p has p real roots
+     * inside the domain \Omega and if further all weights are positive.
+     * These conditions are however not checked within this function.
+     *
+     * Ep: The polynomial defining the extension
+     * Pn: The polynomial defining the basis
+     * p: The degree of the extension
+     * loglevel: The log verbosity
+     */
+    slong rows;
+    fmpq_mat_t M, rhs, X;
+    int i;
+    int solvable;
+    double start;
+
+    start = stage_begin();
+    rows = p;
+    fmpq_mat_init(M, rows, rows);
+    fmpq_mat_init(rhs, rows, 1);
+    extension_system(M, rhs, Pn, p);
+    stage_end(STAGE_ASSEMBLY, start);
+
     /* Try to solve the linear system */
+    start = stage_begin();
     fmpq_mat_init(X, rows, 1);
     fmpq_mat_zero(X);
     solvable = fmpq_mat_solve_fraction_free(X, M, rhs);
+    stage_end(STAGE_SOLVE, start);
+    telemetry_basis(Pn);
+    telemetry_system(M, X);
+    stats_count(solvable ? COUNT_SOLVABLE : COUNT_UNSOLVABLE, 1);
 
-    logit(1, loglevel, "Solvable: %i\n", solvable);
+    logit(SEARCH, 1, loglevel, "Solvable: %i\n", solvable);
 
     /* Assemble the polynomial */
     fmpq_poly_zero(Ep);
@@ -132,9 +216,6 @@ int find_extension(fmpq_poly_t Ep,
     fmpq_poly_canonicalise(Ep);
 
     /* Clean up */
-    fmpq_clear(coeff);
-    fmpq_clear(integral);
-    fmpq_clear(element);
     fmpq_mat_clear(M);
     fmpq_mat_clear(rhs);
     fmpq_mat_clear(X);
@@ -142,7 +223,47 @@ int find_extension(fmpq_poly_t Ep,
 }
 
 
+int find_extension_stored(fmpq_poly_t Ep,
+                          const fmpq_poly_t Pn,
+                          const int levels[],
+                          const int k,
+                          const int loglevel) {
+    /* Extend the polynomial Pn by one Kronrod extension Ep of degree levels[k-1]
+     * where Pn is the tower built from the level sequence levels[0], ..., levels[k-2].
+     *
+     * The persistent store is consulted first, and results computed by
+     * 'find_extension' are inserted afterwards. Without an open store
+     * this is the same as 'find_extension'.
+     *
+     * Ep: The polynomial defining the extension
+     * Pn: The polynomial defining the basis
+     * levels: The level sequence n, p_1, ..., p
+     * k: Length of the level sequence
+     * loglevel: The log verbosity
+     */
+    int solvable, found;
+    double start;
+
+    start = stage_begin();
+    found = exact_store_lookup(Ep, &solvable, levels, k);
+    stage_end(STAGE_STORE, start);
+
+    if(found) {
+        stats_count(COUNT_STORE_HITS, 1);
+        telemetry_stored();
+        logit(CACHE, 1, loglevel, "Solvable: %i (from store)\n", solvable);
+        return solvable;
+    }
+
+    solvable = find_extension(Ep, Pn, levels[k-1], loglevel);
+    exact_store_insert(Ep, solvable, levels, k);
+
+    return solvable;
+}
+
+
 int find_multi_extension(fmpq_poly_t E,
+                         fmpq_poly_struct *factors,
                          const fmpq_poly_t Pn,
                          const int k,
                          const int levels[],
@@ -155,6 +276,7 @@ int find_multi_extension(fmpq_poly_t E,
      * the extension exists and the zero polynomial otherwise.
      *
      * E: The polynomial defining the extension tower
+     * factors: Optional array of k-1 polynomials receiving E_1, ..., E_{k-1}, may be NULL
      * Pn: The polynomial defining the basis
      * k: The number of nested extensions in the tower
      * levels: An array with the extension levels p_0, ..., p_{k-1}
@@ -165,27 +287,29 @@ int find_multi_extension(fmpq_poly_t E,
     int solvable, valid;
     fmpq_poly_t Pt, Et;
     long nrroots;
-    char *strf;
     int success;
+    double start;
 
     fmpq_poly_init(Pt);
     fmpq_poly_set(Pt, Pn);
     fmpq_poly_init(Et);
     fmpq_poly_one(Et);
     fmpq_poly_one(E);
-    strf = fmpq_poly_get_str_pretty(Pn, "t");
 
     success = 1;
 
     for(i = 1; i < k; i++) {
-        logit(1, loglevel, "-------------------------------------------------\n");
-        logit(1, loglevel, "Trying to find an order %i Kronrod extension for:\n", levels[i]);
-        if(loglevel >= 2) {
-            strf = fmpq_poly_get_str_pretty(Pt, "t");
-            flint_printf("P%i : %s\n", i, strf);
+        logit(SEARCH, 1, loglevel, "-------------------------------------------------\n");
+        logit(SEARCH, 1, loglevel, "Trying to find an order %i Kronrod extension for:\n", levels[i]);
+        logit_poly(SEARCH, 2, loglevel, Pt, "P%i : %s\n", i);
+
+        start = candidate_begin(levels[0], levels[i], i);
+        solvable = find_extension_stored(Et, Pt, levels, i+1, loglevel);
+        valid = solvable;
+        if(solvable && validate_extension) {
+            valid = validate_extension_by_poly(&nrroots, Et, NCHECKDIGITS, loglevel);
         }
-
-        solvable = find_extension(Et, Pt, levels[i], loglevel);
+        candidate_end(start, solvable, valid);
 
         if(!solvable) {
             success = 0;
@@ -196,17 +320,17 @@ int find_multi_extension(fmpq_poly_t E,
             break;
         }
 
-        if(validate_extension) {
-            valid = validate_extension_by_poly(&nrroots, Et, NCHECKDIGITS, loglevel);
+        if(!valid) {
+            success = 0;
+            fmpq_poly_zero(Et);
+            printf("************************************\n");
+            printf("*** EXTENSION WITH INVALID NODES ***\n");
+            printf("************************************\n");
+            break;
+        }
 
-            if(!valid) {
-                success = 0;
-                fmpq_poly_zero(Et);
-                printf("************************************\n");
-                printf("*** EXTENSION WITH INVALID NODES ***\n");
-                printf("************************************\n");
-                break;
-            }
+        if(factors != NULL) {
+            fmpq_poly_set(factors + i - 1, Et);
         }
 
         /* Iterate */
@@ -217,7 +341,6 @@ int find_multi_extension(fmpq_poly_t E,
 
     fmpq_poly_canonicalise(E);
 
-    flint_free(strf);
     fmpq_poly_clear(Pt);
     fmpq_poly_clear(Et);
     return success;
@@ -230,8 +353,11 @@ void recursive_enumerate(const fmpq_poly_t Pn,
                          const int maxrec,
                          fmpz_mat_t table,
                          const int validate_weights,
+                         const int classify,
                          const int loglevel) {
-    /* Recursively enumerate quadrature rules
+    /* Recursively enumerate quadrature rules. With 'classify' every
+     * candidate is classified in one pass and a 'CLASS:' line is
+     * printed, the search follows the valid ones as before.
      */
     long n;
     int p;
@@ -239,21 +365,49 @@ void recursive_enumerate(const fmpq_poly_t Pn,
     long nrroots, nrweights;
     fmpq_poly_t Pnp1, En;
     int j;
+    int *levels;
+    double start;
+    classification_t c;
 
-    ps(1, loglevel, rec);
-    logit(1, loglevel, "Trying to find extension of (on layer %i):\n", rec);
+    logit_indent(SEARCH, 1, loglevel, rec, "Trying to find extension of (on layer %i):\n", rec);
 
     fmpq_poly_init(Pnp1);
     fmpq_poly_init(En);
 
     n = fmpq_poly_degree(Pn);
 
+    /* The level sequence leading to Pn */
+    levels = (int *) malloc((rec + 2) * sizeof(int));
+    for(j = 0; j <= rec; j++) {
+        levels[j] = fmpz_get_si(fmpz_mat_entry(table, j, 0));
+    }
+
     /* Loop over possible (non-recursive) extensions */
     for(p = 1; p <= maxp; p++) {
+        levels[rec+1] = p;
+        if(prune_skip(levels, rec+2)) {
+            logit_indent(SEARCH, 1, loglevel, rec, "Skipping extension for n: %ld and p: %i (on layer %i)\n", n, p, rec);
+            continue;
+        }
+        start = candidate_begin(levels[0], p, rec);
 
-        solvable = find_extension(En, Pn, p, loglevel);
+        solvable = find_extension_stored(En, Pn, levels, rec+2, loglevel);
 
-        if(validate_weights) {
+        if(classify) {
+            /* Classify nodes and weights of the whole rule at once */
+            if(solvable) {
+                fmpq_poly_mul(Pnp1, Pn, En);
+            }
+            classify_rule(&c, solvable, Pnp1, NCHECKDIGITS, loglevel);
+            valid = c.cls >= (validate_weights ? CLASS_INDEFINITE : CLASS_NEGATIVE);
+            printf("CLASS: %i  ", rec+1);
+            for(j = 0; j <= rec+1; j++) {
+                printf("%i ", levels[j]);
+            }
+            printf(" ");
+            print_classification(&c);
+            printf("\n");
+        } else if(validate_weights) {
             /* Validate nodes and weights */
             fmpq_poly_mul(Pnp1, Pn, En);
             valid = validate_rule(&nrroots, &nrweights, Pnp1, NCHECKDIGITS, loglevel);
@@ -261,10 +415,10 @@ void recursive_enumerate(const fmpq_poly_t Pn,
             /* Validate only nodes */
             valid = validate_extension_by_poly(&nrroots, En, NCHECKDIGITS, loglevel);
         }
+        candidate_end(start, solvable, solvable && valid);
 
         if(solvable && valid) {
-            ps(1, loglevel, rec);
-            logit(1, loglevel, "Found valid extension for n: %ld and p: %i (on layer %i)\n", n, p, rec);
+            logit_indent(SEARCH, 1, loglevel, rec, "Found valid extension for n: %ld and p: %i (on layer %i)\n", n, p, rec);
 
             fmpz_set_ui(fmpz_mat_entry(table, rec+1, 0), p);
 
@@ -274,31 +428,28 @@ void recursive_enumerate(const fmpq_poly_t Pn,
                 printf(" ");
             }
             printf("\n");
+            ruleindex_record(levels, rec+2);
 
             /* Follow the recursion down */
             if(rec+1 < maxrec) {
-                ps(1, loglevel, rec);
-                logit(1, loglevel, "==> Going down, new layer: %i\n", rec+1);
+                logit_indent(SEARCH, 1, loglevel, rec, "==> Going down, new layer: %i\n", rec+1);
                 fmpq_poly_mul(Pnp1, Pn, En);
-                recursive_enumerate(Pnp1, maxp, rec+1, maxrec, table, validate_weights, loglevel);
+                recursive_enumerate(Pnp1, maxp, rec+1, maxrec, table, validate_weights, classify, loglevel);
             } else {
-                ps(1, loglevel, rec);
-                logit(1, loglevel, "##> Maximum recursion depth reached, not descending\n");
+                logit_indent(SEARCH, 1, loglevel, rec, "##> Maximum recursion depth reached, not descending\n");
             }
 
         } else {
-            ps(1, loglevel, rec);
-            logit(1, loglevel, "No valid extension for n: %ld and p: %i found (on layer %i)\n", n, p, rec);
+            logit_indent(SEARCH, 1, loglevel, rec, "No valid extension for n: %ld and p: %i found (on layer %i)\n", n, p, rec);
         }
     }
-    ps(1, loglevel, rec);
-    logit(1, loglevel, "Maximal extension order p: %i reached\n", maxp);
+    logit_indent(SEARCH, 1, loglevel, rec, "Maximal extension order p: %i reached\n", maxp);
 
-    ps(1, loglevel, rec);
-    logit(1, loglevel, "==> Going up, leaving layer: %i\n", rec);
+    logit_indent(SEARCH, 1, loglevel, rec, "==> Going up, leaving layer: %i\n", rec);
 
     fmpz_set_ui(fmpz_mat_entry(table, rec+1, 0), 0);
 
+    free(levels);
     fmpq_poly_clear(Pnp1);
     fmpq_poly_clear(En);
     return;
@@ -315,8 +466,8 @@ inline void compute_nodes(acb_ptr nodes,
      * prec: Number of bits in target precision
      * loglevel: The log verbosity
      */
-    logit(1, loglevel, "-------------------------------------------------\n");
-    logit(1, loglevel, "Computing nodes\n");
+    logit(NUMERICS, 1, loglevel, "-------------------------------------------------\n");
+    logit(NUMERICS, 1, loglevel, "Computing nodes\n");
     poly_roots(nodes, poly, 53, prec, loglevel);
 }
 
@@ -333,6 +484,24 @@ void compute_nodes_and_weights(acb_ptr nodes,
      * target_prec: Number of bits in target precision
      * loglevel: The log verbosity
      */
+    compute_nodes_and_weights_seeded(nodes, weights, poly, 0, target_prec, loglevel);
+}
+
+
+void compute_nodes_and_weights_seeded(acb_ptr nodes,
+                                      acb_ptr weights,
+                                      const fmpq_poly_t poly,
+                                      const long seed_prec,
+                                      const long target_prec,
+                                      const int loglevel) {
+    /*
+     * nodes: An array containing the nodes, on input the approximations if seeded
+     * weights: An array containing the weights
+     * poly: The polynomial whose roots define the nodes
+     * seed_prec: Number of bits the given nodes are accurate to, 0 if not seeded
+     * target_prec: Number of bits in target precision
+     * loglevel: The log verbosity
+     */
     int k, j;
     slong K;
     fmpq_t integral;
@@ -341,7 +510,19 @@ void compute_nodes_and_weights(acb_ptr nodes,
     acb_mat_t B;
     acb_mat_t X;
     int solvable;
-    long initial_prec, prec;
+    long initial_prec, prec, seeded;
+    double start;
+
+    /* Rules of 16 to 60 digits are computed in multi-double and certified */
+    seeded = seed_prec;
+    if(multidouble_enabled && target_prec >= MD_MINPREC && target_prec <= MD_MAXPREC) {
+        if(md_nodes_and_weights(nodes, weights, poly, seed_prec, target_prec, loglevel)) {
+            return;
+        }
+        logit(NUMERICS, 2, loglevel, "Multi-double engine failed, falling back to ball arithmetic\n");
+        stats_count(COUNT_MULTIDOUBLE_FALLBACKS, 1);
+        seeded = FLINT_MAX(seed_prec, 53);
+    }
 
     K = fmpq_poly_degree(poly);
     acb_init(element);
@@ -352,17 +533,19 @@ void compute_nodes_and_weights(acb_ptr nodes,
     acb_mat_zero(B);
     acb_mat_zero(X);
 
-    logit(1, loglevel, "-------------------------------------------------\n");
-    logit(1, loglevel, "Computing nodes and weights\n");
+    logit(NUMERICS, 1, loglevel, "-------------------------------------------------\n");
+    logit(NUMERICS, 1, loglevel, "Computing nodes and weights\n");
 
     /* Precision in number of bits */
-    initial_prec = 53;
+    initial_prec = FLINT_MAX(53, seeded);
 
     for(prec = initial_prec; ; prec *= 2) {
         /* Find the roots up to prec bits */
-        poly_roots(nodes, poly, prec, prec, loglevel);
+        trace_precision(prec);
+        poly_roots_seeded(nodes, poly, seeded > 0, prec, prec, loglevel);
 
         /* Build the system matrix */
+        start = stage_begin();
         for(k = 0; k < K; k++) {
             for(j = 0; j < K; j++) {
                 acb_pow_ui(element, nodes+j, k, prec);
@@ -378,19 +561,23 @@ void compute_nodes_and_weights(acb_ptr nodes,
         }
 
         /* Solve the system and obtain weights */
-        logit(4, loglevel, " current precision for weights: %ld\n", prec);
+        logit(NUMERICS, 4, loglevel, " current precision for weights: %ld\n", prec);
 
         solvable = acb_mat_solve(X, A, B, prec);
+        stage_end(STAGE_WEIGHTS, start);
+        stats_count(COUNT_WEIGHT_ROUNDS, 1);
 
         for(k = 0; k < K; k++) {
             *(k + weights) = *acb_mat_entry(X, k, 0);
         }
 
-        logit(4, loglevel, "Linear system for weights solvable: %i\n", solvable);
+        logit(NUMERICS, 4, loglevel, "Linear system for weights solvable: %i\n", solvable);
 
         /* Check accuracy of weights here */
         if(solvable && check_accuracy(weights, K, target_prec)) {
-            logit(4, loglevel, "Sufficient bits for target precision reached\n");
+            logit(NUMERICS, 4, loglevel, "Sufficient bits for target precision reached\n");
+            telemetry_weights(prec);
+            progress_weights(prec);
             break;
         }
     }
@@ -413,6 +600,7 @@ int validate_rule(long* nrroots,
     slong deg;
     acb_ptr roots, weights;
     long rroots, nnweights;
+    double start;
 
     /* This extension is invalid */
     deg = fmpq_poly_degree(En);
@@ -427,16 +615,23 @@ int validate_rule(long* nrroots,
     compute_nodes_and_weights(roots, weights, En, prec, loglevel);
 
     /* Validate roots */
+    start = stage_begin();
     rroots = validate_roots(roots, deg, prec, loglevel);
     (*nrroots) = rroots;
 
     /* Validate weights */
     nnweights = validate_weights(weights, deg, prec, loglevel);
     (*nnnweights) = nnweights;
+    stage_end(STAGE_VALIDATE, start);
 
     _acb_vec_clear(roots, deg);
     _acb_vec_clear(weights, deg);
 
+    if(rroots != deg) {
+        progress_reject(REJECT_NODES);
+    } else if(nnweights != deg) {
+        progress_reject(REJECT_WEIGHTS);
+    }
     return (rroots == deg && nnweights == deg) ? 1 : 0;
 }
 
@@ -454,6 +649,7 @@ int validate_extension_by_poly(long* nrroots,
     slong deg;
     acb_ptr roots;
     long valid_roots;
+    double start;
 
     /* This extension is invalid */
     deg = fmpq_poly_degree(En);
@@ -466,13 +662,18 @@ int validate_extension_by_poly(long* nrroots,
     compute_nodes(roots, En, prec, loglevel);
 
     /* Validate roots */
+    start = stage_begin();
     valid_roots = validate_roots(roots, deg, prec, loglevel);
+    stage_end(STAGE_VALIDATE, start);
     (*nrroots) = valid_roots;
 
-    logit(1, loglevel, "Extension rule has valid nodes: %i\n", valid_roots == deg ? 1 : 0);
+    logit(VALIDATION, 1, loglevel, "Extension rule has valid nodes: %i\n", valid_roots == deg ? 1 : 0);
 
     _acb_vec_clear(roots, deg);
 
+    if(valid_roots != deg) {
+        progress_reject(REJECT_NODES);
+    }
     return valid_roots == deg ? 1 : 0;
 }
 
@@ -488,6 +689,7 @@ int validate_extension_by_roots(const acb_ptr roots,
      * loglevel: The log verbosity
      */
     long valid_roots;
+    double start;
 
     /* This extension is invalid */
     if(deg <= 0) {
@@ -495,10 +697,15 @@ int validate_extension_by_roots(const acb_ptr roots,
     }
 
     /* Validate roots */
+    start = stage_begin();
     valid_roots = validate_roots(roots, deg, prec, loglevel);
+    stage_end(STAGE_VALIDATE, start);
 
-    logit(1, loglevel, "Extension rule has valid nodes: %i\n", valid_roots == deg ? 1 : 0);
+    logit(VALIDATION, 1, loglevel, "Extension rule has valid nodes: %i\n", valid_roots == deg ? 1 : 0);
 
+    if(valid_roots != deg) {
+        progress_reject(REJECT_NODES);
+    }
     return valid_roots == deg ? 1 : 0;
 }
 
@@ -514,6 +721,7 @@ int validate_extension_by_weights(const acb_ptr weights,
      * loglevel: The log verbosity
      */
     long valid_weights;
+    double start;
 
     /* This extension is invalid */
     if(deg <= 0) {
@@ -521,12 +729,98 @@ int validate_extension_by_weights(const acb_ptr weights,
     }
 
     /* Validate weights */
+    start = stage_begin();
     valid_weights = validate_weights(weights, deg, prec, loglevel);
+    stage_end(STAGE_VALIDATE, start);
 
-    logit(1, loglevel, "Extension rule has valid weights: %i\n", valid_weights == deg ? 1 : 0);
+    logit(VALIDATION, 1, loglevel, "Extension rule has valid weights: %i\n", valid_weights == deg ? 1 : 0);
 
+    if(valid_weights != deg) {
+        progress_reject(REJECT_WEIGHTS);
+    }
     return valid_weights == deg ? 1 : 0;
 }
 
 
+
+void classify_rule(classification_t *c,
+                   const int solvable,
+                   const fmpq_poly_t P,
+                   const long prec,
+                   const int loglevel) {
+    /* Classify a candidate in one pass, computing nodes and weights once
+     *
+     * c: The classification
+     * solvable: Whether the system for the extension was solvable
+     * P: The polynomial whose roots are the nodes of the whole rule
+     * prec: Number of bits in target precision
+     * loglevel: The log verbosity
+     */
+    acb_ptr nodes, weights;
+    double start, x;
+    long i;
+
+    memset(c, 0, sizeof(classification_t));
+    c->cls = CLASS_UNSOLVABLE;
+    c->node_min = c->node_max = c->imag_max = NAN;
+    c->weight_min = c->weight_max = NAN;
+    if(!solvable || (c->deg = fmpq_poly_degree(P)) <= 0) {
+        return;
+    }
+
+    nodes = _acb_vec_init(c->deg);
+    weights = _acb_vec_init(c->deg);
+    compute_nodes_and_weights(nodes, weights, P, prec, loglevel);
+
+    start = stage_begin();
+    c->real_nodes = validate_real_roots(nodes, c->deg, prec, loglevel);
+    c->domain_nodes = validate_roots(nodes, c->deg, prec, loglevel);
+    count_weights(&c->positive_weights, &c->negative_weights, &c->indefinite_weights, weights, c->deg, prec);
+
+    for(i = 0; i < c->deg; i++) {
+        x = arf_get_d(arb_midref(acb_realref(nodes + i)), ARF_RND_NEAR);
+        c->node_min = (i == 0 || x < c->node_min) ? x : c->node_min;
+        c->node_max = (i == 0 || x > c->node_max) ? x : c->node_max;
+        x = fabs(arf_get_d(arb_midref(acb_imagref(nodes + i)), ARF_RND_NEAR));
+        c->imag_max = (i == 0 || x > c->imag_max) ? x : c->imag_max;
+        x = arf_get_d(arb_midref(acb_realref(weights + i)), ARF_RND_NEAR);
+        c->weight_min = (i == 0 || x < c->weight_min) ? x : c->weight_min;
+        c->weight_max = (i == 0 || x > c->weight_max) ? x : c->weight_max;
+    }
+    stage_end(STAGE_VALIDATE, start);
+
+    if(c->real_nodes < c->deg) {
+        c->cls = CLASS_COMPLEX;
+    } else if(c->domain_nodes < c->deg) {
+        c->cls = CLASS_OUTSIDE;
+    } else if(c->positive_weights + c->indefinite_weights < c->deg) {
+        c->cls = CLASS_NEGATIVE;
+    } else if(c->indefinite_weights > 0) {
+        c->cls = CLASS_INDEFINITE;
+    } else {
+        c->cls = CLASS_VALID;
+    }
+    logit(VALIDATION, 1, loglevel, "Candidate class: %s\n", class_names[c->cls]);
+
+    if(c->cls < CLASS_NEGATIVE) {
+        progress_reject(REJECT_NODES);
+    } else if(c->cls < CLASS_INDEFINITE) {
+        progress_reject(REJECT_WEIGHTS);
+    }
+
+    _acb_vec_clear(nodes, c->deg);
+    _acb_vec_clear(weights, c->deg);
+}
+
+
+void print_classification(const classification_t *c) {
+    /* Print the class and the extrema of a candidate on one line
+     *
+     * c: The classification
+     */
+    printf("%s %ld %ld %ld %ld %ld %ld %.6e %.6e %.6e %.6e %.6e", class_names[c->cls], c->deg, c->real_nodes,
+           c->domain_nodes, c->positive_weights, c->negative_weights, c->indefinite_weights,
+           c->node_min, c->node_max, c->imag_max, c->weight_min, c->weight_max);
+}
+
 #endif
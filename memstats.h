@@ -0,0 +1,311 @@
+/*  Author: R. Bourquin
+ *  Copyright: (C) 2014 R. Bourquin
+ *  License: GNU GPL v2 or above
+ *
+ *  A library of helper functions to search for
+ *  Kronrod extensions of Gauss quadrature rules.
+ */
+
+#ifndef __HH__memstats
+#define __HH__memstats
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <malloc.h>
+#include <gmp.h>
+
+#include "flint/flint.h"
+
+#include "trace.h"
+
+
+/* Accounting of heap allocations
+ *
+ * The memory functions of FLINT (and thereby Arb) and GMP (and thereby
+ * MPFR) are replaced by wrappers around malloc which track the number of
+ * allocations and the live and peak bytes, globally and per thread. In
+ * C++ programs the global operator new and delete are replaced as well.
+ * Block sizes are taken from 'malloc_usable_size'. Blocks allocated before
+ * accounting was enabled are counted when freed, hence the live bytes
+ * are a close but not exact estimate.
+ *
+ * Per stage the number and bytes of allocations and the peak growth of the
+ * live bytes of the thread are recorded, see 'memstats_push' and 'memstats_pop'.
+ */
+
+#define MEMSTATS_MAXDEPTH 32
+#define MEMSTATS_MAXSTAGES 32
+
+
+typedef struct {
+    long live;
+    long peak;
+    long allocs;
+    long bytes;
+    int depth;
+    long stack_live[MEMSTATS_MAXDEPTH];
+    long stack_peak[MEMSTATS_MAXDEPTH];
+    long stack_allocs[MEMSTATS_MAXDEPTH];
+    long stack_bytes[MEMSTATS_MAXDEPTH];
+    /* Avoid false sharing between threads */
+    char pad[64];
+} memstats_thread_t;
+
+typedef struct {
+    long allocs;
+    long bytes;
+    long peak;
+} memstats_stage_t;
+
+
+int memstats_enabled = 0;
+int memstats_nthreads = 0;
+long memstats_live = 0;
+long memstats_peak = 0;
+long memstats_allocs = 0;
+memstats_thread_t *memstats_threads = NULL;
+memstats_stage_t memstats_stages[MEMSTATS_MAXSTAGES];
+
+
+void memstats_enable(void);
+void memstats_account(const long);
+void * memstats_malloc(size_t);
+void * memstats_calloc(size_t, size_t);
+void * memstats_realloc(void *, size_t);
+void memstats_free(void *);
+void * memstats_gmp_realloc(void *, size_t, size_t);
+void memstats_gmp_free(void *, size_t);
+void memstats_push(void);
+void memstats_pop(const int, const double);
+void memstats_report(const char **, const int);
+
+
+void memstats_enable(void) {
+    /* Enable the accounting by installing the memory functions
+     * of FLINT and GMP. Must be called before anything is allocated.
+     */
+    if(memstats_enabled) {
+        return;
+    }
+    memstats_nthreads = sched_nslots();
+    memstats_threads = (memstats_thread_t *) calloc(memstats_nthreads, sizeof(memstats_thread_t));
+    __flint_set_memory_functions(memstats_malloc, memstats_calloc, memstats_realloc, memstats_free);
+    mp_set_memory_functions(memstats_malloc, memstats_gmp_realloc, memstats_gmp_free);
+    memstats_enabled = 1;
+}
+
+
+void memstats_account(const long size) {
+    /* Account for an allocation of positive or a release of negative size
+     *
+     * size: The change of the live bytes
+     */
+    memstats_thread_t *t;
+    long live, peak;
+    int tid;
+
+    live = __atomic_add_fetch(&memstats_live, size, __ATOMIC_RELAXED);
+    peak = __atomic_load_n(&memstats_peak, __ATOMIC_RELAXED);
+    while(live > peak && !__atomic_compare_exchange_n(&memstats_peak, &peak, live, 1,
+                                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    tid = sched_slot();
+    if(tid >= memstats_nthreads) {
+        return;
+    }
+    t = memstats_threads + tid;
+    t->live += size;
+    if(size > 0) {
+        __atomic_add_fetch(&memstats_allocs, 1, __ATOMIC_RELAXED);
+        t->allocs++;
+        t->bytes += size;
+        if(t->live > t->peak) {
+            t->peak = t->live;
+        }
+    }
+}
+
+
+void * memstats_malloc(size_t size) {
+    void *p = malloc(size);
+    if(p != NULL) {
+        memstats_account(malloc_usable_size(p));
+    }
+    return p;
+}
+
+
+void * memstats_calloc(size_t num, size_t size) {
+    void *p = calloc(num, size);
+    if(p != NULL) {
+        memstats_account(malloc_usable_size(p));
+    }
+    return p;
+}
+
+
+void * memstats_realloc(void *ptr, size_t size) {
+    long old;
+    void *p;
+
+    old = ptr != NULL ? malloc_usable_size(ptr) : 0;
+    p = realloc(ptr, size);
+    if(p != NULL) {
+        memstats_account(-old);
+        memstats_account(malloc_usable_size(p));
+    }
+    return p;
+}
+
+
+void memstats_free(void *ptr) {
+    if(ptr != NULL) {
+        memstats_account(-(long) malloc_usable_size(ptr));
+    }
+    free(ptr);
+}
+
+
+void * memstats_gmp_realloc(void *ptr, size_t old_size, size_t new_size) {
+    return memstats_realloc(ptr, new_size);
+}
+
+
+void memstats_gmp_free(void *ptr, size_t size) {
+    memstats_free(ptr);
+}
+
+
+void memstats_push(void) {
+    /* Start accounting a stage of the calling thread
+     */
+    memstats_thread_t *t;
+    int tid;
+
+    tid = sched_slot();
+    if(!memstats_enabled || tid >= memstats_nthreads) {
+        return;
+    }
+    t = memstats_threads + tid;
+    if(t->depth < MEMSTATS_MAXDEPTH) {
+        t->stack_live[t->depth] = t->live;
+        t->stack_peak[t->depth] = t->peak;
+        t->stack_allocs[t->depth] = t->allocs;
+        t->stack_bytes[t->depth] = t->bytes;
+        t->peak = t->live;
+    }
+    t->depth++;
+}
+
+
+void memstats_pop(const int stage,
+                  const double now) {
+    /* Finish accounting a stage of the calling thread
+     *
+     * stage: The stage
+     * now: The current time, used for sampling into the trace
+     */
+    memstats_thread_t *t;
+    memstats_stage_t *s;
+    long growth, peak;
+    int tid, d;
+
+    tid = sched_slot();
+    if(!memstats_enabled || tid >= memstats_nthreads) {
+        return;
+    }
+    t = memstats_threads + tid;
+    t->depth--;
+    d = t->depth;
+    if(d < 0 || d >= MEMSTATS_MAXDEPTH || stage >= MEMSTATS_MAXSTAGES) {
+        t->depth = d < 0 ? 0 : t->depth;
+        return;
+    }
+
+    growth = t->peak - t->stack_live[d];
+    s = memstats_stages + stage;
+    __atomic_add_fetch(&s->allocs, t->allocs - t->stack_allocs[d], __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s->bytes, t->bytes - t->stack_bytes[d], __ATOMIC_RELAXED);
+    peak = __atomic_load_n(&s->peak, __ATOMIC_RELAXED);
+    while(growth > peak && !__atomic_compare_exchange_n(&s->peak, &peak, growth, 1,
+                                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    /* The peak of the enclosing stage includes this one */
+    if(t->stack_peak[d] > t->peak) {
+        t->peak = t->stack_peak[d];
+    }
+
+    trace_counter("live bytes", now, __atomic_load_n(&memstats_live, __ATOMIC_RELAXED));
+}
+
+
+void memstats_report(const char **names,
+                     const int nstages) {
+    /* Print the allocation summary per stage and per thread
+     *
+     * names: The names of the stages
+     * nstages: Number of stages
+     */
+    int i;
+
+    printf("%-15s %14s %14s %14s\n", "stage", "allocations", "bytes", "peak growth");
+    for(i = 0; i < nstages && i < MEMSTATS_MAXSTAGES; i++) {
+        if(memstats_stages[i].allocs == 0) {
+            continue;
+        }
+        printf("%-15s %14ld %14ld %14ld\n", names[i], memstats_stages[i].allocs,
+               memstats_stages[i].bytes, memstats_stages[i].peak);
+    }
+    printf("-------------------------------------------------------------------------------------\n");
+    printf("%-15s %14s %14s %14s\n", "thread", "allocations", "bytes", "peak live");
+    for(i = 0; i < memstats_nthreads; i++) {
+        if(memstats_threads[i].allocs == 0) {
+            continue;
+        }
+        printf("%-15d %14ld %14ld %14ld\n", i, memstats_threads[i].allocs,
+               memstats_threads[i].bytes, memstats_threads[i].peak);
+    }
+    printf("-------------------------------------------------------------------------------------\n");
+    printf("%-24s %14ld\n", "allocations", memstats_allocs);
+    printf("%-24s %14ld\n", "live bytes at exit", memstats_live);
+    printf("%-24s %14ld\n", "peak live bytes", memstats_peak);
+    printf("-------------------------------------------------------------------------------------\n");
+}
+
+
+#ifdef __cplusplus
+
+#include <new>
+
+/* The replacements pair malloc with free on purpose */
+#if defined(__GNUC__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void * operator new(size_t size) {
+    void *p = malloc(size > 0 ? size : 1);
+    if(p == NULL) {
+        throw std::bad_alloc();
+    }
+    if(memstats_enabled) {
+        memstats_account(malloc_usable_size(p));
+    }
+    return p;
+}
+
+void operator delete(void *ptr) noexcept {
+    if(memstats_enabled && ptr != NULL) {
+        memstats_account(-(long) malloc_usable_size(ptr));
+    }
+    free(ptr);
+}
+
+#if defined(__GNUC__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+#endif
+
+
+#endif
@@ -0,0 +1,951 @@
+/*  Author: R. Bourquin
+ *  Copyright: (C) 2014 R. Bourquin
+ *  License: GNU GPL v2 or above
+ *
+ *  A library of helper functions to search for
+ *  Kronrod extensions of Gauss quadrature rules.
+ */
+
+#ifndef __HH__multidouble
+#define __HH__multidouble
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "flint/flint.h"
+#include "flint/fmpz.h"
+#include "flint/fmpq.h"
+#include "flint/fmpq_vec.h"
+#include "flint/fmpq_poly.h"
+
+#include "arf.h"
+#include "arb.h"
+#include "arb_poly.h"
+#include "acb.h"
+
+#include "helpers.h"
+#include "numerics.h"
+#include "switch.h"
+#include "stages.h"
+#include "scheduler.h"
+
+
+/* Multi-double engine for nodes and weights
+ *
+ * Rules of 16 to 60 digits do not need arbitrary precision. Here a number
+ * is the unevaluated sum of n = 2 (double-double, about 32 digits) or
+ * n = 4 (quad-double, about 64 digits) doubles of decreasing magnitude,
+ * combined by the error free transformations two_sum and two_prod.
+ *
+ * 1. The polynomial is converted exactly into the basis of the orthogonal
+ *    polynomials of the family and evaluated with its derivative by the
+ *    Clenshaw recurrence, which is stable where the monomial basis is not.
+ * 2. Roots of double precision from 'poly_roots' are refined by Newton.
+ * 3. The weights solve  sum_i w_i P_m(x_i) = \int P_m(x) w(x) dx  for m < K,
+ *    the right hand side vanishes for m > 0. The matrix is filled by the
+ *    three term recurrence and factored with partial pivoting.
+ * 4. A final pass in ball arithmetic certifies every node by an interval
+ *    Newton step and encloses every weight by
+ *
+ *      w_i = \int p(x) / (x - x_i) w(x) dx / p'(x_i)
+ *
+ *    on the certified node, both in O(K^2) operations.
+ *
+ * The engine gives up if a root is not real, two nodes meet or the balls
+ * of the certification are too wide, 'compute_nodes_and_weights_seeded'
+ * then falls back to ball arithmetic throughout. It is used for target
+ * precisions from MD_MINPREC to MD_MAXPREC bits, that is '-dc 16' to 60.
+ */
+
+#define MD_MAXLIMBS 4
+#define MD_MINPREC 53
+#define MD_MAXPREC 200
+#define MD_GUARD 16
+#define MD_NEWTON 10
+#define MD_CERTIFY_ROUNDS 3
+
+
+typedef struct {
+    double x[MD_MAXLIMBS];
+} md_t;
+
+typedef struct {
+    long K;
+    int n;
+    md_t *coeffs;
+    md_t *A;
+    md_t *B;
+    md_t *C;
+    md_t *nodes;
+} md_rule_t;
+
+typedef struct {
+    const md_rule_t *rule;
+    md_t *M;
+    md_t *b;
+    long j;
+} md_system_t;
+
+typedef struct {
+    const md_rule_t *rule;
+    arb_poly_t P;
+    arb_poly_t dP;
+    arb_ptr moments;
+    arb_ptr nodes;
+    arb_ptr weights;
+    const md_t *w;
+    mag_t radius;
+    long prec;
+    int failed;
+} md_certify_t;
+
+
+int multidouble_enabled = 1;
+
+
+double md_two_sum(const double, const double, double *);
+double md_fast_two_sum(const double, const double, double *);
+double md_two_prod(const double, const double, double *);
+void md_renormalize(md_t *, double *, const int, const int);
+void md_zero(md_t *);
+void md_set_d(md_t *, const double);
+void md_neg(md_t *, const md_t *);
+void md_add(md_t *, const md_t *, const md_t *, const int);
+void md_sub(md_t *, const md_t *, const md_t *, const int);
+void md_mul(md_t *, const md_t *, const md_t *, const int);
+void md_div(md_t *, const md_t *, const md_t *, const int);
+void md_set_arf(md_t *, const arf_t, const int);
+void md_get_arf(arf_t, const md_t *, const int);
+void md_set_fmpq(md_t *, const fmpq_t, const int);
+
+void md_rule_init(md_rule_t *, const fmpq_poly_t, const int);
+void md_rule_clear(md_rule_t *);
+void md_clenshaw(md_t *, md_t *, const md_rule_t *, const md_t *);
+void md_newton_task(void *, const long);
+void md_column_task(void *, const long);
+void md_eliminate_task(void *, const long);
+int md_weights(md_t *, const md_rule_t *);
+void md_certify_task(void *, const long);
+int md_certify(acb_ptr, acb_ptr, const md_rule_t *, const md_t *, const fmpq_poly_t, const long, const long);
+int md_nodes_and_weights(acb_ptr, acb_ptr, const fmpq_poly_t, const long, const long, const int);
+
+
+double md_two_sum(const double a,
+                  const double b,
+                  double *e) {
+    /* Return s = fl(a + b) and the exact error e = a + b - s
+     */
+    double s, bb;
+
+    s = a + b;
+    bb = s - a;
+    *e = (a - (s - bb)) + (b - bb);
+    return s;
+}
+
+
+double md_fast_two_sum(const double a,
+                       const double b,
+                       double *e) {
+    /* As 'md_two_sum' but requires |a| >= |b|
+     */
+    double s;
+
+    s = a + b;
+    *e = b - (s - a);
+    return s;
+}
+
+
+double md_two_prod(const double a,
+                   const double b,
+                   double *e) {
+    /* Return p = fl(a * b) and the exact error e = a * b - p
+     */
+    double p;
+#ifdef FP_FAST_FMA
+    p = a * b;
+    *e = fma(a, b, -p);
+#else
+    double t, ah, al, bh, bl;
+
+    p = a * b;
+    t = 134217729.0 * a;
+    ah = t - (t - a);
+    al = a - ah;
+    t = 134217729.0 * b;
+    bh = t - (t - b);
+    bl = b - bh;
+    *e = ((ah * bh - p) + ah * bl + al * bh) + al * bl;
+#endif
+    return p;
+}
+
+
+void md_renormalize(md_t *z,
+                    double *t,
+                    const int m,
+                    const int n) {
+    /* Compress roughly decreasing terms into n limbs
+     *
+     * z: The result
+     * t: The terms, overwritten
+     * m: Number of terms
+     * n: Number of limbs
+     */
+    double s, e;
+    int i, k;
+
+    /* Accumulate from the smallest term, leaving the errors behind */
+    s = t[m-1];
+    for(i = m - 2; i >= 0; i--) {
+        s = md_two_sum(t[i], s, &e);
+        t[i+1] = e;
+    }
+    t[0] = s;
+
+    /* Extract the leading nonoverlapping limbs */
+    k = 0;
+    for(i = 1; i < m && k < n; i++) {
+        s = md_two_sum(s, t[i], &e);
+        if(e != 0.0) {
+            z->x[k++] = s;
+            s = e;
+        }
+    }
+    if(k < n) {
+        z->x[k++] = s;
+    }
+    for(; k < MD_MAXLIMBS; k++) {
+        z->x[k] = 0.0;
+    }
+}
+
+
+void md_zero(md_t *z) {
+    memset(z, 0, sizeof(md_t));
+}
+
+
+void md_set_d(md_t *z,
+              const double a) {
+    md_zero(z);
+    z->x[0] = a;
+}
+
+
+void md_neg(md_t *z,
+            const md_t *x) {
+    int k;
+
+    for(k = 0; k < MD_MAXLIMBS; k++) {
+        z->x[k] = -x->x[k];
+    }
+}
+
+
+void md_add(md_t *z,
+            const md_t *x,
+            const md_t *y,
+            const int n) {
+    /* z = x + y
+     *
+     * n: Number of limbs
+     */
+    double t[2*MD_MAXLIMBS];
+    double s1, s2, t1, t2;
+    int i, j, k;
+
+    if(n == 2) {
+        s1 = md_two_sum(x->x[0], y->x[0], &s2);
+        t1 = md_two_sum(x->x[1], y->x[1], &t2);
+        s2 += t1;
+        s1 = md_fast_two_sum(s1, s2, &s2);
+        s2 += t2;
+        z->x[0] = md_fast_two_sum(s1, s2, &z->x[1]);
+        z->x[2] = z->x[3] = 0.0;
+        return;
+    }
+
+    /* Merge by magnitude */
+    i = j = k = 0;
+    while(i < n && j < n) {
+        t[k++] = fabs(x->x[i]) >= fabs(y->x[j]) ? x->x[i++] : y->x[j++];
+    }
+    while(i < n) {
+        t[k++] = x->x[i++];
+    }
+    while(j < n) {
+        t[k++] = y->x[j++];
+    }
+    md_renormalize(z, t, 2*n, n);
+}
+
+
+void md_sub(md_t *z,
+            const md_t *x,
+            const md_t *y,
+            const int n) {
+    /* z = x - y
+     *
+     * n: Number of limbs
+     */
+    md_t t;
+
+    md_neg(&t, y);
+    md_add(z, x, &t, n);
+}
+
+
+void md_mul(md_t *z,
+            const md_t *x,
+            const md_t *y,
+            const int n) {
+    /* z = x * y, products of order i + j < n are exact,
+     * those of order n are rounded and higher ones dropped.
+     *
+     * n: Number of limbs
+     */
+    double t[2*MD_MAXLIMBS*(MD_MAXLIMBS+1)];
+    double carry[MD_MAXLIMBS], next[MD_MAXLIMBS];
+    double p, e;
+    int i, j, k, m, c, d;
+
+    if(n == 2) {
+        p = md_two_prod(x->x[0], y->x[0], &e);
+        e += x->x[0] * y->x[1] + x->x[1] * y->x[0];
+        z->x[0] = md_fast_two_sum(p, e, &z->x[1]);
+        z->x[2] = z->x[3] = 0.0;
+        return;
+    }
+
+    m = 0;
+    c = 0;
+    for(k = 0; k <= n; k++) {
+        /* The errors of the previous order belong to this one */
+        for(i = 0; i < c; i++) {
+            t[m++] = carry[i];
+        }
+        d = 0;
+        for(i = 0; i <= k && i < n; i++) {
+            j = k - i;
+            if(j >= n) {
+                continue;
+            }
+            if(k < n) {
+                t[m++] = md_two_prod(x->x[i], y->x[j], &next[d++]);
+            } else {
+                t[m++] = x->x[i] * y->x[j];
+            }
+        }
+        for(i = 0; i < d; i++) {
+            carry[i] = next[i];
+        }
+        c = d;
+    }
+    md_renormalize(z, t, m, n);
+}
+
+
+void md_div(md_t *z,
+            const md_t *x,
+            const md_t *y,
+            const int n) {
+    /* z = x / y by long division with n + 1 partial quotients
+     *
+     * n: Number of limbs
+     */
+    double q[MD_MAXLIMBS+1];
+    md_t r, s, t;
+    int k;
+
+    r = *x;
+    for(k = 0; k <= n; k++) {
+        q[k] = r.x[0] / y->x[0];
+        md_set_d(&s, q[k]);
+        md_mul(&t, y, &s, n);
+        md_sub(&r, &r, &t, n);
+    }
+    md_renormalize(z, q, n + 1, n);
+}
+
+
+void md_set_arf(md_t *z,
+                const arf_t a,
+                const int n) {
+    /* Round a floating point number to n limbs
+     *
+     * z: The result
+     * a: The number
+     * n: Number of limbs
+     */
+    arf_t r, t;
+    int k;
+
+    arf_init(r);
+    arf_init(t);
+    arf_set(r, a);
+    md_zero(z);
+    for(k = 0; k < n; k++) {
+        z->x[k] = arf_get_d(r, ARF_RND_NEAR);
+        arf_set_d(t, z->x[k]);
+        arf_sub(r, r, t, ARF_PREC_EXACT, ARF_RND_DOWN);
+    }
+    arf_clear(r);
+    arf_clear(t);
+}
+
+
+void md_get_arf(arf_t z,
+                const md_t *x,
+                const int n) {
+    /* The exact value of a multi-double number
+     *
+     * z: The result
+     * x: The number
+     * n: Number of limbs
+     */
+    arf_t t;
+    int k;
+
+    arf_init(t);
+    arf_set_d(z, x->x[0]);
+    for(k = 1; k < n; k++) {
+        arf_set_d(t, x->x[k]);
+        arf_add(z, z, t, ARF_PREC_EXACT, ARF_RND_DOWN);
+    }
+    arf_clear(t);
+}
+
+
+void md_set_fmpq(md_t *z,
+                 const fmpq_t q,
+                 const int n) {
+    /* Round a rational number to n limbs
+     *
+     * z: The result
+     * q: The number
+     * n: Number of limbs
+     */
+    arb_t t;
+
+    arb_init(t);
+    arb_set_fmpq(t, q, 53*n + 64);
+    md_set_arf(z, arb_midref(t), n);
+    arb_clear(t);
+}
+
+
+void md_rule_init(md_rule_t *r,
+                  const fmpq_poly_t poly,
+                  const int n) {
+    /* Expand a polynomial in the orthogonal polynomials of the family.
+     * Horner's scheme runs exactly in this basis, where
+     *
+     *   x P_m(x) = (P_{m+1}(x) - B_m P_m(x) + C_m P_{m-1}(x)) / A_m
+     *
+     * r: The rule, its nodes are allocated but not set
+     * poly: The polynomial whose roots define the nodes
+     * n: Number of limbs
+     */
+    long K, j, m;
+    fmpq *q, *t, *swap, *a, *b, *c;
+    fmpq_t A, B, C, coeff;
+
+    K = fmpq_poly_degree(poly);
+    r->K = K;
+    r->n = n;
+    r->coeffs = (md_t *) malloc((K + 1) * sizeof(md_t));
+    r->A = (md_t *) malloc((K + 2) * sizeof(md_t));
+    r->B = (md_t *) malloc((K + 2) * sizeof(md_t));
+    r->C = (md_t *) malloc((K + 2) * sizeof(md_t));
+    r->nodes = (md_t *) malloc(K * sizeof(md_t));
+
+    q = _fmpq_vec_init(K + 2);
+    t = _fmpq_vec_init(K + 2);
+    a = _fmpq_vec_init(K + 2);
+    b = _fmpq_vec_init(K + 2);
+    c = _fmpq_vec_init(K + 2);
+    fmpq_init(A);
+    fmpq_init(B);
+    fmpq_init(C);
+    fmpq_init(coeff);
+
+    for(m = 0; m <= K + 1; m++) {
+        recurrence(A, B, C, m);
+        md_set_fmpq(r->A + m, A, n);
+        md_set_fmpq(r->B + m, B, n);
+        md_set_fmpq(r->C + m, C, n);
+        fmpq_inv(a + m, A);
+        fmpq_mul(b + m, B, a + m);
+        fmpq_mul(c + m, C, a + m);
+    }
+
+    for(j = K; j >= 0; j--) {
+        /* t = x q + coeff_j, q has degree K - j - 1 */
+        _fmpq_vec_zero(t, K + 2);
+        for(m = 0; m < K - j; m++) {
+            if(fmpq_is_zero(q + m)) {
+                continue;
+            }
+            fmpq_addmul(t + m + 1, q + m, a + m);
+            fmpq_submul(t + m, q + m, b + m);
+            if(m > 0) {
+                fmpq_addmul(t + m - 1, q + m, c + m);
+            }
+        }
+        fmpq_poly_get_coeff_fmpq(coeff, poly, j);
+        fmpq_add(t, t, coeff);
+        swap = q;
+        q = t;
+        t = swap;
+    }
+
+    for(m = 0; m <= K; m++) {
+        md_set_fmpq(r->coeffs + m, q + m, n);
+    }
+
+    _fmpq_vec_clear(q, K + 2);
+    _fmpq_vec_clear(t, K + 2);
+    _fmpq_vec_clear(a, K + 2);
+    _fmpq_vec_clear(b, K + 2);
+    _fmpq_vec_clear(c, K + 2);
+    fmpq_clear(A);
+    fmpq_clear(B);
+    fmpq_clear(C);
+    fmpq_clear(coeff);
+}
+
+
+void md_rule_clear(md_rule_t *r) {
+    free(r->coeffs);
+    free(r->A);
+    free(r->B);
+    free(r->C);
+    free(r->nodes);
+}
+
+
+void md_clenshaw(md_t *p,
+                 md_t *dp,
+                 const md_rule_t *r,
+                 const md_t *x) {
+    /* Evaluate the polynomial and its derivative by the recurrence
+     *
+     *   b_k = a_k + (A_k x + B_k) b_{k+1} - C_{k+1} b_{k+2}
+     *   d_k = A_k b_{k+1} + (A_k x + B_k) d_{k+1} - C_{k+1} d_{k+2}
+     *
+     * p: The value
+     * dp: The derivative
+     * r: The rule
+     * x: The point
+     */
+    md_t b0, b1, b2, d0, d1, d2, alpha, t;
+    const int n = r->n;
+    long k;
+
+    md_zero(&b1);
+    md_zero(&b2);
+    md_zero(&d1);
+    md_zero(&d2);
+    for(k = r->K; k >= 0; k--) {
+        md_mul(&alpha, r->A + k, x, n);
+        md_add(&alpha, &alpha, r->B + k, n);
+
+        md_mul(&b0, &alpha, &b1, n);
+        md_add(&b0, &b0, r->coeffs + k, n);
+        md_mul(&t, r->C + k + 1, &b2, n);
+        md_sub(&b0, &b0, &t, n);
+
+        md_mul(&d0, &alpha, &d1, n);
+        md_mul(&t, r->A + k, &b1, n);
+        md_add(&d0, &d0, &t, n);
+        md_mul(&t, r->C + k + 1, &d2, n);
+        md_sub(&d0, &d0, &t, n);
+
+        b2 = b1;
+        b1 = b0;
+        d2 = d1;
+        d1 = d0;
+    }
+    *p = b1;
+    *dp = d1;
+}
+
+
+void md_newton_task(void *arg,
+                    const long i) {
+    /* Task refining the i-th node by Newton steps
+     */
+    md_rule_t *r;
+    md_t p, dp, delta;
+    double eps;
+    int it;
+
+    r = (md_rule_t *) arg;
+    eps = ldexp(1.0, -53*r->n + 8);
+    for(it = 0; it < MD_NEWTON; it++) {
+        md_clenshaw(&p, &dp, r, r->nodes + i);
+        md_div(&delta, &p, &dp, r->n);
+        md_sub(r->nodes + i, r->nodes + i, &delta, r->n);
+        if(!(fabs(delta.x[0]) > eps * fmax(1.0, fabs(r->nodes[i].x[0])))) {
+            break;
+        }
+    }
+}
+
+
+void md_column_task(void *arg,
+                    const long i) {
+    /* Task filling the i-th column P_m(x_i) of the weight system
+     */
+    md_system_t *s;
+    const md_rule_t *r;
+    md_t alpha, t;
+    long m, K;
+    int n;
+
+    s = (md_system_t *) arg;
+    r = s->rule;
+    K = r->K;
+    n = r->n;
+    md_set_d(s->M + i, 1.0);
+    for(m = 0; m + 1 < K; m++) {
+        md_mul(&alpha, r->A + m, r->nodes + i, n);
+        md_add(&alpha, &alpha, r->B + m, n);
+        md_mul(s->M + (m+1)*K + i, &alpha, s->M + m*K + i, n);
+        if(m > 0) {
+            md_mul(&t, r->C + m, s->M + (m-1)*K + i, n);
+            md_sub(s->M + (m+1)*K + i, s->M + (m+1)*K + i, &t, n);
+        }
+    }
+}
+
+
+void md_eliminate_task(void *arg,
+                       const long row) {
+    /* Task eliminating the pivot column j from a row below the pivot
+     */
+    md_system_t *s;
+    md_t f, t;
+    long c, j, K;
+    int n;
+
+    s = (md_system_t *) arg;
+    K = s->rule->K;
+    n = s->rule->n;
+    j = s->j;
+    md_div(&f, s->M + row*K + j, s->M + j*K + j, n);
+    for(c = j + 1; c < K; c++) {
+        md_mul(&t, &f, s->M + j*K + c, n);
+        md_sub(s->M + row*K + c, s->M + row*K + c, &t, n);
+    }
+    md_mul(&t, &f, s->b + j, n);
+    md_sub(s->b + row, s->b + row, &t, n);
+}
+
+
+int md_weights(md_t *w,
+               const md_rule_t *r) {
+    /* Solve for the weights belonging to the nodes of the rule,
+     * returns 0 if the system is numerically singular.
+     *
+     * w: The weights
+     * r: The rule with refined nodes
+     */
+    md_system_t s;
+    md_t t;
+    fmpq_t integral;
+    long K, j, m, c, pivot;
+    int n, ok;
+
+    K = r->K;
+    n = r->n;
+    s.rule = r;
+    s.M = (md_t *) malloc(K * K * sizeof(md_t));
+    s.b = (md_t *) malloc(K * sizeof(md_t));
+
+    sched_for(0, K, md_column_task, &s, SCHED_NORMAL);
+
+    /* Only P_0 = 1 has a nonzero integral */
+    fmpq_init(integral);
+    integrate(integral, 0);
+    md_set_fmpq(s.b, integral, n);
+    fmpq_clear(integral);
+    for(m = 1; m < K; m++) {
+        md_zero(s.b + m);
+    }
+
+    ok = 1;
+    for(j = 0; j < K && ok; j++) {
+        pivot = j;
+        for(m = j + 1; m < K; m++) {
+            if(fabs(s.M[m*K + j].x[0]) > fabs(s.M[pivot*K + j].x[0])) {
+                pivot = m;
+            }
+        }
+        if(!isfinite(s.M[pivot*K + j].x[0]) || s.M[pivot*K + j].x[0] == 0.0) {
+            ok = 0;
+            break;
+        }
+        if(pivot != j) {
+            for(c = j; c < K; c++) {
+                t = s.M[j*K + c];
+                s.M[j*K + c] = s.M[pivot*K + c];
+                s.M[pivot*K + c] = t;
+            }
+            t = s.b[j];
+            s.b[j] = s.b[pivot];
+            s.b[pivot] = t;
+        }
+        s.j = j;
+        sched_for(j + 1, K, md_eliminate_task, &s, SCHED_NORMAL);
+    }
+
+    /* Back substitution */
+    for(j = K - 1; j >= 0 && ok; j--) {
+        w[j] = s.b[j];
+        for(c = j + 1; c < K; c++) {
+            md_mul(&t, s.M + j*K + c, w + c, n);
+            md_sub(w + j, w + j, &t, n);
+        }
+        md_div(w + j, w + j, s.M + j*K + j, n);
+        ok = isfinite(w[j].x[0]);
+    }
+
+    free(s.M);
+    free(s.b);
+    return ok;
+}
+
+
+void md_certify_task(void *arg,
+                     const long i) {
+    /* Task certifying the i-th node and enclosing its weight
+     */
+    md_certify_t *s;
+    arb_t m, X, N, y, q, integral, t;
+    arf_t mid;
+    long j, K, prec;
+
+    s = (md_certify_t *) arg;
+    if(__atomic_load_n(&s->failed, __ATOMIC_RELAXED)) {
+        return;
+    }
+    K = s->rule->K;
+    prec = s->prec;
+    arb_init(m);
+    arb_init(X);
+    arb_init(N);
+    arb_init(y);
+    arb_init(q);
+    arb_init(integral);
+    arb_init(t);
+    arf_init(mid);
+
+    /* Interval Newton: N = m - p(m) / p'(X) inside X proves a unique root in N */
+    md_get_arf(mid, s->rule->nodes + i, s->rule->n);
+    arb_set_arf(m, mid);
+    arb_set_arf(X, mid);
+    mag_set(arb_radref(X), s->radius);
+    arb_poly_evaluate(y, s->P, m, prec);
+    arb_poly_evaluate(t, s->dP, X, prec);
+    arb_div(y, y, t, prec);
+    arb_sub(N, m, y, prec);
+
+    if(!arb_contains(X, N)) {
+        __atomic_store_n(&s->failed, 1, __ATOMIC_RELAXED);
+    } else {
+        /* Divide p(x) by x - x_i and integrate the quotient */
+        arb_poly_get_coeff_arb(q, s->P, K);
+        arb_zero(integral);
+        for(j = K - 1; j >= 0; j--) {
+            arb_addmul(integral, q, s->moments + j, prec);
+            arb_poly_get_coeff_arb(t, s->P, j);
+            arb_addmul(t, q, N, prec);
+            arb_swap(q, t);
+        }
+        arb_poly_evaluate(t, s->dP, N, prec);
+        arb_div(integral, integral, t, prec);
+
+        /* Prefer the multi-double weight as midpoint if it is inside */
+        md_get_arf(mid, s->w + i, s->rule->n);
+        arb_set_arf(y, mid);
+        arb_sub(t, integral, y, prec);
+        arb_add_error(y, t);
+        if(mag_cmp(arb_radref(y), arb_radref(integral)) < 0) {
+            arb_swap(integral, y);
+        }
+
+        arb_swap(s->nodes + i, N);
+        arb_swap(s->weights + i, integral);
+    }
+
+    arb_clear(m);
+    arb_clear(X);
+    arb_clear(N);
+    arb_clear(y);
+    arb_clear(q);
+    arb_clear(integral);
+    arb_clear(t);
+    arf_clear(mid);
+}
+
+
+int md_certify(acb_ptr nodes,
+               acb_ptr weights,
+               const md_rule_t *r,
+               const md_t *w,
+               const fmpq_poly_t poly,
+               const long prec,
+               const long target_prec) {
+    /* Certify the nodes and weights of a rule in ball arithmetic,
+     * returns 1 if all balls are disjoint and fit the target precision.
+     *
+     * nodes: The certified nodes
+     * weights: The certified weights
+     * r: The rule with refined nodes
+     * w: The weights in multi-double
+     * poly: The polynomial whose roots define the nodes
+     * prec: Number of bits used for the certification
+     * target_prec: Number of bits in target precision
+     */
+    md_certify_t s;
+    fmpq_t integral;
+    long K, i, j;
+    int ok;
+
+    K = r->K;
+    s.rule = r;
+    s.w = w;
+    s.prec = prec;
+    s.failed = 0;
+    mag_init(s.radius);
+    mag_set_ui_2exp_si(s.radius, 1, -target_prec - 4);
+
+    arb_poly_init(s.P);
+    arb_poly_init(s.dP);
+    arb_poly_set_fmpq_poly(s.P, poly, prec);
+    arb_poly_derivative(s.dP, s.P, prec);
+
+    s.moments = _arb_vec_init(K);
+    fmpq_init(integral);
+    for(j = 0; j < K; j++) {
+        integrate(integral, j);
+        arb_set_fmpq(s.moments + j, integral, prec);
+    }
+    fmpq_clear(integral);
+
+    s.nodes = _arb_vec_init(K);
+    s.weights = _arb_vec_init(K);
+    sched_for(0, K, md_certify_task, &s, SCHED_NORMAL);
+    ok = !s.failed;
+
+    /* Each ball holds a unique root, disjoint balls hold all K roots */
+    for(i = 0; i < K && ok; i++) {
+        for(j = i + 1; j < K && ok; j++) {
+            ok = !arb_overlaps(s.nodes + i, s.nodes + j);
+        }
+    }
+
+    if(ok) {
+        for(i = 0; i < K; i++) {
+            acb_set_arb(nodes + i, s.nodes + i);
+            acb_set_arb(weights + i, s.weights + i);
+        }
+        ok = check_accuracy(nodes, K, target_prec) && check_accuracy(weights, K, target_prec);
+    }
+
+    _arb_vec_clear(s.moments, K);
+    _arb_vec_clear(s.nodes, K);
+    _arb_vec_clear(s.weights, K);
+    arb_poly_clear(s.P);
+    arb_poly_clear(s.dP);
+    mag_clear(s.radius);
+    return ok;
+}
+
+
+int md_nodes_and_weights(acb_ptr nodes,
+                         acb_ptr weights,
+                         const fmpq_poly_t poly,
+                         const long seed_prec,
+                         const long target_prec,
+                         const int loglevel) {
+    /* Compute nodes and weights in multi-double and certify them,
+     * returns 0 if the engine does not apply. The nodes then hold
+     * approximations to at least 53 bits or seed_prec if seeded.
+     *
+     * nodes: An array containing the nodes, on input the approximations if seeded
+     * weights: An array containing the weights
+     * poly: The polynomial whose roots define the nodes
+     * seed_prec: Number of bits the given nodes are accurate to, 0 if not seeded
+     * target_prec: Number of bits in target precision
+     * loglevel: The log verbosity
+     */
+    md_rule_t r;
+    md_t *w;
+    long K, i, prec;
+    int n, ok, certified, round;
+    double start;
+
+    K = fmpq_poly_degree(poly);
+    if(K < 1) {
+        return 0;
+    }
+    n = target_prec + MD_GUARD <= 2*53 ? 2 : 4;
+
+    logit(NUMERICS, 1, loglevel, "-------------------------------------------------\n");
+    logit(NUMERICS, 1, loglevel, "Computing nodes and weights in %s\n", n == 2 ? "double-double" : "quad-double");
+
+    /* Seeds of double precision */
+    if(seed_prec < 53) {
+        trace_precision(53);
+        poly_roots(nodes, poly, 53, 53, loglevel);
+    }
+    for(i = 0; i < K; i++) {
+        if(arb_is_positive(acb_imagref(nodes+i)) || arb_is_negative(acb_imagref(nodes+i))) {
+            logit(NUMERICS, 4, loglevel, "Nonreal root, multi-double engine not applicable\n");
+            return 0;
+        }
+    }
+
+    start = stage_begin();
+    md_rule_init(&r, poly, n);
+    for(i = 0; i < K; i++) {
+        md_set_arf(r.nodes + i, arb_midref(acb_realref(nodes+i)), n);
+    }
+    sched_for(0, K, md_newton_task, &r, SCHED_NORMAL);
+
+    w = (md_t *) malloc(K * sizeof(md_t));
+    ok = md_weights(w, &r);
+    stage_end(STAGE_MULTIDOUBLE, start);
+    logit(NUMERICS, 4, loglevel, "Multi-double system for weights solvable: %i\n", ok);
+
+    /* Certify in ball arithmetic, the monomial basis needs more bits */
+    certified = 0;
+    prec = 0;
+    for(round = 0; ok && !certified && round < MD_CERTIFY_ROUNDS; round++) {
+        prec = (target_prec + K + 64) << round;
+        logit(NUMERICS, 4, loglevel, " current precision for certification: %ld\n", prec);
+        trace_precision(prec);
+        start = stage_begin();
+        certified = md_certify(nodes, weights, &r, w, poly, prec, target_prec);
+        stage_end(STAGE_CERTIFY, start);
+    }
+
+    if(certified) {
+        logit(NUMERICS, 4, loglevel, "Sufficient bits for target precision certified\n");
+        stats_count(COUNT_MULTIDOUBLE, 1);
+        telemetry_weights(prec);
+        progress_weights(prec);
+    }
+
+    free(w);
+    md_rule_clear(&r);
+    return certified;
+}
+
+
+#endif
@@ -11,6 +11,8 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 #include <stdarg.h>
 
 #include "flint/flint.h"
@@ -27,18 +29,56 @@
 #include "acb_mat.h"
 
 #include "helpers.h"
+#include "stages.h"
+#include "telemetry.h"
+#include "fixvec.h"
+
+
+/* Diagnostics of the root finding, filled by 'poly_roots_diag'
+ *
+ * For every round of precision the working precision, the iteration
+ * budget of 'acb_poly_find_roots', the number of isolated roots and the
+ * time are kept. The iterations actually performed are not reported by
+ * Arb. Only the first ROOTDIAG_MAXROUNDS rounds are kept, 'rounds' counts
+ * all of them. A round fails either by isolation, fewer than deg roots
+ * are isolated, or by accuracy, the radii are too large for the target.
+ * Distances and radii are given as base 2 logarithms.
+ */
+
+#define ROOTDIAG_MAXROUNDS 64
+
+typedef struct {
+    long deg;
+    long rounds;
+    long final_prec;
+    long isolation_failures;
+    long accuracy_failures;
+    long prec[ROOTDIAG_MAXROUNDS];
+    long budget[ROOTDIAG_MAXROUNDS];
+    long isolated[ROOTDIAG_MAXROUNDS];
+    double seconds[ROOTDIAG_MAXROUNDS];
+    double total_seconds;
+    double min_separation;
+    double worst_radius;
+} rootdiag_t;
 
 
 long validate_real_roots(const acb_ptr, const long, const long, const int);
 long validate_real_nonnegative_roots(const acb_ptr, const long, const long, const int);
 long validate_real_interval_roots(const acb_ptr, const long, const long, const int);
 
+void count_weights(long *, long *, long *, const acb_ptr, const long, const long);
 long validate_positive_weights(const acb_ptr, const long, const long, const int);
 
 inline void evaluate_polynomial(acb_t, const fmpq_poly_t, const acb_t, const long);
 inline void evaluate_polynomial_vector(acb_ptr, const fmpq_poly_t, const acb_ptr, const int, long);
 
 void poly_roots(acb_ptr, const fmpq_poly_t, const long, const long, const int);
+void poly_roots_seeded(acb_ptr, const fmpq_poly_t, const int, const long, const long, const int);
+void poly_roots_diag(acb_ptr, rootdiag_t *, const fmpq_poly_t, const int, const long, const long, const int);
+double roots_min_separation(const acb_ptr, const long, const long);
+double roots_worst_radius(const acb_ptr, const long);
+int make_real_roots(acb_ptr, const fmpq_poly_t, const long);
 int check_accuracy(const acb_ptr, const long, const long);
 
 
@@ -65,7 +105,7 @@ long validate_real_roots(const acb_ptr roots,
         }
     }
 
-    logit(1, loglevel, "Valid roots found: %lu out of %lu\n", valid_roots, n);
+    logit(VALIDATION, 1, loglevel, "Valid roots found: %lu out of %lu\n", valid_roots, n);
 
     return valid_roots;
 }
@@ -96,7 +136,7 @@ long validate_real_nonnegative_roots(const acb_ptr roots,
         }
     }
 
-    logit(1, loglevel, "Valid roots found: %lu out of %lu\n", valid_roots, n);
+    logit(VALIDATION, 1, loglevel, "Valid roots found: %lu out of %lu\n", valid_roots, n);
 
     return valid_roots;
 }
@@ -138,12 +178,47 @@ long validate_real_interval_roots(const acb_ptr roots,
     arb_clear(one);
     arb_clear(mone);
 
-    logit(1, loglevel, "Valid roots found: %lu out of %lu\n", valid_roots, n);
+    logit(VALIDATION, 1, loglevel, "Valid roots found: %lu out of %lu\n", valid_roots, n);
 
     return valid_roots;
 }
 
 
+void count_weights(long *positive_weights,
+                   long *negative_weights,
+                   long *indefinite_weights,
+                   const acb_ptr weights,
+                   const long n,
+                   const long prec) {
+    /* Count the real weights by sign, weights with a large
+     * imaginary part are not counted at all.
+     *
+     * positive_weights: Number of weights that are certainly positive
+     * negative_weights: Number of weights that are certainly negative
+     * indefinite_weights: Number of weights whose ball contains zero
+     * weights: Array containing the weights
+     * n: Number of weights in the input array
+     * prec: The number of bits used for validation.
+     */
+    long i;
+
+    *positive_weights = 0;
+    *negative_weights = 0;
+    *indefinite_weights = 0;
+    for(i = 0; i < n; i++) {
+        if(arf_cmpabs_2exp_si(arb_midref(acb_imagref(weights+i)), -prec) <= 0) {
+            if(arb_is_positive(acb_realref(weights+i))) {
+                (*positive_weights)++;
+            } else if(arb_is_negative(acb_realref(weights+i))) {
+                (*negative_weights)++;
+            } else {
+                (*indefinite_weights)++;
+            }
+        }
+    }
+}
+
+
 long validate_positive_weights(const acb_ptr weights,
                                const long n,
                                const long prec,
@@ -162,26 +237,12 @@ long validate_positive_weights(const acb_ptr weights,
     long positive_weights;
     long negative_weights;
     long indefinite_weights;
-    long i;
 
-    positive_weights = 0;
-    negative_weights = 0;
-    indefinite_weights = 0;
-    for(i = 0; i < n; i++) {
-        if(arf_cmpabs_2exp_si(arb_midref(acb_imagref(weights+i)), -prec) <= 0) {
-            if(arb_is_positive(acb_realref(weights+i))) {
-                positive_weights++;
-            } else if(arb_is_negative(acb_realref(weights+i))) {
-                negative_weights++;
-            } else {
-                indefinite_weights++;
-            }
-        }
-    }
+    count_weights(&positive_weights, &negative_weights, &indefinite_weights, weights, n, prec);
 
-    logit(1, loglevel, "Positive weights:   %ld out of %ld\n", positive_weights, n);
-    logit(1, loglevel, "Indefinite weights: %ld out of %ld\n", indefinite_weights, n);
-    logit(1, loglevel, "Negative weights:   %ld out of %ld\n", negative_weights, n);
+    logit(VALIDATION, 1, loglevel, "Positive weights:   %ld out of %ld\n", positive_weights, n);
+    logit(VALIDATION, 1, loglevel, "Indefinite weights: %ld out of %ld\n", indefinite_weights, n);
+    logit(VALIDATION, 1, loglevel, "Negative weights:   %ld out of %ld\n", negative_weights, n);
 
     return positive_weights + indefinite_weights;
 }
@@ -220,6 +281,20 @@ inline void evaluate_polynomial_vector(acb_ptr values,
      * prec: The number of bits used for evaluation.
      */
     acb_poly_t p;
+    fixvec_t x, v;
+
+    /* Real points are evaluated on contiguous vectors */
+    if(fixvec_applicable(points, k, prec)) {
+        fixvec_init(x, k, prec);
+        fixvec_init(v, k, prec);
+        fixvec_set_acb(x, points);
+        fixvec_poly_evaluate(v, P, x);
+        fixvec_get_acb(values, v);
+        fixvec_clear(x);
+        fixvec_clear(v);
+        return;
+    }
+
     acb_poly_init(p);
     acb_poly_set_fmpq_poly(p, P, prec);
     acb_poly_evaluate_vec_fast(values, p, points, k, prec);
@@ -247,24 +322,204 @@ void poly_roots(acb_ptr roots,
      * target_prec: Number of bits in target precision
      * loglevel: The log verbosity
      */
-    long prec, deg, isolated, maxiter;
+    poly_roots_seeded(roots, poly, 0, initial_prec, target_prec, loglevel);
+}
+
+
+void poly_roots_seeded(acb_ptr roots,
+                       const fmpq_poly_t poly,
+                       const int seeded,
+                       const long initial_prec,
+                       const long target_prec,
+                       const int loglevel) {
+    /*
+     * roots: An array containing the roots, on input the approximations if seeded
+     * poly: The polynomial whose roots to compute
+     * seeded: Refine the given approximations instead of starting from scratch
+     * initial_prec: Number of bits in initial precision
+     * target_prec: Number of bits in target precision
+     * loglevel: The log verbosity
+     */
+    poly_roots_diag(roots, NULL, poly, seeded, initial_prec, target_prec, loglevel);
+}
+
+
+void poly_roots_diag(acb_ptr roots,
+                     rootdiag_t *diag,
+                     const fmpq_poly_t poly,
+                     const int seeded,
+                     const long initial_prec,
+                     const long target_prec,
+                     const int loglevel) {
+    /*
+     * roots: An array containing the roots, on input the approximations if seeded
+     * diag: Diagnostics of all rounds, may be NULL
+     * poly: The polynomial whose roots to compute
+     * seeded: Refine the given approximations instead of starting from scratch
+     * initial_prec: Number of bits in initial precision
+     * target_prec: Number of bits in target precision
+     * loglevel: The log verbosity
+     */
+    long prec, deg, isolated, maxiter, r;
+    int accurate;
     acb_poly_t cpoly;
+    double start, diag_start, round_start;
 
+    start = stage_begin();
     deg = fmpq_poly_degree(poly);
     acb_poly_init(cpoly);
+    diag_start = 0.0;
+
+    if(diag != NULL) {
+        memset(diag, 0, sizeof(rootdiag_t));
+        diag->deg = deg;
+        diag_start = monotonic_time();
+    }
 
-    for(prec = initial_prec; ; prec *= 2) {
+    for(prec = initial_prec, r = 0; ; prec *= 2, r++) {
+        trace_precision(prec);
+        round_start = diag != NULL ? monotonic_time() : 0.0;
         acb_poly_set_fmpq_poly(cpoly, poly, prec);
         maxiter = FLINT_MIN(deg, prec);
 
-        logit(4, loglevel, "  current precision for roots: %ld\n", prec);
-        isolated = acb_poly_find_roots(roots, cpoly, prec == initial_prec ? NULL : roots, maxiter, prec);
+        logit(NUMERICS, 4, loglevel, "  current precision for roots: %ld\n", prec);
+        isolated = acb_poly_find_roots(roots, cpoly, (prec == initial_prec && !seeded) ? NULL : roots, maxiter, prec);
+        stats_count(COUNT_ROOT_ROUNDS, 1);
+        stats_count(COUNT_ROOT_BUDGET, maxiter);
+        accurate = isolated == deg && check_accuracy(roots, deg, target_prec);
+
+        if(diag != NULL) {
+            if(r < ROOTDIAG_MAXROUNDS) {
+                diag->prec[r] = prec;
+                diag->budget[r] = maxiter;
+                diag->isolated[r] = isolated;
+                diag->seconds[r] = monotonic_time() - round_start;
+            }
+            diag->rounds = r + 1;
+            if(isolated < deg) {
+                diag->isolation_failures++;
+            } else if(!accurate) {
+                diag->accuracy_failures++;
+            }
+        }
 
-        if(isolated == deg && check_accuracy(roots, deg, target_prec)) {
+        if(accurate) {
+            telemetry_roots(prec);
+            progress_roots(prec);
             break;
         }
     }
+
+    if(diag != NULL) {
+        diag->total_seconds = monotonic_time() - diag_start;
+        diag->final_prec = prec;
+        diag->min_separation = roots_min_separation(roots, deg, prec);
+        diag->worst_radius = roots_worst_radius(roots, deg);
+    }
     acb_poly_clear(cpoly);
+    stage_end(STAGE_ROOTS, start);
+}
+
+
+double roots_min_separation(const acb_ptr roots,
+                            const long deg,
+                            const long prec) {
+    /* Base 2 logarithm of the smallest distance between
+     * the midpoints of two roots, infinity for a single root.
+     *
+     * roots: Array containing the roots
+     * deg: Number of roots
+     * prec: Number of bits used for the distances
+     */
+    acb_t a, b, d;
+    mag_t m, mmin;
+    long i, j;
+    double result;
+
+    if(deg < 2) {
+        return HUGE_VAL;
+    }
+    acb_init(a);
+    acb_init(b);
+    acb_init(d);
+    mag_init(m);
+    mag_init(mmin);
+    mag_inf(mmin);
+
+    for(i = 0; i < deg; i++) {
+        acb_get_mid(a, roots + i);
+        for(j = i + 1; j < deg; j++) {
+            acb_get_mid(b, roots + j);
+            acb_sub(d, a, b, prec);
+            acb_get_mag_lower(m, d);
+            mag_min(mmin, mmin, m);
+        }
+    }
+    result = mag_is_zero(mmin) ? -HUGE_VAL : mag_get_d_log2_approx(mmin);
+
+    acb_clear(a);
+    acb_clear(b);
+    acb_clear(d);
+    mag_clear(m);
+    mag_clear(mmin);
+    return result;
+}
+
+
+double roots_worst_radius(const acb_ptr roots,
+                          const long deg) {
+    /* Base 2 logarithm of the largest radius of all roots
+     *
+     * roots: Array containing the roots
+     * deg: Number of roots
+     */
+    mag_t m;
+    long i;
+    double result;
+
+    mag_init(m);
+    for(i = 0; i < deg; i++) {
+        mag_max(m, m, arb_radref(acb_realref(roots + i)));
+        mag_max(m, m, arb_radref(acb_imagref(roots + i)));
+    }
+    result = mag_is_zero(m) ? -HUGE_VAL : mag_get_d_log2_approx(m);
+    mag_clear(m);
+    return result;
+}
+
+
+int make_real_roots(acb_ptr roots,
+                    const fmpq_poly_t poly,
+                    const long prec) {
+    /* Drop the imaginary parts of the roots if all of them are proven
+     * real, returns 1 then. The roots must be isolated.
+     *
+     * roots: The isolated roots of the polynomial
+     * poly: The real polynomial
+     * prec: Number of bits used for the validation
+     */
+    fmpz_poly_t num;
+    acb_poly_t p;
+    long i, deg;
+    int real;
+
+    deg = fmpq_poly_degree(poly);
+    fmpz_poly_init(num);
+    acb_poly_init(p);
+
+    /* The numerator has the same roots and exact coefficients */
+    fmpq_poly_get_numerator(num, poly);
+    acb_poly_set_fmpz_poly(p, num, FLINT_MAX(prec, FLINT_ABS(fmpz_poly_max_bits(num)) + 1));
+    real = acb_poly_validate_real_roots(roots, p, prec);
+    if(real) {
+        for(i = 0; i < deg; i++) {
+            arb_zero(acb_imagref(roots + i));
+        }
+    }
+
+    fmpz_poly_clear(num);
+    acb_poly_clear(p);
+    return real;
 }
 
 
@@ -0,0 +1,329 @@
+/*  Author: R. Bourquin
+ *  Copyright: (C) 2014 R. Bourquin
+ *  License: GNU GPL v2 or above
+ *
+ *  A library of helper functions to search for
+ *  Kronrod extensions of Gauss quadrature rules.
+ */
+
+#ifndef __HH__output
+#define __HH__output
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <mpfr.h>
+
+#include "arf.h"
+#include "arb.h"
+#include "acb.h"
+
+#include "stages.h"
+
+
+/* Number of entries converted in parallel before writing them out */
+#define OUTPUT_BLOCK 8192
+
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t alloc;
+} outbuf_struct;
+
+typedef outbuf_struct outbuf_t[1];
+
+
+typedef struct {
+    acb_srcptr vec;
+    arb_srcptr table;
+    long cols;
+    long digits;
+    char **strs;
+} outstrs_t;
+
+
+void outbuf_init(outbuf_t);
+void outbuf_clear(outbuf_t);
+void outbuf_puts(outbuf_t, const char *);
+void outbuf_write(outbuf_t, FILE *);
+
+char * arf_get_strd(const arf_t, const long);
+char * arb_get_strd(const arb_t, const long);
+char * acb_get_strd(const acb_t, const long);
+
+void acb_strd_task(void *, const long);
+void arb_row_strd_task(void *, const long);
+
+void print_acb_vec(FILE *, const acb_ptr, const long, const char *, const char *, const long);
+void print_arb_table(FILE *, arb_srcptr, const long, const long, const char *, const char *, const char *, const long);
+
+
+void outbuf_init(outbuf_t buf) {
+    buf->alloc = 1 << 20;
+    buf->len = 0;
+    buf->data = (char *) malloc(buf->alloc);
+}
+
+
+void outbuf_clear(outbuf_t buf) {
+    free(buf->data);
+    buf->data = NULL;
+    buf->len = 0;
+    buf->alloc = 0;
+}
+
+
+void outbuf_puts(outbuf_t buf, const char *str) {
+    /* Append a string to the buffer, growing it geometrically
+     *
+     * buf: The output buffer
+     * str: The string to append
+     */
+    size_t n;
+
+    n = strlen(str);
+    if(buf->len + n > buf->alloc) {
+        while(buf->len + n > buf->alloc) {
+            buf->alloc *= 2;
+        }
+        buf->data = (char *) realloc(buf->data, buf->alloc);
+    }
+    memcpy(buf->data + buf->len, str, n);
+    buf->len += n;
+}
+
+
+void outbuf_write(outbuf_t buf, FILE *file) {
+    /* Write the buffer content with a single call and empty the buffer
+     *
+     * buf: The output buffer
+     * file: The output file
+     */
+    fwrite(buf->data, 1, buf->len, file);
+    buf->len = 0;
+}
+
+
+char * arf_get_strd(const arf_t x, const long digits) {
+    /* Convert a floating point number to a decimal string with the
+     * same layout as 'arf_printd'. The result has to be freed by 'free'.
+     *
+     * x: The number to convert
+     * digits: Number of significant decimal digits
+     */
+    mpfr_t t;
+    char *s, *r;
+    long d;
+
+    d = digits > 1 ? digits : 1;
+    mpfr_init2(t, d * 3.33 + 10);
+    arf_get_mpfr(t, x, MPFR_RNDN);
+    mpfr_asprintf(&s, "%.*Rg", (int) d, t);
+    mpfr_clear(t);
+
+    r = (char *) malloc(strlen(s) + 1);
+    strcpy(r, s);
+    mpfr_free_str(s);
+    return r;
+}
+
+
+char * arb_get_strd(const arb_t x, const long digits) {
+    /* Convert a ball to a decimal string with the
+     * same layout as 'arb_printd'. The result has to be freed by 'free'.
+     *
+     * x: The ball to convert
+     * digits: Number of significant decimal digits
+     */
+    char *mid, *rad, *r;
+    arf_t t;
+
+    arf_init(t);
+    arf_set_mag(t, arb_radref(x));
+    mid = arf_get_strd(arb_midref(x), digits);
+    rad = arf_get_strd(t, 5);
+    arf_clear(t);
+
+    r = (char *) malloc(strlen(mid) + strlen(rad) + 6);
+    sprintf(r, "%s +/- %s", mid, rad);
+    free(mid);
+    free(rad);
+    return r;
+}
+
+
+char * acb_get_strd(const acb_t z, const long digits) {
+    /* Convert a complex ball to a decimal string with the
+     * same layout as 'acb_printd'. The result has to be freed by 'free'.
+     *
+     * z: The complex ball to convert
+     * digits: Number of significant decimal digits
+     */
+    char *re, *im, *rre, *rim, *r;
+    const char *sign;
+    arf_t t;
+
+    arf_init(t);
+    re = arf_get_strd(arb_midref(acb_realref(z)), digits);
+    if(arf_sgn(arb_midref(acb_imagref(z))) < 0) {
+        sign = " - ";
+        arf_neg(t, arb_midref(acb_imagref(z)));
+    } else {
+        sign = " + ";
+        arf_set(t, arb_midref(acb_imagref(z)));
+    }
+    im = arf_get_strd(t, digits);
+    arf_set_mag(t, arb_radref(acb_realref(z)));
+    rre = arf_get_strd(t, 3);
+    arf_set_mag(t, arb_radref(acb_imagref(z)));
+    rim = arf_get_strd(t, 3);
+    arf_clear(t);
+
+    r = (char *) malloc(strlen(re) + strlen(im) + strlen(rre) + strlen(rim) + 24);
+    sprintf(r, "(%s%s%sj)  +/-  (%s, %sj)", re, sign, im, rre, rim);
+    free(re);
+    free(im);
+    free(rre);
+    free(rim);
+    return r;
+}
+
+
+void acb_strd_task(void *arg,
+                   const long j) {
+    /* Task converting the j-th entry of a vector
+     */
+    outstrs_t *o;
+
+    o = (outstrs_t *) arg;
+    o->strs[j] = acb_get_strd(o->vec + j, o->digits);
+}
+
+
+void arb_row_strd_task(void *arg,
+                       const long j) {
+    /* Task converting the j-th row of a table
+     */
+    outstrs_t *o;
+    long k;
+
+    o = (outstrs_t *) arg;
+    for(k = 0; k < o->cols; k++) {
+        o->strs[j*o->cols + k] = arb_get_strd(o->table + j*o->cols + k, o->digits);
+    }
+}
+
+
+void print_acb_vec(FILE *file,
+                   const acb_ptr vec,
+                   const long len,
+                   const char *prefix,
+                   const char *suffix,
+                   const long digits) {
+    /* Print a vector of complex balls one per line. Blocks of entries
+     * are converted to strings in parallel and written in order with
+     * a single write per block.
+     *
+     * file: The output file
+     * vec: The vector to print
+     * len: Number of entries
+     * prefix: String printed before each entry
+     * suffix: String printed after each entry
+     * digits: Number of significant decimal digits
+     */
+    long i, j, block;
+    char **strs;
+    outbuf_t buf;
+    outstrs_t o;
+    double start;
+
+    start = stage_begin();
+    fflush(file);
+    outbuf_init(buf);
+    strs = (char **) malloc(OUTPUT_BLOCK * sizeof(char *));
+    o.strs = strs;
+    o.digits = digits;
+
+    for(i = 0; i < len; i += OUTPUT_BLOCK) {
+        block = len - i < OUTPUT_BLOCK ? len - i : OUTPUT_BLOCK;
+
+        o.vec = vec + i;
+        sched_for(0, block, acb_strd_task, &o, SCHED_LOW);
+
+        for(j = 0; j < block; j++) {
+            outbuf_puts(buf, prefix);
+            outbuf_puts(buf, strs[j]);
+            outbuf_puts(buf, suffix);
+            free(strs[j]);
+        }
+        outbuf_write(buf, file);
+    }
+
+    free(strs);
+    outbuf_clear(buf);
+    stage_end(STAGE_OUTPUT, start);
+}
+
+
+void print_arb_table(FILE *file,
+                     arb_srcptr table,
+                     const long rows,
+                     const long cols,
+                     const char *prefix,
+                     const char *separator,
+                     const char *suffix,
+                     const long digits) {
+    /* Print a table of balls one row per line. Blocks of rows
+     * are converted to strings in parallel and written in order with
+     * a single write per block.
+     *
+     * file: The output file
+     * table: The entries in row-major order
+     * rows: Number of rows
+     * cols: Number of columns
+     * prefix: String printed before each row
+     * separator: String printed after each entry
+     * suffix: String printed after each row
+     * digits: Number of significant decimal digits
+     */
+    long i, j, k, block;
+    char **strs;
+    outbuf_t buf;
+    outstrs_t o;
+    double start;
+
+    start = stage_begin();
+    fflush(file);
+    outbuf_init(buf);
+    strs = (char **) malloc(OUTPUT_BLOCK * cols * sizeof(char *));
+    o.strs = strs;
+    o.cols = cols;
+    o.digits = digits;
+
+    for(i = 0; i < rows; i += OUTPUT_BLOCK) {
+        block = rows - i < OUTPUT_BLOCK ? rows - i : OUTPUT_BLOCK;
+
+        o.table = table + i*cols;
+        sched_for(0, block, arb_row_strd_task, &o, SCHED_LOW);
+
+        for(j = 0; j < block; j++) {
+            outbuf_puts(buf, prefix);
+            for(k = 0; k < cols; k++) {
+                outbuf_puts(buf, strs[j*cols + k]);
+                outbuf_puts(buf, separator);
+                free(strs[j*cols + k]);
+            }
+            outbuf_puts(buf, suffix);
+        }
+        outbuf_write(buf, file);
+    }
+
+    free(strs);
+    outbuf_clear(buf);
+    stage_end(STAGE_OUTPUT, start);
+}
+
+
+#endif
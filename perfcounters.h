@@ -0,0 +1,311 @@
+/*  Author: R. Bourquin
+ *  Copyright: (C) 2014 R. Bourquin
+ *  License: GNU GPL v2 or above
+ *
+ *  A library of helper functions to search for
+ *  Kronrod extensions of Gauss quadrature rules.
+ */
+
+#ifndef __HH__perfcounters
+#define __HH__perfcounters
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "scheduler.h"
+
+
+/* Hardware performance counters per stage and thread
+ *
+ * Every thread opens its own set of Linux perf events on first use: cycles,
+ * instructions, cache misses and branch misses in user space. The cycles
+ * lead a group, so all counters run over the same time windows and are read
+ * at once. If the kernel multiplexes the group with other events the counts
+ * are scaled by the time enabled over the time running. Between
+ * 'perf_push' and 'perf_pop' the differences of the counters are added to
+ * the stage. Stages are nested, hence the counts of a stage include those
+ * of all stages within. Counters the hardware or the kernel do not offer
+ * are left out. The kernel must allow user space profiling, see
+ * /proc/sys/kernel/perf_event_paranoid.
+ */
+
+#define PERF_NCOUNTERS 4
+#define PERF_MAXDEPTH 32
+#define PERF_MAXSTAGES 32
+
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_BRANCH_MISSES
+} perf_counter_t;
+
+const char *perf_counter_names[PERF_NCOUNTERS] = {
+    "cycles",
+    "instructions",
+    "cache misses",
+    "branch misses"
+};
+
+
+typedef struct {
+    int opened;
+    int fd[PERF_NCOUNTERS];
+    /* Position of each counter in a read of the group, -1 if not opened */
+    int slot[PERF_NCOUNTERS];
+    int nslots;
+    int depth;
+    unsigned long long stack[PERF_MAXDEPTH][PERF_NCOUNTERS];
+    /* Avoid false sharing between threads */
+    char pad[64];
+} perf_thread_t;
+
+
+int perf_enabled = 0;
+int perf_nthreads = 0;
+perf_thread_t *perf_threads = NULL;
+unsigned long long perf_stages[PERF_MAXSTAGES][PERF_NCOUNTERS];
+
+
+int perf_open(const unsigned long long, const int);
+int perf_enable(void);
+perf_thread_t * perf_thread(void);
+void perf_read(unsigned long long *, const perf_thread_t *);
+void perf_push(void);
+void perf_pop(const int);
+void perf_report(const char **, const int, const long);
+
+
+int perf_open(const unsigned long long config,
+              const int group) {
+    /* Open a counter of the calling thread, returns the file descriptor or -1
+     *
+     * config: The hardware event
+     * group: The file descriptor of the group leader, -1 to open a leader
+     */
+#ifdef __linux__
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+#else
+    return -1;
+#endif
+}
+
+
+int perf_enable(void) {
+    /* Enable the counters, returns 0 if they are not available
+     */
+    int fd;
+
+    if(perf_enabled) {
+        return 1;
+    }
+#ifdef __linux__
+    /* Probe for permission on the main thread */
+    fd = perf_open(PERF_COUNT_HW_CPU_CYCLES, -1);
+#else
+    fd = -1;
+#endif
+    if(fd < 0) {
+        printf("Hardware performance counters are not available\n");
+        return 0;
+    }
+    close(fd);
+    perf_nthreads = sched_nslots();
+    perf_threads = (perf_thread_t *) calloc(perf_nthreads, sizeof(perf_thread_t));
+    perf_enabled = 1;
+    return 1;
+}
+
+
+perf_thread_t * perf_thread(void) {
+    /* The counters of the calling thread, opened on first use, or NULL
+     */
+#ifdef __linux__
+    const unsigned long long config[PERF_NCOUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+#endif
+    perf_thread_t *t;
+    int tid, i;
+
+    if(!perf_enabled) {
+        return NULL;
+    }
+    tid = sched_slot();
+    if(tid >= perf_nthreads) {
+        return NULL;
+    }
+    t = perf_threads + tid;
+    if(!t->opened) {
+        for(i = 0; i < PERF_NCOUNTERS; i++) {
+            t->fd[i] = -1;
+            t->slot[i] = -1;
+        }
+        t->nslots = 0;
+#ifdef __linux__
+        /* Without the leader there is no group */
+        t->fd[PERF_CYCLES] = perf_open(PERF_COUNT_HW_CPU_CYCLES, -1);
+        if(t->fd[PERF_CYCLES] >= 0) {
+            t->slot[PERF_CYCLES] = t->nslots++;
+            for(i = 0; i < PERF_NCOUNTERS; i++) {
+                if(i != PERF_CYCLES) {
+                    t->fd[i] = perf_open(config[i], t->fd[PERF_CYCLES]);
+                    t->slot[i] = t->fd[i] >= 0 ? t->nslots++ : -1;
+                }
+            }
+        }
+#endif
+        t->opened = 1;
+    }
+    return t;
+}
+
+
+void perf_read(unsigned long long *values,
+               const perf_thread_t *t) {
+    /* Read all counters of a thread at once, scaled to the time enabled
+     *
+     * values: The counter values, zero for unavailable counters
+     * t: The thread
+     */
+    /* Number of counters, time enabled, time running, then the counters */
+    unsigned long long group[3 + PERF_NCOUNTERS];
+    ssize_t len;
+    double scale;
+    int i;
+
+    for(i = 0; i < PERF_NCOUNTERS; i++) {
+        values[i] = 0;
+    }
+    if(t->nslots == 0) {
+        return;
+    }
+    len = read(t->fd[PERF_CYCLES], group, sizeof(group));
+    if(len < (ssize_t) ((3 + t->nslots) * sizeof(unsigned long long)) || group[2] == 0) {
+        return;
+    }
+    scale = (double) group[1] / group[2];
+    for(i = 0; i < PERF_NCOUNTERS; i++) {
+        if(t->slot[i] >= 0) {
+            values[i] = group[2] < group[1] ? (unsigned long long) (scale * group[3 + t->slot[i]]) : group[3 + t->slot[i]];
+        }
+    }
+}
+
+
+void perf_push(void) {
+    /* Start counting a stage of the calling thread
+     */
+    perf_thread_t *t;
+
+    if((t = perf_thread()) == NULL) {
+        return;
+    }
+    if(t->depth < PERF_MAXDEPTH) {
+        perf_read(t->stack[t->depth], t);
+    }
+    t->depth++;
+}
+
+
+void perf_pop(const int stage) {
+    /* Finish counting a stage of the calling thread
+     *
+     * stage: The stage
+     */
+    perf_thread_t *t;
+    unsigned long long values[PERF_NCOUNTERS];
+    int i, d;
+
+    if((t = perf_thread()) == NULL) {
+        return;
+    }
+    t->depth--;
+    d = t->depth;
+    if(d < 0 || d >= PERF_MAXDEPTH || stage >= PERF_MAXSTAGES) {
+        t->depth = d < 0 ? 0 : t->depth;
+        return;
+    }
+    perf_read(values, t);
+    for(i = 0; i < PERF_NCOUNTERS; i++) {
+        __atomic_add_fetch(&perf_stages[stage][i], values[i] - t->stack[d][i], __ATOMIC_RELAXED);
+    }
+}
+
+
+void perf_report(const char **names,
+                 const int nstages,
+                 const long candidates) {
+    /* Print the counters per stage and per thread
+     *
+     * names: The names of the stages
+     * nstages: Number of stages
+     * candidates: Number of candidates for the averages, may be 0
+     */
+    unsigned long long values[PERF_NCOUNTERS];
+    unsigned long long *c;
+    int i;
+
+    printf("%-15s %14s %14s %6s %14s %14s\n", "stage", perf_counter_names[PERF_CYCLES],
+           perf_counter_names[PERF_INSTRUCTIONS], "IPC", perf_counter_names[PERF_CACHE_MISSES],
+           perf_counter_names[PERF_BRANCH_MISSES]);
+    for(i = 0; i < nstages && i < PERF_MAXSTAGES; i++) {
+        c = perf_stages[i];
+        if(c[PERF_CYCLES] == 0) {
+            continue;
+        }
+        printf("%-15s %14llu %14llu %6.2f %14llu %14llu\n", names[i], c[PERF_CYCLES], c[PERF_INSTRUCTIONS],
+               (double) c[PERF_INSTRUCTIONS] / c[PERF_CYCLES], c[PERF_CACHE_MISSES], c[PERF_BRANCH_MISSES]);
+    }
+    if(candidates > 0) {
+        printf("-------------------------------------------------------------------------------------\n");
+        printf("%-15s %14s %14s %6s %14s %14s\n", "per candidate", perf_counter_names[PERF_CYCLES],
+               perf_counter_names[PERF_INSTRUCTIONS], "", perf_counter_names[PERF_CACHE_MISSES],
+               perf_counter_names[PERF_BRANCH_MISSES]);
+        for(i = 0; i < nstages && i < PERF_MAXSTAGES; i++) {
+            c = perf_stages[i];
+            if(c[PERF_CYCLES] == 0) {
+                continue;
+            }
+            printf("%-15s %14.4g %14.4g %6s %14.4g %14.4g\n", names[i], (double) c[PERF_CYCLES] / candidates,
+                   (double) c[PERF_INSTRUCTIONS] / candidates, "", (double) c[PERF_CACHE_MISSES] / candidates,
+                   (double) c[PERF_BRANCH_MISSES] / candidates);
+        }
+    }
+    printf("-------------------------------------------------------------------------------------\n");
+    printf("%-15s %14s %14s %6s %14s %14s\n", "thread", perf_counter_names[PERF_CYCLES],
+           perf_counter_names[PERF_INSTRUCTIONS], "IPC", perf_counter_names[PERF_CACHE_MISSES],
+           perf_counter_names[PERF_BRANCH_MISSES]);
+    for(i = 0; i < perf_nthreads; i++) {
+        if(!perf_threads[i].opened) {
+            continue;
+        }
+        perf_read(values, perf_threads + i);
+        printf("%-15d %14llu %14llu %6.2f %14llu %14llu\n", i, values[PERF_CYCLES], values[PERF_INSTRUCTIONS],
+               values[PERF_CYCLES] > 0 ? (double) values[PERF_INSTRUCTIONS] / values[PERF_CYCLES] : 0.0,
+               values[PERF_CACHE_MISSES], values[PERF_BRANCH_MISSES]);
+    }
+    printf("-------------------------------------------------------------------------------------\n");
+}
+
+
+#endif
@@ -26,31 +26,37 @@ void hermite_polynomial_pro(fmpq_poly_t, const int);
 void integrate_hermite_pro(fmpq_t, const int);
 void moments_hermite_pro(fmpq_mat_t, const int);
 void transcendental_factor_hermite_pro(arb_t, const long);
+void recurrence_hermite_pro(fmpq_t, fmpq_t, fmpq_t, const int);
 
 void hermite_polynomial_phy(fmpq_poly_t, const int);
 void integrate_hermite_phy(fmpq_t, const int);
 void moments_hermite_phy(fmpq_mat_t, const int);
 void transcendental_factor_hermite_phy(arb_t, const long);
+void recurrence_hermite_phy(fmpq_t, fmpq_t, fmpq_t, const int);
 
 void laguerre_polynomial(fmpq_poly_t, const int);
 void integrate_laguerre(fmpq_t, const int);
 void moments_laguerre(fmpq_mat_t, const int);
 void transcendental_factor_laguerre(arb_t, const long);
+void recurrence_laguerre(fmpq_t, fmpq_t, fmpq_t, const int);
 
 void legendre_polynomial(fmpq_poly_t, const int);
 void integrate_legendre(fmpq_t, const int);
 void moments_legendre(fmpq_mat_t, const int);
 void transcendental_factor_legendre(arb_t, const long);
+void recurrence_legendre(fmpq_t, fmpq_t, fmpq_t, const int);
 
 void chebyshevt_polynomial(fmpq_poly_t, const int);
 void integrate_chebyshevt(fmpq_t, const int);
 void moments_chebyshevt(fmpq_mat_t, const int);
 void transcendental_factor_chebyshevt(arb_t, const long);
+void recurrence_chebyshevt(fmpq_t, fmpq_t, fmpq_t, const int);
 
 void chebyshevu_polynomial(fmpq_poly_t, const int);
 void integrate_chebyshevu(fmpq_t, const int);
 void moments_chebyshevu(fmpq_mat_t, const int);
 void transcendental_factor_chebyshevu(arb_t, const long);
+void recurrence_chebyshevu(fmpq_t, fmpq_t, fmpq_t, const int);
 
 
 void hermite_polynomial_pro(fmpq_poly_t Hn, const int n) {
@@ -183,6 +189,20 @@ void transcendental_factor_hermite_pro(arb_t t, const long prec) {
 }
 
 
+void recurrence_hermite_pro(fmpq_t A, fmpq_t B, fmpq_t C, const int n) {
+    /* Coefficients of the three term recursion of the
+     * probabilists' Hermite polynomials:
+     *
+     * H_{n+1}(x) = x H_n(x) - n H_{n-1}(x)
+     *
+     * in the form P_{n+1}(x) = (A x + B) P_n(x) - C P_{n-1}(x)
+     */
+    fmpq_one(A);
+    fmpq_zero(B);
+    fmpq_set_si(C, n, 1);
+}
+
+
 void hermite_polynomial_phy(fmpq_poly_t Hn, const int n) {
     /* Compute the n-th Hermite polynomial by a
      * three term recursion:
@@ -316,6 +336,20 @@ void transcendental_factor_hermite_phy(arb_t t, const long prec) {
 }
 
 
+void recurrence_hermite_phy(fmpq_t A, fmpq_t B, fmpq_t C, const int n) {
+    /* Coefficients of the three term recursion of the
+     * physicists' Hermite polynomials:
+     *
+     * H_{n+1}(x) = 2 x H_n(x) - 2 n H_{n-1}(x)
+     *
+     * in the form P_{n+1}(x) = (A x + B) P_n(x) - C P_{n-1}(x)
+     */
+    fmpq_set_si(A, 2, 1);
+    fmpq_zero(B);
+    fmpq_set_si(C, 2*n, 1);
+}
+
+
 void laguerre_polynomial(fmpq_poly_t Ln, const int n) {
     /* Compute the n-th Laguerre polynomial by a
      * three term recursion:
@@ -437,6 +471,20 @@ void transcendental_factor_laguerre(arb_t t, const long prec) {
 }
 
 
+void recurrence_laguerre(fmpq_t A, fmpq_t B, fmpq_t C, const int n) {
+    /* Coefficients of the three term recursion of the
+     * Laguerre polynomials:
+     *
+     * L_{n+1}(x) = (2*n + 1 - x) / (n + 1) * L_n(x) - n / (n + 1) * L_{n-1}(x)
+     *
+     * in the form P_{n+1}(x) = (A x + B) P_n(x) - C P_{n-1}(x)
+     */
+    fmpq_set_si(A, -1, n + 1);
+    fmpq_set_si(B, 2*n + 1, n + 1);
+    fmpq_set_si(C, n, n + 1);
+}
+
+
 void legendre_polynomial(fmpq_poly_t Pn, const int n) {
     /* Compute the n-th Legendre polynomial by a
      * three term recursion:
@@ -560,6 +608,20 @@ void transcendental_factor_legendre(arb_t t, const long prec) {
 }
 
 
+void recurrence_legendre(fmpq_t A, fmpq_t B, fmpq_t C, const int n) {
+    /* Coefficients of the three term recursion of the
+     * Legendre polynomials:
+     *
+     * P_{n+1}(x) = (2*n + 1) / (n + 1) * x * P_n(x) - n / (n + 1) * P_{n-1}(x)
+     *
+     * in the form P_{n+1}(x) = (A x + B) P_n(x) - C P_{n-1}(x)
+     */
+    fmpq_set_si(A, 2*n + 1, n + 1);
+    fmpq_zero(B);
+    fmpq_set_si(C, n, n + 1);
+}
+
+
 void chebyshevt_polynomial(fmpq_poly_t Tn, const int n) {
     /* Compute the n-th Chebyshev polynomial by a
      * three term recursion:
@@ -696,6 +758,21 @@ void transcendental_factor_chebyshevt(arb_t t, const long prec) {
 }
 
 
+void recurrence_chebyshevt(fmpq_t A, fmpq_t B, fmpq_t C, const int n) {
+    /* Coefficients of the three term recursion of the
+     * Chebyshev polynomials of the first kind:
+     *
+     * T_1(x) = x
+     * T_{n+1}(x) = 2 * x * T_n(x) - T_{n-1}(x)
+     *
+     * in the form P_{n+1}(x) = (A x + B) P_n(x) - C P_{n-1}(x)
+     */
+    fmpq_set_si(A, n == 0 ? 1 : 2, 1);
+    fmpq_zero(B);
+    fmpq_one(C);
+}
+
+
 void chebyshevu_polynomial(fmpq_poly_t Un, const int n) {
     /* Compute the n-th Chebyshev polynomial by a
      * three term recursion:
@@ -833,4 +910,18 @@ void transcendental_factor_chebyshevu(arb_t t, const long prec) {
 }
 
 
+void recurrence_chebyshevu(fmpq_t A, fmpq_t B, fmpq_t C, const int n) {
+    /* Coefficients of the three term recursion of the
+     * Chebyshev polynomials of the second kind:
+     *
+     * U_{n+1}(x) = 2 * x * U_n(x) - U_{n-1}(x)
+     *
+     * in the form P_{n+1}(x) = (A x + B) P_n(x) - C P_{n-1}(x)
+     */
+    fmpq_set_si(A, 2, 1);
+    fmpq_zero(B);
+    fmpq_one(C);
+}
+
+
 #endif
@@ -0,0 +1,415 @@
+/*  Author: R. Bourquin
+ *  Copyright: (C) 2014 R. Bourquin
+ *  License: GNU GPL v2 or above
+ *
+ *  A library of helper functions to search for
+ *  Kronrod extensions of Gauss quadrature rules.
+ */
+
+#ifndef __HH__progress
+#define __HH__progress
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "stages.h"
+
+
+/* Live progress of long searches
+ *
+ * The workers only update a few counters and the candidate each thread
+ * is working on, the frontier. A background thread periodically writes
+ * all values as a file in the Prometheus text format, e.g. for the
+ * textfile collector of the node exporter. The file is written to a
+ * temporary name and renamed into place, hence a scraper never sees a
+ * partial file.
+ *
+ * If the program knows the candidates in advance it announces them by
+ * 'progress_plan'. The remaining time is then estimated from the cost
+ * model p^3 + n p^2 of a candidate (n, p), which follows the growth of
+ * the exact solve for the extension of order p of a rule of order n.
+ */
+
+#define PROGRESS_MAXPATH 4096
+
+typedef enum {
+    REJECT_UNSOLVABLE,
+    REJECT_NODES,
+    REJECT_WEIGHTS,
+    REJECT_OTHER,
+    NREJECTS
+} reject_t;
+
+const char *reject_names[NREJECTS] = {
+    "unsolvable",
+    "nodes",
+    "weights",
+    "other"
+};
+
+
+typedef struct {
+    int active;
+    int n;
+    int p;
+    int depth;
+    reject_t reason;
+    /* Avoid false sharing between threads */
+    char pad[64];
+} progress_thread_t;
+
+
+int progress_enabled = 0;
+int progress_nthreads = 0;
+int progress_stop = 0;
+double progress_interval = 0.0;
+double progress_start = 0.0;
+double progress_last_time = 0.0;
+char progress_file[PROGRESS_MAXPATH];
+const char *progress_family = NULL;
+long progress_planned = 0;
+long progress_planned_cost = 0;
+long progress_candidates = 0;
+long progress_cost = 0;
+long progress_solvable = 0;
+long progress_valid = 0;
+long progress_rejections[NREJECTS];
+long progress_roots_prec = 0;
+long progress_roots_count = 0;
+long progress_weights_prec = 0;
+long progress_weights_count = 0;
+long progress_last_totals[NSTAGES];
+progress_thread_t *progress_threads = NULL;
+pthread_t progress_writer;
+pthread_mutex_t progress_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t progress_wakeup = PTHREAD_COND_INITIALIZER;
+
+
+long progress_cost_model(const int, const int);
+void progress_enable(const char *, const char *, const double);
+void progress_plan(const long, const long);
+progress_thread_t * progress_thread(void);
+void progress_candidate_begin(const int, const int, const int);
+void progress_candidate_end(const int, const int);
+void progress_reject(const reject_t);
+void progress_roots(const long);
+void progress_weights(const long);
+void progress_write(void);
+void * progress_main(void *);
+void progress_close(void);
+
+
+long progress_cost_model(const int n,
+                         const int p) {
+    /* Estimated relative cost of the candidate (n, p)
+     *
+     * n: The order of the basis rule
+     * p: The order of the extension
+     */
+    return (long) p * p * p + (long) n * p * p;
+}
+
+
+void progress_enable(const char *file,
+                     const char *family,
+                     const double interval) {
+    /* Enable the progress file and start its writer thread
+     *
+     * file: The output file
+     * family: Name of the polynomial family
+     * interval: Seconds between two updates of the file
+     */
+    if(progress_enabled) {
+        return;
+    }
+    if(strlen(file) + 16 > PROGRESS_MAXPATH) {
+        printf("Progress file name too long: %s\n", file);
+        return;
+    }
+    strcpy(progress_file, file);
+    progress_family = family;
+    progress_interval = interval > 0.0 ? interval : 15.0;
+    progress_nthreads = sched_nslots();
+    progress_threads = (progress_thread_t *) calloc(progress_nthreads, sizeof(progress_thread_t));
+    progress_start = monotonic_time();
+    progress_last_time = progress_start;
+    stage_totals_enable();
+
+    if(pthread_create(&progress_writer, NULL, progress_main, NULL) != 0) {
+        printf("Can not start the progress writer\n");
+        free(progress_threads);
+        return;
+    }
+    progress_enabled = 1;
+    atexit(progress_close);
+}
+
+
+void progress_plan(const long candidates,
+                   const long cost) {
+    /* Announce the total work of the search
+     *
+     * candidates: Number of candidates
+     * cost: Sum of the cost model over all candidates
+     */
+    progress_planned = candidates;
+    progress_planned_cost = cost;
+}
+
+
+progress_thread_t * progress_thread(void) {
+    /* The frontier of the calling thread or NULL if disabled
+     */
+    int tid;
+
+    if(!progress_enabled) {
+        return NULL;
+    }
+    tid = sched_slot();
+    return tid < progress_nthreads ? progress_threads + tid : NULL;
+}
+
+
+void progress_candidate_begin(const int n,
+                              const int p,
+                              const int depth) {
+    /* Start working on a candidate
+     *
+     * n: The order of the basis rule
+     * p: The order of the extension
+     * depth: The recursion depth
+     */
+    progress_thread_t *t;
+
+    if((t = progress_thread()) == NULL) {
+        return;
+    }
+    t->n = n;
+    t->p = p;
+    t->depth = depth;
+    t->reason = REJECT_OTHER;
+    t->active = 1;
+}
+
+
+void progress_candidate_end(const int solvable,
+                            const int valid) {
+    /* Finish a candidate and count it
+     *
+     * solvable: Whether the extension exists
+     * valid: Whether the extension passed the validation
+     */
+    progress_thread_t *t;
+
+    if((t = progress_thread()) == NULL) {
+        return;
+    }
+    __atomic_add_fetch(&progress_candidates, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&progress_cost, progress_cost_model(t->n, t->p), __ATOMIC_RELAXED);
+    if(solvable) {
+        __atomic_add_fetch(&progress_solvable, 1, __ATOMIC_RELAXED);
+    }
+    if(valid) {
+        __atomic_add_fetch(&progress_valid, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_add_fetch(progress_rejections + (solvable ? t->reason : REJECT_UNSOLVABLE), 1, __ATOMIC_RELAXED);
+    }
+    t->active = 0;
+}
+
+
+void progress_reject(const reject_t reason) {
+    /* Record why the current candidate of the calling thread fails
+     *
+     * reason: The reason
+     */
+    progress_thread_t *t;
+
+    if((t = progress_thread()) != NULL) {
+        t->reason = reason;
+    }
+}
+
+
+void progress_roots(const long prec) {
+    if(progress_enabled) {
+        __atomic_add_fetch(&progress_roots_prec, prec, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&progress_roots_count, 1, __ATOMIC_RELAXED);
+    }
+}
+
+
+void progress_weights(const long prec) {
+    if(progress_enabled) {
+        __atomic_add_fetch(&progress_weights_prec, prec, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&progress_weights_count, 1, __ATOMIC_RELAXED);
+    }
+}
+
+
+void progress_write(void) {
+    /* Write all metrics to a temporary file and rename it into place
+     */
+    char tmppath[PROGRESS_MAXPATH];
+    const char *fam;
+    FILE *file;
+    double now, elapsed, dt, seconds;
+    long candidates, cost, count, totals;
+    int fd, i, ok;
+
+    now = monotonic_time();
+    elapsed = now - progress_start;
+    dt = now - progress_last_time;
+    fam = progress_family;
+    candidates = __atomic_load_n(&progress_candidates, __ATOMIC_RELAXED);
+    cost = __atomic_load_n(&progress_cost, __ATOMIC_RELAXED);
+
+    if(snprintf(tmppath, sizeof(tmppath), "%s.tmp.XXXXXX", progress_file) >= (int) sizeof(tmppath)) {
+        return;
+    }
+    fd = mkstemp(tmppath);
+    if(fd < 0) {
+        return;
+    }
+    fchmod(fd, 0644);
+    file = fdopen(fd, "w");
+    if(file == NULL) {
+        close(fd);
+        remove(tmppath);
+        return;
+    }
+
+    fprintf(file, "# HELP kes_elapsed_seconds Seconds since the start of the search\n");
+    fprintf(file, "# TYPE kes_elapsed_seconds gauge\n");
+    fprintf(file, "kes_elapsed_seconds{family=\"%s\"} %.3f\n", fam, elapsed);
+
+    fprintf(file, "# HELP kes_candidates_total Candidates (n, p) finished, the cells of ekes or nodes of rekes\n");
+    fprintf(file, "# TYPE kes_candidates_total counter\n");
+    fprintf(file, "kes_candidates_total{family=\"%s\"} %ld\n", fam, candidates);
+    fprintf(file, "# HELP kes_solvable_total Candidates with a solvable system\n");
+    fprintf(file, "# TYPE kes_solvable_total counter\n");
+    fprintf(file, "kes_solvable_total{family=\"%s\"} %ld\n", fam, __atomic_load_n(&progress_solvable, __ATOMIC_RELAXED));
+    fprintf(file, "# HELP kes_valid_total Candidates yielding a valid rule\n");
+    fprintf(file, "# TYPE kes_valid_total counter\n");
+    fprintf(file, "kes_valid_total{family=\"%s\"} %ld\n", fam, __atomic_load_n(&progress_valid, __ATOMIC_RELAXED));
+
+    fprintf(file, "# HELP kes_rejections_total Rejected candidates by reason\n");
+    fprintf(file, "# TYPE kes_rejections_total counter\n");
+    for(i = 0; i < NREJECTS; i++) {
+        fprintf(file, "kes_rejections_total{family=\"%s\",reason=\"%s\"} %ld\n", fam, reject_names[i],
+                __atomic_load_n(progress_rejections + i, __ATOMIC_RELAXED));
+    }
+
+    fprintf(file, "# HELP kes_stage_total Completed runs per stage\n");
+    fprintf(file, "# TYPE kes_stage_total counter\n");
+    for(i = 0; i < NSTAGES; i++) {
+        fprintf(file, "kes_stage_total{family=\"%s\",stage=\"%s\"} %ld\n", fam, stage_names[i],
+                __atomic_load_n(stage_totals + i, __ATOMIC_RELAXED));
+    }
+    fprintf(file, "# HELP kes_stage_seconds_total Seconds spent per stage summed over all threads\n");
+    fprintf(file, "# TYPE kes_stage_seconds_total counter\n");
+    for(i = 0; i < NSTAGES; i++) {
+        __atomic_load(stage_seconds + i, &seconds, __ATOMIC_RELAXED);
+        fprintf(file, "kes_stage_seconds_total{family=\"%s\",stage=\"%s\"} %.6f\n", fam, stage_names[i], seconds);
+    }
+    fprintf(file, "# HELP kes_stage_rate Runs per second and stage since the last update\n");
+    fprintf(file, "# TYPE kes_stage_rate gauge\n");
+    for(i = 0; i < NSTAGES; i++) {
+        totals = __atomic_load_n(stage_totals + i, __ATOMIC_RELAXED);
+        fprintf(file, "kes_stage_rate{family=\"%s\",stage=\"%s\"} %.6g\n", fam, stage_names[i],
+                dt > 0.0 ? (totals - progress_last_totals[i]) / dt : 0.0);
+        progress_last_totals[i] = totals;
+    }
+
+    fprintf(file, "# HELP kes_frontier Current candidate (n, p) and recursion depth per thread\n");
+    fprintf(file, "# TYPE kes_frontier gauge\n");
+    for(i = 0; i < progress_nthreads; i++) {
+        if(!progress_threads[i].active) {
+            continue;
+        }
+        fprintf(file, "kes_frontier{family=\"%s\",thread=\"%d\",coordinate=\"n\"} %d\n", fam, i, progress_threads[i].n);
+        fprintf(file, "kes_frontier{family=\"%s\",thread=\"%d\",coordinate=\"p\"} %d\n", fam, i, progress_threads[i].p);
+        fprintf(file, "kes_frontier{family=\"%s\",thread=\"%d\",coordinate=\"depth\"} %d\n", fam, i, progress_threads[i].depth);
+    }
+
+    fprintf(file, "# HELP kes_precision_bits_average Average final working precision\n");
+    fprintf(file, "# TYPE kes_precision_bits_average gauge\n");
+    count = __atomic_load_n(&progress_roots_count, __ATOMIC_RELAXED);
+    if(count > 0) {
+        fprintf(file, "kes_precision_bits_average{family=\"%s\",kind=\"roots\"} %.1f\n", fam,
+                (double) __atomic_load_n(&progress_roots_prec, __ATOMIC_RELAXED) / count);
+    }
+    count = __atomic_load_n(&progress_weights_count, __ATOMIC_RELAXED);
+    if(count > 0) {
+        fprintf(file, "kes_precision_bits_average{family=\"%s\",kind=\"weights\"} %.1f\n", fam,
+                (double) __atomic_load_n(&progress_weights_prec, __ATOMIC_RELAXED) / count);
+    }
+
+    /* Only a planned search has a known end */
+    if(progress_planned > 0) {
+        fprintf(file, "# HELP kes_candidates_planned Candidates of the whole search\n");
+        fprintf(file, "# TYPE kes_candidates_planned gauge\n");
+        fprintf(file, "kes_candidates_planned{family=\"%s\"} %ld\n", fam, progress_planned);
+        fprintf(file, "# HELP kes_progress_ratio Finished fraction of the cost model\n");
+        fprintf(file, "# TYPE kes_progress_ratio gauge\n");
+        fprintf(file, "kes_progress_ratio{family=\"%s\"} %.6f\n", fam,
+                progress_planned_cost > 0 ? (double) cost / progress_planned_cost : 0.0);
+        if(cost > 0) {
+            fprintf(file, "# HELP kes_eta_seconds Estimated seconds until the search is finished\n");
+            fprintf(file, "# TYPE kes_eta_seconds gauge\n");
+            fprintf(file, "kes_eta_seconds{family=\"%s\"} %.0f\n", fam,
+                    elapsed * (progress_planned_cost - cost) / cost);
+        }
+    }
+
+    ok = (fclose(file) == 0);
+    if(!ok || rename(tmppath, progress_file) != 0) {
+        remove(tmppath);
+    }
+    progress_last_time = now;
+}
+
+
+void * progress_main(void *arg) {
+    /* The writer thread, updates the file until stopped
+     */
+    struct timespec deadline;
+    double seconds;
+
+    pthread_mutex_lock(&progress_lock);
+    while(!progress_stop) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        seconds = deadline.tv_nsec * 1e-9 + progress_interval;
+        deadline.tv_sec += (time_t) seconds;
+        deadline.tv_nsec = (long) (1e9 * (seconds - (long) seconds));
+        pthread_cond_timedwait(&progress_wakeup, &progress_lock, &deadline);
+        if(!progress_stop) {
+            progress_write();
+        }
+    }
+    pthread_mutex_unlock(&progress_lock);
+    return NULL;
+}
+
+
+void progress_close(void) {
+    /* Stop the writer and write the final state
+     */
+    pthread_mutex_lock(&progress_lock);
+    progress_stop = 1;
+    pthread_cond_signal(&progress_wakeup);
+    pthread_mutex_unlock(&progress_lock);
+    pthread_join(progress_writer, NULL);
+
+    progress_write();
+    progress_enabled = 0;
+    free(progress_threads);
+}
+
+
+#endif
@@ -0,0 +1,200 @@
+/*  Author: R. Bourquin
+ *  Copyright: (C) 2014 R. Bourquin
+ *  License: GNU GPL v2 or above
+ *
+ *  A library of helper functions to search for
+ *  Kronrod extensions of Gauss quadrature rules.
+ */
+
+#ifndef __HH__prune
+#define __HH__prune
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "switch.h"
+
+
+/* Predicates skipping candidates known to be empty
+ *
+ * Before any exact work on a candidate 'n p_1 ... p_k' every enabled
+ * predicate is asked whether the candidate can be skipped. A predicate
+ * applies only to some families and counts the candidates it removed.
+ * In the recursive search a skipped candidate removes its whole branch.
+ *
+ * order        The basis P = P_n E_{p_1} ... E_{p_j} is orthogonal to all
+ *              polynomials of degree less than its last level, n or p_j.
+ *              For p not larger than this level the first row of the system
+ *              vanishes and 'find_extension' reports the candidate unsolvable.
+ *              Exact for all families and on by default.
+ *
+ * parity       For a symmetric weight the basis P of degree d has the parity
+ *              of d and the system for E_p splits into even and odd parts.
+ *              If d and p are both odd, the (p-1)/2 equations of one part
+ *              act on (p+1)/2 unknowns, hence the matrix is singular and
+ *              'find_extension' reports the candidate unsolvable. Exact and
+ *              on by default.
+ *
+ * literature   Classical Kronrod extensions p = n+1 with real nodes and
+ *              positive weights do not exist for Gauss-Hermite rules with
+ *              n = 3 or n > 4 and for Gauss-Laguerre rules with n >= 23
+ *              (Kahaner and Monegato 1978). The systems may still be
+ *              solvable with complex nodes or negative weights, hence this
+ *              matches the search only with validation of the weights.
+ *              Off by default.
+ */
+
+#define PRUNE_NRULES 3
+
+
+typedef struct {
+    const char *name;
+    const char *description;
+    int enabled;
+    long removed;
+    int (*skip)(const int[], const int);
+} prune_rule_t;
+
+
+int prune_order(const int[], const int);
+int prune_parity(const int[], const int);
+int prune_literature(const int[], const int);
+int prune_symmetric(void);
+int prune_toggle(const char *, const int);
+int prune_skip(const int[], const int);
+void prune_report(void);
+
+
+prune_rule_t prune_rules[PRUNE_NRULES] = {
+    {"order", "p not larger than the previous level", 1, 0, prune_order},
+    {"parity", "odd degree and odd p for symmetric weights", 1, 0, prune_parity},
+    {"literature", "no classical Kronrod extension (Kahaner and Monegato)", 0, 0, prune_literature}
+};
+
+
+int prune_symmetric(void) {
+    /* Whether the weight function of the family is symmetric
+     */
+#if defined(LEGENDRE) || defined(HERMITEPRO) || defined(HERMITE) || defined(CHEBYSHEVT) || defined(CHEBYSHEVU)
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+
+int prune_order(const int levels[],
+                const int k) {
+    /* Skip if the order p does not exceed the previous level
+     *
+     * levels: The candidate 'n p_1 ... p_k', the last entry is p
+     * k: Length of the candidate
+     */
+    return k >= 2 && levels[k-1] <= levels[k-2];
+}
+
+
+int prune_parity(const int levels[],
+                 const int k) {
+    /* Skip if the degree of the basis and the order p are both odd
+     *
+     * levels: The candidate 'n p_1 ... p_k', the last entry is p
+     * k: Length of the candidate
+     */
+    long d;
+    int i;
+
+    if(!prune_symmetric() || k < 2) {
+        return 0;
+    }
+    d = 0;
+    for(i = 0; i < k - 1; i++) {
+        d += levels[i];
+    }
+    return (d % 2 == 1) && (levels[k-1] % 2 == 1);
+}
+
+
+int prune_literature(const int levels[],
+                     const int k) {
+    /* Skip classical Kronrod extensions known not to exist
+     *
+     * levels: The candidate 'n p_1 ... p_k', the last entry is p
+     * k: Length of the candidate
+     */
+    if(k != 2 || levels[1] != levels[0] + 1) {
+        return 0;
+    }
+#if defined(HERMITEPRO) || defined(HERMITE)
+    return levels[0] == 3 || levels[0] > 4;
+#elif defined(LAGUERRE)
+    return levels[0] >= 23;
+#else
+    return 0;
+#endif
+}
+
+
+int prune_toggle(const char *name,
+                 const int enabled) {
+    /* Enable or disable a predicate by name or all by 'all',
+     * returns 0 if the name is unknown.
+     *
+     * name: The name of the predicate
+     * enabled: 1 to enable, 0 to disable
+     */
+    int i, found;
+
+    found = 0;
+    for(i = 0; i < PRUNE_NRULES; i++) {
+        if(!strcmp(name, "all") || !strcmp(name, prune_rules[i].name)) {
+            prune_rules[i].enabled = enabled;
+            found = 1;
+        }
+    }
+    if(!found) {
+        printf("Unknown pruning predicate: %s, known are:", name);
+        for(i = 0; i < PRUNE_NRULES; i++) {
+            printf(" %s", prune_rules[i].name);
+        }
+        printf("\n");
+    }
+    return found;
+}
+
+
+int prune_skip(const int levels[],
+               const int k) {
+    /* Whether an enabled predicate skips the candidate. The first
+     * predicate that applies is credited with the removal.
+     *
+     * levels: The candidate 'n p_1 ... p_k'
+     * k: Length of the candidate
+     */
+    int i;
+
+    for(i = 0; i < PRUNE_NRULES; i++) {
+        if(prune_rules[i].enabled && prune_rules[i].skip(levels, k)) {
+            __atomic_add_fetch(&prune_rules[i].removed, 1, __ATOMIC_RELAXED);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+void prune_report(void) {
+    /* Print the number of candidates removed by each predicate
+     */
+    int i;
+
+    printf("Pruning predicates (family %s):\n", family_name());
+    for(i = 0; i < PRUNE_NRULES; i++) {
+        printf("  %-12s %-4s %10ld removed   %s\n", prune_rules[i].name, prune_rules[i].enabled ? "on" : "off",
+               prune_rules[i].removed, prune_rules[i].description);
+    }
+}
+
+
+#endif
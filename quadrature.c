@@ -8,10 +8,11 @@
 #include <string.h>
 
 #include "libkes.h"
+#include "output.h"
 
 
 int main(int argc, char* argv[]) {
-    int i, j;
+    int i;
     int deg;
     fmpq_poly_t Pn;
     char *strf;
@@ -21,14 +22,24 @@ int main(int argc, char* argv[]) {
     int target_prec;
     int nrprintdigits;
     int loglevel;
+    char *cache;
+    char key[RULE_CACHE_MAXKEY];
+    int cached;
+    long cached_prec;
 
     if(argc <= 1) {
         printf("Compute Gauss quadrature rule\n");
-        printf("Syntax: quadrature [-dc D] [-dp D] [-l L] n\n");
+        printf("Syntax: quadrature [-dc D] [-dp D] [-l L] [-la] [-rc C] [-stats] [-mem] [-perf] [-trace T] n\n");
         printf("Options:\n");
         printf("        -dc  Compute nodes and weights up to this number of decimal digits\n");
         printf("        -dp  Print this number of decimal digits\n");
         printf("        -l   Set the log level\n");
+        printf("        -la  Log asynchronously through per-thread buffers\n");
+        printf("        -rc  Use the numeric rule cache in directory C (default: $KES_RULECACHE)\n");
+        printf("        -stats  Print a timing summary of all stages on exit\n");
+        printf("        -mem    Add allocation counts and peak memory per stage and thread to the summary\n");
+        printf("        -perf   Add hardware counters per stage and thread to the summary (Linux only)\n");
+        printf("        -trace  Write a Chrome trace of all stages and threads to file T\n");
         return EXIT_FAILURE;
     }
 
@@ -36,6 +47,7 @@ int main(int argc, char* argv[]) {
     target_prec = 53;
     nrprintdigits = 20;
     loglevel = 8;
+    cache = NULL;
 
     for(i = 1; i < argc; i++) {
         if (!strcmp(argv[i], "-dc")) {
@@ -45,9 +57,26 @@ int main(int argc, char* argv[]) {
         } else if (!strcmp(argv[i], "-dp")) {
             nrprintdigits = atoi(argv[i+1]);
             i++;
+        } else if (!strcmp(argv[i], "-la")) {
+            log_async_enable();
         } else if (!strcmp(argv[i], "-l")) {
             loglevel = atoi(argv[i+1]);
             i++;
+        } else if (!strcmp(argv[i], "-rc")) {
+            cache = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-stats")) {
+            stats_enable();
+        } else if (!strcmp(argv[i], "-mem")) {
+            memstats_enable();
+            stats_enable();
+        } else if (!strcmp(argv[i], "-perf")) {
+            if(perf_enable()) {
+                stats_enable();
+            }
+        } else if (!strcmp(argv[i], "-trace")) {
+            trace_enable(argv[i+1]);
+            i++;
         } else {
             deg = atoi(argv[i]);
         }
@@ -64,33 +93,42 @@ int main(int argc, char* argv[]) {
     nodes = _acb_vec_init(deg);
     weights = _acb_vec_init(deg);
 
-    /* Precision in number of bits */
-    for(working_prec = target_prec; ; working_prec *= 2) {
-        /* Find nodes and weights */
-        compute_nodes(nodes, Pn, working_prec, loglevel);
-        sort_nodes(nodes, deg);
-        evaluate_weights_formula(weights, nodes, deg, working_prec);
-        /* Accuracy goal reached? */
-        if(check_accuracy(nodes, deg, target_prec) && check_accuracy(weights, deg, target_prec)) {
-            break;
+    rule_cache_open(cache);
+    rule_cache_key(key, "gauss", &deg, 1);
+    cached = rule_cache_lookup(nodes, weights, &cached_prec, key, deg, target_prec);
+
+    if(cached == RULE_CACHE_HIT) {
+        logit(CACHE, 1, loglevel, "Nodes and weights taken from cache (%ld bits)\n", cached_prec);
+    } else {
+        /* Precision in number of bits */
+        for(working_prec = target_prec; ; working_prec *= 2) {
+            /* Find nodes and weights */
+            if(cached == RULE_CACHE_SEED) {
+                logit(CACHE, 1, loglevel, "Refining cached nodes from %ld bits\n", cached_prec);
+                poly_roots_seeded(nodes, Pn, 1, cached_prec, working_prec, loglevel);
+                cached = RULE_CACHE_MISS;
+            } else {
+                compute_nodes(nodes, Pn, working_prec, loglevel);
+            }
+            /* Real nodes allow the fixed-precision weight kernels */
+            make_real_roots(nodes, Pn, working_prec);
+            sort_nodes(nodes, deg);
+            evaluate_weights_formula(weights, nodes, deg, working_prec);
+            /* Accuracy goal reached? */
+            if(check_accuracy(nodes, deg, target_prec) && check_accuracy(weights, deg, target_prec)) {
+                break;
+            }
         }
+        rule_cache_insert(nodes, weights, key, deg, target_prec);
     }
 
     /* Print roots and weights */
     printf("-------------------------------------------------\n");
     printf("The nodes are:\n");
-    for(j = 0; j < deg; j++) {
-        printf("| ");
-        acb_printd(nodes + j, nrprintdigits);
-        printf("\n");
-    }
+    print_acb_vec(stdout, nodes, deg, "| ", "\n", nrprintdigits);
     printf("-------------------------------------------------\n");
     printf("The weights are:\n");
-    for(j = 0; j < deg; j++) {
-        printf("| ");
-        acb_printd(weights + j, nrprintdigits);
-        printf("\n");
-    }
+    print_acb_vec(stdout, weights, deg, "| ", "\n", nrprintdigits);
 
     _acb_vec_clear(nodes, deg);
     _acb_vec_clear(weights, deg);
@@ -12,8 +12,10 @@
 #include <stdarg.h>
 
 #include "numerics.h"
+#include "fixvec.h"
 
 
+int compare_nodes(const void *, const void *);
 void sort_nodes(acb_ptr, const int);
 void evaluate_weights_formula_legendre(acb_ptr, const acb_ptr, const int, const long);
 void evaluate_weights_formula_laguerre(acb_ptr, const acb_ptr, const int, const long);
@@ -23,27 +25,23 @@ void evaluate_weights_formula_chebyshevt(acb_ptr, const acb_ptr, const int, cons
 void evaluate_weights_formula_chebyshevu(acb_ptr, const acb_ptr, const int, const long);
 
 
+int compare_nodes(const void *a,
+                  const void *b) {
+    /* Order two nodes by the midpoints of their real parts
+     */
+    return arf_cmp(arb_midref(acb_realref((const acb_struct *) a)),
+                   arb_midref(acb_realref((const acb_struct *) b)));
+}
+
+
 void sort_nodes(acb_ptr nodes, const int n) {
     /* Sort quadrature nodes in-place
+     *
+     * The balls are moved as a whole, their limbs stay in place.
      *
      * n: Number of nodes
      */
-    int i, j;
-    acb_t t;
-    acb_init(t);
-    // In-place insertion sort (for small n)
-    for(i = 1; i < n; i++) {
-        acb_set(t, (nodes+i));
-        j = i;
-        while(j > 0 &&
-              arf_cmp(arb_midref(acb_realref( (nodes+j-1) )),
-                      arb_midref(acb_realref( t ))) > 0) {
-            acb_set((nodes+j), (nodes+j-1));
-            j--;
-        }
-        acb_set((nodes+j), t);
-    }
-    acb_clear(t);
+    qsort(nodes, n, sizeof(acb_struct), compare_nodes);
 }
 
 
@@ -60,6 +58,7 @@ void evaluate_weights_formula_legendre(acb_ptr weights,
     arb_t pf;
     fmpq_poly_t P;
     acb_ptr t;
+    fixvec_t x, p, q, c;
 
     // The prefactor
     // 2 / n^2
@@ -72,25 +71,56 @@ void evaluate_weights_formula_legendre(acb_ptr weights,
     // The other part
     // (gamma^2 - 1) / (gamma * P_n(gamma) - P_{n-1}(gamma))^2
     fmpq_poly_init(P);
-    t = _acb_vec_init(n);
 
-    legendre_polynomial(P, n);
-    evaluate_polynomial_vector(t, P, nodes, n, prec);
-    legendre_polynomial(P, n-1);
-    evaluate_polynomial_vector(weights, P, nodes, n, prec);
+    if(fixvec_applicable(nodes, n, prec)) {
+        /* The same formula on contiguous fixed-precision vectors */
+        fixvec_init(x, n, prec);
+        fixvec_init(p, n, prec);
+        fixvec_init(q, n, prec);
+        fixvec_init(c, 1, prec);
+        fixvec_set_acb(x, nodes);
+
+        legendre_polynomial(P, n);
+        fixvec_poly_evaluate(p, P, x);
+        legendre_polynomial(P, n-1);
+        fixvec_poly_evaluate(q, P, x);
+
+        fixvec_mul(p, p, x);
+        fixvec_sub(p, p, q);
+        fixvec_mul(p, p, p);
+        fixvec_mul(q, x, x);
+        fixvec_set_arb_scalar(c, pf);
+        fixvec_mul(q, q, c);
+        fixvec_sub(q, c, q);
+        fixvec_div(p, q, p);
+        fixvec_get_acb(weights, p);
+
+        fixvec_clear(x);
+        fixvec_clear(p);
+        fixvec_clear(q);
+        fixvec_clear(c);
+    } else {
+        t = _acb_vec_init(n);
+
+        legendre_polynomial(P, n);
+        evaluate_polynomial_vector(t, P, nodes, n, prec);
+        legendre_polynomial(P, n-1);
+        evaluate_polynomial_vector(weights, P, nodes, n, prec);
+
+        for(k = 0; k < n; k++) {
+            acb_mul((t+k), (t+k), (nodes+k), prec);
+            acb_sub((weights+k), (t+k), (weights+k), prec);
+            acb_pow_ui((weights+k), (weights+k), 2, prec);
+            acb_one((t+k));
+            acb_submul((t+k), (nodes+k), (nodes+k), prec);
+            acb_div((weights+k), (t+k), (weights+k), prec);
+            acb_mul_arb((weights+k), (weights+k), pf, prec);
+        }
 
-    for(k = 0; k < n; k++) {
-        acb_mul((t+k), (t+k), (nodes+k), prec);
-        acb_sub((weights+k), (t+k), (weights+k), prec);
-        acb_pow_ui((weights+k), (weights+k), 2, prec);
-        acb_one((t+k));
-        acb_submul((t+k), (nodes+k), (nodes+k), prec);
-        acb_div((weights+k), (t+k), (weights+k), prec);
-        acb_mul_arb((weights+k), (weights+k), pf, prec);
+        _acb_vec_clear(t, n);
     }
 
     arb_clear(pf);
-    _acb_vec_clear(t, n);
     fmpq_poly_clear(P);
 }
 
@@ -107,6 +137,7 @@ void evaluate_weights_formula_laguerre(acb_ptr weights,
     int k;
     arb_t pf;
     fmpq_poly_t L;
+    fixvec_t x, l, c;
 
     // The prefactor
     // 1 / (n+1)^2
@@ -122,12 +153,32 @@ void evaluate_weights_formula_laguerre(acb_ptr weights,
     fmpq_poly_init(L);
 
     laguerre_polynomial(L, n+1);
-    evaluate_polynomial_vector(weights, L, nodes, n, prec);
 
-    for(k = 0; k < n; k++) {
-        acb_pow_ui((weights+k), (weights+k), 2, prec);
-        acb_div((weights+k), (nodes+k), (weights+k), prec);
-        acb_mul_arb((weights+k), (weights+k), pf, prec);
+    if(fixvec_applicable(nodes, n, prec)) {
+        /* The same formula on contiguous fixed-precision vectors */
+        fixvec_init(x, n, prec);
+        fixvec_init(l, n, prec);
+        fixvec_init(c, 1, prec);
+        fixvec_set_acb(x, nodes);
+        fixvec_set_arb_scalar(c, pf);
+
+        fixvec_poly_evaluate(l, L, x);
+        fixvec_mul(l, l, l);
+        fixvec_div(l, x, l);
+        fixvec_mul(l, l, c);
+        fixvec_get_acb(weights, l);
+
+        fixvec_clear(x);
+        fixvec_clear(l);
+        fixvec_clear(c);
+    } else {
+        evaluate_polynomial_vector(weights, L, nodes, n, prec);
+
+        for(k = 0; k < n; k++) {
+            acb_pow_ui((weights+k), (weights+k), 2, prec);
+            acb_div((weights+k), (nodes+k), (weights+k), prec);
+            acb_mul_arb((weights+k), (weights+k), pf, prec);
+        }
     }
 
     arb_clear(pf);
@@ -147,6 +198,7 @@ void evaluate_weights_formula_hermite_pro(acb_ptr weights,
     int k;
     arb_t t, pf;
     fmpq_poly_t H;
+    fixvec_t x, h, c;
 
     // The prefactor
     // Gamma(n+1) sqrt(2 pi) / n^2
@@ -165,12 +217,31 @@ void evaluate_weights_formula_hermite_pro(acb_ptr weights,
     fmpq_poly_init(H);
 
     hermite_polynomial_pro(H, n-1);
-    evaluate_polynomial_vector(weights, H, nodes, n, prec);
 
-    for(k = 0; k < n; k++) {
-        acb_mul((weights+k), (weights+k), (weights+k), prec);
-        acb_inv((weights+k), (weights+k), prec);
-        acb_mul_arb((weights+k), (weights+k), pf, prec);
+    if(fixvec_applicable(nodes, n, prec)) {
+        /* The same formula on contiguous fixed-precision vectors */
+        fixvec_init(x, n, prec);
+        fixvec_init(h, n, prec);
+        fixvec_init(c, 1, prec);
+        fixvec_set_acb(x, nodes);
+        fixvec_set_arb_scalar(c, pf);
+
+        fixvec_poly_evaluate(h, H, x);
+        fixvec_mul(h, h, h);
+        fixvec_div(h, c, h);
+        fixvec_get_acb(weights, h);
+
+        fixvec_clear(x);
+        fixvec_clear(h);
+        fixvec_clear(c);
+    } else {
+        evaluate_polynomial_vector(weights, H, nodes, n, prec);
+
+        for(k = 0; k < n; k++) {
+            acb_mul((weights+k), (weights+k), (weights+k), prec);
+            acb_inv((weights+k), (weights+k), prec);
+            acb_mul_arb((weights+k), (weights+k), pf, prec);
+        }
     }
 
     arb_clear(t);
@@ -191,6 +262,7 @@ void evaluate_weights_formula_hermite_phy(acb_ptr weights,
     int k;
     arb_t t, pf;
     fmpq_poly_t H;
+    fixvec_t x, h, c;
 
     // The prefactor
     // 2^(n-1) Gamma(n+1) sqrt(pi) / n^2
@@ -209,12 +281,31 @@ void evaluate_weights_formula_hermite_phy(acb_ptr weights,
     fmpq_poly_init(H);
 
     hermite_polynomial_phy(H, n-1);
-    evaluate_polynomial_vector(weights, H, nodes, n, prec);
 
-    for(k = 0; k < n; k++) {
-        acb_mul((weights+k), (weights+k), (weights+k), prec);
-        acb_inv((weights+k), (weights+k), prec);
-        acb_mul_arb((weights+k), (weights+k), pf, prec);
+    if(fixvec_applicable(nodes, n, prec)) {
+        /* The same formula on contiguous fixed-precision vectors */
+        fixvec_init(x, n, prec);
+        fixvec_init(h, n, prec);
+        fixvec_init(c, 1, prec);
+        fixvec_set_acb(x, nodes);
+        fixvec_set_arb_scalar(c, pf);
+
+        fixvec_poly_evaluate(h, H, x);
+        fixvec_mul(h, h, h);
+        fixvec_div(h, c, h);
+        fixvec_get_acb(weights, h);
+
+        fixvec_clear(x);
+        fixvec_clear(h);
+        fixvec_clear(c);
+    } else {
+        evaluate_polynomial_vector(weights, H, nodes, n, prec);
+
+        for(k = 0; k < n; k++) {
+            acb_mul((weights+k), (weights+k), (weights+k), prec);
+            acb_inv((weights+k), (weights+k), prec);
+            acb_mul_arb((weights+k), (weights+k), pf, prec);
+        }
     }
 
     arb_clear(t);
@@ -0,0 +1,251 @@
+/*  Author: R. Bourquin
+    Copyright: (C) 2014 R. Bourquin
+    License: GNU GPL v2 or above
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "libkes.h"
+
+
+#define MAXLEVELS 64
+#define MAXLINE 4096
+#define NBUCKETS 32
+
+
+typedef struct {
+    long count;
+    long rounds;
+    long isolation_failures;
+    long accuracy_failures;
+    long final_prec;
+    double seconds;
+    double max_seconds;
+} bucket_t;
+
+
+void bucket_add(bucket_t *b, const rootdiag_t *diag) {
+    b->count++;
+    b->rounds += diag->rounds;
+    b->isolation_failures += diag->isolation_failures;
+    b->accuracy_failures += diag->accuracy_failures;
+    b->final_prec += diag->final_prec;
+    b->seconds += diag->total_seconds;
+    if(diag->total_seconds > b->max_seconds) {
+        b->max_seconds = diag->total_seconds;
+    }
+}
+
+
+void bucket_print(const char *label, const bucket_t *b) {
+    printf("%-16s %8ld %12.3e %12.3e %8.2f %8ld %8ld %10.1f\n", label, b->count,
+           b->seconds / b->count, b->max_seconds, (double) b->rounds / b->count,
+           b->isolation_failures, b->accuracy_failures, (double) b->final_prec / b->count);
+}
+
+
+void bucket_header(const char *label) {
+    printf("%-16s %8s %12s %12s %8s %8s %8s %10s\n", label, "count", "mean [s]", "max [s]",
+           "rounds", "isofail", "accfail", "prec");
+}
+
+
+int parse_levels(int *levels, char *line) {
+    /* Parse a line 'n p1 ... pk' or a 'RULE: depth n p1 ... pk' line
+     * as written by rekes, returns the number of levels.
+     *
+     * levels: The parsed levels
+     * line: The input line, modified
+     */
+    char *tok;
+    int k;
+
+    k = 0;
+    tok = strtok(line, " \t\r\n");
+    if(tok == NULL || tok[0] == '#') {
+        return 0;
+    }
+    if(!strcmp(tok, "RULE:")) {
+        /* Skip the depth */
+        strtok(NULL, " \t\r\n");
+        tok = strtok(NULL, " \t\r\n");
+    }
+    for(; tok != NULL && k < MAXLEVELS; tok = strtok(NULL, " \t\r\n")) {
+        levels[k++] = atoi(tok);
+    }
+    return k;
+}
+
+
+int main(int argc, char* argv[]) {
+    int i, k, b;
+    int levels[MAXLEVELS];
+    char line[MAXLINE];
+    FILE *corpus;
+    fmpq_poly_t Pn, E;
+    acb_ptr roots;
+    rootdiag_t diag;
+    bucket_t by_degree[NBUCKETS], by_separation[NBUCKETS], total;
+    char label[64];
+    long deg, r;
+    long initial_prec, target_prec;
+    int quiet, loglevel;
+    char *store;
+
+    if(argc <= 1) {
+        printf("Root finding diagnostics over a corpus of extension polynomials\n");
+        printf("Syntax: rootdiag [-dc D] [-ip P] [-q] [-l L] [-st S] [-stats] corpus\n");
+        printf("        -dc  Compute the roots up to this number of decimal digits (default 100)\n");
+        printf("        -ip  Initial precision in bits (default 53)\n");
+        printf("        -q   Print only the summary\n");
+        printf("        -l   Set the log level\n");
+        printf("        -st  Use the exact polynomial store in directory S (default: $KES_STORE)\n");
+        printf("        -stats  Print a timing summary of all stages on exit\n");
+        printf("The corpus has one rule per line given by its levels 'n p1 ... pk',\n");
+        printf("the 'RULE:' lines written by rekes can be used directly. Use '-' for stdin.\n");
+        return EXIT_FAILURE;
+    }
+
+    target_prec = 3.32193 * 100;
+    initial_prec = 53;
+    quiet = 0;
+    loglevel = 0;
+    store = NULL;
+    corpus = NULL;
+
+    for(i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-dc")) {
+            /* 'digits' is in base 10 and log(10)/log(2) = 3.32193 */
+            target_prec = 3.32193 * atoi(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-ip")) {
+            initial_prec = atol(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-q")) {
+            quiet = 1;
+        } else if (!strcmp(argv[i], "-l")) {
+            loglevel = atoi(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-st")) {
+            store = argv[i+1];
+            i++;
+        } else if (!strcmp(argv[i], "-stats")) {
+            stats_enable();
+        } else {
+            corpus = strcmp(argv[i], "-") ? fopen(argv[i], "r") : stdin;
+            if(corpus == NULL) {
+                printf("Can not open corpus: %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+    }
+    if(corpus == NULL) {
+        printf("Missing corpus!\n");
+        return EXIT_FAILURE;
+    }
+
+    exact_store_open(store);
+
+    memset(by_degree, 0, sizeof(by_degree));
+    memset(by_separation, 0, sizeof(by_separation));
+    memset(&total, 0, sizeof(total));
+
+    fmpq_poly_init(Pn);
+    fmpq_poly_init(E);
+
+    if(!quiet) {
+        printf("%-24s %6s %6s %7s %7s %8s %10s %10s %12s\n", "levels", "deg", "rounds", "isofail",
+               "accfail", "prec", "log2 sep", "log2 rad", "time [s]");
+    }
+
+    while(fgets(line, MAXLINE, corpus) != NULL) {
+        k = parse_levels(levels, line);
+        if(k == 0) {
+            continue;
+        }
+
+        /* The polynomial whose roots are the nodes of the rule */
+        polynomial(Pn, levels[0]);
+        if(k > 1) {
+            if(!find_multi_extension(E, NULL, Pn, k, levels, 0, loglevel)) {
+                continue;
+            }
+            fmpq_poly_mul(Pn, Pn, E);
+        }
+        deg = fmpq_poly_degree(Pn);
+        if(deg < 1) {
+            continue;
+        }
+
+        roots = _acb_vec_init(deg);
+        poly_roots_diag(roots, &diag, Pn, 0, initial_prec, target_prec, loglevel);
+        _acb_vec_clear(roots, deg);
+
+        if(!quiet) {
+            label[0] = '\0';
+            for(i = 0; i < k; i++) {
+                snprintf(label + strlen(label), sizeof(label) - strlen(label), i > 0 ? " %d" : "%d", levels[i]);
+            }
+            printf("%-24s %6ld %6ld %7ld %7ld %8ld %10.1f %10.1f %12.3e\n", label, deg, diag.rounds,
+                   diag.isolation_failures, diag.accuracy_failures, diag.final_prec,
+                   diag.min_separation, diag.worst_radius, diag.total_seconds);
+            if(loglevel >= 1) {
+                for(r = 0; r < diag.rounds && r < ROOTDIAG_MAXROUNDS; r++) {
+                    printf("    round %ld: prec %ld, iteration budget %ld, isolated %ld, %.3e s\n", r,
+                           diag.prec[r], diag.budget[r], diag.isolated[r], diag.seconds[r]);
+                }
+                if(diag.rounds > ROOTDIAG_MAXROUNDS) {
+                    printf("    truncated: %ld more rounds not recorded\n", diag.rounds - ROOTDIAG_MAXROUNDS);
+                }
+            }
+        }
+
+        /* Buckets by octaves of the degree and by 8 bits of separation */
+        for(b = 0; b < NBUCKETS - 1 && (2L << b) <= deg; b++);
+        bucket_add(by_degree + b, &diag);
+        b = isfinite(diag.min_separation) ? (int) floor(-diag.min_separation / 8.0) + 1 : (diag.min_separation > 0 ? 0 : NBUCKETS - 1);
+        b = b < 0 ? 0 : (b >= NBUCKETS ? NBUCKETS - 1 : b);
+        bucket_add(by_separation + b, &diag);
+        bucket_add(&total, &diag);
+    }
+    if(corpus != stdin) {
+        fclose(corpus);
+    }
+
+    printf("-------------------------------------------------------------------------------------\n");
+    bucket_header("degree");
+    for(b = 0; b < NBUCKETS; b++) {
+        if(by_degree[b].count > 0) {
+            snprintf(label, sizeof(label), "%ld - %ld", 1L << b, (2L << b) - 1);
+            bucket_print(label, by_degree + b);
+        }
+    }
+    printf("-------------------------------------------------------------------------------------\n");
+    bucket_header("log2 separation");
+    for(b = 0; b < NBUCKETS; b++) {
+        if(by_separation[b].count > 0) {
+            if(b == 0) {
+                snprintf(label, sizeof(label), ">= 0");
+            } else if(b == NBUCKETS - 1) {
+                snprintf(label, sizeof(label), "< %d", -8 * (b - 1));
+            } else {
+                snprintf(label, sizeof(label), "%d - %d", -8 * b, -8 * (b - 1));
+            }
+            bucket_print(label, by_separation + b);
+        }
+    }
+    printf("-------------------------------------------------------------------------------------\n");
+    if(total.count > 0) {
+        bucket_print("all", &total);
+    }
+    printf("-------------------------------------------------------------------------------------\n");
+
+    fmpq_poly_clear(Pn);
+    fmpq_poly_clear(E);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,377 @@
+/*  Author: R. Bourquin
+ *  Copyright: (C) 2014 R. Bourquin
+ *  License: GNU GPL v2 or above
+ *
+ *  A library of helper functions to search for
+ *  Kronrod extensions of Gauss quadrature rules.
+ */
+
+#ifndef __HH__rulecache
+#define __HH__rulecache
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "arb.h"
+#include "acb.h"
+
+#include "switch.h"
+#include "stages.h"
+
+
+/* Cache of numerically computed rules
+ *
+ * The cache directory contains an index file of fixed size records and
+ * one data file per cached rule. A record holds the key 'family:tag:levels',
+ * the precision in bits the rule is accurate to, the number of nodes and
+ * the id naming the data file. The data file holds the nodes and the weights
+ * as exact arb dumps, one ball per line, real and imaginary parts alternating.
+ * Both files are read through read-only memory maps.
+ *
+ * Data files are written to a temporary name and renamed into place under
+ * an exclusive lock of the index, the record is then appended unless the
+ * index has it already. Readers hold a shared lock of the index until the
+ * data file is read.
+ */
+
+#define RULE_CACHE_MAXKEY 232
+
+#define RULE_CACHE_MISS 0
+#define RULE_CACHE_HIT 1
+#define RULE_CACHE_SEED 2
+
+
+typedef struct {
+    char key[RULE_CACHE_MAXKEY];
+    long prec;
+    long len;
+    unsigned long long id;
+} rule_cache_record;
+
+
+char *rule_cache_dir = NULL;
+
+
+void rule_cache_open(const char *);
+int rule_cache_key(char *, const char *, const int[], const int);
+int rule_cache_lookup(acb_ptr, acb_ptr, long *, const char *, const long, const long);
+int rule_cache_insert(const acb_ptr, const acb_ptr, const char *, const long, const long);
+int rule_cache_load(acb_ptr, acb_ptr, const rule_cache_record *);
+
+
+void rule_cache_open(const char *dir) {
+    /* Enable the cache in the given directory. If dir is NULL
+     * the directory is taken from the environment variable KES_RULECACHE.
+     * The cache stays disabled if neither is set.
+     *
+     * dir: The cache directory or NULL
+     */
+    if(dir == NULL) {
+        dir = getenv("KES_RULECACHE");
+    }
+    if(dir == NULL || strlen(dir) == 0) {
+        return;
+    }
+    mkdir(dir, 0777);
+    rule_cache_dir = (char *) malloc(strlen(dir) + 1);
+    strcpy(rule_cache_dir, dir);
+}
+
+
+int rule_cache_key(char *key,
+                   const char *tag,
+                   const int levels[],
+                   const int k) {
+    /* Build the key 'family:tag:n,p_1,...,p_k' of a rule.
+     * Returns 0 and the empty key, which is never cached, if the
+     * key does not fit into RULE_CACHE_MAXKEY characters.
+     *
+     * key: Buffer of size RULE_CACHE_MAXKEY
+     * tag: Tag distinguishing the kind of rule
+     * levels: The level sequence
+     * k: Length of the level sequence
+     */
+    int i, len;
+
+    len = snprintf(key, RULE_CACHE_MAXKEY, "%s:%s:", family_name(), tag);
+    for(i = 0; i < k && len < RULE_CACHE_MAXKEY; i++) {
+        len += snprintf(key + len, RULE_CACHE_MAXKEY - len, i > 0 ? ",%d" : "%d", levels[i]);
+    }
+    if(len >= RULE_CACHE_MAXKEY) {
+        key[0] = '\0';
+        return 0;
+    }
+    return 1;
+}
+
+
+int rule_cache_load(acb_ptr nodes,
+                    acb_ptr weights,
+                    const rule_cache_record *record) {
+    /* Load the nodes and weights of a cached rule from its data file.
+     * Returns 1 on success and 0 otherwise.
+     *
+     * nodes: Array of length record->len receiving the nodes
+     * weights: Array of length record->len receiving the weights
+     * record: The index record of the rule
+     */
+    char path[4096];
+    struct stat st;
+    const char *data, *c, *end;
+    char *line;
+    size_t n, size;
+    long i;
+    int fd, ok;
+    arb_ptr x;
+
+    snprintf(path, sizeof(path), "%s/%016llx.rule", rule_cache_dir, record->id);
+    fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return 0;
+    }
+    if(fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    data = (const char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        return 0;
+    }
+
+    ok = 1;
+    size = 256;
+    line = (char *) malloc(size);
+    c = data;
+    end = data + st.st_size;
+    for(i = 0; i < 4 * record->len && ok; i++) {
+        /* Nodes first, then weights, real and imaginary parts alternating */
+        if(i < 2 * record->len) {
+            x = i % 2 == 0 ? acb_realref(nodes + i/2) : acb_imagref(nodes + i/2);
+        } else {
+            x = i % 2 == 0 ? acb_realref(weights + i/2 - record->len) : acb_imagref(weights + i/2 - record->len);
+        }
+        for(n = 0; c + n < end && c[n] != '\n'; n++);
+        if(c + n >= end) {
+            ok = 0;
+            break;
+        }
+        if(n + 1 > size) {
+            size = n + 1;
+            line = (char *) realloc(line, size);
+        }
+        memcpy(line, c, n);
+        line[n] = '\0';
+        ok = arb_load_str(x, line) == 0;
+        c += n + 1;
+    }
+
+    free(line);
+    munmap((void *) data, st.st_size);
+    return ok;
+}
+
+
+int rule_cache_lookup(acb_ptr nodes,
+                      acb_ptr weights,
+                      long *cached_prec,
+                      const char *key,
+                      const long len,
+                      const long prec) {
+    /* Look up a rule in the cache.
+     *
+     * If an entry with at least the requested precision exists, the least
+     * precise such entry is loaded and rounded and RULE_CACHE_HIT is returned.
+     * Otherwise the most precise entry is loaded unrounded as seed for
+     * refinement and RULE_CACHE_SEED is returned. Without any entry the
+     * result is RULE_CACHE_MISS.
+     *
+     * nodes: Array of length len receiving the nodes
+     * weights: Array of length len receiving the weights
+     * cached_prec: Precision in bits of the loaded entry
+     * key: The key of the rule
+     * len: Number of nodes
+     * prec: Number of bits in target precision
+     */
+    char path[4096];
+    struct stat st;
+    struct flock lock;
+    const rule_cache_record *records;
+    const rule_cache_record *best;
+    long i, count;
+    int fd, result;
+
+    if(rule_cache_dir == NULL || strlen(key) == 0) {
+        return RULE_CACHE_MISS;
+    }
+
+    snprintf(path, sizeof(path), "%s/index", rule_cache_dir);
+    fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return RULE_CACHE_MISS;
+    }
+
+    /* Shared lock, records are appended under an exclusive lock */
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_RDLCK;
+    lock.l_whence = SEEK_SET;
+    fcntl(fd, F_SETLKW, &lock);
+
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(rule_cache_record)) {
+        close(fd);
+        return RULE_CACHE_MISS;
+    }
+    count = st.st_size / sizeof(rule_cache_record);
+    records = (const rule_cache_record *) mmap(NULL, count * sizeof(rule_cache_record), PROT_READ, MAP_SHARED, fd, 0);
+    if(records == MAP_FAILED) {
+        close(fd);
+        return RULE_CACHE_MISS;
+    }
+
+    /* Least precise sufficient entry, or else most precise entry */
+    best = NULL;
+    for(i = 0; i < count; i++) {
+        if(records[i].len != len || strncmp(records[i].key, key, RULE_CACHE_MAXKEY)) {
+            continue;
+        }
+        if(best == NULL
+           || (best->prec < prec && records[i].prec > best->prec)
+           || (best->prec >= prec && records[i].prec >= prec && records[i].prec < best->prec)) {
+            best = records + i;
+        }
+    }
+
+    result = RULE_CACHE_MISS;
+    if(best != NULL && rule_cache_load(nodes, weights, best)) {
+        *cached_prec = best->prec;
+        if(best->prec >= prec) {
+            /* Keep enough bits for the absolute accuracy of large nodes */
+            for(i = 0; i < len; i++) {
+                acb_set_round(nodes + i, nodes + i, prec + 64);
+                acb_set_round(weights + i, weights + i, prec + 64);
+            }
+            result = RULE_CACHE_HIT;
+            stats_count(COUNT_CACHE_HITS, 1);
+        } else {
+            result = RULE_CACHE_SEED;
+        }
+    }
+
+    munmap((void *) records, count * sizeof(rule_cache_record));
+    /* Closing the index releases the lock */
+    close(fd);
+    return result;
+}
+
+
+int rule_cache_insert(const acb_ptr nodes,
+                      const acb_ptr weights,
+                      const char *key,
+                      const long len,
+                      const long prec) {
+    /* Insert a rule into the cache.
+     * Returns 1 on success and 0 otherwise.
+     *
+     * nodes: The nodes
+     * weights: The weights
+     * key: The key of the rule
+     * len: Number of nodes
+     * prec: Number of bits the rule is accurate to
+     */
+    char path[4096];
+    char indexpath[4096];
+    char tmppath[4096 + 64];
+    char *strf;
+    const char *c;
+    FILE *file;
+    struct flock lock;
+    rule_cache_record record, other;
+    long i;
+    int fd, ok;
+
+    if(rule_cache_dir == NULL || strlen(key) == 0 || strlen(key) >= RULE_CACHE_MAXKEY) {
+        return 0;
+    }
+
+    memset(&record, 0, sizeof(record));
+    strcpy(record.key, key);
+    record.prec = prec;
+    record.len = len;
+    record.id = 14695981039346656037ULL;
+    for(c = key; *c; c++) {
+        record.id ^= (unsigned char) *c;
+        record.id *= 1099511628211ULL;
+    }
+    record.id ^= (unsigned long long) prec;
+    record.id *= 1099511628211ULL;
+
+    /* Data file */
+    snprintf(path, sizeof(path), "%s/%016llx.rule", rule_cache_dir, record.id);
+    snprintf(tmppath, sizeof(tmppath), "%s.tmp.XXXXXX", path);
+    fd = mkstemp(tmppath);
+    if(fd < 0) {
+        return 0;
+    }
+    fchmod(fd, 0644);
+    file = fdopen(fd, "w");
+    if(file == NULL) {
+        close(fd);
+        remove(tmppath);
+        return 0;
+    }
+    ok = 1;
+    for(i = 0; i < 4 * len && ok; i++) {
+        if(i < 2 * len) {
+            strf = arb_dump_str(i % 2 == 0 ? acb_realref(nodes + i/2) : acb_imagref(nodes + i/2));
+        } else {
+            strf = arb_dump_str(i % 2 == 0 ? acb_realref(weights + i/2 - len) : acb_imagref(weights + i/2 - len));
+        }
+        ok = fprintf(file, "%s\n", strf) > 0;
+        flint_free(strf);
+    }
+    ok = (fclose(file) == 0) && ok;
+    if(!ok) {
+        remove(tmppath);
+        return 0;
+    }
+
+    /* Exclusive lock, no reader is loading the data file meanwhile */
+    snprintf(indexpath, sizeof(indexpath), "%s/index", rule_cache_dir);
+    fd = open(indexpath, O_RDWR | O_CREAT, 0666);
+    if(fd < 0) {
+        remove(tmppath);
+        return 0;
+    }
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    fcntl(fd, F_SETLKW, &lock);
+
+    if(rename(tmppath, path) != 0) {
+        remove(tmppath);
+        close(fd);
+        return 0;
+    }
+
+    /* The data file of an indexed key and precision was just replaced */
+    while(read(fd, &other, sizeof(other)) == sizeof(other)) {
+        if(other.prec == record.prec && other.len == record.len
+           && !strncmp(other.key, record.key, RULE_CACHE_MAXKEY)) {
+            close(fd);
+            return 1;
+        }
+    }
+    ok = lseek(fd, 0, SEEK_END) >= 0 && write(fd, &record, sizeof(record)) == sizeof(record);
+    close(fd);
+
+    return ok;
+}
+
+
+#endif
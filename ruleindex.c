@@ -0,0 +1,163 @@
+/*  Author: R. Bourquin
+    Copyright: (C) 2014 R. Bourquin
+    License: GNU GPL v2 or above
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libkes.h"
+
+
+#define MAXLINE 4096
+
+
+int build(const char *indexfile,
+          const int nfiles,
+          char *files[]) {
+    /* Merge the sequences of text files into an index
+     *
+     * indexfile: The index, created if it does not exist
+     * nfiles: Number of text files
+     * files: The text files, '-' for stdin
+     */
+    ruleindex_t *idx;
+    FILE *in;
+    char line[MAXLINE];
+    int levels[RULEINDEX_MAXDEPTH];
+    long before, added;
+    int i, k, ok;
+
+    idx = ruleindex_new(family_name());
+    if(!ruleindex_merge(idx, indexfile)) {
+        ruleindex_free(idx);
+        return 0;
+    }
+    before = idx->nrules;
+
+    added = 0;
+    for(i = 0; i < nfiles; i++) {
+        in = strcmp(files[i], "-") ? fopen(files[i], "r") : stdin;
+        if(in == NULL) {
+            printf("Can not open file: %s\n", files[i]);
+            continue;
+        }
+        while(fgets(line, MAXLINE, in) != NULL) {
+            k = ruleindex_parse(levels, line);
+            if(k > 0) {
+                added += ruleindex_insert(idx, levels, k);
+            }
+        }
+        if(in != stdin) {
+            fclose(in);
+        }
+    }
+
+    ok = ruleindex_save(idx, indexfile);
+    if(ok) {
+        fprintf(stderr, "%ld rules, %ld new, %ld nodes\n", before + added, added, idx->nentries);
+    }
+    ruleindex_free(idx);
+    return ok;
+}
+
+
+int main(int argc, char* argv[]) {
+    int i, k;
+    int levels[RULEINDEX_MAXDEPTH];
+    long node, total, found;
+    long maxnodes;
+    int count, depth, summary;
+    char *buildfile;
+    ruleindex_map_t map;
+
+    if(argc <= 1) {
+        printf("Build and query binary indices of level sequences found by rekes\n");
+        printf("Syntax: ruleindex -b I files...\n");
+        printf("        ruleindex [-N N] [-c] [-d] [-s] I [n p1 ... pj]\n");
+        printf("        -b   Merge the sequences in the files into the index I, '-' reads stdin\n");
+        printf("        -N   List only sequences whose rules have at most N nodes\n");
+        printf("        -c   Print only the number of sequences\n");
+        printf("        -d   Print the maximal depth of all sequences below the prefix\n");
+        printf("        -s   Print a summary of the index\n");
+        printf("The files may contain 'RULE:' lines written by rekes or plain lines 'n p1 ... pk'.\n");
+        printf("A query lists all sequences extending the prefix, or all sequences if it is empty.\n");
+        return EXIT_FAILURE;
+    }
+
+    maxnodes = -1;
+    count = 0;
+    depth = 0;
+    summary = 0;
+    buildfile = NULL;
+
+    for(i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-b")) {
+            buildfile = argv[i+1];
+            i += 2;
+            break;
+        } else if (!strcmp(argv[i], "-N")) {
+            maxnodes = atol(argv[i+1]);
+            i++;
+        } else if (!strcmp(argv[i], "-c")) {
+            count = 1;
+        } else if (!strcmp(argv[i], "-d")) {
+            depth = 1;
+        } else if (!strcmp(argv[i], "-s")) {
+            summary = 1;
+        } else {
+            break;
+        }
+    }
+
+    if(buildfile != NULL) {
+        return build(buildfile, argc - i, argv + i) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if(i >= argc) {
+        printf("Missing index!\n");
+        return EXIT_FAILURE;
+    }
+    if(!ruleindex_open(&map, argv[i])) {
+        printf("Can not read rule index: %s\n", argv[i]);
+        return EXIT_FAILURE;
+    }
+    i++;
+
+    /* The prefix */
+    total = 0;
+    for(k = 0; i < argc && k < RULEINDEX_MAXDEPTH; i++, k++) {
+        levels[k] = atoi(argv[i]);
+        total += levels[k];
+    }
+
+    if(summary) {
+        printf("Family: %s\n", map.header->family);
+        printf("Sequences: %llu\n", map.header->nrules);
+        printf("Nodes: %llu\n", map.header->nnodes);
+        printf("Maximal depth: %d\n", map.nodes[0].maxdepth);
+    }
+
+    node = ruleindex_find(&map, levels, k);
+    if(node < 0) {
+        if(count) {
+            printf("0\n");
+        }
+        ruleindex_close(&map);
+        return EXIT_SUCCESS;
+    }
+
+    if(depth) {
+        printf("%d\n", map.nodes[node].maxdepth);
+    }
+    if(count) {
+        found = ruleindex_list(NULL, &map, node, levels, k, total, maxnodes);
+        printf("%ld\n", found);
+    } else if(!depth && !summary) {
+        ruleindex_list(stdout, &map, node, levels, k, total, maxnodes);
+    }
+
+    ruleindex_close(&map);
+    return EXIT_SUCCESS;
+}
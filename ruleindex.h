@@ -0,0 +1,560 @@
+/*  Author: R. Bourquin
+ *  Copyright: (C) 2014 R. Bourquin
+ *  License: GNU GPL v2 or above
+ *
+ *  A library of helper functions to search for
+ *  Kronrod extensions of Gauss quadrature rules.
+ */
+
+#ifndef __HH__ruleindex
+#define __HH__ruleindex
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+
+/* Index of discovered level sequences
+ *
+ * The level sequences 'n p_1 ... p_k' found by the recursive search form a
+ * prefix tree: the children of the node 'n p_1 ... p_j' are the extensions
+ * p_{j+1} found for it. The index is built in memory and stored as a binary
+ * file: a header followed by the nodes in breadth first order. The children
+ * of a node are stored contiguously and sorted by their level, hence a
+ * prefix is found by one binary search per level. Every node also stores
+ * the maximal depth k of any sequence below it.
+ *
+ * Sequences are never stored twice, merging an existing index with new
+ * sequences deduplicates across runs. The file is written to a temporary
+ * name and renamed into place and is read through a read-only memory map.
+ */
+
+#define RULEINDEX_MAGIC "KESRIX1"
+#define RULEINDEX_MAXFAMILY 24
+#define RULEINDEX_MAXDEPTH 64
+#define RULEINDEX_TERMINAL 0x80000000u
+
+
+typedef struct {
+    char magic[8];
+    char family[RULEINDEX_MAXFAMILY];
+    unsigned long long nnodes;
+    unsigned long long nrules;
+} ruleindex_header;
+
+
+typedef struct {
+    /* The level, n for the first level and p_j otherwise */
+    int level;
+    /* The maximal depth k of any sequence in the subtree */
+    int maxdepth;
+    /* Position of the first child */
+    unsigned int first;
+    /* Number of children, RULEINDEX_TERMINAL is set if the sequence is a rule */
+    unsigned int count;
+} ruleindex_node;
+
+
+typedef struct {
+    int level;
+    int terminal;
+    int nchildren;
+    int capacity;
+    long *children;
+} ruleindex_entry;
+
+
+typedef struct {
+    char family[RULEINDEX_MAXFAMILY];
+    ruleindex_entry *entries;
+    long nentries;
+    long capacity;
+    long nrules;
+} ruleindex_t;
+
+
+typedef struct {
+    const ruleindex_header *header;
+    const ruleindex_node *nodes;
+    size_t size;
+} ruleindex_map_t;
+
+
+/* The index the recursive search records into, if any */
+ruleindex_t *rule_index = NULL;
+
+
+ruleindex_t * ruleindex_new(const char *);
+void ruleindex_free(ruleindex_t *);
+long ruleindex_child_add(ruleindex_t *, const long, const int);
+int ruleindex_insert(ruleindex_t *, const int[], const int);
+void ruleindex_record(const int[], const int);
+int ruleindex_parse(int *, char *);
+int ruleindex_merge(ruleindex_t *, const char *);
+void ruleindex_merge_node(ruleindex_t *, const long, const ruleindex_map_t *, const unsigned int);
+int ruleindex_save(const ruleindex_t *, const char *);
+int ruleindex_open(ruleindex_map_t *, const char *);
+void ruleindex_close(ruleindex_map_t *);
+long ruleindex_find(const ruleindex_map_t *, const int[], const int);
+long ruleindex_list(FILE *, const ruleindex_map_t *, const unsigned int, int *, const int, const long, const long);
+long ruleindex_write(FILE *, const ruleindex_t *, const long, int *, const int);
+
+
+ruleindex_t * ruleindex_new(const char *family) {
+    /* Create an empty index holding only the root
+     *
+     * family: The polynomial family of the sequences
+     */
+    ruleindex_t *idx;
+
+    idx = (ruleindex_t *) calloc(1, sizeof(ruleindex_t));
+    strncpy(idx->family, family, RULEINDEX_MAXFAMILY - 1);
+    idx->capacity = 1024;
+    idx->entries = (ruleindex_entry *) calloc(idx->capacity, sizeof(ruleindex_entry));
+    idx->nentries = 1;
+    return idx;
+}
+
+
+void ruleindex_free(ruleindex_t *idx) {
+    long i;
+
+    for(i = 0; i < idx->nentries; i++) {
+        free(idx->entries[i].children);
+    }
+    free(idx->entries);
+    free(idx);
+}
+
+
+long ruleindex_child_add(ruleindex_t *idx,
+                         const long node,
+                         const int level) {
+    /* Find a child or insert it in sorted position, returns its id
+     *
+     * idx: The index
+     * node: The parent node
+     * level: The level of the child
+     */
+    ruleindex_entry *e;
+    long id;
+    int lo, hi, mid;
+
+    e = idx->entries + node;
+    lo = 0;
+    hi = e->nchildren;
+    while(lo < hi) {
+        mid = (lo + hi) / 2;
+        if(idx->entries[e->children[mid]].level < level) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if(lo < e->nchildren && idx->entries[e->children[lo]].level == level) {
+        return e->children[lo];
+    }
+
+    if(idx->nentries == idx->capacity) {
+        idx->capacity *= 2;
+        idx->entries = (ruleindex_entry *) realloc(idx->entries, idx->capacity * sizeof(ruleindex_entry));
+        e = idx->entries + node;
+    }
+    id = idx->nentries++;
+    memset(idx->entries + id, 0, sizeof(ruleindex_entry));
+    idx->entries[id].level = level;
+
+    if(e->nchildren == e->capacity) {
+        e->capacity = e->capacity > 0 ? 2 * e->capacity : 4;
+        e->children = (long *) realloc(e->children, e->capacity * sizeof(long));
+    }
+    memmove(e->children + lo + 1, e->children + lo, (e->nchildren - lo) * sizeof(long));
+    e->children[lo] = id;
+    e->nchildren++;
+    return id;
+}
+
+
+int ruleindex_insert(ruleindex_t *idx,
+                     const int levels[],
+                     const int k) {
+    /* Insert a sequence, returns 1 if it was not yet in the index
+     *
+     * idx: The index
+     * levels: The level sequence 'n p_1 ... p_k'
+     * k: Length of the level sequence
+     */
+    long node;
+    int i;
+
+    if(k < 1 || k > RULEINDEX_MAXDEPTH) {
+        return 0;
+    }
+    node = 0;
+    for(i = 0; i < k; i++) {
+        node = ruleindex_child_add(idx, node, levels[i]);
+    }
+    if(idx->entries[node].terminal) {
+        return 0;
+    }
+    idx->entries[node].terminal = 1;
+    idx->nrules++;
+    return 1;
+}
+
+
+void ruleindex_record(const int levels[],
+                      const int k) {
+    /* Record a discovered sequence in 'rule_index' if enabled
+     *
+     * levels: The level sequence
+     * k: Length of the level sequence
+     */
+    if(rule_index != NULL) {
+        ruleindex_insert(rule_index, levels, k);
+    }
+}
+
+
+int ruleindex_parse(int *levels,
+                    char *line) {
+    /* Parse a 'RULE: depth n p1 ... pk' line as written by rekes or a plain
+     * line 'n p1 ... pk' as written by get_all_rules.sh, returns the number
+     * of levels or 0 if the line holds no sequence.
+     *
+     * levels: Array of length RULEINDEX_MAXDEPTH receiving the levels
+     * line: The input line, modified
+     */
+    char *tok, *end;
+    int k, depth;
+
+    tok = strtok(line, " \t\r\n");
+    if(tok == NULL) {
+        return 0;
+    }
+    depth = RULEINDEX_MAXDEPTH;
+    if(!strcmp(tok, "RULE:")) {
+        if((tok = strtok(NULL, " \t\r\n")) == NULL) {
+            return 0;
+        }
+        depth = atoi(tok) + 1;
+        tok = strtok(NULL, " \t\r\n");
+    }
+    for(k = 0; tok != NULL && k < depth && k < RULEINDEX_MAXDEPTH; tok = strtok(NULL, " \t\r\n")) {
+        levels[k] = strtol(tok, &end, 10);
+        if(*end != '\0' || levels[k] < 1) {
+            return 0;
+        }
+        k++;
+    }
+    return k;
+}
+
+
+void ruleindex_merge_node(ruleindex_t *idx,
+                          const long node,
+                          const ruleindex_map_t *map,
+                          const unsigned int mapnode) {
+    /* Merge the subtree of a mapped node into a node of the index
+     */
+    const ruleindex_node *m;
+    unsigned int i, count;
+    long child;
+
+    m = map->nodes + mapnode;
+    if((m->count & RULEINDEX_TERMINAL) && !idx->entries[node].terminal) {
+        idx->entries[node].terminal = 1;
+        idx->nrules++;
+    }
+    count = m->count & ~RULEINDEX_TERMINAL;
+    for(i = 0; i < count; i++) {
+        child = ruleindex_child_add(idx, node, map->nodes[m->first + i].level);
+        ruleindex_merge_node(idx, child, map, m->first + i);
+    }
+}
+
+
+int ruleindex_merge(ruleindex_t *idx,
+                    const char *file) {
+    /* Merge an index file into the index. Returns 1 on success, also if the
+     * file does not exist, and 0 if it is unreadable or of another family.
+     *
+     * idx: The index
+     * file: The index file
+     */
+    ruleindex_map_t map;
+
+    if(access(file, F_OK) != 0) {
+        return 1;
+    }
+    if(!ruleindex_open(&map, file)) {
+        printf("Can not read rule index: %s\n", file);
+        return 0;
+    }
+    if(strncmp(map.header->family, idx->family, RULEINDEX_MAXFAMILY)) {
+        printf("The rule index %s is of family %s\n", file, map.header->family);
+        ruleindex_close(&map);
+        return 0;
+    }
+    ruleindex_merge_node(idx, 0, &map, 0);
+    ruleindex_close(&map);
+    return 1;
+}
+
+
+int ruleindex_save(const ruleindex_t *idx,
+                   const char *file) {
+    /* Write the index in breadth first order, returns 1 on success
+     *
+     * idx: The index
+     * file: The index file, replaced atomically
+     */
+    ruleindex_header header;
+    ruleindex_node *nodes;
+    long *order, *depth;
+    const ruleindex_entry *e;
+    long i, j, tail;
+    char *tmppath;
+    FILE *out;
+    int fd, ok;
+
+    /* Breadth first order, the children of a node become contiguous */
+    order = (long *) malloc(idx->nentries * sizeof(long));
+    depth = (long *) malloc(idx->nentries * sizeof(long));
+    nodes = (ruleindex_node *) calloc(idx->nentries, sizeof(ruleindex_node));
+    order[0] = 0;
+    depth[0] = -1;
+    tail = 1;
+    for(i = 0; i < tail; i++) {
+        e = idx->entries + order[i];
+        nodes[i].level = e->level;
+        nodes[i].first = tail;
+        nodes[i].count = e->nchildren | (e->terminal ? RULEINDEX_TERMINAL : 0);
+        for(j = 0; j < e->nchildren; j++) {
+            depth[tail] = depth[i] + 1;
+            order[tail++] = e->children[j];
+        }
+    }
+    /* Maximal depths bottom up, children come after their parent */
+    for(i = tail - 1; i >= 0; i--) {
+        nodes[i].maxdepth = idx->entries[order[i]].terminal ? depth[i] : -1;
+        for(j = 0; j < (long) (nodes[i].count & ~RULEINDEX_TERMINAL); j++) {
+            if(nodes[nodes[i].first + j].maxdepth > nodes[i].maxdepth) {
+                nodes[i].maxdepth = nodes[nodes[i].first + j].maxdepth;
+            }
+        }
+    }
+
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, RULEINDEX_MAGIC);
+    memcpy(header.family, idx->family, RULEINDEX_MAXFAMILY);
+    header.nnodes = tail;
+    header.nrules = idx->nrules;
+
+    tmppath = (char *) malloc(strlen(file) + 16);
+    sprintf(tmppath, "%s.tmp.XXXXXX", file);
+    ok = 0;
+    if((fd = mkstemp(tmppath)) >= 0) {
+        fchmod(fd, 0644);
+        if((out = fdopen(fd, "w")) != NULL) {
+            ok = fwrite(&header, sizeof(header), 1, out) == 1
+                 && fwrite(nodes, sizeof(ruleindex_node), tail, out) == (size_t) tail;
+            ok = (fclose(out) == 0) && ok;
+        } else {
+            close(fd);
+        }
+        ok = ok && rename(tmppath, file) == 0;
+        if(!ok) {
+            remove(tmppath);
+        }
+    }
+    if(!ok) {
+        printf("Can not write rule index: %s\n", file);
+    }
+
+    free(tmppath);
+    free(nodes);
+    free(depth);
+    free(order);
+    return ok;
+}
+
+
+int ruleindex_open(ruleindex_map_t *map,
+                   const char *file) {
+    /* Map an index file, returns 1 on success
+     *
+     * map: The mapped index
+     * file: The index file
+     */
+    struct stat st;
+    const char *data;
+    int fd;
+
+    if((fd = open(file, O_RDONLY)) < 0) {
+        return 0;
+    }
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t) (sizeof(ruleindex_header) + sizeof(ruleindex_node))) {
+        close(fd);
+        return 0;
+    }
+    data = (const char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        return 0;
+    }
+    map->size = st.st_size;
+    map->header = (const ruleindex_header *) data;
+    map->nodes = (const ruleindex_node *) (data + sizeof(ruleindex_header));
+    if(strncmp(map->header->magic, RULEINDEX_MAGIC, 8)
+       || sizeof(ruleindex_header) + map->header->nnodes * sizeof(ruleindex_node) != map->size) {
+        ruleindex_close(map);
+        return 0;
+    }
+    return 1;
+}
+
+
+void ruleindex_close(ruleindex_map_t *map) {
+    munmap((void *) map->header, map->size);
+    map->header = NULL;
+    map->nodes = NULL;
+}
+
+
+long ruleindex_find(const ruleindex_map_t *map,
+                    const int levels[],
+                    const int k) {
+    /* Find the node of a prefix, returns its position or -1
+     *
+     * map: The mapped index
+     * levels: The prefix 'n p_1 ... p_j', may be empty
+     * k: Length of the prefix
+     */
+    const ruleindex_node *m;
+    unsigned int lo, hi, mid;
+    long node;
+    int i;
+
+    node = 0;
+    for(i = 0; i < k; i++) {
+        m = map->nodes + node;
+        lo = m->first;
+        hi = m->first + (m->count & ~RULEINDEX_TERMINAL);
+        while(lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            if(map->nodes[mid].level < levels[i]) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if(lo == m->first + (m->count & ~RULEINDEX_TERMINAL) || map->nodes[lo].level != levels[i]) {
+            return -1;
+        }
+        node = lo;
+    }
+    return node;
+}
+
+
+long ruleindex_list(FILE *out,
+                    const ruleindex_map_t *map,
+                    const unsigned int node,
+                    int *levels,
+                    const int k,
+                    const long total,
+                    const long maxnodes) {
+    /* Write all sequences below a node with at most 'maxnodes' nodes in total,
+     * one per line, returns their number. Since all levels are positive the
+     * subtree is pruned as soon as the total exceeds the limit.
+     *
+     * out: The output file or NULL to only count
+     * map: The mapped index
+     * node: The node of the prefix
+     * levels: Array of length RULEINDEX_MAXDEPTH holding the prefix
+     * k: Length of the prefix
+     * total: Sum of the levels of the prefix, the number of nodes of its rule
+     * maxnodes: Maximal total number of nodes, or -1 for no limit
+     */
+    const ruleindex_node *m;
+    unsigned int i, count;
+    long found, t;
+    int j;
+
+    if(maxnodes >= 0 && total > maxnodes) {
+        return 0;
+    }
+    m = map->nodes + node;
+    found = 0;
+    if(m->count & RULEINDEX_TERMINAL) {
+        found++;
+        if(out != NULL) {
+            for(j = 0; j < k; j++) {
+                fprintf(out, j > 0 ? " %d" : "%d", levels[j]);
+            }
+            fprintf(out, "\n");
+        }
+    }
+    if(k >= RULEINDEX_MAXDEPTH) {
+        return found;
+    }
+    count = m->count & ~RULEINDEX_TERMINAL;
+    for(i = 0; i < count; i++) {
+        t = total + map->nodes[m->first + i].level;
+        if(maxnodes >= 0 && t > maxnodes) {
+            /* Children are sorted by level */
+            break;
+        }
+        levels[k] = map->nodes[m->first + i].level;
+        found += ruleindex_list(out, map, m->first + i, levels, k + 1, t, maxnodes);
+    }
+    return found;
+}
+
+
+long ruleindex_write(FILE *out,
+                     const ruleindex_t *idx,
+                     const long node,
+                     int *levels,
+                     const int k) {
+    /* Write all sequences below a node of an index in memory as
+     * 'RULE: depth n p1 ... pk' lines like rekes, returns their number.
+     *
+     * out: The output file
+     * idx: The index
+     * node: The node of the prefix, 0 for the root
+     * levels: Array of length RULEINDEX_MAXDEPTH holding the prefix
+     * k: Length of the prefix
+     */
+    const ruleindex_entry *e;
+    long found;
+    int i, j;
+
+    e = idx->entries + node;
+    found = 0;
+    if(e->terminal) {
+        found++;
+        fprintf(out, "RULE: %i  ", k - 1);
+        for(j = 0; j < k; j++) {
+            fprintf(out, "%d ", levels[j]);
+        }
+        fprintf(out, "\n");
+    }
+    if(k >= RULEINDEX_MAXDEPTH) {
+        return found;
+    }
+    for(i = 0; i < e->nchildren; i++) {
+        levels[k] = idx->entries[e->children[i]].level;
+        found += ruleindex_write(out, idx, e->children[i], levels, k + 1);
+    }
+    return found;
+}
+
+
+#endif
@@ -0,0 +1,83 @@
+import mmap
+import struct
+
+
+class RuleIndex(object):
+    """Read only access to a binary rule index written by 'ruleindex' or 'rekes -ix'.
+
+    The file holds a header followed by the nodes of the prefix tree
+    in breadth first order, see 'ruleindex.h' for the layout.
+    """
+
+    HEADER = struct.Struct("=8s24sQQ")
+    NODE = struct.Struct("=iiII")
+    TERMINAL = 0x80000000
+
+    def __init__(self, filename):
+        with open(filename, "rb") as f:
+            self._data = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, family, nnodes, nrules = self.HEADER.unpack_from(self._data, 0)
+        if not magic.startswith(b"KESRIX1"):
+            raise ValueError("Not a rule index: {}".format(filename))
+        self.family = family.rstrip(b"\0").decode()
+        self.nnodes = nnodes
+        self.nrules = nrules
+
+    def close(self):
+        self._data.close()
+
+    def _node(self, i):
+        level, maxdepth, first, count = self.NODE.unpack_from(self._data, self.HEADER.size + i * self.NODE.size)
+        return level, maxdepth, first, count & ~self.TERMINAL, bool(count & self.TERMINAL)
+
+    def find(self, prefix):
+        """Position of the node of a prefix (n, p1, ..., pj) or None."""
+        node = 0
+        for level in prefix:
+            _, _, first, count, _ = self._node(node)
+            lo, hi = first, first + count
+            while lo < hi:
+                mid = (lo + hi) // 2
+                if self._node(mid)[0] < level:
+                    lo = mid + 1
+                else:
+                    hi = mid
+            if lo == first + count or self._node(lo)[0] != level:
+                return None
+            node = lo
+        return node
+
+    def maxdepth(self, prefix=()):
+        """Maximal depth k of all sequences (n, p1, ..., pk) extending the prefix."""
+        node = self.find(prefix)
+        return None if node is None else self._node(node)[1]
+
+    def rules(self, prefix=(), maxnodes=None):
+        """Generate all sequences extending the prefix, optionally only
+        those whose rules have at most 'maxnodes' nodes in total."""
+        node = self.find(prefix)
+        if node is None:
+            return
+        stack = [(node, tuple(prefix), sum(prefix))]
+        while stack:
+            node, rule, total = stack.pop()
+            if maxnodes is not None and total > maxnodes:
+                continue
+            _, _, first, count, terminal = self._node(node)
+            if terminal:
+                yield rule
+            for child in reversed(range(first, first + count)):
+                level = self._node(child)[0]
+                stack.append((child, rule + (level,), total + level))
+
+    def tree(self, prefix=()):
+        """The sequences extending the prefix as nested dictionaries."""
+        node = self.find(prefix)
+        if node is None:
+            return {}
+
+        def subtree(node):
+            _, _, first, count, _ = self._node(node)
+            return {self._node(c)[0]: subtree(c) for c in range(first, first + count)}
+
+        return subtree(node)
@@ -3,8 +3,16 @@ import os.path as path
 import re
 import itertools
 
+from ruleindex import RuleIndex
+
 
 def get_rulelist(file):
+    if file.endswith('.idx'):
+        index = RuleIndex(file)
+        rules = list(index.rules())
+        index.close()
+        return rules
+
     rules = []
 
     with open(file, 'r') as f:
@@ -23,7 +31,7 @@ def collect_all_rules(rulelistspath):
     for file in os.listdir(rulelistspath):
         print(file)
         if file.startswith('rules_'):
-            m = re.match('rules_n(.*)_maxp(.*)_maxrec(.*).txt', file)
+            m = re.match('rules_n(.*)_maxp(.*)_maxrec(.*).(txt|idx)', file)
             datum = tuple(map(int, (m.group(1), m.group(2), m.group(3))))
             allrules[datum] = get_rulelist(path.join(rulelistspath, file))
 
@@ -0,0 +1,205 @@
+/*  Author: R. Bourquin
+ *  Copyright: (C) 2014 R. Bourquin
+ *  License: GNU GPL v2 or above
+ *
+ *  A library of helper functions to search for
+ *  Kronrod extensions of Gauss quadrature rules.
+ */
+
+#ifndef __HH__ruleserver
+#define __HH__ruleserver
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "helpers.h"
+
+
+/* Protocol of the rule server
+ *
+ * Clients connect to the Unix domain socket of the server and send one
+ * request per line:
+ *
+ *   RULE family prec format n p_1 ... p_k
+ *
+ * where prec is the target precision in bits and format is either 'double'
+ * or 'arb'. The server answers with a single line, either
+ *
+ *   OK name size
+ *
+ * naming a read-only POSIX shared memory segment of the given size in bytes
+ * which holds the rule, or
+ *
+ *   ERR message
+ *
+ * A segment starts with a rule_segment_header followed by the data. In the
+ * 'double' format the data consists of 4*len doubles, the real and imaginary
+ * parts of the nodes followed by those of the weights. In the 'arb' format
+ * the data consists of 4*len lines of exact arb dumps in the same order.
+ *
+ * This header only depends on POSIX and can be included by clients.
+ */
+
+#define RULE_SERVER_MAXLINE 4096
+
+#define RULE_FORMAT_DOUBLE 0
+#define RULE_FORMAT_ARB 1
+
+#define RULE_SEGMENT_MAGIC "KESRULE"
+
+
+typedef struct {
+    char magic[8];
+    long format;
+    long len;
+    long prec;
+    long size;
+} rule_segment_header;
+
+
+typedef struct {
+    const rule_segment_header *header;
+    const char *data;
+    size_t size;
+} rule_segment_t;
+
+
+int rule_format_parse(const char *);
+const char * rule_format_name(const int);
+int rule_server_connect(const char *);
+int rule_server_request(rule_segment_t *, char *, const int, const char *, const int[], const int, const long, const int);
+void rule_segment_release(rule_segment_t *);
+
+
+int rule_format_parse(const char *name) {
+    /* Parse the name of a rule format.
+     * Returns -1 for unknown formats.
+     *
+     * name: The name 'double' or 'arb'
+     */
+    if(!strcmp(name, "double")) {
+        return RULE_FORMAT_DOUBLE;
+    } else if(!strcmp(name, "arb")) {
+        return RULE_FORMAT_ARB;
+    }
+    return -1;
+}
+
+
+const char * rule_format_name(const int format) {
+    return format == RULE_FORMAT_ARB ? "arb" : "double";
+}
+
+
+int rule_server_connect(const char *path) {
+    /* Connect to the rule server listening on a Unix domain socket.
+     * Returns the socket or -1 on failure.
+     *
+     * path: The path of the socket
+     */
+    struct sockaddr_un addr;
+    int fd;
+
+    if(strlen(path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if(connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+int rule_server_request(rule_segment_t *segment,
+                        char *error,
+                        const int fd,
+                        const char *family,
+                        const int levels[],
+                        const int k,
+                        const long prec,
+                        const int format) {
+    /* Request a rule from the server and map its segment read-only.
+     * Returns 1 on success and 0 otherwise.
+     *
+     * segment: The mapped segment, release with 'rule_segment_release'
+     * error: Buffer of size RULE_SERVER_MAXLINE receiving the error message
+     * fd: The socket connected to the server
+     * family: Name of the polynomial family
+     * levels: The level sequence n, p_1, ..., p_k
+     * k: Length of the level sequence
+     * prec: Number of bits in target precision
+     * format: The format of the rule data
+     */
+    char line[RULE_SERVER_MAXLINE];
+    char name[RULE_SERVER_MAXLINE];
+    long size;
+    int i, len, shm;
+    void *data;
+
+    len = snprintf(line, sizeof(line), "RULE %s %ld %s", family, prec, rule_format_name(format));
+    for(i = 0; i < k && len < RULE_SERVER_MAXLINE - 1; i++) {
+        len += snprintf(line + len, sizeof(line) - len, " %d", levels[i]);
+    }
+    if(len >= RULE_SERVER_MAXLINE - 1) {
+        strcpy(error, "request too long");
+        return 0;
+    }
+    line[len++] = '\n';
+    if(write(fd, line, len) != len) {
+        strcpy(error, "can not send request");
+        return 0;
+    }
+
+    if(read_line(fd, line, sizeof(line)) < 0) {
+        strcpy(error, "connection closed");
+        return 0;
+    }
+    if(strncmp(line, "OK ", 3) || sscanf(line + 3, "%s %ld", name, &size) != 2) {
+        strcpy(error, strncmp(line, "ERR ", 4) ? line : line + 4);
+        return 0;
+    }
+
+    shm = shm_open(name, O_RDONLY, 0);
+    if(shm < 0) {
+        snprintf(error, RULE_SERVER_MAXLINE, "can not open segment %.255s", name);
+        return 0;
+    }
+    data = mmap(NULL, size, PROT_READ, MAP_SHARED, shm, 0);
+    close(shm);
+    if(data == MAP_FAILED) {
+        snprintf(error, RULE_SERVER_MAXLINE, "can not map segment %.255s", name);
+        return 0;
+    }
+
+    segment->header = (const rule_segment_header *) data;
+    segment->data = (const char *) data + sizeof(rule_segment_header);
+    segment->size = size;
+    return 1;
+}
+
+
+void rule_segment_release(rule_segment_t *segment) {
+    munmap((void *) segment->header, segment->size);
+    segment->header = NULL;
+    segment->data = NULL;
+    segment->size = 0;
+}
+
+
+#endif
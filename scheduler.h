@@ -0,0 +1,508 @@
+/*  Author: R. Bourquin
+ *  Copyright: (C) 2014 R. Bourquin
+ *  License: GNU GPL v2 or above
+ *
+ *  A library of helper functions to search for
+ *  Kronrod extensions of Gauss quadrature rules.
+ */
+
+#ifndef __HH__scheduler
+#define __HH__scheduler
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "flint/flint.h"
+
+
+/* Work-stealing task scheduler
+ *
+ * All parallel stages submit tasks to a single pool of a fixed number of
+ * workers, hence nested parallel stages never oversubscribe the machine.
+ * The thread calling into the scheduler is worker 0, the pool starts the
+ * other workers on first use. The number of workers is taken from
+ * $KES_THREADS, then $OMP_NUM_THREADS and else the number of processors.
+ *
+ * Every worker owns one deque per priority. A worker pushes and pops its
+ * own tasks at the tail, idle workers steal from the head of the others.
+ * Higher priorities are served first, by the owner and by thieves alike.
+ *
+ * Tasks belong to a group, 'sched_wait' returns once all tasks of the group
+ * have run. A waiting worker runs tasks of that group and of its children
+ * meanwhile, so a task may itself submit and wait for tasks. It never picks
+ * up unrelated outer tasks: these would stall the wait and run a second
+ * candidate on top of the first one in the same thread. Groups nest: a group
+ * created inside a task is a child of the group of that task. Cancelling a
+ * group skips all tasks of the group and of its children that have not yet
+ * started, running tasks can poll 'sched_cancelled'.
+ *
+ * FLINT and Arb are limited to a single thread inside every worker.
+ *
+ * Per-thread statistics index their slots by 'sched_slot'. Workers of the
+ * pool use their id, every other thread takes a free slot on first use and
+ * releases it on exit, so the main thread, log writers and server threads
+ * never share a slot.
+ */
+
+#define SCHED_NPRIORITIES 3
+
+#define SCHED_HIGH 0
+#define SCHED_NORMAL 1
+#define SCHED_LOW 2
+
+/* Slots for threads outside of the pool */
+#define SCHED_EXTRASLOTS 32
+
+
+typedef struct sched_group_s {
+    long pending;
+    int cancelled;
+    struct sched_group_s *parent;
+} sched_group_t;
+
+
+typedef void (*sched_fn_t)(void *, long);
+
+
+typedef struct {
+    sched_fn_t fn;
+    void *arg;
+    long index;
+    sched_group_t *group;
+} sched_task_t;
+
+
+typedef struct {
+    pthread_mutex_t lock;
+    sched_task_t *tasks;
+    /* Ring buffer, the head is stolen from and the tail is the owner's end */
+    long head;
+    long len;
+    long capacity;
+} sched_deque_t;
+
+
+int sched_nworkers = 0;
+int sched_started = 0;
+int sched_shutdown = 0;
+pthread_t *sched_workers = NULL;
+/* The deque of priority q of worker w at index w * SCHED_NPRIORITIES + q */
+sched_deque_t *sched_deques = NULL;
+long sched_queued = 0;
+int sched_sleepers = 0;
+pthread_mutex_t sched_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t sched_wakeup = PTHREAD_COND_INITIALIZER;
+
+/* Slots taken by threads outside of the pool, released by the key's destructor */
+char sched_external[SCHED_EXTRASLOTS];
+pthread_key_t sched_slot_key;
+pthread_once_t sched_slot_once = PTHREAD_ONCE_INIT;
+
+/* The worker id, the statistics slot and the group of the running task per thread */
+__thread int sched_self = 0;
+__thread int sched_slot_id = -1;
+__thread sched_group_t *sched_current = NULL;
+
+
+int sched_nthreads(void);
+int sched_set_threads(const int);
+int sched_nslots(void);
+void sched_slot_release(void *);
+void sched_slot_init(void);
+int sched_slot(void);
+void sched_start(void);
+void sched_stop(void);
+void * sched_worker_main(void *);
+void sched_group_init(sched_group_t *);
+void sched_submit(sched_group_t *, sched_fn_t, void *, const long, const int);
+int sched_within(const sched_group_t *, const sched_group_t *);
+int sched_take(sched_task_t *, const sched_group_t *);
+void sched_run(sched_task_t *);
+void sched_wait(sched_group_t *);
+void sched_cancel(sched_group_t *);
+int sched_cancelled(const sched_group_t *);
+void sched_for(const long, const long, sched_fn_t, void *, const int);
+
+
+int sched_nthreads(void) {
+    /* The fixed number of workers, including the calling thread
+     */
+    const char *env;
+    int n;
+
+    if(sched_nworkers == 0) {
+        env = getenv("KES_THREADS");
+        if(env == NULL) {
+            env = getenv("OMP_NUM_THREADS");
+        }
+        n = env != NULL ? atoi(env) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+        sched_nworkers = n > 0 ? n : 1;
+    }
+    return sched_nworkers;
+}
+
+
+int sched_set_threads(const int n) {
+    /* Set the number of workers, only before the number is fixed by the
+     * first use. Returns 0 if n is not positive or the number is fixed.
+     *
+     * n: The number of workers
+     */
+    if(sched_nworkers != 0 || n <= 0) {
+        return 0;
+    }
+    sched_nworkers = n;
+    return 1;
+}
+
+
+int sched_nslots(void) {
+    /* The number of statistics slots, slot 0 of worker 0 is the first
+     * slot of the threads outside of the pool
+     */
+    return sched_nthreads() - 1 + SCHED_EXTRASLOTS;
+}
+
+
+void sched_slot_release(void *value) {
+    /* Release the slot of a thread outside of the pool on its exit
+     *
+     * value: The index into 'sched_external' plus one
+     */
+    pthread_mutex_lock(&sched_lock);
+    sched_external[(long) value - 1] = 0;
+    pthread_mutex_unlock(&sched_lock);
+}
+
+
+void sched_slot_init(void) {
+    pthread_key_create(&sched_slot_key, sched_slot_release);
+}
+
+
+int sched_slot(void) {
+    /* The statistics slot of the calling thread, see the description above.
+     * The first thread outside of the pool, normally the main thread, is
+     * worker 0 and takes slot 0. Returns 'sched_nslots()' if all are taken.
+     */
+    long j;
+    int n;
+
+    if(sched_slot_id < 0) {
+        n = sched_nthreads();
+        pthread_once(&sched_slot_once, sched_slot_init);
+        pthread_mutex_lock(&sched_lock);
+        for(j = 0; j < SCHED_EXTRASLOTS && sched_external[j]; j++);
+        if(j < SCHED_EXTRASLOTS) {
+            sched_external[j] = 1;
+            sched_slot_id = j == 0 ? 0 : n - 1 + j;
+        } else {
+            sched_slot_id = n - 1 + SCHED_EXTRASLOTS;
+        }
+        pthread_mutex_unlock(&sched_lock);
+        if(j < SCHED_EXTRASLOTS) {
+            pthread_setspecific(sched_slot_key, (void *) (j + 1));
+        }
+    }
+    return sched_slot_id;
+}
+
+
+void sched_start(void) {
+    /* Start the pool, called on first use
+     */
+    long i, n;
+
+    pthread_mutex_lock(&sched_lock);
+    if(sched_started) {
+        pthread_mutex_unlock(&sched_lock);
+        return;
+    }
+    n = sched_nthreads() > 1 ? sched_nworkers : 1;
+    sched_deques = (sched_deque_t *) calloc(n * SCHED_NPRIORITIES, sizeof(sched_deque_t));
+    for(i = 0; i < n * SCHED_NPRIORITIES; i++) {
+        pthread_mutex_init(&sched_deques[i].lock, NULL);
+    }
+    sched_workers = (pthread_t *) calloc(n, sizeof(pthread_t));
+#if defined(__FLINT_RELEASE) && __FLINT_RELEASE >= 20600
+    if(sched_nworkers > 1) {
+        flint_set_num_threads(1);
+    }
+#endif
+    for(i = 1; i < sched_nworkers; i++) {
+        pthread_create(sched_workers + i, NULL, sched_worker_main, (void *) i);
+    }
+    __atomic_store_n(&sched_started, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&sched_lock);
+    atexit(sched_stop);
+}
+
+
+void sched_stop(void) {
+    /* Stop and join all workers, registered with 'atexit'
+     */
+    long i;
+
+    pthread_mutex_lock(&sched_lock);
+    sched_shutdown = 1;
+    pthread_cond_broadcast(&sched_wakeup);
+    pthread_mutex_unlock(&sched_lock);
+    for(i = 1; i < sched_nworkers; i++) {
+        pthread_join(sched_workers[i], NULL);
+    }
+}
+
+
+void * sched_worker_main(void *arg) {
+    /* Run tasks until the pool is stopped, sleep while there are none
+     */
+    sched_task_t task;
+
+    sched_self = (int) (long) arg;
+    sched_slot_id = sched_self;
+#if defined(__FLINT_RELEASE) && __FLINT_RELEASE >= 20600
+    flint_set_num_threads(1);
+#endif
+    for(;;) {
+        if(sched_take(&task, NULL)) {
+            sched_run(&task);
+            continue;
+        }
+        pthread_mutex_lock(&sched_lock);
+        __atomic_add_fetch(&sched_sleepers, 1, __ATOMIC_SEQ_CST);
+        while(__atomic_load_n(&sched_queued, __ATOMIC_SEQ_CST) == 0 && !sched_shutdown) {
+            pthread_cond_wait(&sched_wakeup, &sched_lock);
+        }
+        __atomic_sub_fetch(&sched_sleepers, 1, __ATOMIC_SEQ_CST);
+        if(sched_shutdown) {
+            pthread_mutex_unlock(&sched_lock);
+            break;
+        }
+        pthread_mutex_unlock(&sched_lock);
+    }
+#if defined(__FLINT_RELEASE) && __FLINT_RELEASE >= 20600
+    flint_cleanup();
+#endif
+    return NULL;
+}
+
+
+void sched_group_init(sched_group_t *group) {
+    /* Initialise an empty group, a child of the group of the running task
+     *
+     * group: The group
+     */
+    group->pending = 0;
+    group->cancelled = 0;
+    group->parent = sched_current;
+}
+
+
+void sched_submit(sched_group_t *group,
+                  sched_fn_t fn,
+                  void *arg,
+                  const long index,
+                  const int priority) {
+    /* Submit the task 'fn(arg, index)' to the deque of the calling worker
+     *
+     * group: The group of the task
+     * fn: The function to run
+     * arg: First argument of the function
+     * index: Second argument of the function
+     * priority: One of SCHED_HIGH, SCHED_NORMAL and SCHED_LOW
+     */
+    sched_deque_t *d;
+    sched_task_t *t;
+    long i;
+
+    if(!__atomic_load_n(&sched_started, __ATOMIC_ACQUIRE)) {
+        sched_start();
+    }
+    __atomic_add_fetch(&group->pending, 1, __ATOMIC_SEQ_CST);
+
+    d = sched_deques + sched_self * SCHED_NPRIORITIES
+        + (priority < 0 ? 0 : priority >= SCHED_NPRIORITIES ? SCHED_NPRIORITIES - 1 : priority);
+    pthread_mutex_lock(&d->lock);
+    if(d->len == d->capacity) {
+        /* Grow and unwrap the ring buffer */
+        t = (sched_task_t *) malloc((d->capacity > 0 ? 2 * d->capacity : 64) * sizeof(sched_task_t));
+        for(i = 0; i < d->len; i++) {
+            t[i] = d->tasks[(d->head + i) % d->capacity];
+        }
+        free(d->tasks);
+        d->tasks = t;
+        d->head = 0;
+        d->capacity = d->capacity > 0 ? 2 * d->capacity : 64;
+    }
+    t = d->tasks + (d->head + d->len) % d->capacity;
+    t->fn = fn;
+    t->arg = arg;
+    t->index = index;
+    t->group = group;
+    d->len++;
+    pthread_mutex_unlock(&d->lock);
+
+    __atomic_add_fetch(&sched_queued, 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&sched_sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&sched_lock);
+        pthread_cond_signal(&sched_wakeup);
+        pthread_mutex_unlock(&sched_lock);
+    }
+}
+
+
+int sched_within(const sched_group_t *group,
+                 const sched_group_t *within) {
+    /* Whether a group is the given group or one of its descendants
+     *
+     * group: The group of a task
+     * within: The group, NULL admits all groups
+     */
+    if(within == NULL) {
+        return 1;
+    }
+    for(; group != NULL; group = group->parent) {
+        if(group == within) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+int sched_take(sched_task_t *task,
+               const sched_group_t *within) {
+    /* Take the next task, returns 0 if there is none. For each priority
+     * the own deque is popped at the tail, then the other deques are
+     * stolen from at the head starting with the next worker. A deque
+     * whose end holds a task outside of 'within' is passed over.
+     *
+     * task: The task taken
+     * within: Take only tasks of this group and its descendants, NULL for all
+     */
+    sched_deque_t *d;
+    sched_task_t *t;
+    int q, k, w;
+
+    if(__atomic_load_n(&sched_queued, __ATOMIC_SEQ_CST) == 0) {
+        return 0;
+    }
+    for(q = 0; q < SCHED_NPRIORITIES; q++) {
+        for(k = 0; k < sched_nworkers; k++) {
+            w = (sched_self + k) % sched_nworkers;
+            d = sched_deques + w * SCHED_NPRIORITIES + q;
+            if(__atomic_load_n(&d->len, __ATOMIC_RELAXED) == 0) {
+                continue;
+            }
+            pthread_mutex_lock(&d->lock);
+            if(d->len == 0) {
+                pthread_mutex_unlock(&d->lock);
+                continue;
+            }
+            t = d->tasks + (k == 0 ? (d->head + d->len - 1) % d->capacity : d->head);
+            if(!sched_within(t->group, within)) {
+                pthread_mutex_unlock(&d->lock);
+                continue;
+            }
+            *task = *t;
+            if(k != 0) {
+                d->head = (d->head + 1) % d->capacity;
+            }
+            d->len--;
+            pthread_mutex_unlock(&d->lock);
+            __atomic_sub_fetch(&sched_queued, 1, __ATOMIC_SEQ_CST);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+void sched_run(sched_task_t *task) {
+    /* Run a task unless its group was cancelled
+     *
+     * task: The task
+     */
+    sched_group_t *outer;
+
+    if(!sched_cancelled(task->group)) {
+        outer = sched_current;
+        sched_current = task->group;
+        task->fn(task->arg, task->index);
+        sched_current = outer;
+    }
+    __atomic_sub_fetch(&task->group->pending, 1, __ATOMIC_SEQ_CST);
+}
+
+
+void sched_wait(sched_group_t *group) {
+    /* Wait until all tasks of the group ran, running tasks of the group
+     * and its descendants meanwhile
+     *
+     * group: The group
+     */
+    sched_task_t task;
+
+    while(__atomic_load_n(&group->pending, __ATOMIC_SEQ_CST) > 0) {
+        if(sched_take(&task, group)) {
+            sched_run(&task);
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+
+void sched_cancel(sched_group_t *group) {
+    /* Skip all tasks of the group and its children not yet started
+     *
+     * group: The group
+     */
+    __atomic_store_n(&group->cancelled, 1, __ATOMIC_RELAXED);
+}
+
+
+int sched_cancelled(const sched_group_t *group) {
+    /* Whether the group or one of its parents was cancelled
+     *
+     * group: The group, may be NULL
+     */
+    for(; group != NULL; group = group->parent) {
+        if(__atomic_load_n(&group->cancelled, __ATOMIC_RELAXED)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+void sched_for(const long begin,
+               const long end,
+               sched_fn_t fn,
+               void *arg,
+               const int priority) {
+    /* Run 'fn(arg, i)' for all begin <= i < end as tasks and wait for them.
+     * The calling worker starts at 'begin', thieves steal from 'end'.
+     *
+     * begin: First index
+     * end: One past the last index
+     * fn: The function to run
+     * arg: First argument of the function
+     * priority: One of SCHED_HIGH, SCHED_NORMAL and SCHED_LOW
+     */
+    sched_group_t group;
+    long i;
+
+    sched_group_init(&group);
+    for(i = end - 1; i >= begin; i--) {
+        sched_submit(&group, fn, arg, i, priority);
+    }
+    sched_wait(&group);
+}
+
+
+#endif
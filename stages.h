@@ -0,0 +1,258 @@
+/*  Author: R. Bourquin
+ *  Copyright: (C) 2014 R. Bourquin
+ *  License: GNU GPL v2 or above
+ *
+ *  A library of helper functions to search for
+ *  Kronrod extensions of Gauss quadrature rules.
+ */
+
+#ifndef __HH__stages
+#define __HH__stages
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "trace.h"
+#include "memstats.h"
+#include "perfcounters.h"
+
+
+/* Timing of the computational stages
+ *
+ * Each stage is timed by a monotonic clock between 'stage_begin' and
+ * 'stage_end'. Every timing is kept as a sample such that percentiles
+ * can be reported. Counters record events without timing. If tracing
+ * is enabled every stage is also recorded as trace event. Monitors which
+ * only need running totals per stage enable 'stage_totals'. All of this
+ * is disabled by default and then costs a single test of a global flag.
+ */
+
+typedef enum {
+    STAGE_CANDIDATE,
+    STAGE_ASSEMBLY,
+    STAGE_SOLVE,
+    STAGE_STORE,
+    STAGE_ROOTS,
+    STAGE_WEIGHTS,
+    STAGE_VALIDATE,
+    STAGE_TABLES,
+    STAGE_WEIGHTFACTORS,
+    STAGE_CONSTRUCTION,
+    STAGE_OUTPUT,
+    STAGE_MULTIDOUBLE,
+    STAGE_CERTIFY,
+    NSTAGES
+} stage_t;
+
+typedef enum {
+    COUNT_SOLVABLE,
+    COUNT_UNSOLVABLE,
+    COUNT_STORE_HITS,
+    COUNT_CACHE_HITS,
+    COUNT_ROOT_ROUNDS,
+    COUNT_ROOT_BUDGET,
+    COUNT_WEIGHT_ROUNDS,
+    COUNT_MULTIDOUBLE,
+    COUNT_MULTIDOUBLE_FALLBACKS,
+    COUNT_MIXED_ORBITS,
+    COUNT_MIXED_FALLBACKS,
+    COUNT_ORBITS_RECOMPUTED,
+    NCOUNTERS
+} counter_t;
+
+const char *stage_names[NSTAGES] = {
+    "candidate",
+    "assembly",
+    "exact solve",
+    "store lookup",
+    "root finding",
+    "weight solve",
+    "validation",
+    "tables",
+    "weight factors",
+    "construction",
+    "output",
+    "multi-double",
+    "certification"
+};
+
+const char *counter_names[NCOUNTERS] = {
+    "solvable systems",
+    "unsolvable systems",
+    "store hits",
+    "rule cache hits",
+    "root precision rounds",
+    "root iteration budget",
+    "weight precision rounds",
+    "multi-double rules",
+    "multi-double fallbacks",
+    "mixed-precision orbits",
+    "orbits recomputed in arb",
+    "orbits recomputed at higher precision"
+};
+
+
+typedef struct {
+    double *samples;
+    long len;
+    long alloc;
+} stage_samples_t;
+
+
+int stats_enabled = 0;
+int stage_totals_enabled = 0;
+stage_samples_t stage_samples[NSTAGES];
+long stage_counters[NCOUNTERS];
+long stage_totals[NSTAGES];
+double stage_seconds[NSTAGES];
+pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+void stats_enable(void);
+void stage_totals_enable(void);
+double stage_begin(void);
+void stage_end(const stage_t, const double);
+void stats_count(const counter_t, const long);
+void stats_report(void);
+
+
+void stats_enable(void) {
+    /* Enable timing and counting, the summary
+     * is printed when the program exits.
+     */
+    if(!stats_enabled) {
+        stats_enabled = 1;
+        atexit(stats_report);
+    }
+}
+
+
+void stage_totals_enable(void) {
+    /* Enable the running totals of count and time per stage
+     */
+    stage_totals_enabled = 1;
+}
+
+
+double stage_begin(void) {
+    /* Start timing a stage, returns the start time
+     */
+    if(!stats_enabled && !trace_enabled && !stage_totals_enabled) {
+        return 0.0;
+    }
+    memstats_push();
+    perf_push();
+    return monotonic_time();
+}
+
+
+void stage_end(const stage_t stage,
+               const double start) {
+    /* Finish timing a stage
+     *
+     * stage: The stage
+     * start: The start time returned by 'stage_begin'
+     */
+    double end, seconds, total;
+    stage_samples_t *s;
+
+    if(!stats_enabled && !trace_enabled && !stage_totals_enabled) {
+        return;
+    }
+    end = monotonic_time();
+    perf_pop(stage);
+    memstats_pop(stage, end);
+    trace_record(stage_names[stage], start, end);
+
+    __atomic_add_fetch(stage_totals + stage, 1, __ATOMIC_RELAXED);
+    __atomic_load(stage_seconds + stage, &seconds, __ATOMIC_RELAXED);
+    do {
+        total = seconds + (end - start);
+    } while(!__atomic_compare_exchange(stage_seconds + stage, &seconds, &total, 1,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    if(!stats_enabled) {
+        return;
+    }
+    s = stage_samples + stage;
+
+    pthread_mutex_lock(&stats_lock);
+    if(s->len == s->alloc) {
+        s->alloc = s->alloc > 0 ? 2 * s->alloc : 1024;
+        s->samples = (double *) realloc(s->samples, s->alloc * sizeof(double));
+    }
+    s->samples[s->len++] = end - start;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+
+void stats_count(const counter_t counter,
+                 const long n) {
+    /* Increment a counter
+     *
+     * counter: The counter
+     * n: The increment
+     */
+    if(!stats_enabled) {
+        return;
+    }
+
+    __atomic_add_fetch(stage_counters + counter, n, __ATOMIC_RELAXED);
+}
+
+
+int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+
+void stats_report(void) {
+    /* Print the summary of all stages and counters
+     */
+    int i, width;
+    long j, len;
+    double total, *x;
+
+    printf("-------------------------------------------------------------------------------------\n");
+    printf("%-15s %10s %12s %12s %12s %12s %12s\n", "stage", "count", "total [s]", "p50 [s]", "p90 [s]", "p99 [s]", "max [s]");
+    for(i = 0; i < NSTAGES; i++) {
+        len = stage_samples[i].len;
+        if(len == 0) {
+            continue;
+        }
+        x = stage_samples[i].samples;
+        qsort(x, len, sizeof(double), compare_doubles);
+        total = 0.0;
+        for(j = 0; j < len; j++) {
+            total += x[j];
+        }
+        printf("%-15s %10ld %12.6f %12.3e %12.3e %12.3e %12.3e\n", stage_names[i], len, total,
+               x[len / 2], x[(9 * len) / 10], x[(99 * len) / 100], x[len - 1]);
+    }
+    printf("-------------------------------------------------------------------------------------\n");
+    /* The column of the values follows the longest name */
+    width = 0;
+    for(i = 0; i < NCOUNTERS; i++) {
+        if(stage_counters[i] > 0 && (int) strlen(counter_names[i]) > width) {
+            width = strlen(counter_names[i]);
+        }
+    }
+    for(i = 0; i < NCOUNTERS; i++) {
+        if(stage_counters[i] > 0) {
+            printf("%-*s %10ld\n", width, counter_names[i], stage_counters[i]);
+        }
+    }
+    printf("-------------------------------------------------------------------------------------\n");
+    if(memstats_enabled) {
+        memstats_report(stage_names, NSTAGES);
+    }
+    if(perf_enabled) {
+        perf_report(stage_names, NSTAGES, stage_totals[STAGE_CANDIDATE]);
+    }
+}
+
+
+#endif
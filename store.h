@@ -0,0 +1,215 @@
+/*  Author: R. Bourquin
+ *  Copyright: (C) 2014 R. Bourquin
+ *  License: GNU GPL v2 or above
+ *
+ *  A library of helper functions to search for
+ *  Kronrod extensions of Gauss quadrature rules.
+ */
+
+#ifndef __HH__store
+#define __HH__store
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "flint/flint.h"
+#include "flint/fmpq_poly.h"
+
+#include "switch.h"
+
+
+/* Persistent store of exact extension polynomials
+ *
+ * The extension E_p of a tower is a deterministic function of the family
+ * and of the level sequence  n, p_1, ..., p_{k-1}, p. The store keeps one
+ * file per such key, named by a hash of the key. Files are written to a
+ * temporary name and renamed into place, which is atomic on POSIX file
+ * systems. Concurrent writers of the same key write identical content and
+ * readers never see partially written files.
+ */
+
+#define STORE_MAXKEY 4096
+
+
+char *exact_store_dir = NULL;
+
+
+void exact_store_open(const char *);
+int exact_store_key(char *, const int[], const int);
+void exact_store_path(char *, const char *, const int);
+int exact_store_lookup(fmpq_poly_t, int *, const int[], const int);
+int exact_store_insert(const fmpq_poly_t, const int, const int[], const int);
+
+
+void exact_store_open(const char *dir) {
+    /* Enable the store in the given directory. If dir is NULL
+     * the directory is taken from the environment variable KES_STORE.
+     * The store stays disabled if neither is set.
+     *
+     * dir: The store directory or NULL
+     */
+    if(dir == NULL) {
+        dir = getenv("KES_STORE");
+    }
+    if(dir == NULL || strlen(dir) == 0) {
+        return;
+    }
+    mkdir(dir, 0777);
+    exact_store_dir = (char *) malloc(strlen(dir) + 1);
+    strcpy(exact_store_dir, dir);
+}
+
+
+int exact_store_key(char *key,
+                    const int levels[],
+                    const int k) {
+    /* Build the key 'family:n,p_1,...,p' of an extension.
+     * Returns 0 if the key does not fit into STORE_MAXKEY characters.
+     *
+     * key: Buffer of size STORE_MAXKEY
+     * levels: The level sequence n, p_1, ..., p
+     * k: Length of the level sequence
+     */
+    int i, len;
+
+    len = snprintf(key, STORE_MAXKEY, "%s:", family_name());
+    for(i = 0; i < k && len < STORE_MAXKEY; i++) {
+        len += snprintf(key + len, STORE_MAXKEY - len, i > 0 ? ",%d" : "%d", levels[i]);
+    }
+    return len < STORE_MAXKEY;
+}
+
+
+void exact_store_path(char *path,
+                      const char *key,
+                      const int create) {
+    /* Compute the file name of a key from its 64 bit FNV-1a hash.
+     * The first byte of the hash selects a subdirectory.
+     *
+     * path: Buffer of size STORE_MAXKEY
+     * key: The key
+     * create: Create the subdirectory if missing
+     */
+    unsigned long long h;
+    const char *c;
+
+    h = 14695981039346656037ULL;
+    for(c = key; *c; c++) {
+        h ^= (unsigned char) *c;
+        h *= 1099511628211ULL;
+    }
+
+    snprintf(path, STORE_MAXKEY, "%s/%02llx", exact_store_dir, h >> 56);
+    if(create) {
+        mkdir(path, 0777);
+    }
+    snprintf(path, STORE_MAXKEY, "%s/%02llx/%016llx", exact_store_dir, h >> 56, h);
+}
+
+
+int exact_store_lookup(fmpq_poly_t Ep,
+                       int *solvable,
+                       const int levels[],
+                       const int k) {
+    /* Look up an extension in the store.
+     * Returns 1 if found and 0 otherwise.
+     *
+     * Ep: The polynomial defining the extension
+     * solvable: Whether the extension exists
+     * levels: The level sequence n, p_1, ..., p
+     * k: Length of the level sequence
+     */
+    char key[STORE_MAXKEY];
+    char path[STORE_MAXKEY];
+    char *line;
+    size_t size;
+    FILE *file;
+    int found;
+
+    if(exact_store_dir == NULL || !exact_store_key(key, levels, k)) {
+        return 0;
+    }
+    exact_store_path(path, key, 0);
+
+    file = fopen(path, "r");
+    if(file == NULL) {
+        return 0;
+    }
+
+    found = 0;
+    line = NULL;
+    size = 0;
+    /* Line 1: key, protects against hash collisions */
+    if(getline(&line, &size, file) > 0 && !strncmp(line, key, strlen(key)) && line[strlen(key)] == '\n') {
+        /* Line 2: solvability flag */
+        if(getline(&line, &size, file) > 0 && sscanf(line, "%d", solvable) == 1) {
+            /* Line 3: the polynomial */
+            if(getline(&line, &size, file) > 0) {
+                line[strcspn(line, "\n")] = '\0';
+                found = fmpq_poly_set_str(Ep, line) == 0;
+            }
+        }
+    }
+
+    free(line);
+    fclose(file);
+    return found;
+}
+
+
+int exact_store_insert(const fmpq_poly_t Ep,
+                       const int solvable,
+                       const int levels[],
+                       const int k) {
+    /* Insert an extension into the store.
+     * Returns 1 on success and 0 otherwise.
+     *
+     * Ep: The polynomial defining the extension
+     * solvable: Whether the extension exists
+     * levels: The level sequence n, p_1, ..., p
+     * k: Length of the level sequence
+     */
+    char key[STORE_MAXKEY];
+    char path[STORE_MAXKEY];
+    char tmppath[STORE_MAXKEY + 64];
+    char *strf;
+    FILE *file;
+    int fd, ok;
+
+    if(exact_store_dir == NULL || !exact_store_key(key, levels, k)) {
+        return 0;
+    }
+    exact_store_path(path, key, 1);
+    snprintf(tmppath, sizeof(tmppath), "%s.tmp.XXXXXX", path);
+
+    /* Unique temporary name, writers may be threads of one process */
+    fd = mkstemp(tmppath);
+    if(fd < 0) {
+        return 0;
+    }
+    fchmod(fd, 0644);
+    file = fdopen(fd, "w");
+    if(file == NULL) {
+        close(fd);
+        remove(tmppath);
+        return 0;
+    }
+    strf = fmpq_poly_get_str(Ep);
+    ok = fprintf(file, "%s\n%d\n%s\n", key, solvable, strf) > 0;
+    ok = (fclose(file) == 0) && ok;
+    flint_free(strf);
+
+    if(ok && rename(tmppath, path) == 0) {
+        return 1;
+    }
+    remove(tmppath);
+    return 0;
+}
+
+
+#endif
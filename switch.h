@@ -17,15 +17,39 @@
 #include "quadrature.h"
 
 
+inline const char * family_name(void);
 inline void polynomial(fmpq_poly_t, const int);
 inline void integrate(fmpq_t, const int);
 inline void moments(fmpq_mat_t, const int);
 inline void transcendental_factor(arb_t, const long);
+inline void recurrence(fmpq_t, fmpq_t, fmpq_t, const int);
 inline long validate_roots(const acb_ptr, const long, const long, const int);
 inline long validate_weights(const acb_ptr, const long, const long, const int);
 inline void evaluate_weights_formula(acb_ptr, const acb_ptr, const int, long);
 
 
+inline const char * family_name(void) {
+#ifdef LEGENDRE
+    return "legendre";
+#endif
+#ifdef LAGUERRE
+    return "laguerre";
+#endif
+#ifdef HERMITEPRO
+    return "hermitepro";
+#endif
+#ifdef HERMITE
+    return "hermite";
+#endif
+#ifdef CHEBYSHEVT
+    return "chebyshevt";
+#endif
+#ifdef CHEBYSHEVU
+    return "chebyshevu";
+#endif
+    return "unknown";
+}
+
 inline void polynomial(fmpq_poly_t Pn, const int n) {
 #ifdef LEGENDRE
     legendre_polynomial(Pn, n);
@@ -110,6 +134,27 @@ inline void transcendental_factor(arb_t T, const long prec) {
 #endif
 }
 
+inline void recurrence(fmpq_t A, fmpq_t B, fmpq_t C, const int n) {
+#ifdef LEGENDRE
+    recurrence_legendre(A, B, C, n);
+#endif
+#ifdef LAGUERRE
+    recurrence_laguerre(A, B, C, n);
+#endif
+#ifdef HERMITEPRO
+    recurrence_hermite_pro(A, B, C, n);
+#endif
+#ifdef HERMITE
+    recurrence_hermite_phy(A, B, C, n);
+#endif
+#ifdef CHEBYSHEVT
+    recurrence_chebyshevt(A, B, C, n);
+#endif
+#ifdef CHEBYSHEVU
+    recurrence_chebyshevu(A, B, C, n);
+#endif
+}
+
 inline long validate_roots(const acb_ptr roots,
                            const long n,
                            const long prec,
@@ -0,0 +1,278 @@
+/*  Author: R. Bourquin
+ *  Copyright: (C) 2014 R. Bourquin
+ *  License: GNU GPL v2 or above
+ *
+ *  A library of helper functions to search for
+ *  Kronrod extensions of Gauss quadrature rules.
+ */
+
+#ifndef __HH__telemetry
+#define __HH__telemetry
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "flint/flint.h"
+#include "flint/fmpz.h"
+#include "flint/fmpz_vec.h"
+#include "flint/fmpq.h"
+#include "flint/fmpq_poly.h"
+#include "flint/fmpq_mat.h"
+
+#include "stages.h"
+#include "progress.h"
+
+
+/* Per candidate telemetry of the exact and numerical path
+ *
+ * For every candidate (n, p) one record is written as a line of JSON.
+ * It holds the bit sizes of the coefficients of the basis polynomial,
+ * of the system matrix and of its solution, the size of the common
+ * denominator of the solution and the final precisions reached by the
+ * root finding and the weights. Each thread fills its own record
+ * between 'candidate_begin' and 'candidate_end'.
+ */
+
+typedef struct {
+    int n;
+    int p;
+    int depth;
+    int stored;
+    long basis_num_bits;
+    long basis_den_bits;
+    long matrix_num_bits;
+    long matrix_den_bits;
+    long solution_num_bits;
+    long solution_den_bits;
+    long common_den_bits;
+    long roots_prec;
+    long weights_prec;
+    /* Avoid false sharing between threads */
+    char pad[64];
+} telemetry_record_t;
+
+
+int telemetry_enabled = 0;
+int telemetry_nthreads = 0;
+const char *telemetry_family = NULL;
+FILE *telemetry_file = NULL;
+pthread_mutex_t telemetry_lock = PTHREAD_MUTEX_INITIALIZER;
+telemetry_record_t *telemetry_records = NULL;
+
+
+void telemetry_enable(const char *, const char *);
+void telemetry_close(void);
+telemetry_record_t * telemetry_record(void);
+void fmpq_mat_max_bits(long *, long *, const fmpq_mat_t);
+void telemetry_basis(const fmpq_poly_t);
+void telemetry_system(const fmpq_mat_t, const fmpq_mat_t);
+void telemetry_stored(void);
+void telemetry_roots(const long);
+void telemetry_weights(const long);
+double candidate_begin(const int, const int, const int);
+void candidate_end(const double, const int, const int);
+
+
+void telemetry_enable(const char *file,
+                      const char *family) {
+    /* Enable telemetry, records are appended to the given file
+     *
+     * file: The output file
+     * family: Name of the polynomial family
+     */
+    if(telemetry_enabled) {
+        return;
+    }
+    telemetry_file = fopen(file, "a");
+    if(telemetry_file == NULL) {
+        printf("Can not open telemetry file: %s\n", file);
+        return;
+    }
+    telemetry_family = family;
+    telemetry_nthreads = sched_nslots();
+    telemetry_records = (telemetry_record_t *) calloc(telemetry_nthreads, sizeof(telemetry_record_t));
+    telemetry_enabled = 1;
+    atexit(telemetry_close);
+}
+
+
+void telemetry_close(void) {
+    fclose(telemetry_file);
+    free(telemetry_records);
+    telemetry_enabled = 0;
+}
+
+
+telemetry_record_t * telemetry_record(void) {
+    /* The record of the calling thread or NULL if disabled
+     */
+    int tid;
+
+    if(!telemetry_enabled) {
+        return NULL;
+    }
+    tid = sched_slot();
+    return tid < telemetry_nthreads ? telemetry_records + tid : NULL;
+}
+
+
+void fmpq_mat_max_bits(long *num_bits,
+                       long *den_bits,
+                       const fmpq_mat_t M) {
+    /* Maximal bit sizes of numerators and denominators of a matrix
+     *
+     * num_bits: Maximal number of bits of all numerators
+     * den_bits: Maximal number of bits of all denominators
+     * M: The matrix
+     */
+    slong i, j;
+    long b;
+
+    *num_bits = 0;
+    *den_bits = 0;
+    for(i = 0; i < fmpq_mat_nrows(M); i++) {
+        for(j = 0; j < fmpq_mat_ncols(M); j++) {
+            b = fmpz_bits(fmpq_numref(fmpq_mat_entry(M, i, j)));
+            *num_bits = FLINT_MAX(*num_bits, b);
+            b = fmpz_bits(fmpq_denref(fmpq_mat_entry(M, i, j)));
+            *den_bits = FLINT_MAX(*den_bits, b);
+        }
+    }
+}
+
+
+void telemetry_basis(const fmpq_poly_t Pn) {
+    /* Record the coefficient sizes of the basis polynomial
+     *
+     * Pn: The polynomial defining the basis
+     */
+    telemetry_record_t *r;
+
+    if((r = telemetry_record()) == NULL) {
+        return;
+    }
+    r->basis_num_bits = FLINT_ABS(_fmpz_vec_max_bits(fmpq_poly_numref(Pn), fmpq_poly_length(Pn)));
+    r->basis_den_bits = fmpz_bits(fmpq_poly_denref(Pn));
+}
+
+
+void telemetry_system(const fmpq_mat_t M,
+                      const fmpq_mat_t X) {
+    /* Record the coefficient sizes of the system matrix and its solution
+     *
+     * M: The system matrix
+     * X: The solution
+     */
+    telemetry_record_t *r;
+    fmpz_t den;
+    slong i;
+
+    if((r = telemetry_record()) == NULL) {
+        return;
+    }
+    fmpq_mat_max_bits(&r->matrix_num_bits, &r->matrix_den_bits, M);
+    fmpq_mat_max_bits(&r->solution_num_bits, &r->solution_den_bits, X);
+
+    fmpz_init(den);
+    fmpz_one(den);
+    for(i = 0; i < fmpq_mat_nrows(X); i++) {
+        fmpz_lcm(den, den, fmpq_denref(fmpq_mat_entry(X, i, 0)));
+    }
+    r->common_den_bits = fmpz_bits(den);
+    fmpz_clear(den);
+}
+
+
+void telemetry_stored(void) {
+    telemetry_record_t *r;
+
+    if((r = telemetry_record()) != NULL) {
+        r->stored = 1;
+    }
+}
+
+
+void telemetry_roots(const long prec) {
+    telemetry_record_t *r;
+
+    if((r = telemetry_record()) != NULL) {
+        r->roots_prec = prec;
+    }
+}
+
+
+void telemetry_weights(const long prec) {
+    telemetry_record_t *r;
+
+    if((r = telemetry_record()) != NULL) {
+        r->weights_prec = prec;
+    }
+}
+
+
+double candidate_begin(const int n,
+                       const int p,
+                       const int depth) {
+    /* Start working on a candidate extension, returns the start time
+     *
+     * n: The order of the basis rule
+     * p: The order of the extension
+     * depth: The recursion depth
+     */
+    telemetry_record_t *r;
+    double start;
+
+    trace_context(n, p, depth);
+    progress_candidate_begin(n, p, depth);
+    if((r = telemetry_record()) != NULL) {
+        memset(r, 0, sizeof(telemetry_record_t));
+        r->n = n;
+        r->p = p;
+        r->depth = depth;
+    }
+    /* Pairs with the 'stage_end' in 'candidate_end' */
+    start = stage_begin();
+    if(start == 0.0 && telemetry_enabled) {
+        start = monotonic_time();
+    }
+    return start;
+}
+
+
+void candidate_end(const double start,
+                   const int solvable,
+                   const int valid) {
+    /* Finish a candidate and write its telemetry record
+     *
+     * start: The start time returned by 'candidate_begin'
+     * solvable: Whether the extension exists
+     * valid: Whether the extension passed the validation
+     */
+    telemetry_record_t *r;
+    double seconds;
+
+    stage_end(STAGE_CANDIDATE, start);
+    progress_candidate_end(solvable, valid);
+    if((r = telemetry_record()) == NULL) {
+        return;
+    }
+    seconds = monotonic_time() - start;
+
+    pthread_mutex_lock(&telemetry_lock);
+    fprintf(telemetry_file, "{\"family\": \"%s\", \"n\": %d, \"p\": %d, \"depth\": %d, "
+            "\"solvable\": %d, \"valid\": %d, \"stored\": %d, \"seconds\": %.6e, "
+            "\"basis_num_bits\": %ld, \"basis_den_bits\": %ld, "
+            "\"matrix_num_bits\": %ld, \"matrix_den_bits\": %ld, "
+            "\"solution_num_bits\": %ld, \"solution_den_bits\": %ld, "
+            "\"common_den_bits\": %ld, \"roots_prec\": %ld, \"weights_prec\": %ld}\n",
+            telemetry_family, r->n, r->p, r->depth, solvable, valid, r->stored, seconds,
+            r->basis_num_bits, r->basis_den_bits, r->matrix_num_bits, r->matrix_den_bits,
+            r->solution_num_bits, r->solution_den_bits,
+            r->common_den_bits, r->roots_prec, r->weights_prec);
+    pthread_mutex_unlock(&telemetry_lock);
+}
+
+
+#endif
@@ -7,10 +7,91 @@
 #include <stdio.h>
 
 #include "polynomials.h"
+#include "quadrature.h"
+
+
+int check_fixvec(const int, const long);
+
+
+int check_fixvec(const int n, const long prec) {
+    /* Compare the fixed-precision kernels against the acb reference
+     * on the nodes of the Gauss-Legendre rule of size n.
+     *
+     * n: The number of nodes of the rule.
+     * prec: The working precision in bits.
+     *
+     * Returns the number of values where both results do not overlap
+     * or the fixed-precision result lost more than half of the precision.
+     * A rule the fixed-precision kernels do not apply to counts as failure.
+     *
+     * The monomial coefficients of P_n grow like (1+sqrt(2))^n, so Horner
+     * evaluation loses about 1.3 n bits. Choose n and prec accordingly.
+     */
+    int i, failures, mismatches;
+    fmpq_poly_t P, Q;
+    acb_ptr nodes, values, reference;
+
+    fmpq_poly_init(P);
+    fmpq_poly_init(Q);
+    legendre_polynomial(P, n);
+    legendre_polynomial(Q, n-1);
+
+    nodes = _acb_vec_init(n);
+    values = _acb_vec_init(n);
+    reference = _acb_vec_init(n);
+
+    poly_roots(nodes, P, 53, prec, 0);
+    make_real_roots(nodes, P, prec);
+
+    failures = 0;
+
+    if(!fixvec_applicable(nodes, n, prec)) {
+        printf("Fixed-precision kernels not applicable for n=%d at prec=%ld\n", n, prec);
+        failures++;
+    } else {
+        /* Horner evaluation */
+        mismatches = 0;
+        fixvec_enabled = 1;
+        evaluate_polynomial_vector(values, Q, nodes, n, prec);
+        fixvec_enabled = 0;
+        evaluate_polynomial_vector(reference, Q, nodes, n, prec);
+        for(i = 0; i < n; i++) {
+            if(!acb_overlaps(values+i, reference+i) || acb_rel_accuracy_bits(values+i) < prec / 2) {
+                mismatches++;
+            }
+        }
+        printf("Horner evaluation n=%d prec=%ld: %d mismatches\n", n, prec, mismatches);
+        failures += mismatches;
+
+        /* Weight formula */
+        mismatches = 0;
+        fixvec_enabled = 1;
+        evaluate_weights_formula_legendre(values, nodes, n, prec);
+        fixvec_enabled = 0;
+        evaluate_weights_formula_legendre(reference, nodes, n, prec);
+        fixvec_enabled = 1;
+        for(i = 0; i < n; i++) {
+            if(!acb_overlaps(values+i, reference+i) || acb_rel_accuracy_bits(values+i) < prec / 2) {
+                mismatches++;
+            }
+        }
+        printf("Legendre weights n=%d prec=%ld: %d mismatches\n", n, prec, mismatches);
+        failures += mismatches;
+    }
+
+    _acb_vec_clear(nodes, n);
+    _acb_vec_clear(values, n);
+    _acb_vec_clear(reference, n);
+    fmpq_poly_clear(P);
+    fmpq_poly_clear(Q);
+
+    return failures;
+}
 
 
 int main(int argc, char* argv[]) {
     int n, N;
+    int failures;
     fmpq_poly_t P;
     fmpq_poly_t L;
     fmpq_poly_t H;
@@ -112,6 +193,11 @@ int main(int argc, char* argv[]) {
     printf("\n\n");
 
 
+    printf("Fixed-precision kernels against acb:\n");
+    failures = check_fixvec(64, 256);
+    printf("\n\n");
+
+
     fmpq_poly_clear(P);
     fmpq_poly_clear(L);
     fmpq_poly_clear(H);
@@ -119,5 +205,5 @@ int main(int argc, char* argv[]) {
     fmpq_poly_clear(U);
     fmpq_mat_clear(M);
 
-    return EXIT_SUCCESS;
+    return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -0,0 +1,48 @@
+#!/bin/bash
+# Run a small map of ekes through the coordinator with two workers on localhost
+# and compare it against the map computed directly by ekes.
+#
+# A third connection stays open without sending anything during the whole run.
+# It must not hold up the workers, hence no lease may expire.
+
+PORT=${PORT:-7177}
+MAXN=${MAXN:-16}
+MAXP=${MAXP:-24}
+TMP=$(mktemp -d)
+trap 'kill $(jobs -p) 2> /dev/null; rm -rf $TMP' EXIT
+
+# The first map between two separator lines
+./ekes $MAXN $MAXP | awk '/^=====/ { print; if(++n == 2) exit; next } n == 1' > $TMP/direct.dat
+
+./kescoord -port $PORT -lease 5 -tile 4 -ekes $MAXN $MAXP > $TMP/coord.dat 2> $TMP/coord.log &
+COORD=$!
+sleep 1
+
+# The stalled client
+exec 3<> /dev/tcp/localhost/$PORT
+
+./ekes -w localhost:$PORT > $TMP/worker1.log &
+WORKER1=$!
+./ekes -w localhost:$PORT > $TMP/worker2.log &
+WORKER2=$!
+
+wait $WORKER1 $WORKER2
+exec 3>&-
+wait $COORD
+STATUS=$?
+
+if [ $STATUS -ne 0 ]; then
+    echo "Coordinator failed:"
+    cat $TMP/coord.log
+    exit 1
+fi
+if grep -q "expired" $TMP/coord.log; then
+    echo "Leases expired while a client was stalled:"
+    grep "expired" $TMP/coord.log
+    exit 1
+fi
+if ! diff $TMP/direct.dat $TMP/coord.dat; then
+    echo "The maps differ"
+    exit 1
+fi
+echo "Coordinated map of $MAXN x $MAXP agrees with ekes"
@@ -0,0 +1,252 @@
+/*  Author: R. Bourquin
+ *  Copyright: (C) 2014 R. Bourquin
+ *  License: GNU GPL v2 or above
+ *
+ *  A library of helper functions to search for
+ *  Kronrod extensions of Gauss quadrature rules.
+ */
+
+#ifndef __HH__trace
+#define __HH__trace
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "scheduler.h"
+
+
+/* Event trace in the Chrome trace event format
+ *
+ * Every worker of the scheduler appends complete events to its own buffer, hence
+ * no locking is needed while tracing. Each event is tagged with the
+ * context of its thread: the candidate (n, p), the recursion depth and
+ * the working precision. Counter events sample a value over time.
+ * All buffers are written as a single JSON file on exit which can be
+ * opened in Perfetto or chrome://tracing.
+ */
+
+typedef struct {
+    const char *name;
+    char phase;
+    double start;
+    double duration;
+    long value;
+    int n;
+    int p;
+    int depth;
+    long prec;
+} trace_event_t;
+
+typedef struct {
+    trace_event_t *events;
+    long len;
+    long alloc;
+    int n;
+    int p;
+    int depth;
+    long prec;
+    /* Avoid false sharing between threads */
+    char pad[64];
+} trace_buffer_t;
+
+
+int trace_enabled = 0;
+int trace_nthreads = 0;
+double trace_epoch = 0.0;
+char *trace_file = NULL;
+trace_buffer_t *trace_buffers = NULL;
+
+
+double monotonic_time(void);
+void trace_enable(const char *);
+trace_buffer_t * trace_buffer(void);
+void trace_context(const int, const int, const int);
+void trace_precision(const long);
+trace_event_t * trace_append(void);
+void trace_record(const char *, const double, const double);
+void trace_counter(const char *, const double, const long);
+void trace_write(void);
+
+
+double monotonic_time(void) {
+    /* Seconds of the monotonic clock
+     */
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+
+void trace_enable(const char *file) {
+    /* Enable tracing, the trace is written to the file on exit.
+     *
+     * file: The output file
+     */
+    if(trace_enabled) {
+        return;
+    }
+    trace_nthreads = sched_nslots();
+    trace_buffers = (trace_buffer_t *) calloc(trace_nthreads, sizeof(trace_buffer_t));
+    trace_file = (char *) malloc(strlen(file) + 1);
+    strcpy(trace_file, file);
+    trace_epoch = monotonic_time();
+    trace_enabled = 1;
+    atexit(trace_write);
+}
+
+
+trace_buffer_t * trace_buffer(void) {
+    /* The buffer of the calling thread or NULL
+     */
+    int tid;
+
+    tid = sched_slot();
+    return tid < trace_nthreads ? trace_buffers + tid : NULL;
+}
+
+
+void trace_context(const int n,
+                   const int p,
+                   const int depth) {
+    /* Set the candidate of the calling thread
+     *
+     * n: The order of the basis rule
+     * p: The order of the extension
+     * depth: The recursion depth
+     */
+    trace_buffer_t *b;
+
+    if(!trace_enabled || (b = trace_buffer()) == NULL) {
+        return;
+    }
+    b->n = n;
+    b->p = p;
+    b->depth = depth;
+}
+
+
+void trace_precision(const long prec) {
+    /* Set the working precision of the calling thread
+     *
+     * prec: Number of bits
+     */
+    trace_buffer_t *b;
+
+    if(!trace_enabled || (b = trace_buffer()) == NULL) {
+        return;
+    }
+    b->prec = prec;
+}
+
+
+trace_event_t * trace_append(void) {
+    /* Append an event tagged with the context of the calling thread
+     * to its buffer. Returns NULL if tracing is disabled.
+     */
+    trace_buffer_t *b;
+    trace_event_t *e;
+
+    if(!trace_enabled || (b = trace_buffer()) == NULL) {
+        return NULL;
+    }
+    if(b->len == b->alloc) {
+        b->alloc = b->alloc > 0 ? 2 * b->alloc : 4096;
+        b->events = (trace_event_t *) realloc(b->events, b->alloc * sizeof(trace_event_t));
+    }
+    e = b->events + b->len;
+    e->n = b->n;
+    e->p = b->p;
+    e->depth = b->depth;
+    e->prec = b->prec;
+    b->len++;
+    return e;
+}
+
+
+void trace_record(const char *name,
+                  const double start,
+                  const double end) {
+    /* Record a complete event of the calling thread
+     *
+     * name: The name of the event
+     * start: Start time of the monotonic clock
+     * end: End time of the monotonic clock
+     */
+    trace_event_t *e;
+
+    if((e = trace_append()) == NULL) {
+        return;
+    }
+    e->name = name;
+    e->phase = 'X';
+    e->start = start - trace_epoch;
+    e->duration = end - start;
+    e->value = 0;
+}
+
+
+void trace_counter(const char *name,
+                   const double now,
+                   const long value) {
+    /* Record a sample of a counter
+     *
+     * name: The name of the counter
+     * now: Time of the monotonic clock
+     * value: The value of the counter
+     */
+    trace_event_t *e;
+
+    if((e = trace_append()) == NULL) {
+        return;
+    }
+    e->name = name;
+    e->phase = 'C';
+    e->start = now - trace_epoch;
+    e->duration = 0.0;
+    e->value = value;
+}
+
+
+void trace_write(void) {
+    /* Write all events as Chrome trace event JSON
+     */
+    FILE *file;
+    trace_event_t *e;
+    long i;
+    int t, first;
+
+    file = fopen(trace_file, "w");
+    if(file == NULL) {
+        printf("Can not open trace file: %s\n", trace_file);
+        return;
+    }
+
+    fprintf(file, "{\"traceEvents\": [\n");
+    first = 1;
+    for(t = 0; t < trace_nthreads; t++) {
+        for(i = 0; i < trace_buffers[t].len; i++) {
+            e = trace_buffers[t].events + i;
+            if(e->phase == 'C') {
+                fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"C\", \"pid\": 0, \"tid\": %d, "
+                        "\"ts\": %.3f, \"args\": {\"value\": %ld}}",
+                        first ? "" : ",\n", e->name, t, 1e6 * e->start, e->value);
+                first = 0;
+                continue;
+            }
+            fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, "
+                    "\"ts\": %.3f, \"dur\": %.3f, "
+                    "\"args\": {\"n\": %d, \"p\": %d, \"depth\": %d, \"prec\": %ld}}",
+                    first ? "" : ",\n", e->name, t, 1e6 * e->start, 1e6 * e->duration,
+                    e->n, e->p, e->depth, e->prec);
+            first = 0;
+        }
+        free(trace_buffers[t].events);
+    }
+    fprintf(file, "\n], \"displayTimeUnit\": \"ms\"}\n");
+    fclose(file);
+}
+
+
+#endif